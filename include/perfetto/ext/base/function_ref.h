@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_FUNCTION_REF_H_
+#define INCLUDE_PERFETTO_EXT_BASE_FUNCTION_REF_H_
+
+#include <stddef.h>
+
+#include <type_traits>
+#include <utility>
+
+namespace perfetto {
+namespace base {
+
+template <typename Signature>
+class FunctionRef;
+
+// Non-owning reference to a callable, similar to the proposed
+// std::function_ref. Unlike std::function, it never allocates and can be
+// passed around as cheaply as a pair of pointers.
+//
+// The referenced callable must outlive the FunctionRef. In practice this
+// means that FunctionRef should only be used for function parameters that are
+// invoked before the function returns, and never stored:
+//
+//   void ForEachChild(base::FunctionRef<void(Node*)> fn);
+//   ForEachChild([&](Node* child) { ... });  // OK.
+//
+//   base::FunctionRef<void()> fn = [] {};  // Dangling, the lambda is a
+//   fn();                                   // temporary.
+//
+template <typename Ret, typename... Args>
+class FunctionRef<Ret(Args...)> {
+ public:
+  FunctionRef() = default;
+  FunctionRef(std::nullptr_t) {}  // NOLINT(google-explicit-constructor)
+
+  template <typename Callable,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<Callable>::type,
+                FunctionRef>::value>::type>
+  FunctionRef(Callable&& callable)  // NOLINT(google-explicit-constructor)
+      : callable_(const_cast<void*>(static_cast<const void*>(&callable))),
+        invoke_(&Invoke<typename std::remove_reference<Callable>::type>) {}
+
+  Ret operator()(Args... args) const {
+    return invoke_(callable_, std::forward<Args>(args)...);
+  }
+
+  explicit operator bool() const { return invoke_ != nullptr; }
+
+ private:
+  template <typename Callable>
+  static Ret Invoke(void* callable, Args... args) {
+    return (*static_cast<Callable*>(callable))(std::forward<Args>(args)...);
+  }
+
+  void* callable_ = nullptr;
+  Ret (*invoke_)(void*, Args...) = nullptr;
+};
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_FUNCTION_REF_H_
@@ -31,6 +31,9 @@
 #include <mutex>
 #include <vector>
 
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+#include <sys/epoll.h>
+#endif
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 #include <poll.h>
 #endif
@@ -53,6 +56,12 @@ namespace base {
 //
 // TODO(rsavitski): consider adding a thread-check in the destructor, after
 // auditing existing usages.
+// On Linux and Android (unless the enable_perfetto_epoll_task_runner GN arg is
+// turned off) file descriptor watches are backed by epoll(7) rather than
+// poll(2). This keeps the watched set registered in the kernel, so the cost of
+// each run loop iteration doesn't grow with the number of watched fds. The fds
+// that epoll refuses (e.g. regular files) are still watched with poll(2).
+//
 // TODO(primiano): rename this to TaskRunnerImpl. The "Unix" part is misleading
 // now as it supports also Windows.
 class UnixTaskRunner : public TaskRunner {
@@ -86,18 +95,36 @@ class UnixTaskRunner : public TaskRunner {
   void UpdateWatchTasksLocked();
   int GetDelayMsToNextTaskLocked() const;
   void RunImmediateAndDelayedTask();
-  void PostFileDescriptorWatches(uint64_t windows_wait_result);
+  void PostFileDescriptorWatches(uint64_t wait_result);
   void RunFileDescriptorWatch(PlatformHandle);
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  void AddEpollWatchLocked(PlatformHandle);
+  void RecreateEpollAfterForkLocked();
+#endif
 
   ThreadChecker thread_checker_;
   PlatformThreadId created_thread_id_ = GetThreadId();
 
   EventFd event_;
 
-// The array of fds/handles passed to poll(2) / WaitForMultipleObjects().
-#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  // Lock-protected. Replaced with a new instance in the child process after a
+  // fork(), see RecreateEpollAfterForkLocked().
+  ScopedFile epoll_fd_;
+  uint32_t epoll_fork_generation_ = 0;
+
+  // The buffer passed to epoll_wait(2).
+  std::vector<struct epoll_event> epoll_events_;
+
+  // The fds that could not be added to the epoll instance, passed to poll(2)
+  // together with the epoll fd itself, which is always the first entry. Empty
+  // if there are no such fds.
+  std::vector<struct pollfd> poll_fds_;
+#elif PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // The array of handles passed to WaitForMultipleObjects().
   std::vector<PlatformHandle> poll_fds_;
 #else
+  // The array of fds passed to poll(2).
   std::vector<struct pollfd> poll_fds_;
 #endif
 
@@ -116,6 +143,12 @@ class UnixTaskRunner : public TaskRunner {
     // polling it again until the queued task runs. On Windows we can't do that.
     // Instead we keep track of its state here.
     bool pending = false;
+#elif PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    // Watches are registered with EPOLLONESHOT, which makes epoll ignore the
+    // fd until RunFileDescriptorWatch() re-arms it. If epoll_ctl(2) rejected
+    // the fd, it is in |poll_fds_| instead and handled as on other UNIXes.
+    bool poll_fallback = false;
+    size_t poll_fd_index = 0;  // Index into |poll_fds_|, if |poll_fallback|.
 #else
     size_t poll_fd_index;  // Index into |poll_fds_|.
 #endif
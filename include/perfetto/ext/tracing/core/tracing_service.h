@@ -40,6 +40,7 @@ class TaskRunner;
 class Consumer;
 class Producer;
 class SharedMemoryArbiter;
+class TracePacket;
 class TraceWriter;
 
 // Exposed for testing.
@@ -272,10 +273,28 @@ class PERFETTO_EXPORT TracingService {
     kDisabled
   };
 
+  // Compresses in place the given packets, replacing them with one or more
+  // packets that have the |compressed_packets| field set.
+  using CompressorFn = void (*)(std::vector<TracePacket>*);
+
+  struct InitOpts {
+    // Not a default member initializer, as those can't be used by the default
+    // argument of CreateInstance() below, within the same enclosing class.
+    InitOpts() : compressor_fn(nullptr) {}
+
+    // Function used to compress the trace when the TraceConfig sets a
+    // |compression_type|. It's a function pointer rather than a hard dependency
+    // so that embedders of the service that don't need compression (e.g. the
+    // in-process backend of the client library) don't have to link zlib.
+    // If null, the service will ignore the |compression_type| of the config.
+    CompressorFn compressor_fn;
+  };
+
   // Implemented in src/core/tracing_service_impl.cc .
   static std::unique_ptr<TracingService> CreateInstance(
       std::unique_ptr<SharedMemory::Factory>,
-      base::TaskRunner*);
+      base::TaskRunner*,
+      InitOpts init_opts = {});
 
   virtual ~TracingService();
 
@@ -115,6 +115,20 @@ struct PERFETTO_EXPORT Config {
   DropFtraceDataBefore drop_ftrace_data_before =
       DropFtraceDataBefore::kTracingStarted;
 
+  // When non-zero, bounds the memory used to sort traces which are fully
+  // sorted before being parsed (|kForceFullSort|, JSON and Fuchsia traces).
+  // Once the events waiting to be sorted take more than this many bytes, they
+  // are sorted and written to a temporary file, and all these files are
+  // merged back at the end of the trace. The size of the events is estimated,
+  // so the actual memory usage of the sorter can be somewhat higher.
+  uint64_t sorter_memory_limit_bytes = 0;
+
+  // When set to true, the numeric columns of the largest tables (e.g. sched,
+  // slice, counter) are compressed once the trace has been fully parsed. This
+  // reduces the memory usage of large traces at the cost of slightly slower
+  // queries, as the values have to be decoded when they are read.
+  bool compress_tables = false;
+
   // Any built-in metric proto or sql files matching these paths are skipped
   // during trace processor metric initialization.
   std::vector<std::string> skip_builtin_metric_paths;
@@ -76,6 +76,15 @@ struct Hasher {
   size_t operator()(const Key& k) const { return static_cast<size_t>(k.val); }
 };
 
+// Spreads sequential keys over the whole table.
+struct Hash64 {
+  size_t operator()(uint64_t x) const {
+    base::Hash hash;
+    hash.Update(x);
+    return static_cast<size_t>(hash.digest());
+  }
+};
+
 int Key::instances = 0;
 int Value::instances = 0;
 
@@ -191,6 +200,34 @@ TYPED_TEST(FlatHashMapTest, FillWithTombstones) {
   }
 }
 
+// Erasing leaves tombstones behind. A map with a small but constantly
+// changing set of keys must not fill up with them.
+TYPED_TEST(FlatHashMapTest, RehashesTombstones) {
+  class TestMap : public FlatHashMap<uint64_t, uint64_t, Hash64,
+                                     typename TestFixture::Probe> {
+   public:
+    size_t num_tombstones() const { return this->num_tombstones_; }
+    size_t max_probe_length() const { return this->max_probe_length_; }
+  };
+  TestMap fmap;
+
+  const uint64_t kLive = 64;
+  for (uint64_t i = 0; i < 100000; i++) {
+    ASSERT_TRUE(fmap.Insert(i, i).second);
+    if (i >= kLive) {
+      ASSERT_TRUE(fmap.Erase(i - kLive));
+    }
+    ASSERT_LT(fmap.size() + fmap.num_tombstones(), fmap.capacity());
+  }
+  EXPECT_EQ(fmap.size(), kLive);
+  EXPECT_EQ(fmap.capacity(), 1024u);
+  EXPECT_LT(fmap.max_probe_length(), fmap.capacity() / 2);
+  for (uint64_t i = 100000 - kLive; i < 100000; i++) {
+    ASSERT_NE(fmap.Find(i), nullptr);
+    ASSERT_EQ(*fmap.Find(i), i);
+  }
+}
+
 TYPED_TEST(FlatHashMapTest, Collisions) {
   FlatHashMap<int, int, CollidingHasher, typename TestFixture::Probe> fmap(
       /*initial_capacity=*/0, /*load_limit_pct=*/100);
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/function_ref.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+int CallTwice(FunctionRef<int(int)> fn) {
+  return fn(fn(1));
+}
+
+TEST(FunctionRefTest, Empty) {
+  FunctionRef<void()> fn;
+  EXPECT_FALSE(fn);
+  FunctionRef<void()> null_fn = nullptr;
+  EXPECT_FALSE(null_fn);
+}
+
+TEST(FunctionRefTest, Lambda) {
+  int calls = 0;
+  EXPECT_EQ(CallTwice([&calls](int x) {
+              calls++;
+              return x * 3;
+            }),
+            9);
+  EXPECT_EQ(calls, 2);
+}
+
+TEST(FunctionRefTest, ReferencesCallable) {
+  int state = 0;
+  auto increment = [&state]() { return ++state; };
+  FunctionRef<int()> fn = increment;
+  EXPECT_TRUE(fn);
+  EXPECT_EQ(fn(), 1);
+  EXPECT_EQ(fn(), 2);
+
+  // Copies refer to the same callable.
+  FunctionRef<int()> copy = fn;
+  EXPECT_EQ(copy(), 3);
+  EXPECT_EQ(state, 3);
+}
+
+TEST(FunctionRefTest, StdFunction) {
+  std::function<std::string(const std::string&)> append =
+      [](const std::string& s) { return s + "!"; };
+  FunctionRef<std::string(const std::string&)> fn = append;
+  EXPECT_EQ(fn("foo"), "foo!");
+}
+
+TEST(FunctionRefTest, MoveOnlyArguments) {
+  auto fn = [](std::unique_ptr<int> ptr) { return *ptr; };
+  FunctionRef<int(std::unique_ptr<int>)> ref = fn;
+  EXPECT_EQ(ref(std::unique_ptr<int>(new int(42))), 42);
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
@@ -24,6 +24,7 @@
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/base/test/gtest_test_suite.h"
 #include "test/gtest_and_gmock.h"
@@ -385,6 +386,26 @@ TEST_F(TaskRunnerTest, FileDescriptorClosedEvent) {
   task_runner.Run();
 }
 
+TEST_F(TaskRunnerTest, FileDescriptorWatchOnRegularFile) {
+  auto& task_runner = this->task_runner;
+  // poll(2) reports regular files as always readable, while epoll(7) can't
+  // watch them at all.
+  TempFile file = TempFile::Create();
+  EventFd evt;
+  int file_events = 0;
+  task_runner.AddFileDescriptorWatch(file.fd(), [&] {
+    if (++file_events == 3) {
+      task_runner.RemoveFileDescriptorWatch(file.fd());
+      evt.Notify();
+    }
+  });
+  task_runner.AddFileDescriptorWatch(evt.fd(), [&task_runner] {
+    task_runner.Quit();
+  });
+  task_runner.Run();
+  EXPECT_EQ(file_events, 3);
+}
+
 #endif
 
 }  // namespace
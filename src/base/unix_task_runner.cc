@@ -28,7 +28,12 @@
 #include <unistd.h>
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+#include <pthread.h>
+#endif
+
 #include <algorithm>
+#include <atomic>
 #include <limits>
 
 #include "perfetto/ext/base/watchdog.h"
@@ -36,7 +41,42 @@
 namespace perfetto {
 namespace base {
 
+namespace {
+
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+// Max number of ready fds fetched by each epoll_wait(2). Any further ready fd
+// is returned by the next iteration of the run loop.
+constexpr size_t kMaxEpollEvents = 64;
+
+// Incremented in the child process after each fork().
+std::atomic<uint32_t> g_fork_generation{};
+
+void OnForkChild() {
+  g_fork_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool EpollCtl(int epoll_fd, int op, int fd, uint32_t events) {
+  struct epoll_event ev {};
+  ev.events = events;
+  ev.data.fd = fd;
+  return epoll_ctl(epoll_fd, op, fd, &ev) == 0;
+}
+#endif
+
+}  // namespace
+
 UnixTaskRunner::UnixTaskRunner() {
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  static bool atfork_registered = [] {
+    PERFETTO_CHECK(pthread_atfork(nullptr, nullptr, &OnForkChild) == 0);
+    return true;
+  }();
+  base::ignore_result(atfork_registered);
+  epoll_fork_generation_ = g_fork_generation.load(std::memory_order_relaxed);
+  epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+  PERFETTO_CHECK(epoll_fd_);
+  epoll_events_.resize(kMaxEpollEvents);
+#endif
   AddFileDescriptorWatch(event_.fd(), [] {
     // Not reached -- see PostFileDescriptorWatches().
     PERFETTO_DFATAL("Should be unreachable.");
@@ -76,6 +116,26 @@ void UnixTaskRunner::Run() {
     // WaitForSingleObject() for the one handle that WaitForMultipleObject()
     // returned.
     PostFileDescriptorWatches(ret);
+#elif PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    int epoll_timeout_ms = poll_timeout_ms;
+    if (!poll_fds_.empty()) {
+      // Some fds could not be added to the epoll instance. Wait for them with
+      // poll(2), together with the epoll fd, which is readable when any of
+      // the other fds is ready, then fetch those without blocking.
+      int ret = PERFETTO_EINTR(poll(&poll_fds_[0],
+                                    static_cast<nfds_t>(poll_fds_.size()),
+                                    poll_timeout_ms));
+      PERFETTO_CHECK(ret >= 0);
+      epoll_timeout_ms = 0;
+    }
+    int ret = 0;
+    if (poll_fds_.empty() || (poll_fds_[0].revents & POLLIN)) {
+      ret = PERFETTO_EINTR(epoll_wait(*epoll_fd_, &epoll_events_[0],
+                                      static_cast<int>(epoll_events_.size()),
+                                      epoll_timeout_ms));
+    }
+    PERFETTO_CHECK(ret >= 0);
+    PostFileDescriptorWatches(static_cast<uint64_t>(ret));
 #else
     int ret = PERFETTO_EINTR(poll(
         &poll_fds_[0], static_cast<nfds_t>(poll_fds_.size()), poll_timeout_ms));
@@ -107,6 +167,25 @@ bool UnixTaskRunner::IsIdleForTesting() {
 
 void UnixTaskRunner::UpdateWatchTasksLocked() {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  // Add/RemoveFileDescriptorWatch() keep the epoll registrations up to date,
+  // so there is nothing to rebuild for them, unless we are in a freshly forked
+  // child. Only the set of fds that fall back to poll(2) is rebuilt here.
+  RecreateEpollAfterForkLocked();
+  if (!watch_tasks_changed_)
+    return;
+  watch_tasks_changed_ = false;
+  poll_fds_.clear();
+  for (auto& it : watch_tasks_) {
+    WatchTask& watch_task = it.second;
+    if (!watch_task.poll_fallback)
+      continue;
+    if (poll_fds_.empty())
+      poll_fds_.push_back({*epoll_fd_, POLLIN, 0});
+    watch_task.poll_fd_index = poll_fds_.size();
+    poll_fds_.push_back({it.first, POLLIN | POLLHUP, 0});
+  }
+#else
 #if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
   if (!watch_tasks_changed_)
     return;
@@ -124,6 +203,7 @@ void UnixTaskRunner::UpdateWatchTasksLocked() {
     poll_fds_.push_back({handle, POLLIN | POLLHUP, 0});
 #endif
   }
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
 }
 
 void UnixTaskRunner::RunImmediateAndDelayedTask() {
@@ -154,20 +234,49 @@ void UnixTaskRunner::RunImmediateAndDelayedTask() {
     RunTaskWithWatchdogGuard(delayed_task);
 }
 
-void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
+void UnixTaskRunner::PostFileDescriptorWatches(uint64_t wait_result) {
   PERFETTO_DCHECK_THREAD(thread_checker_);
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  // |wait_result| is the number of events returned by epoll_wait(2). Only the
+  // fds that are ready are visited, regardless of how many are watched.
+  for (size_t i = 0; i < wait_result; i++) {
+    const PlatformHandle handle = epoll_events_[i].data.fd;
+
+    // The wake-up event is handled inline to avoid an infinite recursion of
+    // posted tasks.
+    if (handle == event_.fd()) {
+      event_.Clear();
+      continue;
+    }
+
+    // The watch has been disabled by EPOLLONESHOT and will be re-armed by
+    // RunFileDescriptorWatch(), so no duplicate tasks are posted meanwhile.
+    PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, handle));
+  }
+
+  // The first entry of |poll_fds_| is the epoll fd, handled above.
+  for (size_t i = 1; i < poll_fds_.size(); i++) {
+    const PlatformHandle handle = poll_fds_[i].fd;
+    if (!(poll_fds_[i].revents & (POLLIN | POLLHUP)))
+      continue;
+    poll_fds_[i].revents = 0;
+    PostTask(std::bind(&UnixTaskRunner::RunFileDescriptorWatch, this, handle));
+    // Make poll(2) ignore the fd while its task is pending.
+    PERFETTO_DCHECK(poll_fds_[i].fd >= 0);
+    poll_fds_[i].fd = -poll_fds_[i].fd;
+  }
+#else
   for (size_t i = 0; i < poll_fds_.size(); i++) {
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     const PlatformHandle handle = poll_fds_[i];
-    // |windows_wait_result| is the result of WaitForMultipleObjects() call. If
+    // |wait_result| is the result of WaitForMultipleObjects() call. If
     // one of the objects was signalled, it will have a value between
     // [0, poll_fds_.size()].
-    if (i != windows_wait_result &&
-        WaitForSingleObject(handle, 0) != WAIT_OBJECT_0) {
+    if (i != wait_result && WaitForSingleObject(handle, 0) != WAIT_OBJECT_0) {
       continue;
     }
 #else
-    base::ignore_result(windows_wait_result);
+    base::ignore_result(wait_result);
     const PlatformHandle handle = poll_fds_[i].fd;
     if (!(poll_fds_[i].revents & (POLLIN | POLLHUP)))
       continue;
@@ -201,6 +310,7 @@ void UnixTaskRunner::PostFileDescriptorWatches(uint64_t windows_wait_result) {
     poll_fds_[i].fd = -poll_fds_[i].fd;
 #endif
   }
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
 }
 
 void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
@@ -212,9 +322,21 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
       return;
     WatchTask& watch_task = it->second;
 
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    // Watches in the epoll instance are re-armed after the task has run, see
+    // below. The others are handled as in the poll(2) implementation.
+    if (watch_task.poll_fallback) {
+      UpdateWatchTasksLocked();
+      size_t fd_index = watch_task.poll_fd_index;
+      PERFETTO_DCHECK(fd_index < poll_fds_.size());
+      PERFETTO_DCHECK(::abs(poll_fds_[fd_index].fd) == fd);
+      poll_fds_[fd_index].fd = fd;
+    }
+#else
     // Make poll(2) pay attention to the fd again. Since another thread may have
     // updated this watch we need to refresh the set first.
     UpdateWatchTasksLocked();
+#endif
 
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     // On Windows we manually track the presence of outstanding tasks for the
@@ -222,7 +344,7 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
     // task to the |poll_fds_| vector.
     PERFETTO_DCHECK(watch_task.pending);
     watch_task.pending = false;
-#else
+#elif !PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
     size_t fd_index = watch_task.poll_fd_index;
     PERFETTO_DCHECK(fd_index < poll_fds_.size());
     PERFETTO_DCHECK(::abs(poll_fds_[fd_index].fd) == fd);
@@ -232,6 +354,26 @@ void UnixTaskRunner::RunFileDescriptorWatch(PlatformHandle fd) {
   }
   errno = 0;
   RunTaskWithWatchdogGuard(task);
+
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+  std::lock_guard<std::mutex> lock(lock_);
+  // The task might have forked. Don't re-arm the watch in the epoll instance
+  // shared with the parent.
+  RecreateEpollAfterForkLocked();
+  // The task might have removed the watch.
+  auto it = watch_tasks_.find(fd);
+  if (it == watch_tasks_.end() || it->second.poll_fallback)
+    return;
+  // Re-arm the watch, so epoll_wait(2) reports the fd again.
+  if (EpollCtl(*epoll_fd_, EPOLL_CTL_MOD, fd,
+               EPOLLIN | EPOLLHUP | EPOLLONESHOT)) {
+    return;
+  }
+  // The file has been closed, or replaced by dup2(), without removing the
+  // watch first, which dropped its epoll registration. Watch whatever the fd
+  // refers to now, as poll(2) would.
+  AddEpollWatchLocked(fd);
+#endif
 }
 
 int UnixTaskRunner::GetDelayMsToNextTaskLocked() const {
@@ -269,19 +411,33 @@ void UnixTaskRunner::PostDelayedTask(std::function<void()> task,
 void UnixTaskRunner::AddFileDescriptorWatch(PlatformHandle fd,
                                             std::function<void()> task) {
   PERFETTO_DCHECK(PlatformHandleChecker::IsValid(fd));
+  bool wake_up;
   {
     std::lock_guard<std::mutex> lock(lock_);
     PERFETTO_DCHECK(!watch_tasks_.count(fd));
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    // Must happen before |fd| is in |watch_tasks_|, or it would be added twice.
+    RecreateEpollAfterForkLocked();
+#endif
     WatchTask& watch_task = watch_tasks_[fd];
     watch_task.callback = std::move(task);
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
     watch_task.pending = false;
+#elif PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    AddEpollWatchLocked(fd);
 #else
     watch_task.poll_fd_index = SIZE_MAX;
 #endif
+#if !PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
     watch_tasks_changed_ = true;
+#endif
+    wake_up = watch_tasks_changed_;
   }
-  WakeUp();
+  // The run loop needs to rebuild the set passed to poll(2). With epoll this is
+  // needed only if the fd fell back to poll(2), as epoll_wait(2) picks up new
+  // registrations by itself.
+  if (wake_up)
+    WakeUp();
 }
 
 void UnixTaskRunner::RemoveFileDescriptorWatch(PlatformHandle fd) {
@@ -289,12 +445,64 @@ void UnixTaskRunner::RemoveFileDescriptorWatch(PlatformHandle fd) {
   {
     std::lock_guard<std::mutex> lock(lock_);
     PERFETTO_DCHECK(watch_tasks_.count(fd));
-    watch_tasks_.erase(fd);
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    auto it = watch_tasks_.find(fd);
+    if (it != watch_tasks_.end() && it->second.poll_fallback)
+      watch_tasks_changed_ = true;
+#else
     watch_tasks_changed_ = true;
+#endif
+    watch_tasks_.erase(fd);
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+    // If the fd has been closed already the kernel has dropped the epoll
+    // registration on its own, hence the result is deliberately ignored.
+    RecreateEpollAfterForkLocked();
+    epoll_ctl(*epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
   }
   // No need to schedule a wake-up for this.
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_EPOLL_TASK_RUNNER)
+void UnixTaskRunner::AddEpollWatchLocked(PlatformHandle fd) {
+  auto it = watch_tasks_.find(fd);
+  PERFETTO_DCHECK(it != watch_tasks_.end());
+  WatchTask& watch_task = it->second;
+  // The wake-up event is handled inline by PostFileDescriptorWatches() and
+  // never re-armed, hence it's the only level-triggered persistent watch.
+  uint32_t events = EPOLLIN | EPOLLHUP;
+  if (fd != event_.fd())
+    events |= EPOLLONESHOT;
+  bool poll_fallback = !EpollCtl(*epoll_fd_, EPOLL_CTL_ADD, fd, events);
+  if (poll_fallback) {
+    // This fails with EPERM for fds that don't support polling, like regular
+    // files, which are reported as always readable by poll(2). Keep that
+    // behavior by watching the fd with poll(2) instead.
+    PERFETTO_DPLOG("epoll_ctl(ADD, %d) failed, falling back to poll()", fd);
+  }
+  if (poll_fallback || watch_task.poll_fallback)
+    watch_tasks_changed_ = true;
+  watch_task.poll_fallback = poll_fallback;
+}
+
+void UnixTaskRunner::RecreateEpollAfterForkLocked() {
+  const uint32_t fork_generation =
+      g_fork_generation.load(std::memory_order_relaxed);
+  if (PERFETTO_LIKELY(fork_generation == epoll_fork_generation_))
+    return;
+  // Unlike the fds passed to poll(2), the epoll instance and its set of
+  // registered fds are shared with the parent process after a fork(). Leave
+  // that to the parent and start over with a new one.
+  epoll_fork_generation_ = fork_generation;
+  epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+  PERFETTO_CHECK(epoll_fd_);
+  // |poll_fds_| refers to the old epoll fd.
+  watch_tasks_changed_ = true;
+  for (const auto& it : watch_tasks_)
+    AddEpollWatchLocked(it.first);
+}
+#endif
+
 bool UnixTaskRunner::RunsTasksOnCurrentThread() const {
   return GetThreadId() == created_thread_id_;
 }
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/base/event_fd.h"
+#include "perfetto/ext/base/unix_task_runner.h"
+
+namespace {
+
+using ::perfetto::base::EventFd;
+using ::perfetto::base::UnixTaskRunner;
+
+// Tasks posted for each Run() in BM_TaskRunnerPostTask.
+constexpr int kTasksPerRun = 100;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// The argument is the number of idle fds watched by the task runner, which
+// resembles traced serving many connected but quiet producers.
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1);
+  } else {
+    b->RangeMultiplier(8)->Range(1, 512);
+  }
+}
+
+// Keeps |num_fds| watches on fds that never become readable.
+class IdleWatches {
+ public:
+  IdleWatches(UnixTaskRunner* task_runner, size_t num_fds)
+      : task_runner_(task_runner) {
+    for (size_t i = 0; i < num_fds; i++) {
+      evts_.emplace_back(new EventFd());
+      task_runner_->AddFileDescriptorWatch(evts_.back()->fd(), [] {});
+    }
+  }
+
+  ~IdleWatches() {
+    for (const auto& evt : evts_)
+      task_runner_->RemoveFileDescriptorWatch(evt->fd());
+  }
+
+ private:
+  UnixTaskRunner* const task_runner_;
+  std::vector<std::unique_ptr<EventFd>> evts_;
+};
+
+}  // namespace
+
+// Throughput of immediate tasks, each one posting the next one. Each task
+// dispatched goes through an iteration of the run loop, and hence through a
+// poll(2) / epoll_wait(2) call.
+static void BM_TaskRunnerPostTask(benchmark::State& state) {
+  UnixTaskRunner task_runner;
+  IdleWatches idle_watches(&task_runner, static_cast<size_t>(state.range(0)));
+
+  int tasks_left = 0;
+  std::function<void()> task;
+  task = [&task_runner, &tasks_left, &task] {
+    if (--tasks_left == 0) {
+      task_runner.Quit();
+      return;
+    }
+    task_runner.PostTask(task);
+  };
+
+  for (auto _ : state) {
+    tasks_left = kTasksPerRun;
+    task_runner.PostTask(task);
+    task_runner.Run();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kTasksPerRun);
+}
+
+// Latency from an fd becoming readable to its watch callback running.
+static void BM_TaskRunnerFileDescriptorWatch(benchmark::State& state) {
+  UnixTaskRunner task_runner;
+  IdleWatches idle_watches(&task_runner, static_cast<size_t>(state.range(0)));
+
+  EventFd evt;
+  task_runner.AddFileDescriptorWatch(evt.fd(), [&task_runner, &evt] {
+    evt.Clear();
+    task_runner.Quit();
+  });
+
+  for (auto _ : state) {
+    evt.Notify();
+    task_runner.Run();
+  }
+  task_runner.RemoveFileDescriptorWatch(evt.fd());
+}
+
+BENCHMARK(BM_TaskRunnerPostTask)->Apply(BenchmarkArgs);
+BENCHMARK(BM_TaskRunnerFileDescriptorWatch)->Apply(BenchmarkArgs);
@@ -64,6 +64,13 @@ BufferedFrameDeserializer::BeginReceive() {
 }
 
 bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
+  return EndReceive(recv_size, [this](const uint8_t* data, size_t size) {
+    DecodeFrame(reinterpret_cast<const char*>(data), size);
+  });
+}
+
+bool BufferedFrameDeserializer::EndReceive(size_t recv_size,
+                                           const FrameBytesCallback& on_frame) {
   const auto page_size = base::GetSysPageSize();
   PERFETTO_CHECK(recv_size + size_ <= capacity_);
   size_ += recv_size;
@@ -118,7 +125,8 @@ bool BufferedFrameDeserializer::EndReceive(size_t recv_size) {
     }
 
     // Case C. We got at least one header and whole frame.
-    DecodeFrame(rd_ptr, payload_size);
+    if (payload_size > 0)
+      on_frame(reinterpret_cast<const uint8_t*>(rd_ptr), payload_size);
     consumed_size += next_frame_size;
   }
 
@@ -18,7 +18,9 @@
 #define SRC_IPC_BUFFERED_FRAME_DESERIALIZER_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
+#include <functional>
 #include <list>
 #include <memory>
 
@@ -69,6 +71,16 @@ using Frame = ::perfetto::protos::gen::IPCFrame;
 //   ... process |frame|
 // }
 //
+// Alternatively, callers that are sensitive to the cost of decoding each frame
+// into a heap-allocated Frame (i.e. the host, which receives a high rate of
+// CommitData requests) can pass a callback to EndReceive() and decode the
+// frame in place with protozero:
+//
+// rpc_frame_decoder.EndReceive(rsize, [](const uint8_t* data, size_t size) {
+//   protos::pbzero::IPCFrame::Decoder frame(data, size);
+//   ... process |frame|
+// });
+//
 // Design goals:
 // -------------
 // - Optimize for the realistic case of each recv() receiving one or more
@@ -88,6 +100,11 @@ class BufferedFrameDeserializer {
     size_t size;
   };
 
+  // Invoked by EndReceive() for each complete (and non-empty) frame. The
+  // arguments point to the proto-encoded frame (without the size header)
+  // inside the receive buffer and are valid only for the duration of the call.
+  using FrameBytesCallback = std::function<void(const uint8_t*, size_t)>;
+
   // |max_capacity| is overridable only for tests.
   explicit BufferedFrameDeserializer(size_t max_capacity = kIPCBufferSize);
   ~BufferedFrameDeserializer();
@@ -108,6 +125,13 @@ class BufferedFrameDeserializer {
   // caller is expected to shutdown the socket and terminate the ipc.
   bool EndReceive(size_t recv_size) PERFETTO_WARN_UNUSED_RESULT;
 
+  // Like the above, but doesn't decode and queue frames for PopNextFrame().
+  // Instead, passes the encoded bytes of each complete frame to |on_frame|,
+  // without any copy or heap allocation. The callback is invoked before
+  // EndReceive() returns and must not call back into this class.
+  bool EndReceive(size_t recv_size, const FrameBytesCallback& on_frame)
+      PERFETTO_WARN_UNUSED_RESULT;
+
   // Decodes and returns the next decoded frame in the buffer if any, nullptr
   // if no further frames have been decoded.
   std::unique_ptr<Frame> PopNextFrame();
@@ -306,6 +306,40 @@ TEST(BufferedFrameDeserializerTest, CanRecoverAfterUnparsableFrames) {
   }
 }
 
+// Tests the EndReceive() variant that passes the encoded frames to a callback
+// rather than queueing them. Frames are fed one byte at a time and in batches.
+TEST(BufferedFrameDeserializerTest, FrameBytesCallback) {
+  BufferedFrameDeserializer bfd;
+  std::vector<std::vector<char>> frames;
+  std::vector<char> stream;
+  for (size_t i = 1; i <= 20; i++) {
+    frames.emplace_back(GetSimpleFrame(i * 30));
+    stream.insert(stream.end(), frames.back().begin(), frames.back().end());
+  }
+
+  std::vector<std::string> received;
+  auto on_frame = [&received](const uint8_t* data, size_t size) {
+    received.emplace_back(reinterpret_cast<const char*>(data), size);
+  };
+  for (size_t off = 0, i = 0; off < stream.size(); i++) {
+    // Alternate single-byte recv()s with larger ones spanning several frames.
+    size_t recv_size = std::min<size_t>(i % 2 ? 1 : 577, stream.size() - off);
+    BufferedFrameDeserializer::ReceiveBuffer rbuf = bfd.BeginReceive();
+    ASSERT_GE(rbuf.size, recv_size);
+    memcpy(rbuf.data, &stream[off], recv_size);
+    ASSERT_TRUE(bfd.EndReceive(recv_size, on_frame));
+    off += recv_size;
+  }
+
+  ASSERT_EQ(frames.size(), received.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    ASSERT_EQ(std::string(frames[i].begin() + kHeaderSize, frames[i].end()),
+              received[i]);
+  }
+  ASSERT_FALSE(bfd.PopNextFrame());
+  ASSERT_EQ(0u, bfd.size());
+}
+
 // Test that we can sustain recvs() which constantly max out the capacity.
 // It sets up four frames:
 // |frame1|: small, 1024 + 4 bytes.
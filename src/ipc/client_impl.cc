@@ -297,7 +297,10 @@ void ClientImpl::OnInvokeMethodReply(QueuedRequest req,
     // If this becomes a hotspot, optimize by maintaining a dedicated hashtable.
     for (const auto& method : service_proxy->GetDescriptor().methods) {
       if (req.method_name == method.name) {
-        decoded_reply = method.reply_proto_decoder(reply.reply_proto());
+        const std::string& reply_proto = reply.reply_proto();
+        decoded_reply = method.reply_proto_decoder(
+            reinterpret_cast<const uint8_t*>(reply_proto.data()),
+            reply_proto.size());
         break;
       }
     }
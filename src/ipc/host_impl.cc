@@ -29,6 +29,7 @@
 #include "perfetto/ext/ipc/service_descriptor.h"
 
 #include "protos/perfetto/ipc/wire_protocol.gen.h"
+#include "protos/perfetto/ipc/wire_protocol.pbzero.h"
 
 // TODO(primiano): put limits on #connections/uid and req. queue (b/69093705).
 
@@ -141,6 +142,13 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
   auto peer_uid = GetPosixPeerUid(client->sock.get());
   auto scoped_key = g_crash_key_uid.SetScoped(static_cast<int64_t>(peer_uid));
 
+  // Frames are dispatched straight out of the receive buffer, as soon as each
+  // recv() completes them, without materializing a Frame object. This matters
+  // for producers that send CommitData requests at a high rate.
+  BufferedFrameDeserializer::FrameBytesCallback on_frame =
+      [this, client](const uint8_t* data, size_t size) {
+        OnReceivedFrame(client, data, size);
+      };
   size_t rsize;
   do {
     auto buf = frame_deserializer.BeginReceive();
@@ -150,20 +158,20 @@ void HostImpl::OnDataAvailable(base::UnixSocket* sock) {
       PERFETTO_DCHECK(!client->received_fd);
       client->received_fd = std::move(fd);
     }
-    if (!frame_deserializer.EndReceive(rsize))
+    if (!frame_deserializer.EndReceive(rsize, on_frame))
       return OnDisconnect(client->sock.get());
   } while (rsize > 0);
-
-  for (;;) {
-    std::unique_ptr<Frame> frame = frame_deserializer.PopNextFrame();
-    if (!frame)
-      break;
-    OnReceivedFrame(client, *frame);
-  }
 }
 
 void HostImpl::OnReceivedFrame(ClientConnection* client,
-                               const Frame& req_frame) {
+                               const uint8_t* data,
+                               size_t size) {
+  protos::pbzero::IPCFrame::Decoder req_frame(data, size);
+  if (req_frame.bytes_left()) {
+    PERFETTO_DLOG("Received unparsable RPC frame from client %" PRIu64,
+                  client->id);
+    return;
+  }
   if (req_frame.has_msg_bind_service())
     return OnBindService(client, req_frame);
   if (req_frame.has_msg_invoke_method())
@@ -176,14 +184,18 @@ void HostImpl::OnReceivedFrame(ClientConnection* client,
   SendFrame(client, reply_frame);
 }
 
-void HostImpl::OnBindService(ClientConnection* client, const Frame& req_frame) {
+void HostImpl::OnBindService(
+    ClientConnection* client,
+    const protos::pbzero::IPCFrame::Decoder& req_frame) {
   // Binding a service doesn't do anything major. It just returns back the
   // service id and its method map.
-  const Frame::BindService& req = req_frame.msg_bind_service();
+  protos::pbzero::IPCFrame::BindService::Decoder req(
+      req_frame.msg_bind_service());
   Frame reply_frame;
   reply_frame.set_request_id(req_frame.request_id());
   auto* reply = reply_frame.mutable_msg_bind_service_reply();
-  const ExposedService* service = GetServiceByName(req.service_name());
+  const ExposedService* service =
+      GetServiceByName(req.service_name().ToStdString());
   if (service) {
     reply->set_success(true);
     reply->set_service_id(service->id);
@@ -197,9 +209,11 @@ void HostImpl::OnBindService(ClientConnection* client, const Frame& req_frame) {
   SendFrame(client, reply_frame);
 }
 
-void HostImpl::OnInvokeMethod(ClientConnection* client,
-                              const Frame& req_frame) {
-  const Frame::InvokeMethod& req = req_frame.msg_invoke_method();
+void HostImpl::OnInvokeMethod(
+    ClientConnection* client,
+    const protos::pbzero::IPCFrame::Decoder& req_frame) {
+  protos::pbzero::IPCFrame::InvokeMethod::Decoder req(
+      req_frame.msg_invoke_method());
   Frame reply_frame;
   RequestID request_id = req_frame.request_id();
   reply_frame.set_request_id(request_id);
@@ -216,8 +230,9 @@ void HostImpl::OnInvokeMethod(ClientConnection* client,
     return SendFrame(client, reply_frame);
 
   const ServiceDescriptor::Method& method = methods[method_id - 1];
+  protozero::ConstBytes args_proto = req.args_proto();
   std::unique_ptr<ProtoMessage> decoded_req_args(
-      method.request_proto_decoder(req.args_proto()));
+      method.request_proto_decoder(args_proto.data, args_proto.size));
   if (!decoded_req_args)
     return SendFrame(client, reply_frame);
 
@@ -30,6 +30,13 @@
 #include "src/ipc/buffered_frame_deserializer.h"
 
 namespace perfetto {
+
+namespace protos {
+namespace pbzero {
+class IPCFrame_Decoder;
+}  // namespace pbzero
+}  // namespace protos
+
 namespace ipc {
 
 class HostImpl : public Host, public base::UnixSocket::EventListener {
@@ -73,9 +80,11 @@ class HostImpl : public Host, public base::UnixSocket::EventListener {
   HostImpl& operator=(const HostImpl&) = delete;
 
   bool Initialize(const char* socket_name);
-  void OnReceivedFrame(ClientConnection*, const Frame&);
-  void OnBindService(ClientConnection*, const Frame&);
-  void OnInvokeMethod(ClientConnection*, const Frame&);
+  void OnReceivedFrame(ClientConnection*, const uint8_t* data, size_t size);
+  void OnBindService(ClientConnection*,
+                     const protos::pbzero::IPCFrame_Decoder&);
+  void OnInvokeMethod(ClientConnection*,
+                      const protos::pbzero::IPCFrame_Decoder&);
   void ReplyToMethodInvocation(ClientID, RequestID, AsyncResult<ProtoMessage>);
   const ExposedService* GetServiceByName(const std::string&);
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/unix_task_runner.h"
+#include "perfetto/ext/ipc/client.h"
+#include "perfetto/ext/ipc/host.h"
+#include "src/ipc/test/test_socket.h"
+
+#include "src/ipc/test/greeter_service.gen.h"
+#include "src/ipc/test/greeter_service.ipc.h"
+
+namespace {
+
+using ::perfetto::base::UnixTaskRunner;
+using ::perfetto::ipc::AsyncResult;
+using ::perfetto::ipc::Client;
+using ::perfetto::ipc::Deferred;
+using ::perfetto::ipc::Host;
+using ::perfetto::ipc::Service;
+using ::perfetto::ipc::ServiceProxy;
+
+using namespace ::ipc_test::gen;
+
+::perfetto::ipc::TestSocket kTestSocket{"ipc_benchmark"};
+
+// Replies to SayHello() echoing back the request, unless the client asked to
+// drop the reply.
+class EchoGreeterService : public Greeter {
+ public:
+  void SayHello(const GreeterRequestMsg& request,
+                DeferredGreeterReplyMsg reply) override {
+    if (!reply.IsBound())
+      return;
+    auto res = AsyncResult<GreeterReplyMsg>::Create();
+    res->set_message(request.name());
+    reply.Resolve(std::move(res));
+  }
+
+  void WaveGoodbye(const GreeterRequestMsg&, DeferredGreeterReplyMsg) override {
+  }
+};
+
+class QuitOnConnect : public ServiceProxy::EventListener {
+ public:
+  explicit QuitOnConnect(UnixTaskRunner* task_runner)
+      : task_runner_(task_runner) {}
+  void OnConnect() override { task_runner_->Quit(); }
+  void OnDisconnect() override { task_runner_->Quit(); }
+
+ private:
+  UnixTaskRunner* const task_runner_;
+};
+
+// Host and client live on the same thread and talk over a real socket. This
+// measures the full cost of a method invocation on both sides: serialization,
+// send(), recv(), frame tokenization and decoding, and dispatching.
+class IpcBenchmarkEnv {
+ public:
+  IpcBenchmarkEnv() : listener_(&task_runner_) {
+    kTestSocket.Destroy();
+    host_ = Host::CreateInstance(kTestSocket.name(), &task_runner_);
+    PERFETTO_CHECK(host_);
+    PERFETTO_CHECK(host_->ExposeService(
+        std::unique_ptr<Service>(new EchoGreeterService())));
+    client_ = Client::CreateInstance({kTestSocket.name(), /*retry=*/false},
+                                     &task_runner_);
+    proxy_.reset(new GreeterProxy(&listener_));
+    client_->BindService(proxy_->GetWeakPtr());
+    task_runner_.Run();
+    PERFETTO_CHECK(proxy_->connected());
+  }
+
+  ~IpcBenchmarkEnv() { kTestSocket.Destroy(); }
+
+  // Sends |num_requests| - 1 requests without a reply, followed by one request
+  // with a reply, and runs the task runner until the reply is received.
+  void SendAndWaitForReply(const GreeterRequestMsg& req, size_t num_requests) {
+    for (size_t i = 1; i < num_requests; i++)
+      proxy_->SayHello(req, Deferred<GreeterReplyMsg>());
+    Deferred<GreeterReplyMsg> reply;
+    reply.Bind([this](AsyncResult<GreeterReplyMsg> res) {
+      PERFETTO_CHECK(res.success());
+      task_runner_.Quit();
+    });
+    proxy_->SayHello(req, std::move(reply));
+    task_runner_.Run();
+  }
+
+ private:
+  UnixTaskRunner task_runner_;
+  QuitOnConnect listener_;
+  std::unique_ptr<Host> host_;
+  std::unique_ptr<Client> client_;
+  std::unique_ptr<GreeterProxy> proxy_;
+};
+
+void BM_IpcRoundTrip(benchmark::State& state) {
+  IpcBenchmarkEnv env;
+  GreeterRequestMsg req;
+  req.set_name(std::string(static_cast<size_t>(state.range(0)), 'x'));
+
+  for (auto _ : state)
+    env.SendAndWaitForReply(req, /*num_requests=*/1);
+
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+// Resembles a producer issuing CommitData requests in a burst: most requests
+// don't want a reply, so several of them typically end up in the same recv().
+void BM_IpcOneWayBurst(benchmark::State& state) {
+  IpcBenchmarkEnv env;
+  GreeterRequestMsg req;
+  req.set_name(std::string(64, 'x'));
+  const size_t burst_size = static_cast<size_t>(state.range(0));
+
+  for (auto _ : state)
+    env.SendAndWaitForReply(req, burst_size);
+
+  state.SetItemsProcessed(
+      static_cast<int64_t>(state.iterations() * burst_size));
+}
+
+}  // namespace
+
+BENCHMARK(BM_IpcRoundTrip)->Arg(16)->Arg(1024)->Arg(16 * 1024);
+BENCHMARK(BM_IpcOneWayBurst)->Arg(8)->Arg(64)->Arg(256);
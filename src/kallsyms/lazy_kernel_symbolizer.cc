@@ -150,7 +150,7 @@ LazyKernelSymbolizer::LazyKernelSymbolizer() = default;
 LazyKernelSymbolizer::~LazyKernelSymbolizer() = default;
 
 KernelSymbolMap* LazyKernelSymbolizer::GetOrCreateKernelSymbolMap() {
-  PERFETTO_DCHECK_THREAD(thread_checker_);
+  std::lock_guard<std::mutex> lock(mutex_);
   if (symbol_map_)
     return symbol_map_.get();
 
@@ -164,7 +164,7 @@ KernelSymbolMap* LazyKernelSymbolizer::GetOrCreateKernelSymbolMap() {
 }
 
 void LazyKernelSymbolizer::Destroy() {
-  PERFETTO_DCHECK_THREAD(thread_checker_);
+  std::lock_guard<std::mutex> lock(mutex_);
   symbol_map_.reset();
   base::MaybeReleaseAllocatorMemToOS();  // For Scudo, b/170217718.
 }
@@ -18,8 +18,7 @@
 #define SRC_KALLSYMS_LAZY_KERNEL_SYMBOLIZER_H_
 
 #include <memory>
-
-#include "perfetto/ext/base/thread_checker.h"
+#include <mutex>
 
 namespace perfetto {
 
@@ -36,6 +35,7 @@ class KernelSymbolMap;
 // this way all CpuReader instances can share the same symbol map instance.
 // The object being shared is LazyKernelSymbolizer, which is cheap and always
 // valid. LazyKernelSymbolizer may or may not contain a valid symbol map.
+// It is thread-safe, as CpuReader-s can run on dedicated reader threads.
 class LazyKernelSymbolizer {
  public:
   // Constructs an empty instance. Does NOT load any symbols upon construction.
@@ -46,7 +46,10 @@ class LazyKernelSymbolizer {
   // Returns |instance_|, creating it if doesn't exist or was destroyed.
   KernelSymbolMap* GetOrCreateKernelSymbolMap();
 
-  bool is_valid() const { return !!symbol_map_; }
+  bool is_valid() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !!symbol_map_;
+  }
 
   // Destroys the |symbol_map_| freeing up memory. A further call to
   // GetOrCreateKernelSymbolMap() will create it again.
@@ -57,8 +60,8 @@ class LazyKernelSymbolizer {
       const char* ksyms_path_for_testing = nullptr);
 
  private:
+  mutable std::mutex mutex_;
   std::unique_ptr<KernelSymbolMap> symbol_map_;
-  PERFETTO_THREAD_CHECKER(thread_checker_)
 };
 
 }  // namespace perfetto
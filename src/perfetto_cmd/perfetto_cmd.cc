@@ -29,6 +29,7 @@
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
 #include <io.h>
 #else
+#include <poll.h>
 #include <unistd.h>
 #endif
 
@@ -57,6 +58,7 @@
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/tracing/core/data_source_descriptor.h"
 #include "perfetto/tracing/core/trace_config.h"
+#include "perfetto/tracing/core/tracing_service_capabilities.h"
 #include "perfetto/tracing/core/tracing_service_state.h"
 #include "src/android_stats/statsd_logging_helper.h"
 #include "src/perfetto_cmd/config.h"
@@ -685,18 +687,7 @@ base::Optional<int> PerfettoCmd::ParseCmdlineAndMaybeDaemonize(int argc,
       packet_writer_ = CreateFilePacketWriter(trace_out_stream_.get());
   }
 
-  if (trace_config_->compression_type() ==
-      TraceConfig::COMPRESSION_TYPE_DEFLATE) {
-    if (packet_writer_) {
-#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
-      packet_writer_ = CreateZipPacketWriter(std::move(packet_writer_));
-#else
-      PERFETTO_ELOG("Cannot compress. Zlib not enabled in the build config");
-#endif
-    } else {
-      PERFETTO_ELOG("Cannot compress when tracing directly to file.");
-    }
-  }
+  MaybeCompressFromCli();
 
   if (save_to_incidentd_ && !ignore_guardrails_ &&
       (trace_config_->duration_ms() == 0 &&
@@ -918,6 +909,28 @@ void PerfettoCmd::OnConnect() {
   }
 
   PERFETTO_DCHECK(trace_config_);
+
+  // Services that predate service-side compression (or are built without a
+  // compressor) silently ignore compression_type. Ask first, and compress
+  // here instead if needed.
+  if (trace_config_->compression_type() ==
+          TraceConfig::COMPRESSION_TYPE_DEFLATE &&
+      !trace_config_->compress_from_cli()) {
+    consumer_endpoint_->QueryCapabilities(
+        [this](const TracingServiceCapabilities& caps) {
+          if (!caps.has_trace_compression()) {
+            PERFETTO_LOG("The service can't compress, compressing the trace");
+            trace_config_->set_compress_from_cli(true);
+            MaybeCompressFromCli();
+          }
+          StartTracing();
+        });
+    return;
+  }
+  StartTracing();
+}
+
+void PerfettoCmd::StartTracing() {
   trace_config_->set_enable_extra_guardrails(save_to_incidentd_);
 
   // Set the statsd logging flag if we're uploading
@@ -1068,6 +1081,27 @@ bool PerfettoCmd::OpenOutputFile() {
   return true;
 }
 
+// By default compression is performed by the tracing service, both when
+// reading back the trace and when writing into the file. compress_from_cli
+// restores the legacy behavior of compressing here on the client side. It's
+// also set when the service can't compress, see OnConnect().
+void PerfettoCmd::MaybeCompressFromCli() {
+  if (!trace_config_->compress_from_cli() ||
+      trace_config_->compression_type() !=
+          TraceConfig::COMPRESSION_TYPE_DEFLATE) {
+    return;
+  }
+  if (packet_writer_) {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    packet_writer_ = CreateZipPacketWriter(std::move(packet_writer_));
+#else
+    PERFETTO_ELOG("Cannot compress. Zlib not enabled in the build config");
+#endif
+  } else {
+    PERFETTO_ELOG("Cannot compress when tracing directly to file.");
+  }
+}
+
 void PerfettoCmd::SetupCtrlCSignalHandler() {
   base::InstallCtrCHandler([] { g_perfetto_cmd->SignalCtrlC(); });
   task_runner_.AddFileDescriptorWatch(ctrl_c_evt_.fd(), [this] {
@@ -72,6 +72,9 @@ class PerfettoCmd : public Consumer {
 
  private:
   bool OpenOutputFile();
+  void MaybeCompressFromCli();
+  // Sends the trace config to the service, once connected.
+  void StartTracing();
   void SetupCtrlCSignalHandler();
   void FinalizeTraceAndExit();
   void PrintUsage(const char* argv0);
@@ -16,6 +16,7 @@
 
 #include "src/profiling/common/callstack_trie.h"
 
+#include <algorithm>
 #include <vector>
 
 #include "perfetto/ext/base/string_splitter.h"
@@ -126,29 +127,37 @@ Interned<Frame> GlobalCallstackTrie::MakeRootFrame() {
   return frame_interner_.Intern(frame);
 }
 
+std::vector<std::unique_ptr<GlobalCallstackTrie::Node>>::iterator
+GlobalCallstackTrie::Node::LowerBound(const Interned<Frame>& loc) {
+  return std::lower_bound(
+      children_.begin(), children_.end(), loc,
+      [](const std::unique_ptr<Node>& child, const Interned<Frame>& l) {
+        return child->location_ < l;
+      });
+}
+
 GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::AddChild(
     const Interned<Frame>& loc,
     uint64_t callstack_id,
     Node* parent) {
-  auto it = children_.emplace(loc, callstack_id, parent);
-  return const_cast<Node*>(&(*it.first));
+  auto it = LowerBound(loc);
+  PERFETTO_DCHECK(it == children_.end() || !((*it)->location_ == loc));
+  it = children_.emplace(it, new Node(loc, callstack_id, parent));
+  return it->get();
 }
+
 void GlobalCallstackTrie::Node::RemoveChild(Node* node) {
-  children_.erase(*node);
+  auto it = LowerBound(node->location_);
+  PERFETTO_DCHECK(it != children_.end() && it->get() == node);
+  children_.erase(it);
 }
 
 GlobalCallstackTrie::Node* GlobalCallstackTrie::Node::GetChild(
     const Interned<Frame>& loc) {
-  // This will be nicer with C++14 transparent comparators.
-  // Then we will be able to look up by just the key using a sutiable
-  // comparator.
-  //
-  // For now we need to allow to construct Node from the key.
-  Node node(loc);
-  auto it = children_.find(node);
-  if (it == children_.end())
+  auto it = LowerBound(loc);
+  if (it == children_.end() || !((*it)->location_ == loc))
     return nullptr;
-  return const_cast<Node*>(&(*it));
+  return it->get();
 }
 
 }  // namespace profiling
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/elf_cache.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <utility>
+
+namespace perfetto {
+namespace profiling {
+
+// static
+ElfCache* ElfCache::GetInstance() {
+  static ElfCache* instance = new ElfCache();
+  return instance;
+}
+
+ElfCache::ElfCache(uint64_t budget_bytes) : budget_bytes_(budget_bytes) {}
+ElfCache::~ElfCache() = default;
+
+// static
+bool ElfCache::IsCacheable(unwindstack::MapInfo* map_info) {
+  const std::string& name = map_info->name();
+  return (map_info->flags() & PROT_EXEC) &&
+         !(map_info->flags() & unwindstack::MAPS_FLAGS_DEVICE_MAP) &&
+         !name.empty() && name[0] == '/';
+}
+
+// static
+bool ElfCache::GetFileKey(unwindstack::MapInfo* map_info, FileKey* key) {
+  const std::string& name = map_info->name();
+  struct stat buf;
+  if (stat(name.c_str(), &buf) == -1)
+    return false;
+  key->dev = buf.st_dev;
+  key->ino = buf.st_ino;
+  key->size = buf.st_size;
+  key->mtime_ns = static_cast<int64_t>(buf.st_mtim.tv_sec) * 1000000000 +
+                  buf.st_mtim.tv_nsec;
+  key->offset = map_info->offset();
+  return true;
+}
+
+void ElfCache::PopulateMaps(unwindstack::Maps* maps,
+                            std::vector<unwindstack::MapInfo*>* populated,
+                            uint64_t* hits,
+                            uint64_t* misses) {
+  // Look up the files before taking the lock. Consecutive maps are usually
+  // of the same file.
+  std::vector<std::pair<unwindstack::MapInfo*, FileKey>> candidates;
+  uint64_t missing_files = 0;
+  const std::string* prev_name = nullptr;
+  bool prev_ok = false;
+  FileKey prev_key{};
+  for (const std::shared_ptr<unwindstack::MapInfo>& map_info : *maps) {
+    if (!IsCacheable(map_info.get()) || map_info->elf())
+      continue;
+    const std::string& name = map_info->name();
+    if (prev_name == nullptr || *prev_name != name) {
+      prev_ok = GetFileKey(map_info.get(), &prev_key);
+      prev_name = &name;
+    }
+    if (!prev_ok) {
+      missing_files++;
+      continue;
+    }
+    FileKey key = prev_key;
+    key.offset = map_info->offset();
+    candidates.emplace_back(map_info.get(), key);
+  }
+
+  std::lock_guard<std::mutex> l(mutex_);
+  *misses += missing_files;
+  stats_.misses += missing_files;
+  for (const auto& map_and_key : candidates) {
+    unwindstack::MapInfo* map_info = map_and_key.first;
+    auto it = by_file_.find(map_and_key.second);
+    if (it == by_file_.end()) {
+      ++*misses;
+      stats_.misses++;
+      continue;
+    }
+    const CachedMap& cached = it->second;
+    lru_.splice(lru_.begin(), lru_, cached.elf);
+    map_info->set_elf(cached.elf->elf);
+    map_info->set_elf_offset(cached.elf_offset);
+    map_info->set_elf_start_offset(cached.elf_start_offset);
+    populated->push_back(map_info);
+    ++*hits;
+    stats_.hits++;
+  }
+}
+
+void ElfCache::Add(unwindstack::MapInfo* map_info) {
+  if (!IsCacheable(map_info))
+    return;
+  // Memory backed ELF files are read from the memory of the process, so they
+  // cannot be shared.
+  std::shared_ptr<unwindstack::Elf> elf = map_info->elf();
+  if (!elf || !elf->valid() || map_info->memory_backed_elf())
+    return;
+  std::string build_id = map_info->GetBuildID();
+  if (build_id.empty())
+    return;
+  FileKey key;
+  if (!GetFileKey(map_info, &key))
+    return;
+  uint64_t elf_start_offset = map_info->elf_start_offset();
+  uint64_t file_size = static_cast<uint64_t>(key.size);
+  uint64_t size_bytes =
+      file_size > elf_start_offset ? file_size - elf_start_offset : 0;
+
+  std::lock_guard<std::mutex> l(mutex_);
+  auto file_it = by_file_.find(key);
+  if (file_it != by_file_.end()) {
+    lru_.splice(lru_.begin(), lru_, file_it->second.elf);
+    return;
+  }
+
+  ListIterator elf_it;
+  auto build_id_it = by_build_id_.find(build_id);
+  if (build_id_it != by_build_id_.end()) {
+    // Another copy of the same file. Later maps share the ELF already cached.
+    elf_it = build_id_it->second;
+    lru_.splice(lru_.begin(), lru_, elf_it);
+  } else {
+    lru_.push_front(CachedElf{build_id, std::move(elf), size_bytes, {}});
+    elf_it = lru_.begin();
+    by_build_id_.emplace(std::move(build_id), elf_it);
+    stats_.num_files++;
+    stats_.size_bytes += size_bytes;
+  }
+  elf_it->files.push_back(key);
+  by_file_.emplace(key, CachedMap{elf_it, map_info->elf_offset(),
+                                  elf_start_offset});
+  EvictOverBudgetLocked();
+}
+
+void ElfCache::EvictOverBudgetLocked() {
+  while (stats_.size_bytes > budget_bytes_ && !lru_.empty()) {
+    CachedElf& victim = lru_.back();
+    for (const FileKey& key : victim.files)
+      by_file_.erase(key);
+    by_build_id_.erase(victim.build_id);
+    stats_.size_bytes -= victim.size_bytes;
+    stats_.num_files--;
+    stats_.evictions++;
+    lru_.pop_back();
+  }
+}
+
+void ElfCache::Clear() {
+  std::lock_guard<std::mutex> l(mutex_);
+  by_file_.clear();
+  by_build_id_.clear();
+  lru_.clear();
+  stats_.num_files = 0;
+  stats_.size_bytes = 0;
+}
+
+ElfCache::Stats ElfCache::GetStats() {
+  std::lock_guard<std::mutex> l(mutex_);
+  return stats_;
+}
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_COMMON_ELF_CACHE_H_
+#define SRC_PROFILING_COMMON_ELF_CACHE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <unwindstack/Elf.h>
+#include <unwindstack/Maps.h>
+
+namespace perfetto {
+namespace profiling {
+
+// Keeps the ELF files that libunwindstack parsed for unwinding, so that they
+// can be reused for other processes and later profiling sessions of the same
+// daemon.
+//
+// Without this, every profiled process parses the ELF headers and unwind
+// tables of the system libraries again, even though most processes map the
+// same ones. The parsed files are keyed by their build id, so the same
+// library found at different paths shares one entry. Looking up the build id
+// would need the file to be read, so maps are matched through the identity
+// of the mapped file (device, inode, size, mtime) and the offset of the
+// mapping, which is remembered when an ELF file is added.
+//
+// The size of the cached files is bounded by |budget_bytes|, evicting the
+// least recently used ones first. The size of a file is the part of it
+// that libunwindstack maps into memory.
+//
+// Thread-safe.
+class ElfCache {
+ public:
+  struct Stats {
+    // Executable file-backed maps that were (not) found in the cache.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t num_files = 0;
+    uint64_t size_bytes = 0;
+  };
+
+  static constexpr uint64_t kDefaultBudgetBytes = 256 * 1024 * 1024;
+
+  // The cache shared by all profiled processes of this daemon.
+  static ElfCache* GetInstance();
+
+  explicit ElfCache(uint64_t budget_bytes = kDefaultBudgetBytes);
+  ~ElfCache();
+
+  ElfCache(const ElfCache&) = delete;
+  ElfCache& operator=(const ElfCache&) = delete;
+
+  // Sets the ELF file of all the maps in |maps| that are in the cache, so
+  // that libunwindstack does not create it. This needs to be called right
+  // after parsing the maps, before they are used for unwinding.
+  // Appends the maps that were set to |populated|, and adds the number of
+  // executable file-backed maps that were (not) found to |hits| and |misses|.
+  void PopulateMaps(unwindstack::Maps* maps,
+                    std::vector<unwindstack::MapInfo*>* populated,
+                    uint64_t* hits,
+                    uint64_t* misses);
+
+  // Adds the ELF file libunwindstack created for |map_info|, if it can be
+  // shared with other processes.
+  void Add(unwindstack::MapInfo* map_info);
+
+  void Clear();
+
+  Stats GetStats();
+
+ private:
+  // Identifies the mapping of a file.
+  struct FileKey {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+    uint64_t offset;
+
+    bool operator<(const FileKey& other) const {
+      return std::tie(dev, ino, size, mtime_ns, offset) <
+             std::tie(other.dev, other.ino, other.size, other.mtime_ns,
+                      other.offset);
+    }
+  };
+
+  struct CachedElf {
+    std::string build_id;
+    std::shared_ptr<unwindstack::Elf> elf;
+    uint64_t size_bytes;
+    // The mappings that resolve to this ELF file.
+    std::vector<FileKey> files;
+  };
+  using ListIterator = std::list<CachedElf>::iterator;
+
+  struct CachedMap {
+    ListIterator elf;
+    uint64_t elf_offset;
+    uint64_t elf_start_offset;
+  };
+
+  static bool IsCacheable(unwindstack::MapInfo* map_info);
+  static bool GetFileKey(unwindstack::MapInfo* map_info, FileKey* key);
+
+  void EvictOverBudgetLocked();
+
+  const uint64_t budget_bytes_;
+
+  std::mutex mutex_;
+  // Most recently used first.
+  std::list<CachedElf> lru_;
+  std::map<std::string, ListIterator> by_build_id_;
+  std::map<FileKey, CachedMap> by_file_;
+  Stats stats_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_COMMON_ELF_CACHE_H_
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/elf_cache.h"
+
+#include <fcntl.h>
+
+#include <unwindstack/Regs.h>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "src/profiling/common/unwind_support.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+UnwindingMetadata SelfMetadata(ElfCache* cache) {
+  return UnwindingMetadata(base::OpenFile("/proc/self/maps", O_RDONLY),
+                           base::OpenFile("/proc/self/mem", O_RDONLY), cache);
+}
+
+// The map of the code of this test.
+std::shared_ptr<unwindstack::MapInfo> FindOwnMap(UnwindingMetadata* metadata) {
+  uint64_t pc = reinterpret_cast<uint64_t>(&FindOwnMap);
+  for (const std::shared_ptr<unwindstack::MapInfo>& map_info :
+       metadata->fd_maps) {
+    if (map_info->start() <= pc && pc < map_info->end())
+      return map_info;
+  }
+  return nullptr;
+}
+
+// Unwinding through the code of this test has the ELF file of the test
+// binary created, and offered to the ElfCache.
+unwindstack::Elf* UnwindThroughOwnMap(UnwindingMetadata* metadata) {
+  std::shared_ptr<unwindstack::MapInfo> map_info = FindOwnMap(metadata);
+  if (!map_info)
+    return nullptr;
+  unwindstack::Elf* elf = map_info->GetElf(
+      metadata->fd_mem, unwindstack::Regs::CurrentArch());
+  unwindstack::FrameData frame{};
+  frame.map_info = map_info;
+  metadata->AddToElfCache({frame});
+  return elf;
+}
+
+TEST(ElfCacheTest, SharesElfAcrossProcesses) {
+  ElfCache cache;
+  UnwindingMetadata first = SelfMetadata(&cache);
+  EXPECT_EQ(first.elf_cache_hits, 0u);
+  EXPECT_GT(first.elf_cache_misses, 0u);
+  unwindstack::Elf* elf = UnwindThroughOwnMap(&first);
+  ASSERT_NE(elf, nullptr);
+  ASSERT_TRUE(elf->valid());
+  EXPECT_EQ(cache.GetStats().num_files, 1u);
+
+  UnwindingMetadata second = SelfMetadata(&cache);
+  EXPECT_GT(second.elf_cache_hits, 0u);
+  std::shared_ptr<unwindstack::MapInfo> map_info = FindOwnMap(&second);
+  ASSERT_TRUE(map_info);
+  EXPECT_EQ(map_info->elf().get(), elf);
+
+  // Offering it again does not add another file.
+  UnwindThroughOwnMap(&second);
+  EXPECT_EQ(cache.GetStats().num_files, 1u);
+}
+
+TEST(ElfCacheTest, ReparseMaps) {
+  ElfCache cache;
+  UnwindingMetadata metadata = SelfMetadata(&cache);
+  unwindstack::Elf* elf = UnwindThroughOwnMap(&metadata);
+  ASSERT_NE(elf, nullptr);
+
+  metadata.ReparseMaps();
+  EXPECT_GT(metadata.elf_cache_hits, 0u);
+  std::shared_ptr<unwindstack::MapInfo> map_info = FindOwnMap(&metadata);
+  ASSERT_TRUE(map_info);
+  EXPECT_EQ(map_info->elf().get(), elf);
+}
+
+TEST(ElfCacheTest, EvictsOverBudget) {
+  ElfCache cache(/*budget_bytes=*/0);
+  UnwindingMetadata first = SelfMetadata(&cache);
+  ASSERT_NE(UnwindThroughOwnMap(&first), nullptr);
+  ElfCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(stats.num_files, 0u);
+  EXPECT_EQ(stats.size_bytes, 0u);
+  EXPECT_EQ(stats.evictions, 1u);
+
+  UnwindingMetadata second = SelfMetadata(&cache);
+  EXPECT_EQ(second.elf_cache_hits, 0u);
+}
+
+TEST(ElfCacheTest, Clear) {
+  ElfCache cache;
+  UnwindingMetadata first = SelfMetadata(&cache);
+  ASSERT_NE(UnwindThroughOwnMap(&first), nullptr);
+  cache.Clear();
+  EXPECT_EQ(cache.GetStats().num_files, 0u);
+
+  UnwindingMetadata second = SelfMetadata(&cache);
+  EXPECT_EQ(second.elf_cache_hits, 0u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -14,7 +14,7 @@
  * limitations under the License.
  */
 
-#include "src/profiling/memory/log_histogram.h"
+#include "src/profiling/common/log_histogram.h"
 
 #include <stddef.h>
 
@@ -14,8 +14,8 @@
  * limitations under the License.
  */
 
-#ifndef SRC_PROFILING_MEMORY_LOG_HISTOGRAM_H_
-#define SRC_PROFILING_MEMORY_LOG_HISTOGRAM_H_
+#ifndef SRC_PROFILING_COMMON_LOG_HISTOGRAM_H_
+#define SRC_PROFILING_COMMON_LOG_HISTOGRAM_H_
 
 #include <stddef.h>
 
@@ -33,6 +33,10 @@ class LogHistogram {
   static constexpr size_t kBuckets = 20;
 
   void Add(uint64_t value) { values_[GetBucket(value)]++; }
+  void Merge(const LogHistogram& other) {
+    for (size_t i = 0; i < kBuckets; ++i)
+      values_[i] += other.values_[i];
+  }
   std::vector<std::pair<uint64_t, uint64_t>> GetData() const;
 
  private:
@@ -44,4 +48,4 @@ class LogHistogram {
 }  // namespace profiling
 }  // namespace perfetto
 
-#endif  // SRC_PROFILING_MEMORY_LOG_HISTOGRAM_H_
+#endif  // SRC_PROFILING_COMMON_LOG_HISTOGRAM_H_
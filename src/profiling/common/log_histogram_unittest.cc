@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/common/log_histogram.h"
+
+#include <limits>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::Contains;
+using ::testing::Pair;
+
+TEST(LogHistogramTest, Simple) {
+  LogHistogram h;
+  h.Add(1);
+  h.Add(0);
+  EXPECT_THAT(h.GetData(), Contains(Pair(2, 1)));
+  EXPECT_THAT(h.GetData(), Contains(Pair(1, 1)));
+}
+
+TEST(LogHistogramTest, Overflow) {
+  LogHistogram h;
+  h.Add(std::numeric_limits<uint64_t>::max());
+  EXPECT_THAT(h.GetData(), Contains(Pair(LogHistogram::kMaxBucket, 1)));
+}
+
+TEST(LogHistogramTest, Merge) {
+  LogHistogram a;
+  a.Add(0);
+  a.Add(3);
+  a.Add(std::numeric_limits<uint64_t>::max());
+  LogHistogram b;
+  b.Add(3);
+  b.Add(100);
+  b.Add(std::numeric_limits<uint64_t>::max());
+
+  LogHistogram merged;
+  merged.Merge(a);
+  merged.Merge(b);
+
+  // The buckets are summed, and both inputs are left untouched.
+  auto data = merged.GetData();
+  ASSERT_EQ(data.size(), static_cast<size_t>(LogHistogram::kBuckets));
+  EXPECT_THAT(data, Contains(Pair(1, 1)));
+  EXPECT_THAT(data, Contains(Pair(4, 2)));
+  EXPECT_THAT(data, Contains(Pair(128, 1)));
+  EXPECT_THAT(data, Contains(Pair(LogHistogram::kMaxBucket, 2)));
+  uint64_t total = 0;
+  for (const auto& bucket : data)
+    total += bucket.second;
+  EXPECT_EQ(total, 6u);
+  EXPECT_THAT(a.GetData(), Contains(Pair(4, 1)));
+  EXPECT_THAT(b.GetData(), Contains(Pair(4, 1)));
+
+  // Merging an empty histogram is a no-op.
+  merged.Merge(LogHistogram());
+  EXPECT_EQ(merged.GetData(), data);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
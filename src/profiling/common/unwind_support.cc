@@ -93,23 +93,52 @@ void FDMaps::Reset() {
 }
 
 UnwindingMetadata::UnwindingMetadata(base::ScopedFile maps_fd,
-                                     base::ScopedFile mem_fd)
+                                     base::ScopedFile mem_fd,
+                                     ElfCache* cache)
     : fd_maps(std::move(maps_fd)),
-      fd_mem(std::make_shared<FDMemory>(std::move(mem_fd))) {
+      fd_mem(std::make_shared<FDMemory>(std::move(mem_fd))),
+      elf_cache(cache) {
   if (!fd_maps.Parse())
     PERFETTO_DLOG("Failed initial maps parse");
+  PopulateFromElfCache();
 }
 
 void UnwindingMetadata::ReparseMaps() {
   reparses++;
-  fd_maps.Reset();
+  ResetMaps();
   fd_maps.Parse();
+  PopulateFromElfCache();
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   jit_debug.reset();
   dex_files.reset();
 #endif
 }
 
+void UnwindingMetadata::ResetMaps() {
+  elf_cache_maps.clear();
+  fd_maps.Reset();
+}
+
+void UnwindingMetadata::PopulateFromElfCache() {
+  if (!elf_cache)
+    return;
+  std::vector<unwindstack::MapInfo*> populated;
+  elf_cache->PopulateMaps(&fd_maps, &populated, &elf_cache_hits,
+                          &elf_cache_misses);
+  elf_cache_maps.insert(populated.begin(), populated.end());
+}
+
+void UnwindingMetadata::AddToElfCache(
+    const std::vector<unwindstack::FrameData>& frames) {
+  if (!elf_cache)
+    return;
+  for (const unwindstack::FrameData& frame : frames) {
+    unwindstack::MapInfo* map_info = frame.map_info.get();
+    if (map_info && elf_cache_maps.insert(map_info).second)
+      elf_cache->Add(map_info);
+  }
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
 unwindstack::JitDebug* UnwindingMetadata::GetJitDebug(unwindstack::ArchEnum arch) {
   if (jit_debug.get() == nullptr) {
@@ -22,6 +22,8 @@
 
 #include <memory>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include <unwindstack/Maps.h>
 #include <unwindstack/Unwinder.h>
@@ -33,6 +35,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/base/time.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "src/profiling/common/elf_cache.h"
 
 namespace perfetto {
 namespace profiling {
@@ -92,7 +95,11 @@ class StackOverlayMemory : public unwindstack::Memory {
 };
 
 struct UnwindingMetadata {
-  UnwindingMetadata(base::ScopedFile maps_fd, base::ScopedFile mem_fd);
+  // If |elf_cache| is set, the ELF files of the process are shared through it
+  // with other processes.
+  UnwindingMetadata(base::ScopedFile maps_fd,
+                    base::ScopedFile mem_fd,
+                    ElfCache* elf_cache = nullptr);
 
   // move-only
   UnwindingMetadata(const UnwindingMetadata&) = delete;
@@ -102,6 +109,13 @@ struct UnwindingMetadata {
   UnwindingMetadata& operator=(UnwindingMetadata&&) = default;
 
   void ReparseMaps();
+  // Drops the parsed maps. They are parsed again by the next ReparseMaps().
+  void ResetMaps();
+
+  // Sets the ELF files of the parsed maps that are in the ElfCache.
+  void PopulateFromElfCache();
+  // Offers the ELF files that were used to unwind |frames| to the ElfCache.
+  void AddToElfCache(const std::vector<unwindstack::FrameData>& frames);
 
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   unwindstack::JitDebug* GetJitDebug(unwindstack::ArchEnum arch);
@@ -116,6 +130,11 @@ struct UnwindingMetadata {
   std::shared_ptr<unwindstack::Memory> fd_mem;
   uint64_t reparses = 0;
   base::TimeMillis last_maps_reparse_time{0};
+  ElfCache* elf_cache = nullptr;
+  // Maps that were populated from or offered to the |elf_cache|.
+  std::unordered_set<const unwindstack::MapInfo*> elf_cache_maps;
+  uint64_t elf_cache_hits = 0;
+  uint64_t elf_cache_misses = 0;
 #if PERFETTO_BUILDFLAG(PERFETTO_ANDROID_BUILD)
   std::unique_ptr<unwindstack::JitDebug> jit_debug;
   std::unique_ptr<unwindstack::DexFiles> dex_files;
@@ -17,10 +17,11 @@
 #ifndef SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 #define SRC_PROFILING_MEMORY_BOOKKEEPING_H_
 
-#include <map>
+#include <memory>
 #include <vector>
 
 #include "perfetto/base/time.h"
+#include "perfetto/ext/base/flat_hash_map.h"
 #include "src/profiling/common/callstack_trie.h"
 #include "src/profiling/common/interner.h"
 #include "src/profiling/memory/unwound_messages.h"
@@ -89,6 +90,24 @@
 namespace perfetto {
 namespace profiling {
 
+// Hasher for the addresses, sequence numbers and pointers HeapTracker is
+// keyed by. std::hash is the identity for those, and aligned addresses would
+// only ever hit a fraction of the slots of a base::FlatHashMap.
+struct BookkeepingHash {
+  size_t operator()(uint64_t x) const {
+    // Finalizer of MurmurHash3.
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<size_t>(x);
+  }
+  size_t operator()(const void* p) const {
+    return (*this)(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)));
+  }
+};
+
 // Snapshot for memory allocations of a particular process. Shares callsites
 // with other processes.
 class HeapTracker {
@@ -145,10 +164,10 @@ class HeapTracker {
     // * We need to remove them after the callstacks were dumped, which
     //   currently happens after the allocations are dumped.
     // * This way, we do not destroy and recreate callstacks as frequently.
-    for (auto it_and_alloc : dead_callstack_allocations_) {
-      auto& it = it_and_alloc.first;
-      uint64_t allocated = it_and_alloc.second;
-      const CallstackAllocations& alloc = it->second;
+    for (const auto& node_and_alloc : dead_callstack_allocations_) {
+      GlobalCallstackTrie::Node* node = node_and_alloc.first;
+      uint64_t allocated = node_and_alloc.second;
+      const CallstackAllocations& alloc = **callstack_allocations_.Find(node);
       // For non-dump-at-max, we need to check, even if there are still no
       // allocations referencing this callstack, whether there were any
       // allocations that happened but were freed again. If that was the case,
@@ -160,27 +179,27 @@ class HeapTracker {
         // TODO(fmayer): We could probably be smarter than throw away
         // our whole frames cache.
         ClearFrameCache();
-        callstack_allocations_.erase(it);
+        callstack_allocations_.Erase(node);
       }
     }
     dead_callstack_allocations_.clear();
 
-    for (auto it = callstack_allocations_.begin();
-         it != callstack_allocations_.end(); ++it) {
-      const CallstackAllocations& alloc = it->second;
+    for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
+      const CallstackAllocations& alloc = *it.value();
       fn(alloc);
 
       if (alloc.allocs == 0)
         dead_callstack_allocations_.emplace_back(
-            it, !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
+            it.key(),
+            !dump_at_max_mode_ ? alloc.value.totals.allocation_count : 0);
     }
   }
 
   template <typename F>
   void GetAllocations(F fn) {
-    for (const auto& addr_and_allocation : allocations_) {
-      const Allocation& alloc = addr_and_allocation.second;
-      fn(addr_and_allocation.first, alloc.sample_size, alloc.alloc_size,
+    for (auto it = allocations_.GetIterator(); it; ++it) {
+      const Allocation& alloc = it.value();
+      fn(it.key(), alloc.sample_size, alloc.alloc_size,
          alloc.callstack_allocations()->node->id());
     }
   }
@@ -191,7 +210,7 @@ class HeapTracker {
     RecordOperation(sequence_number, {address, timestamp});
   }
 
-  void ClearFrameCache() { frame_cache_.clear(); }
+  void ClearFrameCache() { frame_cache_.Clear(); }
 
   uint64_t dump_timestamp() {
     return dump_at_max_mode_ ? max_timestamp_ : committed_timestamp_;
@@ -256,15 +275,17 @@ class HeapTracker {
 
   CallstackAllocations* MaybeCreateCallstackAllocations(
       GlobalCallstackTrie::Node* node) {
-    auto callstack_allocations_it = callstack_allocations_.find(node);
-    if (callstack_allocations_it == callstack_allocations_.end()) {
+    std::unique_ptr<CallstackAllocations>* callstack_allocations =
+        callstack_allocations_.Find(node);
+    if (!callstack_allocations) {
       GlobalCallstackTrie::IncrementNode(node);
       bool inserted;
-      std::tie(callstack_allocations_it, inserted) =
-          callstack_allocations_.emplace(node, node);
+      std::tie(callstack_allocations, inserted) = callstack_allocations_.Insert(
+          node, std::unique_ptr<CallstackAllocations>(
+                    new CallstackAllocations(node)));
       PERFETTO_DCHECK(inserted);
     }
-    return &callstack_allocations_it->second;
+    return callstack_allocations->get();
   }
 
   void RecordOperation(uint64_t sequence_number,
@@ -298,11 +319,11 @@ class HeapTracker {
         alloc.callstack_allocations()->value.retain_max.max_count =
             alloc.callstack_allocations()->value.retain_max.cur_count;
       } else {
-        for (auto& p : callstack_allocations_) {
+        for (auto it = callstack_allocations_.GetIterator(); it; ++it) {
           // We need to reset max = cur for every CallstackAllocation, as we
           // do not know which ones have changed since the last max.
           // TODO(fmayer): Add an index to speed this up
-          CallstackAllocations& csa = p.second;
+          CallstackAllocations& csa = *it.value();
           csa.value.retain_max.max = csa.value.retain_max.cur;
           csa.value.retain_max.max_count = csa.value.retain_max.cur_count;
         }
@@ -331,13 +352,22 @@ class HeapTracker {
   // We cannot use an interner here, because after the last allocation goes
   // away, we still need to keep the CallstackAllocations around until the next
   // dump.
-  std::map<GlobalCallstackTrie::Node*, CallstackAllocations>
+  // Allocations point to their CallstackAllocations, so those are heap
+  // allocated to keep them in place when the table is rehashed.
+  base::FlatHashMap<GlobalCallstackTrie::Node*,
+                    std::unique_ptr<CallstackAllocations>,
+                    BookkeepingHash>
       callstack_allocations_;
 
-  std::vector<std::pair<decltype(callstack_allocations_)::iterator, uint64_t>>
+  std::vector<std::pair<GlobalCallstackTrie::Node*, uint64_t>>
       dead_callstack_allocations_;
 
-  std::map<uint64_t /* allocation address */, Allocation> allocations_;
+  // There can be millions of live allocations. Unlike a std::map, this does
+  // not need a heap node (and its pointers) per allocation.
+  base::FlatHashMap<uint64_t /* allocation address */,
+                    Allocation,
+                    BookkeepingHash>
+      allocations_;
 
   // An operation is either a commit of an allocation or freeing of an
   // allocation. An operation is a free if its seq_id is larger than
@@ -346,7 +376,12 @@ class HeapTracker {
   //
   // If its seq_id is less than the sequence_number of the corresponding
   // allocation it could be either, but is ignored either way.
-  std::map<uint64_t /* seq_id */, PendingOperation /* allocation address */>
+  //
+  // Operations are committed in sequence order, so this is looked up by the
+  // next sequence number to commit rather than iterated in order.
+  base::FlatHashMap<uint64_t /* seq_id */,
+                    PendingOperation /* allocation address */,
+                    BookkeepingHash>
       pending_operations_;
 
   uint64_t committed_timestamp_ = 0;
@@ -363,7 +398,8 @@ class HeapTracker {
 
   // We index by abspc, which is unique as long as the maps do not change.
   // This is why we ClearFrameCache after we reparsed maps.
-  std::unordered_map<uint64_t /* abs pc */, Interned<Frame>> frame_cache_;
+  base::FlatHashMap<uint64_t /* abs pc */, Interned<Frame>, BookkeepingHash>
+      frame_cache_;
 };
 
 }  // namespace profiling
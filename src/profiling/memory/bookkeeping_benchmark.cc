@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <map>
+#include <thread>
+#include <tuple>
+
+#include "perfetto/base/build_config.h"
+#include "src/profiling/memory/bookkeeping.h"
+#include "src/profiling/memory/unwound_record_queue.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#include <malloc.h>
+#endif
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr uint64_t kDataSourceId = 1;
+constexpr size_t kRecordsPerClient = 20000;
+constexpr size_t kStackDepth = 16;
+constexpr size_t kDistinctStacks = 64;
+
+std::vector<unwindstack::FrameData> MakeStack(uint64_t leaf_pc) {
+  std::vector<unwindstack::FrameData> frames;
+  for (uint64_t i = 0; i < kStackDepth; ++i) {
+    unwindstack::FrameData frame{};
+    frame.pc = i == 0 ? leaf_pc : 0x100 + i;
+    frames.emplace_back(std::move(frame));
+  }
+  return frames;
+}
+
+std::unique_ptr<AllocRecord> MakeAllocRecord(pid_t pid, uint64_t seq) {
+  std::unique_ptr<AllocRecord> rec(new AllocRecord());
+  rec->pid = pid;
+  rec->data_source_instance_id = kDataSourceId;
+  rec->timestamp = seq;
+  rec->alloc_metadata = {};
+  rec->alloc_metadata.sequence_number = seq;
+  rec->alloc_metadata.alloc_address = 0x1000 + seq * 16;
+  rec->alloc_metadata.sample_size = 32;
+  rec->alloc_metadata.alloc_size = 32;
+  rec->frames = MakeStack(seq % kDistinctStacks);
+  rec->build_ids.resize(kStackDepth);
+  return rec;
+}
+
+// RSS would not show memory that the allocator reuses from earlier runs.
+uint64_t HeapBytesInUse() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  struct mallinfo2 info = mallinfo2();
+#else
+  struct mallinfo info = mallinfo();
+#endif
+  return static_cast<uint64_t>(info.uordblks) +
+         static_cast<uint64_t>(info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+// Synthetic client: allocates and frees right away, like an UnwindingWorker
+// would report it for a process.
+void RunClient(pid_t pid, UnwoundRecordQueue* queue) {
+  for (uint64_t seq = 1; seq < kRecordsPerClient; seq += 2) {
+    UnwoundRecord alloc(UnwoundRecord::Type::kAlloc);
+    alloc.alloc_record = MakeAllocRecord(pid, seq);
+    queue->Push(std::move(alloc));
+
+    FreeRecord free_rec{};
+    free_rec.pid = pid;
+    free_rec.data_source_instance_id = kDataSourceId;
+    free_rec.timestamp = seq + 1;
+    free_rec.entry.sequence_number = seq + 1;
+    free_rec.entry.addr = 0x1000 + seq * 16;
+    UnwoundRecord free(UnwoundRecord::Type::kFree);
+    free.free_records.emplace_back(std::move(free_rec));
+    queue->Push(std::move(free));
+  }
+}
+
+// Throughput of handing records over from |range(0)| client threads, each with
+// its own queue, and doing the bookkeeping for them on one thread.
+static void BM_HeapprofdBookkeeping(benchmark::State& state) {
+  const size_t num_clients = static_cast<size_t>(state.range(0));
+  size_t records = 0;
+  for (auto _ : state) {
+    GlobalCallstackTrie callsites;
+    std::map<pid_t, HeapTracker> trackers;
+    std::vector<UnwoundRecordQueue> queues(num_clients);
+    std::atomic<size_t> clients_done(0);
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < num_clients; ++i) {
+      clients.emplace_back([i, &queues, &clients_done] {
+        RunClient(static_cast<pid_t>(i + 1), &queues[i]);
+        clients_done++;
+      });
+    }
+
+    std::vector<UnwoundRecord> batch;
+    for (;;) {
+      bool done = clients_done.load() == num_clients;
+      size_t batch_records = 0;
+      for (UnwoundRecordQueue& queue : queues) {
+        queue.TakeAll(&batch);
+        batch_records += batch.size();
+        for (UnwoundRecord& rec : batch) {
+          if (rec.type == UnwoundRecord::Type::kAlloc) {
+            const AllocRecord& alloc = *rec.alloc_record;
+            auto it = trackers.find(alloc.pid);
+            if (it == trackers.end()) {
+              it = trackers
+                       .emplace(std::piecewise_construct,
+                                std::forward_as_tuple(alloc.pid),
+                                std::forward_as_tuple(&callsites,
+                                                      /*dump_at_max=*/false))
+                       .first;
+            }
+            it->second.RecordMalloc(
+                alloc.frames, alloc.build_ids,
+                alloc.alloc_metadata.alloc_address,
+                alloc.alloc_metadata.sample_size,
+                alloc.alloc_metadata.alloc_size,
+                alloc.alloc_metadata.sequence_number, alloc.timestamp);
+          } else {
+            for (const FreeRecord& free_rec : rec.free_records) {
+              trackers.at(free_rec.pid)
+                  .RecordFree(free_rec.entry.addr,
+                              free_rec.entry.sequence_number,
+                              free_rec.timestamp);
+            }
+          }
+        }
+        batch.clear();
+      }
+      records += batch_records;
+      if (done && batch_records == 0)
+        break;
+    }
+    for (std::thread& client : clients)
+      client.join();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(records));
+}
+
+// Malloc and free throughput of a HeapTracker with |range(0)| live
+// allocations, and the memory used per live allocation.
+static void BM_HeapTrackerLiveAllocations(benchmark::State& state) {
+  const uint64_t live = static_cast<uint64_t>(state.range(0));
+  std::vector<std::vector<unwindstack::FrameData>> stacks;
+  for (uint64_t i = 0; i < kDistinctStacks; ++i)
+    stacks.emplace_back(MakeStack(i));
+  const std::vector<std::string> build_ids(kStackDepth);
+
+  GlobalCallstackTrie callsites;
+  HeapTracker tracker(&callsites, /*dump_at_max_mode=*/false);
+  auto address = [](uint64_t i) { return 0x7f0000000000 + i * 32; };
+
+  const uint64_t heap_before = HeapBytesInUse();
+  uint64_t seq = 0;
+  for (uint64_t i = 0; i < live; ++i) {
+    ++seq;
+    tracker.RecordMalloc(stacks[i % kDistinctStacks], build_ids, address(i),
+                         32, 32, seq, seq);
+  }
+  const uint64_t heap_after = HeapBytesInUse();
+
+  // Free the oldest allocation and make a new one, keeping |live| of them.
+  uint64_t next = live;
+  for (auto _ : state) {
+    ++seq;
+    tracker.RecordFree(address(next - live), seq, seq);
+    ++seq;
+    tracker.RecordMalloc(stacks[next % kDistinctStacks], build_ids,
+                         address(next), 32, 32, seq, seq);
+    ++next;
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * 2);
+  state.counters["bytes_per_alloc"] = benchmark::Counter(
+      static_cast<double>(heap_after - heap_before) / static_cast<double>(live));
+}
+
+}  // namespace
+
+BENCHMARK(BM_HeapTrackerLiveAllocations)->Arg(1 << 10)->Arg(1 << 20);
+BENCHMARK(BM_HeapprofdBookkeeping)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -27,6 +27,7 @@
 #include "perfetto/ext/base/event_fd.h"
 #include "perfetto/ext/base/getopt.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_socket.h"
 #include "perfetto/ext/base/watchdog.h"
 #include "perfetto/ext/tracing/ipc/default_socket.h"
@@ -43,7 +44,7 @@ namespace perfetto {
 namespace profiling {
 namespace {
 
-int StartCentralHeapprofd();
+int StartCentralHeapprofd(size_t unwinder_threads);
 
 int GetListeningSocket() {
   const char* sock_fd = getenv(kHeapprofdSocketEnvVar);
@@ -59,7 +60,7 @@ int GetListeningSocket() {
 
 base::EventFd* g_dump_evt = nullptr;
 
-int StartCentralHeapprofd() {
+int StartCentralHeapprofd(size_t unwinder_threads) {
   // We set this up before launching any threads, so we do not have to use a
   // std::atomic for g_dump_evt.
   g_dump_evt = new base::EventFd();
@@ -67,7 +68,7 @@ int StartCentralHeapprofd() {
   base::UnixTaskRunner task_runner;
   base::Watchdog::GetInstance()->Start();  // crash on exceedingly long tasks
   HeapprofdProducer producer(HeapprofdMode::kCentral, &task_runner,
-                             /* exit_when_done= */ false);
+                             /* exit_when_done= */ false, unwinder_threads);
 
   int listening_raw_socket = GetListeningSocket();
   auto listening_socket = base::UnixSocket::Listen(
@@ -96,10 +97,18 @@ int StartCentralHeapprofd() {
 
 int HeapprofdMain(int argc, char** argv) {
   bool cleanup_crash = false;
-
-  enum { kCleanupCrash = 256, kTargetPid, kTargetCmd, kInheritFd };
+  size_t unwinder_threads = HeapprofdProducer::kDefaultUnwinderThreads;
+
+  enum {
+    kCleanupCrash = 256,
+    kTargetPid,
+    kTargetCmd,
+    kInheritFd,
+    kUnwinderThreads
+  };
   static option long_options[] = {
       {"cleanup-after-crash", no_argument, nullptr, kCleanupCrash},
+      {"unwinder-threads", required_argument, nullptr, kUnwinderThreads},
       {nullptr, 0, nullptr, 0}};
   int c;
   while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
@@ -107,6 +116,15 @@ int HeapprofdMain(int argc, char** argv) {
       case kCleanupCrash:
         cleanup_crash = true;
         break;
+      case kUnwinderThreads: {
+        base::Optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads == 0) {
+          PERFETTO_ELOG("Invalid --unwinder-threads: %s", optarg);
+          return 1;
+        }
+        unwinder_threads = *threads;
+        break;
+      }
     }
   }
 
@@ -123,7 +141,7 @@ int HeapprofdMain(int argc, char** argv) {
   }
 
   // start as a central daemon.
-  return StartCentralHeapprofd();
+  return StartCentralHeapprofd(unwinder_threads);
 }
 
 }  // namespace profiling
@@ -57,7 +57,6 @@ namespace {
 using ::perfetto::protos::pbzero::ProfilePacket;
 
 constexpr char kHeapprofdDataSource[] = "android.heapprofd";
-constexpr size_t kUnwinderThreads = 5;
 
 constexpr uint32_t kInitialConnectionBackoffMs = 100;
 constexpr uint32_t kMaxConnectionBackoffMs = 30 * 1000;
@@ -201,15 +200,19 @@ bool HeapprofdConfigToClientConfiguration(
   return true;
 }
 
-// We create kUnwinderThreads unwinding threads. Bookkeeping is done on the main
-// thread.
+constexpr size_t HeapprofdProducer::kDefaultUnwinderThreads;
+
+// We create |unwinder_threads| unwinding threads. Bookkeeping is done on the
+// main thread, which takes the unwound records from the workers in batches.
 HeapprofdProducer::HeapprofdProducer(HeapprofdMode mode,
                                      base::TaskRunner* task_runner,
-                                     bool exit_when_done)
+                                     bool exit_when_done,
+                                     size_t unwinder_threads)
     : task_runner_(task_runner),
       mode_(mode),
       exit_when_done_(exit_when_done),
-      unwinding_workers_(MakeUnwindingWorkers(this, kUnwinderThreads)),
+      record_queues_(unwinder_threads),
+      unwinding_workers_(MakeUnwindingWorkers(this, unwinder_threads)),
       socket_delegate_(this),
       weak_factory_(this) {
   CheckDataSourceCpuTask();
@@ -324,10 +327,12 @@ void HeapprofdProducer::Restart() {
   base::TaskRunner* task_runner = task_runner_;
   const char* socket_name = producer_sock_name_;
   const bool exit_when_done = exit_when_done_;
+  const size_t unwinder_threads = unwinding_workers_.size();
 
   // Invoke destructor and then the constructor again.
   this->~HeapprofdProducer();
-  new (this) HeapprofdProducer(mode, task_runner, exit_when_done);
+  new (this)
+      HeapprofdProducer(mode, task_runner, exit_when_done, unwinder_threads);
 
   ConnectWithRetries(socket_name);
 }
@@ -559,7 +564,8 @@ void HeapprofdProducer::StartDataSource(DataSourceInstanceID id,
 }
 
 UnwindingWorker& HeapprofdProducer::UnwinderForPID(pid_t pid) {
-  return unwinding_workers_[static_cast<uint64_t>(pid) % kUnwinderThreads];
+  return unwinding_workers_[static_cast<uint64_t>(pid) %
+                            unwinding_workers_.size()];
 }
 
 void HeapprofdProducer::StopDataSource(DataSourceInstanceID id) {
@@ -654,6 +660,8 @@ void HeapprofdProducer::SetStats(
   stats->set_total_unwinding_time_us(process_state.total_unwinding_time_us);
   stats->set_client_spinlock_blocked_us(
       process_state.client_spinlock_blocked_us);
+  stats->set_elf_cache_hits(process_state.elf_cache_hits);
+  stats->set_elf_cache_misses(process_state.elf_cache_misses);
   auto* unwinding_hist = stats->set_unwinding_time_us();
   for (const auto& p : process_state.unwinding_time_us.GetData()) {
     auto* bucket = unwinding_hist->add_buckets();
@@ -945,55 +953,82 @@ void HeapprofdProducer::HandleClientConnection(
   pending_processes_.emplace(peer_pid, std::move(pending_process));
 }
 
+size_t HeapprofdProducer::WorkerIndex(UnwindingWorker* worker) const {
+  PERFETTO_DCHECK(worker >= unwinding_workers_.data() &&
+                  worker < unwinding_workers_.data() + unwinding_workers_.size());
+  return static_cast<size_t>(worker - unwinding_workers_.data());
+}
+
+void HeapprofdProducer::PushRecord(UnwindingWorker* worker,
+                                   UnwoundRecord record) {
+  size_t worker_index = WorkerIndex(worker);
+  // Only the first record of a batch schedules a task, the following ones are
+  // picked up by it.
+  if (!record_queues_[worker_index].Push(std::move(record)))
+    return;
+  auto weak_this = weak_factory_.GetWeakPtr();
+  task_runner_->PostTask([weak_this, worker_index] {
+    if (weak_this)
+      weak_this->HandleQueuedRecords(worker_index);
+  });
+}
+
 void HeapprofdProducer::PostAllocRecord(
     UnwindingWorker* worker,
     std::unique_ptr<AllocRecord> alloc_rec) {
-  // Once we can use C++14, this should be std::moved into the lambda instead.
-  auto* raw_alloc_rec = alloc_rec.release();
-  auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, raw_alloc_rec, worker] {
-    std::unique_ptr<AllocRecord> unique_alloc_ref =
-        std::unique_ptr<AllocRecord>(raw_alloc_rec);
-    if (weak_this) {
-      weak_this->HandleAllocRecord(unique_alloc_ref.get());
-      worker->ReturnAllocRecord(std::move(unique_alloc_ref));
-    }
-  });
+  UnwoundRecord record(UnwoundRecord::Type::kAlloc);
+  record.alloc_record = std::move(alloc_rec);
+  PushRecord(worker, std::move(record));
 }
 
-void HeapprofdProducer::PostFreeRecord(UnwindingWorker*,
+void HeapprofdProducer::PostFreeRecord(UnwindingWorker* worker,
                                        std::vector<FreeRecord> free_recs) {
-  // Once we can use C++14, this should be std::moved into the lambda instead.
-  std::vector<FreeRecord>* raw_free_recs =
-      new std::vector<FreeRecord>(std::move(free_recs));
-  auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, raw_free_recs] {
-    if (weak_this) {
-      for (FreeRecord& free_rec : *raw_free_recs)
-        weak_this->HandleFreeRecord(std::move(free_rec));
-    }
-    delete raw_free_recs;
-  });
+  UnwoundRecord record(UnwoundRecord::Type::kFree);
+  record.free_records = std::move(free_recs);
+  PushRecord(worker, std::move(record));
 }
 
-void HeapprofdProducer::PostHeapNameRecord(UnwindingWorker*,
+void HeapprofdProducer::PostHeapNameRecord(UnwindingWorker* worker,
                                            HeapNameRecord rec) {
-  auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, rec] {
-    if (weak_this)
-      weak_this->HandleHeapNameRecord(rec);
-  });
+  UnwoundRecord record(UnwoundRecord::Type::kHeapName);
+  record.heap_name_record = rec;
+  PushRecord(worker, std::move(record));
 }
 
-void HeapprofdProducer::PostSocketDisconnected(UnwindingWorker*,
+void HeapprofdProducer::PostSocketDisconnected(UnwindingWorker* worker,
                                                DataSourceInstanceID ds_id,
                                                pid_t pid,
                                                SharedRingBuffer::Stats stats) {
-  auto weak_this = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_this, ds_id, pid, stats] {
-    if (weak_this)
-      weak_this->HandleSocketDisconnected(ds_id, pid, stats);
-  });
+  UnwoundRecord record(UnwoundRecord::Type::kSocketDisconnected);
+  record.data_source_instance_id = ds_id;
+  record.pid = pid;
+  record.stats = stats;
+  PushRecord(worker, std::move(record));
+}
+
+void HeapprofdProducer::HandleQueuedRecords(size_t worker_index) {
+  UnwindingWorker& worker = unwinding_workers_[worker_index];
+  record_queues_[worker_index].TakeAll(&queued_records_);
+  for (UnwoundRecord& record : queued_records_) {
+    switch (record.type) {
+      case UnwoundRecord::Type::kAlloc:
+        HandleAllocRecord(record.alloc_record.get());
+        worker.ReturnAllocRecord(std::move(record.alloc_record));
+        break;
+      case UnwoundRecord::Type::kFree:
+        for (FreeRecord& free_rec : record.free_records)
+          HandleFreeRecord(std::move(free_rec));
+        break;
+      case UnwoundRecord::Type::kHeapName:
+        HandleHeapNameRecord(record.heap_name_record);
+        break;
+      case UnwoundRecord::Type::kSocketDisconnected:
+        HandleSocketDisconnected(record.data_source_instance_id, record.pid,
+                                 record.stats);
+        break;
+    }
+  }
+  queued_records_.clear();
 }
 
 void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
@@ -1051,6 +1086,8 @@ void HeapprofdProducer::HandleAllocRecord(AllocRecord* alloc_rec) {
   process_state.heap_samples++;
   process_state.unwinding_time_us.Add(alloc_rec->unwinding_time_us);
   process_state.total_unwinding_time_us += alloc_rec->unwinding_time_us;
+  process_state.elf_cache_hits = alloc_rec->elf_cache_hits;
+  process_state.elf_cache_misses = alloc_rec->elf_cache_misses;
 
   // abspc may no longer refer to the same functions, as we had to reparse
   // maps. Reset the cache.
@@ -34,15 +34,16 @@
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/forward_decls.h"
 #include "src/profiling/common/interning_output.h"
+#include "src/profiling/common/log_histogram.h"
 #include "src/profiling/common/proc_utils.h"
 #include "src/profiling/common/profiler_guardrails.h"
 #include "src/profiling/memory/bookkeeping.h"
 #include "src/profiling/memory/bookkeeping_dump.h"
-#include "src/profiling/memory/log_histogram.h"
 #include "src/profiling/memory/shared_ring_buffer.h"
 #include "src/profiling/memory/system_property.h"
 #include "src/profiling/memory/unwinding.h"
 #include "src/profiling/memory/unwound_messages.h"
+#include "src/profiling/memory/unwound_record_queue.h"
 
 #include "protos/perfetto/config/profiling/heapprofd_config.gen.h"
 
@@ -105,9 +106,12 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     HeapprofdProducer* producer_;
   };
 
+  static constexpr size_t kDefaultUnwinderThreads = 5;
+
   HeapprofdProducer(HeapprofdMode mode,
                     base::TaskRunner* task_runner,
-                    bool exit_when_done);
+                    bool exit_when_done,
+                    size_t unwinder_threads = kDefaultUnwinderThreads);
   ~HeapprofdProducer() override;
 
   // Producer Impl:
@@ -136,6 +140,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
                               pid_t,
                               SharedRingBuffer::Stats) override;
 
+  // Handles all the records queued by the worker at |worker_index|, in order.
+  void HandleQueuedRecords(size_t worker_index);
   void HandleAllocRecord(AllocRecord*);
   void HandleFreeRecord(FreeRecord);
   void HandleHeapNameRecord(HeapNameRecord);
@@ -190,6 +196,8 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     uint64_t heap_samples = 0;
     uint64_t map_reparses = 0;
     uint64_t unwinding_errors = 0;
+    uint64_t elf_cache_hits = 0;
+    uint64_t elf_cache_misses = 0;
 
     uint64_t total_unwinding_time_us = 0;
     uint64_t client_spinlock_blocked_us = 0;
@@ -245,6 +253,9 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
     SharedRingBuffer shmem;
   };
 
+  size_t WorkerIndex(UnwindingWorker* worker) const;
+  void PushRecord(UnwindingWorker* worker, UnwoundRecord record);
+
   void HandleClientConnection(std::unique_ptr<base::UnixSocket> new_connection,
                               Process process);
 
@@ -313,6 +324,11 @@ class HeapprofdProducer : public Producer, public UnwindingWorker::Delegate {
 
   std::map<FlushRequestID, size_t> flushes_in_progress_;
   std::map<DataSourceInstanceID, DataSource> data_sources_;
+  // Must outlive unwinding_workers_, which push to them from their threads.
+  // One per worker.
+  std::vector<UnwoundRecordQueue> record_queues_;
+  // Reused across HandleQueuedRecords() calls.
+  std::vector<UnwoundRecord> queued_records_;
   std::vector<UnwindingWorker> unwinding_workers_;
 
   // Specific to mode_ == kChild
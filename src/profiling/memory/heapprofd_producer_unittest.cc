@@ -27,9 +27,7 @@
 namespace perfetto {
 namespace profiling {
 
-using ::testing::Contains;
 using ::testing::Eq;
-using ::testing::Pair;
 using ::testing::Property;
 
 class MockProducerEndpoint : public TracingService::ProducerEndpoint {
@@ -55,20 +53,6 @@ class MockProducerEndpoint : public TracingService::ProducerEndpoint {
   MOCK_METHOD1(Sync, void(std::function<void()>));
 };
 
-TEST(LogHistogramTest, Simple) {
-  LogHistogram h;
-  h.Add(1);
-  h.Add(0);
-  EXPECT_THAT(h.GetData(), Contains(Pair(2, 1)));
-  EXPECT_THAT(h.GetData(), Contains(Pair(1, 1)));
-}
-
-TEST(LogHistogramTest, Overflow) {
-  LogHistogram h;
-  h.Add(std::numeric_limits<uint64_t>::max());
-  EXPECT_THAT(h.GetData(), Contains(Pair(LogHistogram::kMaxBucket, 1)));
-}
-
 TEST(HeapprofdProducerTest, ExposesDataSource) {
   base::TestTaskRunner task_runner;
   HeapprofdProducer producer(HeapprofdMode::kCentral, &task_runner,
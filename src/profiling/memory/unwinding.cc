@@ -51,6 +51,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/thread_task_runner.h"
 
+#include "src/profiling/common/elf_cache.h"
 #include "src/profiling/memory/unwound_messages.h"
 #include "src/profiling/memory/wire_protocol.h"
 
@@ -184,6 +185,7 @@ bool DoUnwind(WireMessage* msg, UnwindingMetadata* metadata, AllocRecord* out) {
   for (size_t i = 0; i < out->frames.size(); ++i) {
     out->build_ids[i] = metadata->GetBuildId(out->frames[i]);
   }
+  metadata->AddToElfCache(out->frames);
 
   if (error_code != unwindstack::ERROR_NONE) {
     PERFETTO_DLOG("Unwinding error %" PRIu8, error_code);
@@ -340,6 +342,8 @@ void UnwindingWorker::HandleBuffer(UnwindingWorker* self,
       DoUnwind(&msg, unwinding_metadata, rec.get());
     rec->unwinding_time_us = static_cast<uint64_t>(
         ((base::GetWallTimeNs() / 1000) - start_time_us).count());
+    rec->elf_cache_hits = unwinding_metadata->elf_cache_hits;
+    rec->elf_cache_misses = unwinding_metadata->elf_cache_misses;
     delegate->PostAllocRecord(self, std::move(rec));
   } else if (msg.record_type == RecordType::Free) {
     FreeRecord rec;
@@ -385,7 +389,8 @@ void UnwindingWorker::HandleHandoffSocket(HandoffData handoff_data) {
   pid_t peer_pid = sock->peer_pid_linux();
 
   UnwindingMetadata metadata(std::move(handoff_data.maps_fd),
-                             std::move(handoff_data.mem_fd));
+                             std::move(handoff_data.mem_fd),
+                             ElfCache::GetInstance());
   ClientData client_data{
       handoff_data.data_source_instance_id,
       std::move(sock),
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/memory/unwound_record_queue.h"
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace profiling {
+
+UnwoundRecordQueue::UnwoundRecordQueue() : mutex_(new std::mutex()) {}
+UnwoundRecordQueue::~UnwoundRecordQueue() = default;
+
+UnwoundRecordQueue::UnwoundRecordQueue(UnwoundRecordQueue&&) noexcept =
+    default;
+UnwoundRecordQueue& UnwoundRecordQueue::operator=(
+    UnwoundRecordQueue&&) noexcept = default;
+
+bool UnwoundRecordQueue::Push(UnwoundRecord record) {
+  std::lock_guard<std::mutex> l(*mutex_);
+  records_.emplace_back(std::move(record));
+  return records_.size() == 1;
+}
+
+void UnwoundRecordQueue::TakeAll(std::vector<UnwoundRecord>* records) {
+  PERFETTO_DCHECK(records->empty());
+  std::lock_guard<std::mutex> l(*mutex_);
+  records_.swap(*records);
+}
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_MEMORY_UNWOUND_RECORD_QUEUE_H_
+#define SRC_PROFILING_MEMORY_UNWOUND_RECORD_QUEUE_H_
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "perfetto/ext/tracing/core/basic_types.h"
+#include "src/profiling/memory/shared_ring_buffer.h"
+#include "src/profiling/memory/unwound_messages.h"
+
+namespace perfetto {
+namespace profiling {
+
+// One of the messages an UnwindingWorker hands over to the bookkeeping thread.
+// Only the fields for |type| are set.
+struct UnwoundRecord {
+  enum class Type {
+    kAlloc,
+    kFree,
+    kHeapName,
+    kSocketDisconnected,
+  };
+
+  explicit UnwoundRecord(Type t) : type(t) {}
+
+  Type type;
+  std::unique_ptr<AllocRecord> alloc_record;  // kAlloc.
+  std::vector<FreeRecord> free_records;       // kFree.
+  HeapNameRecord heap_name_record{};          // kHeapName.
+
+  // kSocketDisconnected.
+  DataSourceInstanceID data_source_instance_id = 0;
+  pid_t pid = 0;
+  SharedRingBuffer::Stats stats{};
+};
+
+// Hands records over from one UnwindingWorker to the bookkeeping thread.
+//
+// Posting a task per record costs a std::function allocation and an eventfd
+// wakeup of the main thread for each record. Instead, the worker appends to
+// this queue and only the first Push() into an empty queue needs to schedule a
+// drain. The bookkeeping thread then takes the whole batch at once, swapping
+// the vectors so that their capacity is reused. Records are kept in the order
+// they were pushed, so a disconnect is always handled after the last records
+// of the process.
+//
+// Thread-safe. The lock is only held to append or to swap the vectors, and
+// each queue is shared by a single worker and the bookkeeping thread.
+//
+// TODO(fmayer): this only batches the handoff, the HeapTracker bookkeeping of
+// all processes still runs on the main thread. Sharding it per process onto
+// the workers needs per-shard GlobalCallstackTrie and interning, and dumps
+// that collect from all the shards. Once that is done, this should become a
+// lock-free SPSC ring.
+class UnwoundRecordQueue {
+ public:
+  UnwoundRecordQueue();
+  ~UnwoundRecordQueue();
+
+  UnwoundRecordQueue(UnwoundRecordQueue&&) noexcept;
+  UnwoundRecordQueue& operator=(UnwoundRecordQueue&&) noexcept;
+
+  // Returns true if the queue was empty, in which case the caller must
+  // arrange for TakeAll() to be called.
+  bool Push(UnwoundRecord record);
+
+  // Moves all queued records into |records|, which must be empty.
+  void TakeAll(std::vector<UnwoundRecord>* records);
+
+ private:
+  // Heap allocated so the queue can be kept in a std::vector.
+  std::unique_ptr<std::mutex> mutex_;
+  std::vector<UnwoundRecord> records_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_MEMORY_UNWOUND_RECORD_QUEUE_H_
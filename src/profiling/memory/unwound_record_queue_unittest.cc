@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/memory/unwound_record_queue.h"
+
+#include <thread>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+UnwoundRecord FreeRecordFor(pid_t pid, uint64_t seq) {
+  UnwoundRecord record(UnwoundRecord::Type::kFree);
+  FreeRecord free_rec{};
+  free_rec.pid = pid;
+  free_rec.entry.sequence_number = seq;
+  record.free_records.emplace_back(free_rec);
+  return record;
+}
+
+TEST(UnwoundRecordQueueTest, OnlyFirstPushSchedules) {
+  UnwoundRecordQueue queue;
+  EXPECT_TRUE(queue.Push(FreeRecordFor(1, 1)));
+  EXPECT_FALSE(queue.Push(FreeRecordFor(1, 2)));
+
+  std::vector<UnwoundRecord> records;
+  queue.TakeAll(&records);
+  ASSERT_EQ(records.size(), 2u);
+  records.clear();
+
+  EXPECT_TRUE(queue.Push(FreeRecordFor(1, 3)));
+}
+
+TEST(UnwoundRecordQueueTest, KeepsOrder) {
+  UnwoundRecordQueue queue;
+  std::unique_ptr<AllocRecord> alloc(new AllocRecord());
+  alloc->pid = 1;
+  UnwoundRecord alloc_record(UnwoundRecord::Type::kAlloc);
+  alloc_record.alloc_record = std::move(alloc);
+  queue.Push(std::move(alloc_record));
+  queue.Push(FreeRecordFor(1, 2));
+  UnwoundRecord disconnect(UnwoundRecord::Type::kSocketDisconnected);
+  disconnect.pid = 1;
+  queue.Push(std::move(disconnect));
+
+  std::vector<UnwoundRecord> records;
+  queue.TakeAll(&records);
+  ASSERT_EQ(records.size(), 3u);
+  EXPECT_EQ(records[0].type, UnwoundRecord::Type::kAlloc);
+  ASSERT_TRUE(records[0].alloc_record);
+  EXPECT_EQ(records[0].alloc_record->pid, 1);
+  EXPECT_EQ(records[1].type, UnwoundRecord::Type::kFree);
+  EXPECT_EQ(records[1].free_records[0].entry.sequence_number, 2u);
+  EXPECT_EQ(records[2].type, UnwoundRecord::Type::kSocketDisconnected);
+}
+
+TEST(UnwoundRecordQueueTest, ConcurrentPush) {
+  constexpr uint64_t kNumRecords = 10000;
+  UnwoundRecordQueue queue;
+  std::thread producer([&queue] {
+    for (uint64_t seq = 0; seq < kNumRecords; ++seq)
+      queue.Push(FreeRecordFor(1, seq));
+  });
+
+  uint64_t next_seq = 0;
+  std::vector<UnwoundRecord> records;
+  while (next_seq < kNumRecords) {
+    queue.TakeAll(&records);
+    for (const UnwoundRecord& record : records)
+      EXPECT_EQ(record.free_records[0].entry.sequence_number, next_seq++);
+    records.clear();
+  }
+  producer.join();
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -23,6 +23,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "perfetto/ext/base/utils.h"
 #include "src/profiling/perf/regs_parsing.h"
 
@@ -114,6 +116,32 @@ PerfRingBuffer::~PerfRingBuffer() {
 base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
     int perf_fd,
     size_t data_page_count) {
+  // If PROT_WRITE, kernel won't overwrite unread samples.
+  base::Optional<PerfRingBuffer> ret =
+      Map(perf_fd, MAP_SHARED, data_page_count);
+  if (!ret)
+    return base::nullopt;
+
+  PERFETTO_CHECK(ret->metadata_page_->data_offset == base::kPageSize);
+  PERFETTO_CHECK(ret->metadata_page_->data_size = ret->data_buf_sz_);
+  return ret;
+}
+
+base::Optional<PerfRingBuffer> PerfRingBuffer::AllocateForTesting(
+    size_t data_page_count) {
+  base::Optional<PerfRingBuffer> ret =
+      Map(-1, MAP_PRIVATE | MAP_ANONYMOUS, data_page_count);
+  if (!ret)
+    return base::nullopt;
+
+  ret->metadata_page_->data_offset = base::kPageSize;
+  ret->metadata_page_->data_size = ret->data_buf_sz_;
+  return ret;
+}
+
+base::Optional<PerfRingBuffer> PerfRingBuffer::Map(int fd,
+                                                   int flags,
+                                                   size_t data_page_count) {
   // perf_event_open requires the ring buffer to be a power of two in size.
   PERFETTO_DCHECK(IsPowerOfTwo(data_page_count));
 
@@ -123,9 +151,8 @@ base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
   ret.data_buf_sz_ = data_page_count * base::kPageSize;
   ret.mmap_sz_ = ret.data_buf_sz_ + base::kPageSize;
 
-  // If PROT_WRITE, kernel won't overwrite unread samples.
-  void* mmap_addr = mmap(nullptr, ret.mmap_sz_, PROT_READ | PROT_WRITE,
-                         MAP_SHARED, perf_fd, 0);
+  void* mmap_addr =
+      mmap(nullptr, ret.mmap_sz_, PROT_READ | PROT_WRITE, flags, fd, 0);
   if (mmap_addr == MAP_FAILED) {
     PERFETTO_PLOG("failed mmap");
     return base::nullopt;
@@ -134,9 +161,6 @@ base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
   // Expected layout is [ metadata page ] [ data pages ... ]
   ret.metadata_page_ = reinterpret_cast<perf_event_mmap_page*>(mmap_addr);
   ret.data_buf_ = reinterpret_cast<char*>(mmap_addr) + base::kPageSize;
-  PERFETTO_CHECK(ret.metadata_page_->data_offset == base::kPageSize);
-  PERFETTO_CHECK(ret.metadata_page_->data_size = ret.data_buf_sz_);
-
   return base::make_optional(std::move(ret));
 }
 
@@ -147,24 +171,47 @@ base::Optional<PerfRingBuffer> PerfRingBuffer::Allocate(
 // Is there an argument for maintaining our own copy of |data_tail| instead of
 // reloading it?
 char* PerfRingBuffer::ReadRecordNonconsuming() {
+  ReadBatch batch = BeginBatch();
+  if (batch.write_offset == batch.read_offset)
+    return nullptr;  // no new data
+  return RecordAt(batch.read_offset);
+}
+
+PerfRingBuffer::ReadBatch PerfRingBuffer::BeginBatch() {
   static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t), "");
 
   PERFETTO_DCHECK(valid());
 
+  ReadBatch batch;
   // |data_tail| is written only by this userspace thread, so we can safely read
   // it without any synchronization.
-  uint64_t read_offset = metadata_page_->data_tail;
+  batch.read_offset = metadata_page_->data_tail;
 
   // |data_head| is written by the kernel, perform an acquiring load such that
-  // the payload reads below are ordered after this load.
-  uint64_t write_offset =
+  // the payload reads of the batch are ordered after this load.
+  batch.write_offset =
       reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_head)
           ->load(std::memory_order_acquire);
 
-  PERFETTO_DCHECK(read_offset <= write_offset);
-  if (write_offset == read_offset)
-    return nullptr;  // no new data
+  PERFETTO_DCHECK(batch.read_offset <= batch.write_offset);
+  return batch;
+}
+
+char* PerfRingBuffer::NextRecord(ReadBatch* batch) {
+  if (batch->read_offset == batch->write_offset)
+    return nullptr;
+  char* record = RecordAt(batch->read_offset);
+  batch->read_offset += reinterpret_cast<perf_event_header*>(record)->size;
+  PERFETTO_DCHECK(batch->read_offset <= batch->write_offset);
+  return record;
+}
+
+void PerfRingBuffer::CommitBatch(const ReadBatch& batch) {
+  PERFETTO_DCHECK(batch.read_offset >= metadata_page_->data_tail);
+  Consume(static_cast<size_t>(batch.read_offset - metadata_page_->data_tail));
+}
 
+char* PerfRingBuffer::RecordAt(uint64_t read_offset) {
   size_t read_pos = static_cast<size_t>(read_offset & (data_buf_sz_ - 1));
 
   // event header (64 bits) guaranteed to be contiguous
@@ -209,6 +256,25 @@ void PerfRingBuffer::Consume(size_t bytes) {
       ->store(updated_tail, std::memory_order_release);
 }
 
+bool PerfRingBuffer::WriteRecordForTesting(const char* record) {
+  uint16_t size = reinterpret_cast<const perf_event_header*>(record)->size;
+  uint64_t head = metadata_page_->data_head;
+  uint64_t tail =
+      reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_tail)
+          ->load(std::memory_order_acquire);
+  if (head + size - tail > data_buf_sz_)
+    return false;
+
+  size_t write_pos = static_cast<size_t>(head & (data_buf_sz_ - 1));
+  size_t prefix_sz =
+      std::min(static_cast<size_t>(size), data_buf_sz_ - write_pos);
+  memcpy(data_buf_ + write_pos, record, prefix_sz);
+  memcpy(data_buf_, record + prefix_sz, size - prefix_sz);
+  reinterpret_cast<std::atomic<uint64_t>*>(&metadata_page_->data_head)
+      ->store(head + size, std::memory_order_release);
+  return true;
+}
+
 EventReader::EventReader(uint32_t cpu,
                          perf_event_attr event_attr,
                          base::ScopedFile perf_fd,
@@ -249,19 +315,34 @@ base::Optional<EventReader> EventReader::ConfigureEvents(
                                           std::move(ring_buffer.value()));
 }
 
-base::Optional<ParsedSample> EventReader::ReadUntilSample(
-    std::function<void(uint64_t)> records_lost_callback) {
-  for (;;) {
-    char* event = ring_buffer_.ReadRecordNonconsuming();
+// static
+EventReader EventReader::CreateForTesting(uint32_t cpu,
+                                          const perf_event_attr& event_attr,
+                                          PerfRingBuffer ring_buffer) {
+  return EventReader(cpu, event_attr, base::ScopedFile(),
+                     std::move(ring_buffer));
+}
+
+bool EventReader::ReadSamples(
+    uint64_t max_samples,
+    std::vector<ParsedSample>* samples,
+    const std::function<void(uint64_t)>& records_lost_callback) {
+  // Parse everything up to the writer's position at this point, and update
+  // |data_tail| only once at the end. Parsing copies the contents of the
+  // samples out of the ring buffer.
+  PerfRingBuffer::ReadBatch batch = ring_buffer_.BeginBatch();
+  uint64_t num_samples = 0;
+  while (num_samples < max_samples) {
+    char* event = ring_buffer_.NextRecord(&batch);
     if (!event)
-      return base::nullopt;  // caught up with the writer
+      break;  // caught up with the writer
 
     auto* event_hdr = reinterpret_cast<const perf_event_header*>(event);
 
     if (event_hdr->type == PERF_RECORD_SAMPLE) {
-      ParsedSample sample = ParseSampleRecord(cpu_, event);
-      ring_buffer_.Consume(event_hdr->size);
-      return base::make_optional(std::move(sample));
+      samples->emplace_back(ParseSampleRecord(cpu_, event));
+      num_samples++;
+      continue;
     }
 
     if (event_hdr->type == PERF_RECORD_LOST) {
@@ -277,21 +358,21 @@ base::Optional<ParsedSample> EventReader::ReadUntilSample(
           event + sizeof(perf_event_header) + sizeof(uint64_t));
 
       records_lost_callback(records_lost);
-      ring_buffer_.Consume(event_hdr->size);
       continue;  // keep looking for a sample
     }
 
     // Kernel had to throttle irqs.
     if (event_hdr->type == PERF_RECORD_THROTTLE ||
         event_hdr->type == PERF_RECORD_UNTHROTTLE) {
-      ring_buffer_.Consume(event_hdr->size);
       continue;  // keep looking for a sample
     }
 
     PERFETTO_DFATAL_OR_ELOG("Unsupported event type [%zu]",
                             static_cast<size_t>(event_hdr->type));
-    ring_buffer_.Consume(event_hdr->size);
   }
+  bool caught_up = batch.read_offset == batch.write_offset;
+  ring_buffer_.CommitBatch(batch);
+  return !caught_up;
 }
 
 // Generally, samples can belong to any cpu (which can be recorded with
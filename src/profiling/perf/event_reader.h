@@ -22,6 +22,9 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 
+#include <functional>
+#include <vector>
+
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
@@ -33,9 +36,22 @@ namespace profiling {
 
 class PerfRingBuffer {
  public:
+  // Records between the reader's and the writer's position, at the time of
+  // BeginBatch. Reading the records advances |read_offset|, the kernel only
+  // sees them as consumed after CommitBatch.
+  struct ReadBatch {
+    uint64_t read_offset = 0;
+    uint64_t write_offset = 0;
+  };
+
   static base::Optional<PerfRingBuffer> Allocate(int perf_fd,
                                                  size_t data_page_count);
 
+  // Ring buffer that is not backed by a perf event. Records are written with
+  // WriteRecordForTesting, in place of the kernel.
+  static base::Optional<PerfRingBuffer> AllocateForTesting(
+      size_t data_page_count);
+
   ~PerfRingBuffer();
 
   // move-only
@@ -47,9 +63,29 @@ class PerfRingBuffer {
   char* ReadRecordNonconsuming();
   void Consume(size_t bytes);
 
+  ReadBatch BeginBatch();
+  // Returns the next record of |batch| and advances past it, or nullptr if
+  // all of its records were read. The returned pointer is valid until the
+  // next call.
+  char* NextRecord(ReadBatch* batch);
+  // Consumes the records read from |batch|, with a single update of the
+  // reader's position.
+  void CommitBatch(const ReadBatch& batch);
+
+  // Appends a record (that starts with a perf_event_header) like the kernel
+  // would. Returns false if there is not enough free space.
+  bool WriteRecordForTesting(const char* record);
+
  private:
   PerfRingBuffer() = default;
 
+  static base::Optional<PerfRingBuffer> Map(int fd,
+                                            int flags,
+                                            size_t data_page_count);
+
+  // Returns a pointer to the contiguous record at |read_offset|.
+  char* RecordAt(uint64_t read_offset);
+
   bool valid() const { return metadata_page_ != nullptr; }
 
   // Points at the start of the mmap'd region.
@@ -79,11 +115,19 @@ class EventReader {
       uint32_t cpu,
       const EventConfig& event_cfg);
 
-  // Consumes records from the ring buffer until either encountering a sample,
-  // or catching up to the writer. The other record of interest
-  // (PERF_RECORD_LOST) is handled via the given callback.
-  base::Optional<ParsedSample> ReadUntilSample(
-      std::function<void(uint64_t)> lost_events_callback);
+  // Reader of |ring_buffer|, which is not backed by a perf event.
+  static EventReader CreateForTesting(uint32_t cpu,
+                                      const perf_event_attr& event_attr,
+                                      PerfRingBuffer ring_buffer);
+
+  // Consumes records from the ring buffer until either |max_samples| samples
+  // were appended to |samples|, or catching up to the writer. The other
+  // record of interest (PERF_RECORD_LOST) is handled via the given callback.
+  // The consumed records are handed back to the kernel at once, at the end.
+  // Returns false if caught up with the writer.
+  bool ReadSamples(uint64_t max_samples,
+                   std::vector<ParsedSample>* samples,
+                   const std::function<void(uint64_t)>& records_lost_callback);
 
   void EnableEvents();
   // Pauses the event counting, without invalidating existing samples.
@@ -91,6 +135,8 @@ class EventReader {
 
   uint32_t cpu() const { return cpu_; }
 
+  PerfRingBuffer* ring_buffer_for_testing() { return &ring_buffer_; }
+
   ~EventReader() = default;
 
   // move-only
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <linux/perf_event.h>
+#include <string.h>
+
+#include <limits>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "src/profiling/perf/event_reader.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+// 128 KiB, like a small per-cpu buffer of traced_perf.
+constexpr size_t kDataPageCount = 32;
+constexpr uint64_t kStackSize = 1024;
+
+perf_event_attr SampleAttr() {
+  perf_event_attr attr = {};
+  attr.sample_type =
+      PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_STACK_USER;
+  return attr;
+}
+
+template <typename T>
+void Append(std::vector<char>* record, T value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  record->insert(record->end(), bytes, bytes + sizeof(T));
+}
+
+// Sample with the layout of SampleAttr() and a user stack of |kStackSize|.
+std::vector<char> SampleRecord() {
+  std::vector<char> record(sizeof(perf_event_header));
+  Append(&record, uint32_t{42});  // pid
+  Append(&record, uint32_t{42});  // tid
+  Append(&record, uint64_t{1});   // time
+  Append(&record, kStackSize);
+  record.insert(record.end(), kStackSize, 'x');
+  Append(&record, kStackSize);  // dyn_size
+
+  perf_event_header header = {};
+  header.type = PERF_RECORD_SAMPLE;
+  header.size = static_cast<uint16_t>(record.size());
+  memcpy(record.data(), &header, sizeof(header));
+  return record;
+}
+
+EventReader CreateReader() {
+  base::Optional<PerfRingBuffer> ring_buffer =
+      PerfRingBuffer::AllocateForTesting(kDataPageCount);
+  PERFETTO_CHECK(ring_buffer);
+  return EventReader::CreateForTesting(/*cpu=*/0, SampleAttr(),
+                                       std::move(*ring_buffer));
+}
+
+// Fills the ring buffer, like the kernel would between two read ticks.
+void FillRingBuffer(PerfRingBuffer* ring_buffer,
+                    const std::vector<char>& record) {
+  while (ring_buffer->WriteRecordForTesting(record.data())) {
+  }
+}
+
+// Reading one record at a time, updating the reader position after each.
+static void BM_PerfRingBufferReadPerRecord(benchmark::State& state) {
+  EventReader reader = CreateReader();
+  PerfRingBuffer* ring_buffer = reader.ring_buffer_for_testing();
+  const std::vector<char> record = SampleRecord();
+  size_t records = 0;
+  for (auto _ : state) {
+    FillRingBuffer(ring_buffer, record);
+    while (char* event = ring_buffer->ReadRecordNonconsuming()) {
+      benchmark::DoNotOptimize(event);
+      ring_buffer->Consume(reinterpret_cast<perf_event_header*>(event)->size);
+      records++;
+    }
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(records));
+}
+
+// Reading all available records, updating the reader position once.
+static void BM_PerfRingBufferReadBatch(benchmark::State& state) {
+  EventReader reader = CreateReader();
+  PerfRingBuffer* ring_buffer = reader.ring_buffer_for_testing();
+  const std::vector<char> record = SampleRecord();
+  size_t records = 0;
+  for (auto _ : state) {
+    FillRingBuffer(ring_buffer, record);
+    PerfRingBuffer::ReadBatch batch = ring_buffer->BeginBatch();
+    while (char* event = ring_buffer->NextRecord(&batch)) {
+      benchmark::DoNotOptimize(event);
+      records++;
+    }
+    ring_buffer->CommitBatch(batch);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(records));
+}
+
+// Parsing the samples of a full ring buffer, as traced_perf's read tick does.
+static void BM_EventReaderReadSamples(benchmark::State& state) {
+  EventReader reader = CreateReader();
+  const std::vector<char> record = SampleRecord();
+  std::vector<ParsedSample> samples;
+  size_t records = 0;
+  for (auto _ : state) {
+    FillRingBuffer(reader.ring_buffer_for_testing(), record);
+    samples.clear();
+    reader.ReadSamples(std::numeric_limits<uint64_t>::max(), &samples,
+                       [](uint64_t) {});
+    records += samples.size();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(records));
+}
+
+}  // namespace
+
+BENCHMARK(BM_PerfRingBufferReadPerRecord);
+BENCHMARK(BM_PerfRingBufferReadBatch);
+BENCHMARK(BM_EventReaderReadSamples);
+
+}  // namespace profiling
+}  // namespace perfetto
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/event_reader.h"
+
+#include <linux/perf_event.h>
+#include <string.h>
+
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+constexpr uint32_t kCpu = 3;
+
+perf_event_attr SampleAttr() {
+  perf_event_attr attr = {};
+  attr.sample_type =
+      PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_STACK_USER;
+  return attr;
+}
+
+template <typename T>
+void Append(std::vector<char>* record, T value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  record->insert(record->end(), bytes, bytes + sizeof(T));
+}
+
+void SetHeader(std::vector<char>* record, uint32_t type) {
+  perf_event_header header = {};
+  header.type = type;
+  header.size = static_cast<uint16_t>(record->size());
+  memcpy(record->data(), &header, sizeof(header));
+}
+
+// Sample with the layout of SampleAttr(), with |stack_size| bytes of stack
+// filled with |stack_byte|.
+std::vector<char> SampleRecord(pid_t pid,
+                               uint64_t timestamp,
+                               uint64_t stack_size,
+                               char stack_byte) {
+  std::vector<char> record(sizeof(perf_event_header));
+  Append(&record, static_cast<uint32_t>(pid));
+  Append(&record, static_cast<uint32_t>(pid));
+  Append(&record, timestamp);
+  Append(&record, stack_size);
+  record.insert(record.end(), stack_size, stack_byte);
+  if (stack_size > 0)
+    Append(&record, stack_size);  // dyn_size
+  SetHeader(&record, PERF_RECORD_SAMPLE);
+  return record;
+}
+
+std::vector<char> LostRecord(uint64_t lost) {
+  std::vector<char> record(sizeof(perf_event_header));
+  Append(&record, uint64_t{0});
+  Append(&record, lost);
+  SetHeader(&record, PERF_RECORD_LOST);
+  return record;
+}
+
+EventReader CreateReader(size_t data_page_count) {
+  base::Optional<PerfRingBuffer> ring_buffer =
+      PerfRingBuffer::AllocateForTesting(data_page_count);
+  PERFETTO_CHECK(ring_buffer);
+  return EventReader::CreateForTesting(kCpu, SampleAttr(),
+                                       std::move(*ring_buffer));
+}
+
+void Write(EventReader* reader, const std::vector<char>& record) {
+  ASSERT_TRUE(reader->ring_buffer_for_testing()->WriteRecordForTesting(
+      record.data()));
+}
+
+TEST(EventReaderTest, ReadsAllAvailableSamples) {
+  EventReader reader = CreateReader(1);
+  Write(&reader, SampleRecord(1, 10, 16, 'a'));
+  Write(&reader, LostRecord(5));
+  Write(&reader, SampleRecord(2, 20, 0, 0));
+  Write(&reader, SampleRecord(3, 30, 8, 'b'));
+
+  uint64_t lost = 0;
+  std::vector<ParsedSample> samples;
+  EXPECT_FALSE(reader.ReadSamples(
+      100, &samples, [&lost](uint64_t records_lost) { lost += records_lost; }));
+  EXPECT_EQ(lost, 5u);
+  ASSERT_EQ(samples.size(), 3u);
+  EXPECT_EQ(samples[0].common.cpu, kCpu);
+  EXPECT_EQ(samples[0].common.pid, 1);
+  EXPECT_EQ(samples[0].common.timestamp, 10u);
+  EXPECT_EQ(samples[0].stack, std::vector<char>(16, 'a'));
+  EXPECT_TRUE(samples[0].stack_maxed);
+  EXPECT_EQ(samples[1].common.pid, 2);
+  EXPECT_TRUE(samples[1].stack.empty());
+  EXPECT_EQ(samples[2].common.timestamp, 30u);
+
+  // Everything was consumed.
+  samples.clear();
+  EXPECT_FALSE(reader.ReadSamples(100, &samples, [](uint64_t) {}));
+  EXPECT_TRUE(samples.empty());
+  EXPECT_EQ(reader.ring_buffer_for_testing()->ReadRecordNonconsuming(),
+            nullptr);
+}
+
+TEST(EventReaderTest, StopsAtMaxSamples) {
+  EventReader reader = CreateReader(1);
+  for (uint64_t ts = 1; ts <= 5; ts++)
+    Write(&reader, SampleRecord(1, ts, 8, 'a'));
+
+  std::vector<ParsedSample> samples;
+  EXPECT_TRUE(reader.ReadSamples(2, &samples, [](uint64_t) {}));
+  ASSERT_EQ(samples.size(), 2u);
+  EXPECT_EQ(samples[1].common.timestamp, 2u);
+
+  // The remaining samples are still there.
+  EXPECT_FALSE(reader.ReadSamples(100, &samples, [](uint64_t) {}));
+  ASSERT_EQ(samples.size(), 5u);
+  EXPECT_EQ(samples[2].common.timestamp, 3u);
+  EXPECT_EQ(samples[4].common.timestamp, 5u);
+}
+
+TEST(EventReaderTest, ReconstructsWrappedRecords) {
+  EventReader reader = CreateReader(1);
+  // Records that do not divide the buffer size, so that they end up wrapping
+  // around its end.
+  for (uint64_t ts = 1; ts <= 20; ts++) {
+    char stack_byte = static_cast<char>('a' + ts);
+    Write(&reader, SampleRecord(1, ts, 1000, stack_byte));
+    Write(&reader, SampleRecord(1, ts, 1000, stack_byte));
+
+    std::vector<ParsedSample> samples;
+    EXPECT_FALSE(reader.ReadSamples(100, &samples, [](uint64_t) {}));
+    ASSERT_EQ(samples.size(), 2u);
+    for (const ParsedSample& sample : samples) {
+      EXPECT_EQ(sample.common.timestamp, ts);
+      EXPECT_EQ(sample.stack, std::vector<char>(1000, stack_byte));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -36,6 +36,7 @@
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/data_source_descriptor.h"
 #include "src/profiling/common/callstack_trie.h"
+#include "src/profiling/common/log_histogram.h"
 #include "src/profiling/common/proc_utils.h"
 #include "src/profiling/common/producer_support.h"
 #include "src/profiling/common/profiler_guardrails.h"
@@ -277,11 +278,15 @@ protos::pbzero::Profiling::StackUnwindError ToProtoEnum(
 }  // namespace
 
 PerfProducer::PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-                           base::TaskRunner* task_runner)
+                           base::TaskRunner* task_runner,
+                           size_t unwinder_threads)
     : task_runner_(task_runner),
       proc_fd_getter_(proc_fd_getter),
-      unwinding_worker_(this),
       weak_factory_(this) {
+  PERFETTO_CHECK(unwinder_threads > 0);
+  for (size_t i = 0; i < unwinder_threads; ++i) {
+    unwinding_workers_.emplace_back(new UnwinderHandle(this));
+  }
   proc_fd_getter->SetDelegate(this);
 }
 
@@ -338,6 +343,17 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
     per_cpu_readers.emplace_back(std::move(event_reader.value()));
   }
 
+  StartDataSourceWithReaders(ds_id, config, std::move(event_config.value()),
+                             std::move(per_cpu_readers),
+                             event_config_pb.max_daemon_memory_kb());
+}
+
+void PerfProducer::StartDataSourceWithReaders(
+    DataSourceInstanceID ds_id,
+    const DataSourceConfig& config,
+    EventConfig event_config,
+    std::vector<EventReader> per_cpu_readers,
+    uint32_t max_daemon_memory_kb) {
   auto buffer_id = static_cast<BufferID>(config.target_buffer());
   auto writer = endpoint_->CreateTraceWriter(buffer_id);
 
@@ -346,7 +362,7 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
   bool inserted;
   std::tie(ds_it, inserted) = data_sources_.emplace(
       std::piecewise_construct, std::forward_as_tuple(ds_id),
-      std::forward_as_tuple(event_config.value(), std::move(writer),
+      std::forward_as_tuple(std::move(event_config), std::move(writer),
                             std::move(per_cpu_readers)));
   PERFETTO_CHECK(inserted);
   DataSourceState& ds = ds_it->second;
@@ -364,11 +380,12 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
 
   // Inform unwinder of the new data source instance, and optionally start a
   // periodic task to clear its cached state.
-  unwinding_worker_->PostStartDataSource(ds_id,
-                                         ds.event_config.kernel_frames());
-  if (ds.event_config.unwind_state_clear_period_ms()) {
-    unwinding_worker_->PostClearCachedStatePeriodic(
-        ds_id, ds.event_config.unwind_state_clear_period_ms());
+  for (auto& unwinder : unwinding_workers_) {
+    (*unwinder)->PostStartDataSource(ds_id, ds.event_config.kernel_frames());
+    if (ds.event_config.unwind_state_clear_period_ms()) {
+      (*unwinder)->PostClearCachedStatePeriodic(
+          ds_id, ds.event_config.unwind_state_clear_period_ms());
+    }
   }
 
   // Kick off periodic read task.
@@ -382,7 +399,6 @@ void PerfProducer::StartDataSource(DataSourceInstanceID ds_id,
       TimeToNextReadTickMs(ds_id, tick_period_ms));
 
   // Optionally kick off periodic memory footprint limit check.
-  uint32_t max_daemon_memory_kb = event_config_pb.max_daemon_memory_kb();
   if (max_daemon_memory_kb > 0) {
     task_runner_->PostDelayedTask(
         [weak_this, ds_id, max_daemon_memory_kb] {
@@ -526,12 +542,15 @@ void PerfProducer::TickDataSourceRead(DataSourceInstanceID ds_id) {
     }
   }
 
-  // Wake up the unwinder as we've (likely) pushed samples into its queue.
-  unwinding_worker_->PostProcessQueue();
+  // Wake up the unwinders as we've (likely) pushed samples into their queues.
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostProcessQueue();
 
   if (PERFETTO_UNLIKELY(ds.status == DataSourceState::Status::kShuttingDown) &&
       !more_records_available) {
-    unwinding_worker_->PostInitiateDataSourceStop(ds_id);
+    ds.pending_unwinder_stops = unwinding_workers_.size();
+    for (auto& unwinder : unwinding_workers_)
+      (*unwinder)->PostInitiateDataSourceStop(ds_id);
   } else {
     // otherwise, keep reading
     auto tick_period_ms = it->second.event_config.read_tick_period_ms();
@@ -561,36 +580,35 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     });
   };
 
-  for (uint64_t i = 0; i < max_samples; i++) {
-    base::Optional<ParsedSample> sample =
-        reader->ReadUntilSample(records_lost_callback);
-    if (!sample) {
-      return false;  // caught up to the writer
-    }
+  // Parse all available samples (up to |max_samples|) in one pass over the
+  // ring buffer, then hand them off.
+  read_samples_.clear();
+  bool more_records_available =
+      reader->ReadSamples(max_samples, &read_samples_, records_lost_callback);
 
+  for (ParsedSample& sample : read_samples_) {
     // Counter-only mode: skip the unwinding stage, enqueue the sample for
     // output immediately.
     if (!ds->event_config.sample_callstacks()) {
       CompletedSample output;
-      output.common = sample->common;
+      output.common = sample.common;
       EmitSample(ds_id, std::move(output));
       continue;
     }
 
     // If sampling callstacks, we're not interested in kernel threads/workers.
-    if (!sample->regs) {
+    if (!sample.regs) {
       continue;
     }
 
     // Request proc-fds for the process if this is the first time we see it.
-    pid_t pid = sample->common.pid;
+    pid_t pid = sample.common.pid;
     auto& process_state = ds->process_states[pid];  // insert if new
 
     if (process_state == ProcessTrackingStatus::kExpired) {
       PERFETTO_DLOG("Skipping sample for previously expired pid [%d]",
                     static_cast<int>(pid));
-      EmitSkippedSample(ds_id, std::move(sample.value()),
-                        SampleSkipReason::kReadStage);
+      EmitSkippedSample(ds_id, std::move(sample), SampleSkipReason::kReadStage);
       continue;
     }
 
@@ -627,35 +645,35 @@ bool PerfProducer::ReadAndParsePerCpuBuffer(EventReader* reader,
     // that are waiting in the unwinding queue.
     uint64_t max_footprint_bytes =
         ds->event_config.max_enqueued_footprint_bytes();
-    uint64_t sample_stack_size = sample->stack.size();
+    uint64_t sample_stack_size = sample.stack.size();
     if (max_footprint_bytes) {
-      uint64_t footprint_bytes = unwinding_worker_->GetEnqueuedFootprint();
+      uint64_t footprint_bytes = GetEnqueuedFootprint();
       if (footprint_bytes + sample_stack_size >= max_footprint_bytes) {
         PERFETTO_DLOG("Skipping sample enqueueing due to footprint limit.");
-        EmitSkippedSample(ds_id, std::move(sample.value()),
+        EmitSkippedSample(ds_id, std::move(sample),
                           SampleSkipReason::kUnwindEnqueue);
         continue;
       }
     }
 
     // Push the sample into the unwinding queue if there is room.
-    auto& queue = unwinding_worker_->unwind_queue();
+    UnwinderHandle& unwinder = UnwinderForPid(pid);
+    auto& queue = unwinder->unwind_queue();
     WriteView write_view = queue.BeginWrite();
     if (write_view.valid) {
-      queue.at(write_view.write_pos) =
-          UnwindEntry{ds_id, std::move(sample.value())};
+      queue.at(write_view.write_pos) = UnwindEntry{ds_id, std::move(sample)};
       queue.CommitWrite();
-      unwinding_worker_->IncrementEnqueuedFootprint(sample_stack_size);
+      unwinder->IncrementEnqueuedFootprint(sample_stack_size);
     } else {
       PERFETTO_DLOG("Unwinder queue full, skipping sample");
-      EmitSkippedSample(ds_id, std::move(sample.value()),
+      EmitSkippedSample(ds_id, std::move(sample),
                         SampleSkipReason::kUnwindEnqueue);
     }
   }
 
-  // Most likely more events in the kernel buffer. Though we might be exactly on
-  // the boundary due to |max_samples|.
-  return true;
+  // Release the parsed samples' buffers that were not handed off.
+  read_samples_.clear();
+  return more_records_available;
 }
 
 // Note: first-fit makes descriptor request fulfillment not true FIFO. But the
@@ -689,7 +707,7 @@ void PerfProducer::OnProcDescriptors(pid_t pid,
                     static_cast<int>(pid), static_cast<size_t>(it.first));
 
       proc_status_it->second = ProcessTrackingStatus::kResolved;
-      unwinding_worker_->PostAdoptProcDescriptors(
+      UnwinderForPid(pid)->PostAdoptProcDescriptors(
           it.first, pid, std::move(maps_fd), std::move(mem_fd));
       return;  // done
     }
@@ -752,7 +770,7 @@ void PerfProducer::EvaluateDescriptorLookupTimeout(DataSourceInstanceID ds_id,
     proc_status_it->second = ProcessTrackingStatus::kExpired;
     // Also inform the unwinder of the state change (so that it can discard any
     // of the already-enqueued samples).
-    unwinding_worker_->PostRecordTimedOutProcDescriptors(ds_id, pid);
+    UnwinderForPid(pid)->PostRecordTimedOutProcDescriptors(ds_id, pid);
   }
 }
 
@@ -895,16 +913,20 @@ void PerfProducer::InitiateReaderStop(DataSourceState* ds) {
   }
 }
 
-void PerfProducer::PostFinishDataSourceStop(DataSourceInstanceID ds_id) {
+void PerfProducer::PostFinishDataSourceStop(DataSourceInstanceID ds_id,
+                                            UnwinderStats stats) {
+  // hack: c++11 lambdas can't be moved into, so stash the stats on the heap.
+  UnwinderStats* raw_stats = new UnwinderStats(std::move(stats));
   auto weak_producer = weak_factory_.GetWeakPtr();
-  task_runner_->PostTask([weak_producer, ds_id] {
+  task_runner_->PostTask([weak_producer, ds_id, raw_stats] {
     if (weak_producer)
-      weak_producer->FinishDataSourceStop(ds_id);
+      weak_producer->FinishDataSourceStop(ds_id, std::move(*raw_stats));
+    delete raw_stats;
   });
 }
 
-void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
-  PERFETTO_LOG("FinishDataSourceStop(%zu)", static_cast<size_t>(ds_id));
+void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id,
+                                        UnwinderStats stats) {
   auto ds_it = data_sources_.find(ds_id);
   if (ds_it == data_sources_.end()) {
     PERFETTO_DLOG("FinishDataSourceStop(%zu): source gone",
@@ -914,6 +936,14 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   DataSourceState& ds = ds_it->second;
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
 
+  // Wait for the other unwinders.
+  ds.unwinder_stats.emplace_back(std::move(stats));
+  PERFETTO_CHECK(ds.pending_unwinder_stops > 0);
+  if (--ds.pending_unwinder_stops > 0)
+    return;
+
+  PERFETTO_LOG("FinishDataSourceStop(%zu)", static_cast<size_t>(ds_id));
+  EmitUnwinderStats(&ds);
   ds.trace_writer->Flush();
   data_sources_.erase(ds_it);
 
@@ -926,6 +956,46 @@ void PerfProducer::FinishDataSourceStop(DataSourceInstanceID ds_id) {
   }
 }
 
+void PerfProducer::EmitUnwinderStats(DataSourceState* ds) {
+  auto packet = StartTracePacket(ds->trace_writer.get());
+  packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
+  packet->set_timestamp_clock_id(
+      protos::pbzero::BuiltinClock::BUILTIN_CLOCK_BOOTTIME);
+
+  uint64_t unwound_samples = 0;
+  uint64_t elf_cache_hits = 0;
+  uint64_t elf_cache_misses = 0;
+  LogHistogram unwinding_time_us;
+  auto* stats_pb = packet->set_perf_sample()->set_unwinder_stats();
+  for (const UnwinderStats& stats : ds->unwinder_stats) {
+    unwound_samples += stats.unwound_samples;
+    elf_cache_hits += stats.elf_cache_hits;
+    elf_cache_misses += stats.elf_cache_misses;
+    unwinding_time_us.Merge(stats.unwinding_time_us);
+    stats_pb->add_max_queue_occupancy(
+        static_cast<uint32_t>(stats.max_queue_occupancy));
+  }
+  stats_pb->set_unwound_samples(unwound_samples);
+  stats_pb->set_elf_cache_hits(elf_cache_hits);
+  stats_pb->set_elf_cache_misses(elf_cache_misses);
+  auto* hist_pb = stats_pb->set_unwinding_time_us();
+  for (const auto& p : unwinding_time_us.GetData()) {
+    auto* bucket = hist_pb->add_buckets();
+    if (p.first == LogHistogram::kMaxBucket)
+      bucket->set_max_bucket(true);
+    else
+      bucket->set_upper_limit(p.first);
+    bucket->set_count(p.second);
+  }
+}
+
+uint64_t PerfProducer::GetEnqueuedFootprint() {
+  uint64_t footprint_bytes = 0;
+  for (auto& unwinder : unwinding_workers_)
+    footprint_bytes += (*unwinder)->GetEnqueuedFootprint();
+  return footprint_bytes;
+}
+
 // TODO(rsavitski): maybe make the tracing service respect premature
 // producer-driven stops, and then issue a NotifyDataSourceStopped here.
 // Alternatively (and at the expense of higher complexity) introduce a new data
@@ -944,7 +1014,8 @@ void PerfProducer::PurgeDataSource(DataSourceInstanceID ds_id) {
   PERFETTO_LOG("Stopping DataSource(%zu) prematurely",
                static_cast<size_t>(ds_id));
 
-  unwinding_worker_->PostPurgeDataSource(ds_id);
+  for (auto& unwinder : unwinding_workers_)
+    (*unwinder)->PostPurgeDataSource(ds_id);
 
   // Write a packet indicating the abrupt stop.
   {
@@ -1059,9 +1130,11 @@ void PerfProducer::Restart() {
   const char* socket_name = producer_socket_name_;
   ProcDescriptorGetter* proc_fd_getter = proc_fd_getter_;
 
+  size_t unwinder_threads = unwinding_workers_.size();
+
   // Invoke destructor and then the constructor again.
   this->~PerfProducer();
-  new (this) PerfProducer(proc_fd_getter, task_runner);
+  new (this) PerfProducer(proc_fd_getter, task_runner, unwinder_threads);
 
   ConnectWithRetries(socket_name);
 }
@@ -19,7 +19,9 @@
 
 #include <deque>
 #include <map>
+#include <memory>
 #include <queue>
+#include <vector>
 
 #include <unistd.h>
 
@@ -54,13 +56,16 @@ namespace profiling {
 // summary in the mean time: three stages: (1) kernel buffer reader that parses
 // the samples -> (2) callstack unwinder -> (3) interning and serialization of
 // samples. This class handles stages (1) and (3) on the main thread. Unwinding
-// is done by |Unwinder| on a dedicated thread.
+// is done by a pool of |Unwinder|s, each on a dedicated thread.
 class PerfProducer : public Producer,
                      public ProcDescriptorDelegate,
                      public Unwinder::Delegate {
  public:
+  static constexpr size_t kDefaultUnwinderThreads = 1;
+
   PerfProducer(ProcDescriptorGetter* proc_fd_getter,
-               base::TaskRunner* task_runner);
+               base::TaskRunner* task_runner,
+               size_t unwinder_threads = kDefaultUnwinderThreads);
   ~PerfProducer() override = default;
 
   PerfProducer(const PerfProducer&) = delete;
@@ -95,7 +100,27 @@ class PerfProducer : public Producer,
                       CompletedSample sample) override;
   void PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
                                      ParsedSample sample) override;
-  void PostFinishDataSourceStop(DataSourceInstanceID ds_id) override;
+  void PostFinishDataSourceStop(DataSourceInstanceID ds_id,
+                                UnwinderStats stats) override;
+
+  // Exposed for testing.
+  void SetProducerEndpointForTesting(
+      std::unique_ptr<TracingService::ProducerEndpoint> endpoint) {
+    endpoint_ = std::move(endpoint);
+  }
+  // Starts the data source with the given readers, which don't need to be
+  // backed by perf events, instead of the ones set up from the config.
+  void StartDataSourceForTesting(DataSourceInstanceID ds_id,
+                                 const DataSourceConfig& config,
+                                 EventConfig event_config,
+                                 std::vector<EventReader> per_cpu_readers) {
+    StartDataSourceWithReaders(ds_id, config, std::move(event_config),
+                               std::move(per_cpu_readers),
+                               /*max_daemon_memory_kb=*/0);
+  }
+  size_t UnwinderIndexForPid(pid_t pid) const {
+    return static_cast<size_t>(pid) % unwinding_workers_.size();
+  }
 
  private:
   // State of the producer's connection to tracing service (traced).
@@ -145,6 +170,11 @@ class PerfProducer : public Producer,
     // Command lines we have decided to unwind, up to a total of
     // additional_cmdline_count values.
     base::FlatSet<std::string> additional_cmdlines;
+
+    // Unwinders that have not finished stopping this source yet, and the
+    // stats of the ones that have.
+    size_t pending_unwinder_stops = 0;
+    std::vector<UnwinderStats> unwinder_stats;
   };
 
   // For |EmitSkippedSample|.
@@ -154,6 +184,13 @@ class PerfProducer : public Producer,
     kUnwindStage,    // discarded at unwind stage
   };
 
+  // Second half of |StartDataSource|, once the perf events are set up.
+  void StartDataSourceWithReaders(DataSourceInstanceID ds_id,
+                                  const DataSourceConfig& config,
+                                  EventConfig event_config,
+                                  std::vector<EventReader> per_cpu_readers,
+                                  uint32_t max_daemon_memory_kb);
+
   void ConnectService();
   void Restart();
   void ResetConnectionBackoff();
@@ -202,9 +239,11 @@ class PerfProducer : public Producer,
   // this producer once there are no more outstanding samples for the data
   // source at the unwinding stage.
   void InitiateReaderStop(DataSourceState* ds);
-  // Destroys the state belonging to this instance, and acks the stop to the
-  // tracing service.
-  void FinishDataSourceStop(DataSourceInstanceID ds_id);
+  // Called by each unwinder once it is done with the data source. Once all of
+  // them are, writes the unwinder stats, destroys the state belonging to this
+  // instance, and acks the stop to the tracing service.
+  void FinishDataSourceStop(DataSourceInstanceID ds_id, UnwinderStats stats);
+  void EmitUnwinderStats(DataSourceState* ds);
   // Immediately destroys the data source state, and instructs the unwinder to
   // do the same. This is used for abrupt stops.
   void PurgeDataSource(DataSourceInstanceID ds_id);
@@ -217,6 +256,11 @@ class PerfProducer : public Producer,
 
   void StartMetatraceSource(DataSourceInstanceID ds_id, BufferID target_buffer);
 
+  UnwinderHandle& UnwinderForPid(pid_t pid) {
+    return *unwinding_workers_[UnwinderIndexForPid(pid)];
+  }
+  uint64_t GetEnqueuedFootprint();
+
   // Task runner owned by the main thread.
   base::TaskRunner* const task_runner_;
   State state_ = kNotStarted;
@@ -246,8 +290,13 @@ class PerfProducer : public Producer,
   // State associated with perf-sampling data sources.
   std::map<DataSourceInstanceID, DataSourceState> data_sources_;
 
-  // Unwinding stage, running on a dedicated thread.
-  UnwinderHandle unwinding_worker_;
+  // Samples read from a kernel ring buffer in one pass, kept to reuse the
+  // allocation across reads.
+  std::vector<ParsedSample> read_samples_;
+
+  // Unwinding stage, running on dedicated threads. Samples are sharded across
+  // them by pid, see |UnwinderForPid|.
+  std::vector<std::unique_ptr<UnwinderHandle>> unwinding_workers_;
 
   // Used for tracepoint name -> id lookups. Initialized lazily, and in general
   // best effort - can be null if tracefs isn't accessible.
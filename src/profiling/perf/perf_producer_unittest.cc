@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/perf/perf_producer.h"
+
+#include <set>
+#include <vector>
+
+#include "perfetto/ext/tracing/core/commit_data_request.h"
+#include "perfetto/tracing/core/data_source_config.h"
+#include "perfetto/tracing/core/data_source_descriptor.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/tracing/core/trace_writer_for_testing.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/config/profiling/perf_event_config.gen.h"
+#include "protos/perfetto/trace/profiling/profile_packet.gen.h"
+#include "protos/perfetto/trace/trace_packet.gen.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::InvokeWithoutArgs;
+
+constexpr DataSourceInstanceID kDataSourceId = 1;
+
+class MockProducerEndpoint : public TracingService::ProducerEndpoint {
+ public:
+  MOCK_METHOD1(UnregisterDataSource, void(const std::string&));
+  MOCK_METHOD1(NotifyFlushComplete, void(FlushRequestID));
+  MOCK_METHOD1(NotifyDataSourceStarted, void(DataSourceInstanceID));
+  MOCK_METHOD1(NotifyDataSourceStopped, void(DataSourceInstanceID));
+
+  MOCK_CONST_METHOD0(shared_memory, SharedMemory*());
+  MOCK_CONST_METHOD0(shared_buffer_page_size_kb, size_t());
+  MOCK_METHOD2(CreateTraceWriter,
+               std::unique_ptr<TraceWriter>(BufferID, BufferExhaustedPolicy));
+  MOCK_METHOD0(MaybeSharedMemoryArbiter, SharedMemoryArbiter*());
+  MOCK_CONST_METHOD0(IsShmemProvidedByProducer, bool());
+  MOCK_METHOD1(ActivateTriggers, void(const std::vector<std::string>&));
+
+  MOCK_METHOD1(RegisterDataSource, void(const DataSourceDescriptor&));
+  MOCK_METHOD1(UpdateDataSource, void(const DataSourceDescriptor&));
+  MOCK_METHOD2(CommitData, void(const CommitDataRequest&, CommitDataCallback));
+  MOCK_METHOD2(RegisterTraceWriter, void(uint32_t, uint32_t));
+  MOCK_METHOD1(UnregisterTraceWriter, void(uint32_t));
+  MOCK_METHOD1(Sync, void(std::function<void()>));
+};
+
+// The producer destroys the trace writer of a data source as soon as it has
+// stopped, so it's given this one that writes into one owned by the test.
+class ForwardingTraceWriter : public TraceWriter {
+ public:
+  explicit ForwardingTraceWriter(TraceWriter* writer) : writer_(writer) {}
+
+  TracePacketHandle NewTracePacket() override {
+    return writer_->NewTracePacket();
+  }
+  void Flush(std::function<void()> callback) override {
+    writer_->Flush(std::move(callback));
+  }
+  WriterID writer_id() const override { return writer_->writer_id(); }
+  uint64_t written() const override { return writer_->written(); }
+
+ private:
+  TraceWriter* const writer_;
+};
+
+DataSourceConfig PerfDataSourceConfig() {
+  protos::gen::PerfEventConfig perf_cfg;
+  perf_cfg.set_ring_buffer_read_period_ms(1);
+  DataSourceConfig ds_cfg;
+  ds_cfg.set_name("linux.perf");
+  ds_cfg.set_perf_event_config_raw(perf_cfg.SerializeAsString());
+  return ds_cfg;
+}
+
+// Starts and stops a data source that has no per-cpu readers, so that the
+// stop goes straight to the unwinders. Returns the packets that were written
+// for the data source.
+std::vector<protos::gen::TracePacket> StartAndStop(size_t unwinder_threads) {
+  base::TestTaskRunner task_runner;
+  DirectDescriptorGetter proc_fd_getter;
+  PerfProducer producer(&proc_fd_getter, &task_runner, unwinder_threads);
+
+  TraceWriterForTesting trace_writer;
+  std::unique_ptr<MockProducerEndpoint> endpoint(new MockProducerEndpoint());
+  EXPECT_CALL(*endpoint, CreateTraceWriter(_, _))
+      .WillOnce(Invoke([&trace_writer](BufferID, BufferExhaustedPolicy) {
+        return std::unique_ptr<TraceWriter>(
+            new ForwardingTraceWriter(&trace_writer));
+      }));
+  auto stopped = task_runner.CreateCheckpoint("stopped");
+  EXPECT_CALL(*endpoint, NotifyDataSourceStopped(kDataSourceId))
+      .WillOnce(InvokeWithoutArgs(stopped));
+  producer.SetProducerEndpointForTesting(std::move(endpoint));
+
+  DataSourceConfig ds_config = PerfDataSourceConfig();
+  base::Optional<EventConfig> event_config = EventConfig::Create(ds_config);
+  PERFETTO_CHECK(event_config.has_value());
+  producer.StartDataSourceForTesting(kDataSourceId, ds_config,
+                                     std::move(event_config.value()),
+                                     std::vector<EventReader>());
+  producer.StopDataSource(kDataSourceId);
+  task_runner.RunUntilCheckpoint("stopped");
+
+  return trace_writer.GetAllTracePackets();
+}
+
+// Returns the unwinder stats packets in |packets|.
+std::vector<protos::gen::PerfSample_UnwinderStats> GetUnwinderStats(
+    const std::vector<protos::gen::TracePacket>& packets) {
+  std::vector<protos::gen::PerfSample_UnwinderStats> stats;
+  for (const auto& packet : packets) {
+    if (packet.has_perf_sample() && packet.perf_sample().has_unwinder_stats())
+      stats.push_back(packet.perf_sample().unwinder_stats());
+  }
+  return stats;
+}
+
+TEST(PerfProducerTest, ShardsPidsAcrossUnwinders) {
+  base::TestTaskRunner task_runner;
+  DirectDescriptorGetter proc_fd_getter;
+  PerfProducer producer(&proc_fd_getter, &task_runner,
+                        /*unwinder_threads=*/3);
+
+  // All the samples of a process go to the same unwinder, and consecutive pids
+  // are spread across all of them.
+  std::set<size_t> unwinders;
+  for (pid_t pid = 1000; pid < 1006; pid++) {
+    size_t unwinder = producer.UnwinderIndexForPid(pid);
+    EXPECT_LT(unwinder, 3u);
+    EXPECT_EQ(producer.UnwinderIndexForPid(pid), unwinder);
+    unwinders.insert(unwinder);
+  }
+  EXPECT_EQ(unwinders.size(), 3u);
+}
+
+TEST(PerfProducerTest, SingleUnwinderGetsAllPids) {
+  base::TestTaskRunner task_runner;
+  DirectDescriptorGetter proc_fd_getter;
+  PerfProducer producer(&proc_fd_getter, &task_runner);
+
+  for (pid_t pid = 1000; pid < 1006; pid++)
+    EXPECT_EQ(producer.UnwinderIndexForPid(pid), 0u);
+}
+
+TEST(PerfProducerTest, StopWaitsForSingleUnwinder) {
+  auto stats = GetUnwinderStats(StartAndStop(/*unwinder_threads=*/1));
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].max_queue_occupancy().size(), 1u);
+  EXPECT_EQ(stats[0].unwound_samples(), 0u);
+  EXPECT_TRUE(stats[0].has_elf_cache_hits());
+  EXPECT_TRUE(stats[0].has_elf_cache_misses());
+}
+
+TEST(PerfProducerTest, StopWaitsForAllUnwinders) {
+  // The stop is acked to the service once, after all the unwinders have
+  // finished, and their stats are written together.
+  auto stats = GetUnwinderStats(StartAndStop(/*unwinder_threads=*/4));
+  ASSERT_EQ(stats.size(), 1u);
+  EXPECT_EQ(stats[0].max_queue_occupancy().size(), 4u);
+  EXPECT_EQ(stats[0].unwound_samples(), 0u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -15,6 +15,8 @@
  */
 
 #include "src/profiling/perf/traced_perf.h"
+#include "perfetto/ext/base/getopt.h"
+#include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/unix_task_runner.h"
 #include "perfetto/ext/tracing/ipc/default_socket.h"
 #include "src/profiling/perf/perf_producer.h"
@@ -40,7 +42,28 @@ int GetRawInheritedListeningSocket() {
 }  // namespace
 
 // TODO(rsavitski): watchdog.
-int TracedPerfMain(int, char**) {
+int TracedPerfMain(int argc, char** argv) {
+  size_t unwinder_threads = profiling::PerfProducer::kDefaultUnwinderThreads;
+
+  enum { kUnwinderThreads = 256 };
+  static option long_options[] = {
+      {"unwinder-threads", required_argument, nullptr, kUnwinderThreads},
+      {nullptr, 0, nullptr, 0}};
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (c) {
+      case kUnwinderThreads: {
+        base::Optional<uint32_t> threads = base::CStringToUInt32(optarg);
+        if (!threads || *threads == 0) {
+          PERFETTO_ELOG("Invalid --unwinder-threads: %s", optarg);
+          return 1;
+        }
+        unwinder_threads = *threads;
+        break;
+      }
+    }
+  }
+
   base::UnixTaskRunner task_runner;
 
 // TODO(rsavitski): support standalone --root or similar on android.
@@ -51,7 +74,8 @@ int TracedPerfMain(int, char**) {
   DirectDescriptorGetter proc_fd_getter;
 #endif
 
-  profiling::PerfProducer producer(&proc_fd_getter, &task_runner);
+  profiling::PerfProducer producer(&proc_fd_getter, &task_runner,
+                                   unwinder_threads);
   producer.ConnectWithRetries(GetProducerSocket());
   task_runner.Run();
   return 0;
@@ -16,15 +16,17 @@
 
 #include "src/profiling/perf/unwinding.h"
 
+#include <algorithm>
 #include <cinttypes>
-#include <mutex>
 
 #include <unwindstack/Unwinder.h>
 
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/no_destructor.h"
 #include "perfetto/ext/base/thread_utils.h"
 #include "perfetto/ext/base/utils.h"
+#include "src/profiling/common/elf_cache.h"
 
 namespace {
 constexpr size_t kUnwindingMaxFrames = 1000;
@@ -38,7 +40,6 @@ Unwinder::Delegate::~Delegate() = default;
 
 Unwinder::Unwinder(Delegate* delegate, base::UnixTaskRunner* task_runner)
     : task_runner_(task_runner), delegate_(delegate) {
-  ResetAndEnableUnwindstackCache();
   base::MaybeSetThreadName("stack-unwinding");
 }
 
@@ -111,8 +112,8 @@ void Unwinder::AdoptProcDescriptors(DataSourceInstanceID ds_id,
   PERFETTO_METATRACE_SCOPED(TAG_PRODUCER, PROFILER_MAPS_PARSE);
 
   proc_state.status = ProcessState::Status::kResolved;
-  proc_state.unwind_state =
-      UnwindingMetadata{std::move(maps_fd), std::move(mem_fd)};
+  proc_state.unwind_state = UnwindingMetadata{
+      std::move(maps_fd), std::move(mem_fd), ElfCache::GetInstance()};
 }
 
 void Unwinder::PostRecordTimedOutProcDescriptors(DataSourceInstanceID ds_id,
@@ -204,6 +205,13 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
   if (read_view.read_pos == read_view.write_pos)
     return pending_sample_sources;
 
+  uint64_t queue_occupancy = read_view.write_pos - read_view.read_pos;
+  for (auto& id_and_ds : data_sources_) {
+    UnwinderStats& stats = id_and_ds.second.stats;
+    stats.max_queue_occupancy =
+        std::max(stats.max_queue_occupancy, queue_occupancy);
+  }
+
   // Walk the queue.
   for (auto read_pos = read_view.read_pos; read_pos < read_view.write_pos;
        read_pos++) {
@@ -260,10 +268,14 @@ base::FlatSet<DataSourceInstanceID> Unwinder::ConsumeAndUnwindReadySamples() {
                                  static_cast<int32_t>(pid));
 
       PERFETTO_CHECK(proc_state.unwind_state.has_value());
+      base::TimeNanos start_time = base::GetWallTimeNs();
       CompletedSample unwound_sample =
           UnwindSample(entry.sample, &proc_state.unwind_state.value(),
                        proc_state.attempted_unwinding);
       proc_state.attempted_unwinding = true;
+      ds.stats.unwound_samples++;
+      ds.stats.unwinding_time_us.Add(static_cast<uint64_t>(
+          (base::GetWallTimeNs() - start_time).count() / 1000));
 
       PERFETTO_METATRACE_COUNTER(TAG_PRODUCER, PROFILER_UNWIND_CURRENT_PID, 0);
 
@@ -391,6 +403,7 @@ CompletedSample Unwinder::UnwindSample(const ParsedSample& sample,
 
   ret.build_ids.resize(kernel_frames_size, "");
 
+  unwind_state->AddToElfCache(unwind.frames);
   for (unwindstack::FrameData& frame : unwind.frames) {
     ret.build_ids.emplace_back(unwind_state->GetBuildId(frame));
     ret.frames.emplace_back(std::move(frame));
@@ -483,16 +496,24 @@ void Unwinder::FinishDataSourceStop(DataSourceInstanceID ds_id) {
 
   // Drop unwinder's state tied to the source.
   PERFETTO_CHECK(ds.status == DataSourceState::Status::kShuttingDown);
+  UnwinderStats stats = std::move(ds.stats);
+  for (const auto& pid_and_process : ds.process_states) {
+    const ProcessState& process = pid_and_process.second;
+    if (!process.unwind_state.has_value())
+      continue;
+    stats.elf_cache_hits += process.unwind_state->elf_cache_hits;
+    stats.elf_cache_misses += process.unwind_state->elf_cache_misses;
+  }
   data_sources_.erase(it);
 
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
-    ResetAndEnableUnwindstackCache();
+    ElfCache::GetInstance()->Clear();
   }
 
   // Inform service thread that the unwinder is done with the source.
-  delegate_->PostFinishDataSourceStop(ds_id);
+  delegate_->PostFinishDataSourceStop(ds_id, std::move(stats));
 }
 
 void Unwinder::PostPurgeDataSource(DataSourceInstanceID ds_id) {
@@ -512,7 +533,7 @@ void Unwinder::PurgeDataSource(DataSourceInstanceID ds_id) {
   // Clean up state if there are no more active sources.
   if (data_sources_.empty()) {
     kernel_symbolizer_.Destroy();
-    ResetAndEnableUnwindstackCache();
+    ElfCache::GetInstance()->Clear();
     // Also purge scudo on Android, which would normally be done by the service
     // thread in |FinishDataSourceStop|. This is important as most of the scudo
     // overhead comes from libunwindstack.
@@ -542,27 +563,13 @@ void Unwinder::ClearCachedStatePeriodic(DataSourceInstanceID ds_id,
   PERFETTO_DLOG("Clearing unwinder's cached state.");
 
   for (auto& pid_and_process : ds.process_states) {
-    pid_and_process.second.unwind_state->fd_maps.Reset();
+    pid_and_process.second.unwind_state->ResetMaps();
   }
-  ResetAndEnableUnwindstackCache();
+  ElfCache::GetInstance()->Clear();
   base::MaybeReleaseAllocatorMemToOS();
 
   PostClearCachedStatePeriodic(ds_id, period_ms);  // repost
 }
 
-void Unwinder::ResetAndEnableUnwindstackCache() {
-  PERFETTO_DLOG("Resetting unwindstack cache");
-  // Libunwindstack uses an unsynchronized variable for setting/checking whether
-  // the cache is enabled. Therefore unwinding and cache toggling should stay on
-  // the same thread, but we might be moving unwinding across threads if we're
-  // recreating |Unwinder| instances (during a reconnect to traced). Therefore,
-  // use our own static lock to synchronize the cache toggling.
-  // TODO(rsavitski): consider fixing this in libunwindstack itself.
-  static std::mutex* lock = new std::mutex{};
-  std::lock_guard<std::mutex> guard{*lock};
-  unwindstack::Elf::SetCachingEnabled(false);  // free any existing state
-  unwindstack::Elf::SetCachingEnabled(true);   // reallocate a fresh cache
-}
-
 }  // namespace profiling
 }  // namespace perfetto
@@ -34,6 +34,7 @@
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "src/kallsyms/kernel_symbol_map.h"
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
+#include "src/profiling/common/log_histogram.h"
 #include "src/profiling/common/unwind_support.h"
 #include "src/profiling/perf/common_types.h"
 #include "src/profiling/perf/unwind_queue.h"
@@ -43,10 +44,26 @@ namespace profiling {
 
 constexpr static uint32_t kUnwindQueueCapacity = 1024;
 
+// Statistics of the unwinding stage for one data source, handed over to the
+// producer once the data source stops.
+struct UnwinderStats {
+  uint64_t unwound_samples = 0;
+  uint64_t max_queue_occupancy = 0;
+  LogHistogram unwinding_time_us;
+  // Executable file-backed maps whose parsed ELF file was (not) reused from
+  // the ElfCache, summed over the processes of the data source.
+  uint64_t elf_cache_hits = 0;
+  uint64_t elf_cache_misses = 0;
+};
+
 // Unwinds callstacks based on the sampled stack and register state (see
 // |ParsedSample|). Has a single unwinding ring queue, shared across
 // all data sources.
 //
+// There can be several Unwinders, each on its own thread. In that case, the
+// producer shards the samples by pid, so that the unwinding state of a process
+// is only ever used by one of them.
+//
 // Samples cannot be unwound without having /proc/<pid>/{maps,mem} file
 // descriptors for that process. This lookup can be asynchronous (e.g. on
 // Android), so the unwinder might have to wait before it can process (or
@@ -81,7 +98,8 @@ class Unwinder {
                                 CompletedSample sample) = 0;
     virtual void PostEmitUnwinderSkippedSample(DataSourceInstanceID ds_id,
                                                ParsedSample sample) = 0;
-    virtual void PostFinishDataSourceStop(DataSourceInstanceID ds_id) = 0;
+    virtual void PostFinishDataSourceStop(DataSourceInstanceID ds_id,
+                                          UnwinderStats stats) = 0;
 
     virtual ~Delegate();
   };
@@ -142,6 +160,7 @@ class Unwinder {
 
     Status status = Status::kActive;
     std::map<pid_t, ProcessState> process_states;
+    UnwinderStats stats;
   };
 
   // Accounting for how much heap memory is attached to the enqueued samples at
@@ -202,18 +221,18 @@ class Unwinder {
                                                    std::memory_order_relaxed);
   }
 
-  // Clears the parsed maps for all previously-sampled processes, and resets the
-  // libunwindstack cache. This has the effect of deallocating the cached Elf
-  // objects within libunwindstack, which take up non-trivial amounts of memory.
+  // Clears the parsed maps for all previously-sampled processes, and clears the
+  // ElfCache. This has the effect of deallocating the cached Elf objects, which
+  // take up non-trivial amounts of memory.
   //
   // There are two reasons for having this operation:
   // * over a longer trace, it's desireable to drop heavy state for processes
   //   that haven't been sampled recently.
-  // * since libunwindstack's cache is not bounded, it'll tend towards having
-  //   state for all processes that are targeted by the profiling config.
-  //   Clearing the cache periodically helps keep its footprint closer to the
-  //   actual working set (NB: which might still be arbitrarily big, depending
-  //   on the profiling config).
+  // * the ElfCache tends towards holding its whole budget of Elf objects, for
+  //   all processes that are targeted by the profiling config. Clearing the
+  //   cache periodically helps keep its footprint closer to the actual
+  //   working set (NB: the parsed maps of the processes keep their Elf objects
+  //   alive, so this might still exceed the budget).
   //
   // After this function completes, the next unwind for each process will
   // therefore incur a guaranteed maps reparse.
@@ -228,12 +247,8 @@ class Unwinder {
   // TODO(rsavitski): dropping the full parsed maps is somewhat excessive, could
   // instead clear just the |MapInfo.elf| shared_ptr, but that's considered too
   // brittle as it's an implementation detail of libunwindstack.
-  // TODO(rsavitski): improve libunwindstack cache's architecture (it is still
-  // worth having at the moment to speed up unwinds across map reparses).
   void ClearCachedStatePeriodic(DataSourceInstanceID ds_id, uint32_t period_ms);
 
-  void ResetAndEnableUnwindstackCache();
-
   base::UnixTaskRunner* const task_runner_;
   Delegate* const delegate_;
   UnwindQueue<UnwindEntry, kUnwindQueueCapacity> unwind_queue_;
@@ -49,6 +49,8 @@ class BreakpadSymbolizer : public Symbolizer {
 
   bool BuildIdNeedsHexConversion() override { return false; }
 
+  std::string GetCacheKey() override { return "breakpad-1"; }
+
  private:
   std::string symbol_dir_path_;
   std::string file_path_for_testing_;
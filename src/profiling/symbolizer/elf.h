@@ -31,7 +31,13 @@ namespace profiling {
 
 constexpr auto PT_LOAD = 1;
 constexpr auto PF_X = 1;
+constexpr auto SHT_SYMTAB = 2;
 constexpr auto SHT_NOTE = 7;
+constexpr auto SHT_NOBITS = 8;
+constexpr auto SHT_DYNSYM = 11;
+constexpr auto SHF_COMPRESSED = 0x800;
+constexpr auto STT_FUNC = 2;
+constexpr auto EM_ARM = 40;
 constexpr auto NT_GNU_BUILD_ID = 3;
 constexpr auto ELFCLASS32 = 1;
 constexpr auto ELFCLASS64 = 2;
@@ -88,6 +94,14 @@ struct Elf32 {
     Word n_descsz;
     Word n_type;
   };
+  struct Sym {
+    Word st_name;
+    Addr st_value;
+    Word st_size;
+    unsigned char st_info;
+    unsigned char st_other;
+    Half st_shndx;
+  };
   struct Phdr {
     uint32_t p_type;
     Off p_offset;
@@ -142,6 +156,14 @@ struct Elf64 {
     Word n_descsz;
     Word n_type;
   };
+  struct Sym {
+    Word st_name;
+    unsigned char st_info;
+    unsigned char st_other;
+    Half st_shndx;
+    Addr st_value;
+    Xword st_size;
+  };
   struct Phdr {
     uint32_t p_type;
     uint32_t p_flags;
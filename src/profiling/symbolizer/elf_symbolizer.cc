@@ -0,0 +1,820 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/elf_symbolizer.h"
+
+#include "perfetto/base/build_config.h"
+
+// This translation unit is built only on Linux, MacOS and Windows. See
+// //gn/BUILD.gn.
+#if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <tuple>
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <cxxabi.h>
+#endif
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "src/profiling/symbolizer/elf.h"
+
+namespace perfetto {
+namespace profiling {
+
+namespace {
+
+// DWARF line number program opcodes and forms, see the DWARF 5 standard,
+// section 6.2 and 7.22.
+enum LineStandardOpcode : uint8_t {
+  kLnsCopy = 1,
+  kLnsAdvancePc = 2,
+  kLnsAdvanceLine = 3,
+  kLnsSetFile = 4,
+  kLnsConstAddPc = 8,
+  kLnsFixedAdvancePc = 9,
+};
+
+enum LineExtendedOpcode : uint8_t {
+  kLneEndSequence = 1,
+  kLneSetAddress = 2,
+  kLneDefineFile = 3,
+};
+
+enum LineContentType : uint64_t {
+  kLnctPath = 1,
+  kLnctDirectoryIndex = 2,
+};
+
+enum Form : uint64_t {
+  kFormBlock2 = 0x03,
+  kFormBlock4 = 0x04,
+  kFormData2 = 0x05,
+  kFormData4 = 0x06,
+  kFormData8 = 0x07,
+  kFormString = 0x08,
+  kFormBlock = 0x09,
+  kFormBlock1 = 0x0a,
+  kFormData1 = 0x0b,
+  kFormSdata = 0x0d,
+  kFormStrp = 0x0e,
+  kFormUdata = 0x0f,
+  kFormData16 = 0x1e,
+  kFormLineStrp = 0x1f,
+};
+
+bool InRange(const void* base,
+             size_t total_size,
+             const void* ptr,
+             size_t size) {
+  return ptr >= base && static_cast<const char*>(ptr) + size <=
+                            static_cast<const char*>(base) + total_size;
+}
+
+// Bounds-checked reader of little-endian DWARF data. After reading past the
+// end, all reads return zero and ok() is false.
+class DwarfReader {
+ public:
+  DwarfReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+  bool ok() const { return ok_; }
+  size_t pos() const { return pos_; }
+  bool at_end() const { return pos_ >= size_; }
+
+  void Seek(size_t pos) {
+    if (pos > size_) {
+      ok_ = false;
+      pos = size_;
+    }
+    pos_ = pos;
+  }
+  void Skip(uint64_t bytes) {
+    if (bytes > size_ - pos_) {
+      ok_ = false;
+      pos_ = size_;
+      return;
+    }
+    pos_ += static_cast<size_t>(bytes);
+  }
+
+  template <typename T>
+  T Read() {
+    T value = 0;
+    if (sizeof(T) > size_ - pos_) {
+      ok_ = false;
+      pos_ = size_;
+      return value;
+    }
+    memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return value;
+  }
+
+  uint64_t ReadUint(size_t bytes) {
+    switch (bytes) {
+      case 1:
+        return Read<uint8_t>();
+      case 2:
+        return Read<uint16_t>();
+      case 4:
+        return Read<uint32_t>();
+      case 8:
+        return Read<uint64_t>();
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  uint64_t ReadUleb128() {
+    uint64_t value = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+      uint8_t byte = Read<uint8_t>();
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80) || !ok_)
+        return value;
+    }
+  }
+
+  int64_t ReadSleb128() {
+    uint64_t value = 0;
+    uint32_t shift = 0;
+    uint8_t byte;
+    do {
+      byte = Read<uint8_t>();
+      if (shift < 64)
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while ((byte & 0x80) && ok_);
+    if (shift < 64 && (byte & 0x40))
+      value |= ~uint64_t(0) << shift;
+    return static_cast<int64_t>(value);
+  }
+
+  // Returns nullptr if the string is not terminated within the data.
+  const char* ReadCString() {
+    const char* start = data_ + pos_;
+    const void* end = memchr(start, '\0', size_ - pos_);
+    if (!end) {
+      ok_ = false;
+      pos_ = size_;
+      return nullptr;
+    }
+    pos_ = static_cast<size_t>(static_cast<const char*>(end) - data_) + 1;
+    return start;
+  }
+
+ private:
+  const char* data_;
+  size_t size_;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+const char* StringAt(const char* strings, size_t size, uint64_t offset) {
+  if (!strings || offset >= size ||
+      !memchr(strings + offset, '\0', size - static_cast<size_t>(offset))) {
+    return nullptr;
+  }
+  return strings + offset;
+}
+
+bool IsAbsolutePath(const std::string& path) {
+  return (!path.empty() && (path[0] == '/' || path[0] == '\\')) ||
+         (path.size() > 2 && path[1] == ':');
+}
+
+std::string JoinPath(const std::string& dir, const std::string& file) {
+  if (dir.empty() || IsAbsolutePath(file))
+    return file;
+  return dir + "/" + file;
+}
+
+// Format of an attribute of the directory and file entries of a DWARF 5 line
+// table header.
+struct EntryFormat {
+  uint64_t content_type;
+  uint64_t form;
+};
+
+struct LineTableStrings {
+  const char* debug_str;
+  size_t debug_str_size;
+  const char* debug_line_str;
+  size_t debug_line_str_size;
+};
+
+// Reads an attribute of a DWARF 5 directory or file entry. Sets |string| for
+// string forms, |number| for constant forms, and skips others.
+bool ReadEntryAttribute(DwarfReader* reader,
+                        uint64_t form,
+                        bool dwarf64,
+                        const LineTableStrings& strings,
+                        const char** string,
+                        uint64_t* number) {
+  switch (form) {
+    case kFormString:
+      *string = reader->ReadCString();
+      return true;
+    case kFormStrp:
+    case kFormLineStrp: {
+      uint64_t offset = reader->ReadUint(dwarf64 ? 8 : 4);
+      *string = form == kFormStrp
+                    ? StringAt(strings.debug_str, strings.debug_str_size,
+                               offset)
+                    : StringAt(strings.debug_line_str,
+                               strings.debug_line_str_size, offset);
+      return true;
+    }
+    case kFormUdata:
+      *number = reader->ReadUleb128();
+      return true;
+    case kFormSdata:
+      *number = static_cast<uint64_t>(reader->ReadSleb128());
+      return true;
+    case kFormData1:
+      *number = reader->ReadUint(1);
+      return true;
+    case kFormData2:
+      *number = reader->ReadUint(2);
+      return true;
+    case kFormData4:
+      *number = reader->ReadUint(4);
+      return true;
+    case kFormData8:
+      *number = reader->ReadUint(8);
+      return true;
+    case kFormData16:
+      reader->Skip(16);
+      return true;
+    case kFormBlock:
+      reader->Skip(reader->ReadUleb128());
+      return true;
+    case kFormBlock1:
+      reader->Skip(reader->ReadUint(1));
+      return true;
+    case kFormBlock2:
+      reader->Skip(reader->ReadUint(2));
+      return true;
+    case kFormBlock4:
+      reader->Skip(reader->ReadUint(4));
+      return true;
+  }
+  // E.g. DW_FORM_strx, which would need .debug_str_offsets.
+  PERFETTO_DLOG("Unsupported form in line table header: %" PRIu64, form);
+  return false;
+}
+
+// Reads the directory or file name table of a DWARF 5 line table header.
+// Entries are appended to |names|, with their directory index to |dirs|.
+bool ReadEntryTable(DwarfReader* reader,
+                    bool dwarf64,
+                    const LineTableStrings& strings,
+                    std::vector<std::string>* names,
+                    std::vector<uint64_t>* dirs) {
+  uint8_t format_count = reader->Read<uint8_t>();
+  std::vector<EntryFormat> formats;
+  for (uint8_t i = 0; i < format_count; ++i) {
+    uint64_t content_type = reader->ReadUleb128();
+    uint64_t form = reader->ReadUleb128();
+    formats.push_back({content_type, form});
+  }
+  uint64_t count = reader->ReadUleb128();
+  for (uint64_t i = 0; i < count && reader->ok(); ++i) {
+    const char* name = nullptr;
+    uint64_t dir = 0;
+    for (const EntryFormat& format : formats) {
+      const char* string = nullptr;
+      uint64_t number = 0;
+      if (!ReadEntryAttribute(reader, format.form, dwarf64, strings, &string,
+                              &number)) {
+        return false;
+      }
+      if (format.content_type == kLnctPath)
+        name = string;
+      else if (format.content_type == kLnctDirectoryIndex)
+        dir = number;
+    }
+    names->emplace_back(name ? name : "");
+    dirs->push_back(dir);
+  }
+  return reader->ok();
+}
+
+std::string Demangle(const char* name) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  int ignored;
+  std::unique_ptr<char, base::FreeDeleter> demangled(
+      abi::__cxa_demangle(name, nullptr, nullptr, &ignored));
+  if (demangled)
+    return demangled.get();
+#endif
+  return name;
+}
+
+}  // namespace
+
+// static
+std::unique_ptr<ElfSymbolIndex> ElfSymbolIndex::Create(
+    const std::string& file_name) {
+  base::Optional<size_t> size = base::GetFileSize(file_name);
+  if (!size.has_value()) {
+    PERFETTO_PLOG("Failed to get file size %s", file_name.c_str());
+    return nullptr;
+  }
+  if (*size <= EI_CLASS)
+    return nullptr;
+
+  std::unique_ptr<ElfSymbolIndex> index(new ElfSymbolIndex());
+  index->map_.reset(new ScopedReadMmap(file_name.c_str(), *size));
+  if (!index->map_->IsValid()) {
+    PERFETTO_PLOG("mmap");
+    return nullptr;
+  }
+  const char* mem = static_cast<const char*>(**index->map_);
+  if (mem[EI_MAG0] != ELFMAG0 || mem[EI_MAG1] != ELFMAG1 ||
+      mem[EI_MAG2] != ELFMAG2 || mem[EI_MAG3] != ELFMAG3) {
+    return nullptr;
+  }
+
+  bool parsed = false;
+  switch (mem[EI_CLASS]) {
+    case ELFCLASS32:
+      parsed = index->Parse<Elf32>(mem, *size);
+      break;
+    case ELFCLASS64:
+      parsed = index->Parse<Elf64>(mem, *size);
+      break;
+  }
+  if (!parsed) {
+    PERFETTO_ELOG("Corrupted ELF %s.", file_name.c_str());
+    return nullptr;
+  }
+  return index;
+}
+
+ElfSymbolIndex::~ElfSymbolIndex() = default;
+
+template <typename E>
+bool ElfSymbolIndex::Parse(const char* mem, size_t size) {
+  const typename E::Ehdr* ehdr = reinterpret_cast<const typename E::Ehdr*>(mem);
+  if (!InRange(mem, size, ehdr, sizeof(typename E::Ehdr)))
+    return false;
+  if (ehdr->e_shnum == 0 || ehdr->e_shstrndx >= ehdr->e_shnum)
+    return true;  // No sections, nothing to symbolize with.
+
+  void* base = const_cast<char*>(mem);
+  if (!InRange(mem, size, GetShdr<E>(base, ehdr, 0),
+               ehdr->e_shnum * sizeof(typename E::Shdr))) {
+    return false;
+  }
+
+  // Returns the contents of a section, or nullptr if there are none in the
+  // file.
+  auto contents = [mem, size](const typename E::Shdr* shdr) -> const char* {
+    if (shdr->sh_type == SHT_NOBITS ||
+        !InRange(mem, size, mem + shdr->sh_offset,
+                 static_cast<size_t>(shdr->sh_size))) {
+      return nullptr;
+    }
+    return mem + shdr->sh_offset;
+  };
+
+  const typename E::Shdr* shstrtab =
+      GetShdr<E>(base, ehdr, ehdr->e_shstrndx);
+  const char* section_names = contents(shstrtab);
+  size_t section_names_size = static_cast<size_t>(shstrtab->sh_size);
+
+  const typename E::Shdr* symtab = nullptr;
+  const typename E::Shdr* dynsym = nullptr;
+  const typename E::Shdr* debug_line = nullptr;
+  const typename E::Shdr* debug_str = nullptr;
+  const typename E::Shdr* debug_line_str = nullptr;
+  for (size_t i = 0; i < ehdr->e_shnum; ++i) {
+    const typename E::Shdr* shdr = GetShdr<E>(base, ehdr, i);
+    if (shdr->sh_type == SHT_SYMTAB) {
+      symtab = shdr;
+      continue;
+    }
+    if (shdr->sh_type == SHT_DYNSYM) {
+      dynsym = shdr;
+      continue;
+    }
+    const char* name =
+        StringAt(section_names, section_names_size, shdr->sh_name);
+    if (!name)
+      continue;
+    if (strcmp(name, ".debug_line") == 0)
+      debug_line = shdr;
+    else if (strcmp(name, ".debug_str") == 0)
+      debug_str = shdr;
+    else if (strcmp(name, ".debug_line_str") == 0)
+      debug_line_str = shdr;
+  }
+
+  if (symtab || dynsym)
+    ParseSymbols<E>(mem, size, ehdr, symtab ? symtab : dynsym);
+
+  if (debug_line && (debug_line->sh_flags & SHF_COMPRESSED)) {
+    // Would need zlib.
+    PERFETTO_ELOG("Compressed debug sections are not supported.");
+    debug_line = nullptr;
+  }
+  if (debug_line && contents(debug_line)) {
+    auto section_size = [](const typename E::Shdr* shdr) -> size_t {
+      return shdr ? static_cast<size_t>(shdr->sh_size) : 0;
+    };
+    ParseLineTables(contents(debug_line), section_size(debug_line),
+                    debug_str ? contents(debug_str) : nullptr,
+                    section_size(debug_str),
+                    debug_line_str ? contents(debug_line_str) : nullptr,
+                    section_size(debug_line_str));
+  }
+  return true;
+}
+
+template <typename E>
+void ElfSymbolIndex::ParseSymbols(const char* mem,
+                                  size_t size,
+                                  const typename E::Ehdr* ehdr,
+                                  const typename E::Shdr* symtab) {
+  void* base = const_cast<char*>(mem);
+  if (symtab->sh_link >= ehdr->e_shnum)
+    return;
+  const typename E::Shdr* strtab = GetShdr<E>(base, ehdr, symtab->sh_link);
+  const char* syms = mem + symtab->sh_offset;
+  const char* strings = mem + strtab->sh_offset;
+  size_t strings_size = static_cast<size_t>(strtab->sh_size);
+  if (!InRange(mem, size, syms, static_cast<size_t>(symtab->sh_size)) ||
+      !InRange(mem, size, strings, strings_size)) {
+    return;
+  }
+  // On ARM, the lowest bit of the address of Thumb functions is set.
+  uint64_t address_mask =
+      ehdr->e_machine == EM_ARM ? ~uint64_t(1) : ~uint64_t(0);
+
+  size_t num_syms =
+      static_cast<size_t>(symtab->sh_size) / sizeof(typename E::Sym);
+  functions_.reserve(num_syms);
+  for (size_t i = 0; i < num_syms; ++i) {
+    typename E::Sym sym;
+    memcpy(&sym, syms + i * sizeof(sym), sizeof(sym));
+    if ((sym.st_info & 0xf) != STT_FUNC || sym.st_value == 0)
+      continue;
+    const char* name = StringAt(strings, strings_size, sym.st_name);
+    if (!name || !*name)
+      continue;
+    functions_.push_back(
+        {sym.st_value & address_mask, static_cast<uint64_t>(sym.st_size),
+         name});
+  }
+
+  // Of the symbols at the same address, keep the largest.
+  std::sort(functions_.begin(), functions_.end(),
+            [](const Function& a, const Function& b) {
+              return std::tie(a.start, b.size) < std::tie(b.start, a.size);
+            });
+  functions_.erase(std::unique(functions_.begin(), functions_.end(),
+                               [](const Function& a, const Function& b) {
+                                 return a.start == b.start;
+                               }),
+                   functions_.end());
+  functions_.shrink_to_fit();
+}
+
+void ElfSymbolIndex::ParseLineTables(const char* debug_line,
+                                     size_t debug_line_size,
+                                     const char* debug_str,
+                                     size_t debug_str_size,
+                                     const char* debug_line_str,
+                                     size_t debug_line_str_size) {
+  const LineTableStrings strings{debug_str, debug_str_size, debug_line_str,
+                                 debug_line_str_size};
+  std::map<std::string, uint32_t> file_ids;
+  std::vector<LineRow> sequence;
+
+  DwarfReader section(debug_line, debug_line_size);
+  while (!section.at_end() && section.ok()) {
+    // Line number program header of a compilation unit.
+    uint64_t unit_length = section.Read<uint32_t>();
+    bool dwarf64 = unit_length == 0xffffffff;
+    if (dwarf64)
+      unit_length = section.Read<uint64_t>();
+    size_t unit_start = section.pos();
+    if (!section.ok() || unit_length > debug_line_size - unit_start)
+      break;
+    size_t unit_end = unit_start + static_cast<size_t>(unit_length);
+    DwarfReader unit(debug_line, unit_end);
+    unit.Seek(unit_start);
+    section.Seek(unit_end);
+
+    uint16_t version = unit.Read<uint16_t>();
+    if (version < 2 || version > 5) {
+      PERFETTO_DLOG("Unsupported line table version %u", version);
+      continue;
+    }
+    if (version >= 5) {
+      unit.Read<uint8_t>();  // address_size
+      unit.Read<uint8_t>();  // segment_selector_size
+    }
+    uint64_t header_length = unit.ReadUint(dwarf64 ? 8 : 4);
+    size_t program_start = unit.pos() + static_cast<size_t>(header_length);
+    uint8_t min_inst_length = unit.Read<uint8_t>();
+    if (version >= 4)
+      unit.Read<uint8_t>();  // maximum_operations_per_instruction
+    unit.Read<uint8_t>();    // default_is_stmt
+    int8_t line_base = unit.Read<int8_t>();
+    uint8_t line_range = unit.Read<uint8_t>();
+    uint8_t opcode_base = unit.Read<uint8_t>();
+    if (!unit.ok() || line_range == 0 || opcode_base == 0)
+      continue;
+    std::vector<uint8_t> opcode_lengths(opcode_base - 1u);
+    for (uint8_t& length : opcode_lengths)
+      length = unit.Read<uint8_t>();
+
+    // Directory and file names, indexed like the line program does: from 1
+    // before DWARF 5, where 0 is the compilation directory, and from 0 after.
+    std::vector<std::string> dirs;
+    std::vector<std::string> file_names;
+    std::vector<uint64_t> file_dirs;
+    if (version >= 5) {
+      std::vector<uint64_t> unused;
+      if (!ReadEntryTable(&unit, dwarf64, strings, &dirs, &unused) ||
+          !ReadEntryTable(&unit, dwarf64, strings, &file_names, &file_dirs)) {
+        continue;
+      }
+      // Directories are relative to the compilation directory, the first one.
+      for (size_t i = 1; i < dirs.size(); ++i)
+        dirs[i] = JoinPath(dirs[0], dirs[i]);
+    } else {
+      dirs.emplace_back();
+      while (const char* dir = unit.ReadCString()) {
+        if (!*dir)
+          break;
+        dirs.emplace_back(dir);
+      }
+      file_names.emplace_back();
+      file_dirs.push_back(0);
+      while (const char* file = unit.ReadCString()) {
+        if (!*file)
+          break;
+        file_names.emplace_back(file);
+        file_dirs.push_back(unit.ReadUleb128());
+        unit.ReadUleb128();  // modification time
+        unit.ReadUleb128();  // file length
+      }
+    }
+    if (!unit.ok())
+      continue;
+
+    // Index of the files of this unit in |files_|, resolved lazily.
+    std::vector<uint32_t> file_ids_in_unit(file_names.size(), 0);
+    std::vector<bool> file_resolved(file_names.size(), false);
+    auto file_id = [&](uint64_t file) -> uint32_t {
+      if (file >= file_names.size())
+        return 0;
+      size_t i = static_cast<size_t>(file);
+      if (!file_resolved[i]) {
+        std::string dir = file_dirs[i] < dirs.size()
+                              ? dirs[static_cast<size_t>(file_dirs[i])]
+                              : std::string();
+        std::string path = JoinPath(dir, file_names[i]);
+        auto it = file_ids.emplace(path, static_cast<uint32_t>(files_.size()));
+        if (it.second)
+          files_.emplace_back(std::move(path));
+        file_ids_in_unit[i] = it.first->second;
+        file_resolved[i] = true;
+      }
+      return file_ids_in_unit[i];
+    };
+    if (files_.empty())
+      files_.emplace_back();  // file id 0: unknown.
+
+    // Run the line number program.
+    unit.Seek(program_start);
+    uint64_t address = 0;
+    uint64_t file = 1;
+    int64_t line = 1;
+    sequence.clear();
+    auto emit_row = [&](bool end_sequence) {
+      sequence.push_back({address, file_id(file),
+                          static_cast<uint32_t>(std::max<int64_t>(line, 0)),
+                          end_sequence});
+    };
+    while (!unit.at_end() && unit.ok()) {
+      uint8_t opcode = unit.Read<uint8_t>();
+      if (opcode >= opcode_base) {
+        uint8_t adjusted = static_cast<uint8_t>(opcode - opcode_base);
+        address += (adjusted / line_range) * min_inst_length;
+        line += line_base + adjusted % line_range;
+        emit_row(false);
+        continue;
+      }
+      switch (opcode) {
+        case 0: {
+          uint64_t length = unit.ReadUleb128();
+          size_t next = unit.pos() + static_cast<size_t>(length);
+          uint8_t extended = unit.Read<uint8_t>();
+          if (extended == kLneEndSequence) {
+            emit_row(true);
+            // Sequences at address 0 belong to functions that the linker
+            // discarded.
+            if (sequence.front().address != 0) {
+              line_rows_.insert(line_rows_.end(), sequence.begin(),
+                                sequence.end());
+            }
+            sequence.clear();
+            address = 0;
+            file = 1;
+            line = 1;
+          } else if (extended == kLneSetAddress) {
+            address = unit.ReadUint(static_cast<size_t>(length - 1));
+          } else if (extended == kLneDefineFile && version < 5) {
+            const char* name = unit.ReadCString();
+            file_names.emplace_back(name ? name : "");
+            file_dirs.push_back(unit.ReadUleb128());
+            file_ids_in_unit.push_back(0);
+            file_resolved.push_back(false);
+          }
+          unit.Seek(next);
+          break;
+        }
+        case kLnsCopy:
+          emit_row(false);
+          break;
+        case kLnsAdvancePc:
+          address += unit.ReadUleb128() * min_inst_length;
+          break;
+        case kLnsAdvanceLine:
+          line += unit.ReadSleb128();
+          break;
+        case kLnsSetFile:
+          file = unit.ReadUleb128();
+          break;
+        case kLnsConstAddPc:
+          address += ((255u - opcode_base) / line_range) * min_inst_length;
+          break;
+        case kLnsFixedAdvancePc:
+          address += unit.Read<uint16_t>();
+          break;
+        default:
+          // Other standard opcodes only change state that is not needed
+          // here. Skip their operands.
+          for (uint8_t i = 0; i < opcode_lengths[opcode - 1u]; ++i)
+            unit.ReadUleb128();
+          break;
+      }
+    }
+  }
+
+  // Where a sequence ends at the address another one starts, the end row
+  // must come first.
+  std::stable_sort(line_rows_.begin(), line_rows_.end(),
+                   [](const LineRow& a, const LineRow& b) {
+                     return std::make_tuple(a.address, !a.end_sequence) <
+                            std::make_tuple(b.address, !b.end_sequence);
+                   });
+  line_rows_.shrink_to_fit();
+}
+
+std::vector<std::vector<SymbolizedFrame>> ElfSymbolIndex::Symbolize(
+    const std::vector<uint64_t>& addresses) const {
+  std::vector<std::vector<SymbolizedFrame>> result(addresses.size());
+
+  // Resolve the addresses in increasing order, so that the lookups in the
+  // function and line tables only ever move forward.
+  std::vector<size_t> order(addresses.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&addresses](size_t a, size_t b) {
+    return addresses[a] < addresses[b];
+  });
+
+  auto function_it = functions_.begin();
+  auto line_it = line_rows_.begin();
+  const Function* last_function = nullptr;
+  std::string last_function_name;
+  for (size_t i : order) {
+    uint64_t address = addresses[i];
+    function_it = std::upper_bound(
+        function_it, functions_.end(), address,
+        [](uint64_t addr, const Function& f) { return addr < f.start; });
+    if (function_it == functions_.begin())
+      continue;
+    const Function& function = *(function_it - 1);
+    if (function.size != 0 && address >= function.start + function.size)
+      continue;
+
+    if (&function != last_function) {
+      last_function = &function;
+      last_function_name = Demangle(function.name);
+    }
+    SymbolizedFrame frame;
+    frame.function_name = last_function_name;
+
+    line_it = std::upper_bound(
+        line_it, line_rows_.end(), address,
+        [](uint64_t addr, const LineRow& row) { return addr < row.address; });
+    if (line_it != line_rows_.begin()) {
+      const LineRow& row = *(line_it - 1);
+      if (!row.end_sequence) {
+        frame.file_name = files_[row.file];
+        frame.line = row.line;
+      }
+    }
+    result[i].emplace_back(std::move(frame));
+  }
+  return result;
+}
+
+ElfSymbolizer::ElfSymbolizer(std::unique_ptr<BinaryFinder> finder,
+                             size_t num_threads)
+    : finder_(std::move(finder)),
+      num_threads_(num_threads ? num_threads
+                               : std::max(1u,
+                                          std::thread::hardware_concurrency())) {
+}
+
+ElfSymbolizer::~ElfSymbolizer() = default;
+
+void ElfSymbolizer::Preload(
+    const std::vector<std::pair<std::string, std::string>>&
+        names_and_build_ids) {
+  // Finding the binaries is not thread-safe, parsing them is.
+  std::vector<std::pair<std::string, std::unique_ptr<ElfSymbolIndex>*>> todo;
+  for (const auto& name_and_build_id : names_and_build_ids) {
+    base::Optional<FoundBinary> binary = finder_->FindBinary(
+        name_and_build_id.first, name_and_build_id.second);
+    if (!binary)
+      continue;
+    auto it = indices_.emplace(binary->file_name, nullptr);
+    if (it.second)
+      todo.emplace_back(binary->file_name, &it.first->second);
+  }
+
+  std::atomic<size_t> next(0);
+  auto parse = [&todo, &next] {
+    for (size_t i = next++; i < todo.size(); i = next++)
+      *todo[i].second = ElfSymbolIndex::Create(todo[i].first);
+  };
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_threads_, todo.size()); ++i)
+    threads.emplace_back(parse);
+  parse();
+  for (std::thread& thread : threads)
+    thread.join();
+}
+
+std::vector<std::vector<SymbolizedFrame>> ElfSymbolizer::Symbolize(
+    const std::string& mapping_name,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  base::Optional<FoundBinary> binary =
+      finder_->FindBinary(mapping_name, build_id);
+  if (!binary)
+    return {};
+  auto it = indices_.find(binary->file_name);
+  if (it == indices_.end()) {
+    it = indices_
+             .emplace(binary->file_name,
+                      ElfSymbolIndex::Create(binary->file_name))
+             .first;
+  }
+  const ElfSymbolIndex* index = it->second.get();
+  if (!index)
+    return {};
+
+  uint64_t load_bias_correction =
+      GetLoadBiasCorrection(*binary, load_bias, mapping_name);
+  if (load_bias_correction == 0)
+    return index->Symbolize(addresses);
+  std::vector<uint64_t> corrected(addresses);
+  for (uint64_t& address : corrected)
+    address += load_bias_correction;
+  return index->Symbolize(corrected);
+}
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
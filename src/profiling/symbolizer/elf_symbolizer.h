@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
+#define SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/profiling/symbolizer/local_symbolizer.h"
+#include "src/profiling/symbolizer/scoped_read_mmap.h"
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// Functions and source lines of an ELF file, sorted by address. Built from the
+// symbol table (.symtab, or .dynsym if there is none) and the DWARF line
+// tables (.debug_line) of the file.
+class ElfSymbolIndex {
+ public:
+  // Returns nullptr if |file_name| is not a valid ELF file.
+  static std::unique_ptr<ElfSymbolIndex> Create(const std::string& file_name);
+
+  ~ElfSymbolIndex();
+
+  // For each of the |addresses| (virtual addresses in the ELF file), returns
+  // the function that contains it and its source line, if known. Addresses
+  // that are not within a function get no frame.
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::vector<uint64_t>& addresses) const;
+
+  size_t num_functions() const { return functions_.size(); }
+  size_t num_line_rows() const { return line_rows_.size(); }
+
+ private:
+  struct Function {
+    uint64_t start;
+    uint64_t size;
+    // Points into the string table in |map_|.
+    const char* name;
+  };
+
+  struct LineRow {
+    uint64_t address;
+    uint32_t file;
+    uint32_t line;
+    // The first address after a sequence of rows.
+    bool end_sequence;
+  };
+
+  ElfSymbolIndex() = default;
+
+  template <typename E>
+  bool Parse(const char* mem, size_t size);
+  template <typename E>
+  void ParseSymbols(const char* mem,
+                    size_t size,
+                    const typename E::Ehdr* ehdr,
+                    const typename E::Shdr* symtab);
+  void ParseLineTables(const char* debug_line,
+                       size_t debug_line_size,
+                       const char* debug_str,
+                       size_t debug_str_size,
+                       const char* debug_line_str,
+                       size_t debug_line_str_size);
+
+  std::unique_ptr<ScopedReadMmap> map_;
+  std::vector<Function> functions_;
+  std::vector<LineRow> line_rows_;
+  std::vector<std::string> files_;
+};
+
+// Symbolizer that reads the binaries found by |finder| in-process, instead of
+// using llvm-symbolizer. Each binary is parsed once into an ElfSymbolIndex,
+// which then resolves all the addresses of a mapping in one pass.
+//
+// Unlike llvm-symbolizer, this does not resolve inlined functions: each
+// address gets at most one frame, with the function of the symbol table that
+// contains it, and the source line of the address.
+class ElfSymbolizer : public Symbolizer {
+ public:
+  // Binaries are parsed on up to |num_threads| threads in Preload(). If 0, on
+  // as many as there are cores.
+  explicit ElfSymbolizer(std::unique_ptr<BinaryFinder> finder,
+                         size_t num_threads = 0);
+  ~ElfSymbolizer() override;
+
+  void Preload(const std::vector<std::pair<std::string, std::string>>&
+                   names_and_build_ids) override;
+
+  std::vector<std::vector<SymbolizedFrame>> Symbolize(
+      const std::string& mapping_name,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& address) override;
+
+  bool BuildIdNeedsHexConversion() override { return true; }
+
+  // To be bumped when the frames returned for an address change.
+  std::string GetCacheKey() override { return "elf-1"; }
+
+ private:
+  std::unique_ptr<BinaryFinder> finder_;
+  const size_t num_threads_;
+  // By file name. Null if the file could not be parsed.
+  std::map<std::string, std::unique_ptr<ElfSymbolIndex>> indices_;
+};
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_ELF_SYMBOLIZER_H_
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/base/build_config.h"
+#include "test/gtest_and_gmock.h"
+
+// This translation unit is built only on Linux and MacOS. See //gn/BUILD.gn.
+#if PERFETTO_BUILDFLAG(PERFETTO_LOCAL_SYMBOLIZER)
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/utils.h"
+#include "src/base/test/tmp_dir_tree.h"
+#include "src/profiling/symbolizer/elf.h"
+#include "src/profiling/symbolizer/elf_symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+template <typename T>
+void Append(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void AppendCString(std::string* out, const char* str) {
+  out->append(str, strlen(str) + 1);
+}
+
+// 64-bit ELF file with the given sections, which are laid out after the ELF
+// header. The section header string table is added as the last section.
+class ElfBuilder {
+ public:
+  // Returns the index of the section.
+  size_t AddSection(const char* name,
+                    uint32_t type,
+                    const std::string& contents,
+                    uint32_t link = 0) {
+    Section section;
+    section.shdr.sh_name = static_cast<uint32_t>(section_names_.size());
+    section.shdr.sh_type = type;
+    section.shdr.sh_link = link;
+    section.shdr.sh_size = contents.size();
+    section.contents = contents;
+    AppendCString(&section_names_, name);
+    sections_.push_back(section);
+    return sections_.size() - 1;
+  }
+
+  std::string Build() {
+    size_t shstrtab = AddSection(".shstrtab", 3, section_names_ + '\0');
+
+    Elf64::Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    ehdr.e_ident[EI_MAG0] = ELFMAG0;
+    ehdr.e_ident[EI_MAG1] = ELFMAG1;
+    ehdr.e_ident[EI_MAG2] = ELFMAG2;
+    ehdr.e_ident[EI_MAG3] = ELFMAG3;
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_ehsize = sizeof(ehdr);
+    ehdr.e_shentsize = sizeof(Elf64::Shdr);
+    ehdr.e_shnum = static_cast<uint16_t>(sections_.size());
+    ehdr.e_shstrndx = static_cast<uint16_t>(shstrtab);
+
+    std::string data;
+    for (Section& section : sections_) {
+      data.resize(base::AlignUp<8>(data.size()));
+      section.shdr.sh_offset = sizeof(ehdr) + data.size();
+      data += section.contents;
+    }
+    data.resize(base::AlignUp<8>(data.size()));
+    ehdr.e_shoff = sizeof(ehdr) + data.size();
+
+    std::string elf;
+    Append(&elf, ehdr);
+    elf += data;
+    for (const Section& section : sections_)
+      Append(&elf, section.shdr);
+    return elf;
+  }
+
+ private:
+  struct Section {
+    Elf64::Shdr shdr = {};
+    std::string contents;
+  };
+  // Starts with the null section.
+  std::vector<Section> sections_{Section()};
+  std::string section_names_{'\0'};
+};
+
+void AppendSymbol(std::string* symtab,
+                  std::string* strtab,
+                  const char* name,
+                  uint64_t value,
+                  uint64_t size,
+                  uint8_t type) {
+  Elf64::Sym sym = {};
+  sym.st_name = static_cast<uint32_t>(strtab->size());
+  sym.st_info = type;
+  sym.st_value = value;
+  sym.st_size = size;
+  Append(symtab, sym);
+  AppendCString(strtab, name);
+}
+
+void AppendSetAddress(std::string* program, uint64_t address) {
+  program->append({0, 9, 2});  // DW_LNE_set_address
+  Append(program, address);
+}
+
+void AppendEndSequence(std::string* program) {
+  program->append({0, 1, 1});  // DW_LNE_end_sequence
+}
+
+// DWARF 4 line table with a single compilation unit.
+std::string LineTable(const std::string& program) {
+  std::string header;
+  header.push_back(1);   // minimum_instruction_length
+  header.push_back(1);   // maximum_operations_per_instruction
+  header.push_back(1);   // default_is_stmt
+  header.push_back(-5);  // line_base
+  header.push_back(14);  // line_range
+  header.push_back(13);  // opcode_base
+  header.append({0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1});
+  AppendCString(&header, "src");
+  header.push_back(0);
+  AppendCString(&header, "a.cc");
+  header.append({1, 0, 0});  // directory, mtime, length
+  AppendCString(&header, "/abs/b.h");
+  header.append({0, 0, 0});
+  header.push_back(0);
+
+  std::string unit;
+  Append(&unit, uint16_t{4});  // version
+  Append(&unit, static_cast<uint32_t>(header.size()));
+  unit += header;
+  unit += program;
+
+  std::string table;
+  Append(&table, static_cast<uint32_t>(unit.size()));
+  return table + unit;
+}
+
+std::string CreateElf() {
+  std::string symtab;
+  std::string strtab(1, '\0');
+  Append(&symtab, Elf64::Sym{});
+  AppendSymbol(&symtab, &strtab, "foo", 0x1000, 0x20, STT_FUNC);
+  AppendSymbol(&symtab, &strtab, "bar", 0x1020, 0x10, STT_FUNC);
+  AppendSymbol(&symtab, &strtab, "_ZN3baz3quxEv", 0x1100, 0x10, STT_FUNC);
+  AppendSymbol(&symtab, &strtab, "data", 0x2000, 0x10, /*STT_OBJECT=*/1);
+
+  std::string program;
+  // Discarded function, at address 0.
+  AppendSetAddress(&program, 0);
+  program.push_back(1);  // DW_LNS_copy
+  program.push_back(2);  // DW_LNS_advance_pc
+  program.push_back(0x10);
+  AppendEndSequence(&program);
+
+  AppendSetAddress(&program, 0x1000);
+  program.push_back(3);  // DW_LNS_advance_line
+  program.push_back(9);
+  program.push_back(1);  // DW_LNS_copy: 0x1000 a.cc:10
+  // Special opcode, advancing the address by 0x10 and the line by 2:
+  // 0x1010 a.cc:12
+  program.push_back(static_cast<char>(13 + (2 + 5) + 14 * 0x10));
+  program.push_back(4);  // DW_LNS_set_file
+  program.push_back(2);
+  program.push_back(2);  // DW_LNS_advance_pc
+  program.push_back(0x08);
+  program.push_back(1);  // DW_LNS_copy: 0x1018 /abs/b.h:12
+  program.push_back(2);  // DW_LNS_advance_pc
+  program.push_back(0x18);
+  AppendEndSequence(&program);  // 0x1030
+
+  ElfBuilder builder;
+  size_t strtab_index = builder.AddSection(".strtab", 3, strtab);
+  builder.AddSection(".symtab", SHT_SYMTAB, symtab,
+                     static_cast<uint32_t>(strtab_index));
+  builder.AddSection(".debug_line", 1, LineTable(program));
+  return builder.Build();
+}
+
+std::vector<SymbolizedFrame> Frame(const char* function_name,
+                                   const char* file_name,
+                                   uint32_t line) {
+  SymbolizedFrame frame;
+  frame.function_name = function_name;
+  frame.file_name = file_name;
+  frame.line = line;
+  return {frame};
+}
+
+MATCHER_P(FramesAre, expected, "") {
+  if (arg.size() != expected.size())
+    return false;
+  for (size_t i = 0; i < arg.size(); ++i) {
+    if (arg[i].function_name != expected[i].function_name ||
+        arg[i].file_name != expected[i].file_name ||
+        arg[i].line != expected[i].line) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST(ElfSymbolIndexTest, Symbolize) {
+  base::TmpDirTree tmp;
+  tmp.AddFile("lib.so", CreateElf());
+  std::unique_ptr<ElfSymbolIndex> index =
+      ElfSymbolIndex::Create(tmp.AbsolutePath("lib.so"));
+  ASSERT_TRUE(index);
+  EXPECT_EQ(index->num_functions(), 3u);
+
+  // Not sorted, to check that the results are in the order of the input.
+  std::vector<std::vector<SymbolizedFrame>> frames = index->Symbolize(
+      {0x1104, 0x1000, 0x1010, 0x1018, 0x1024, 0x1030, 0x2000, 0x8});
+  EXPECT_THAT(
+      frames,
+      ElementsAre(FramesAre(Frame("baz::qux()", "", 0)),
+                  FramesAre(Frame("foo", "src/a.cc", 10)),
+                  FramesAre(Frame("foo", "src/a.cc", 12)),
+                  FramesAre(Frame("foo", "/abs/b.h", 12)),
+                  FramesAre(Frame("bar", "/abs/b.h", 12)), IsEmpty(),
+                  IsEmpty(), IsEmpty()));
+}
+
+TEST(ElfSymbolIndexTest, NotElf) {
+  base::TmpDirTree tmp;
+  tmp.AddFile("lib.so", "not an ELF file");
+  EXPECT_FALSE(ElfSymbolIndex::Create(tmp.AbsolutePath("lib.so")));
+}
+
+class FixedBinaryFinder : public BinaryFinder {
+ public:
+  explicit FixedBinaryFinder(std::string file_name)
+      : file_name_(std::move(file_name)) {}
+
+  base::Optional<FoundBinary> FindBinary(const std::string&,
+                                         const std::string& build_id) override {
+    if (build_id != "build-id")
+      return base::nullopt;
+    return FoundBinary{file_name_, 0};
+  }
+
+ private:
+  std::string file_name_;
+};
+
+TEST(ElfSymbolizerTest, PreloadAndSymbolize) {
+  base::TmpDirTree tmp;
+  tmp.AddFile("lib.so", CreateElf());
+  ElfSymbolizer symbolizer(std::unique_ptr<BinaryFinder>(
+                               new FixedBinaryFinder(tmp.AbsolutePath("lib.so"))),
+                           /*num_threads=*/4);
+  symbolizer.Preload({{"/lib.so", "build-id"}, {"/other.so", "other"}});
+
+  EXPECT_THAT(symbolizer.Symbolize("/lib.so", "build-id", 0, {0x1024}),
+              ElementsAre(FramesAre(Frame("bar", "/abs/b.h", 12))));
+  EXPECT_THAT(symbolizer.Symbolize("/other.so", "other", 0, {0x1024}),
+              IsEmpty());
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif
@@ -17,6 +17,8 @@
 #include "src/profiling/symbolizer/local_symbolizer.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <cinttypes>
 #include <memory>
@@ -28,10 +30,12 @@
 #include "perfetto/base/compiler.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/profiling/symbolizer/elf.h"
+#include "src/profiling/symbolizer/elf_symbolizer.h"
 #include "src/profiling/symbolizer/scoped_read_mmap.h"
 
 namespace perfetto {
@@ -53,7 +57,13 @@ std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
       finder.reset(new LocalBinaryIndexer(std::move(binary_path)));
     else
       PERFETTO_FATAL("Invalid symbolizer mode [find | index]: %s", mode);
-    symbolizer.reset(new LocalSymbolizer(std::move(finder)));
+    std::string llvm_symbolizer = GetLlvmSymbolizerPath();
+    if (!llvm_symbolizer.empty()) {
+      symbolizer.reset(
+          new LocalSymbolizer(llvm_symbolizer, std::move(finder)));
+    } else {
+      symbolizer.reset(new ElfSymbolizer(std::move(finder)));
+    }
 #else
     base::ignore_result(mode);
     PERFETTO_FATAL("This build does not support local symbolization.");
@@ -115,6 +125,35 @@ std::vector<std::string> GetLines(
   return lines;
 }
 
+std::string GetLlvmSymbolizerPath() {
+  const char* llvm_symbolizer = getenv("PERFETTO_LLVM_SYMBOLIZER");
+  if (llvm_symbolizer && *llvm_symbolizer)
+    return llvm_symbolizer;
+
+  const char* elf_symbolizer = getenv("PERFETTO_ELF_SYMBOLIZER");
+  if (elf_symbolizer && strcmp(elf_symbolizer, "1") == 0)
+    return "";
+
+  const char* path = getenv("PATH");
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  const char kPathSeparator = ';';
+#else
+  const char kPathSeparator = ':';
+#endif
+  for (base::StringSplitter dir(path ? path : "", kPathSeparator);
+       dir.Next();) {
+    std::string candidate =
+        std::string(dir.cur_token()) + "/" + kDefaultSymbolizer;
+    if (base::FileExists(candidate))
+      return candidate;
+  }
+  PERFETTO_LOG(
+      "%s not found in PATH, reading the binaries in-process. Inlined "
+      "functions will not be resolved.",
+      kDefaultSymbolizer);
+  return "";
+}
+
 namespace {
 bool InRange(const void* base,
              size_t total_size,
@@ -322,6 +361,21 @@ bool ParseLlvmSymbolizerLine(const std::string& line,
   return true;
 }
 
+uint64_t GetLoadBiasCorrection(const FoundBinary& binary,
+                               uint64_t load_bias,
+                               const std::string& mapping_name) {
+  if (binary.load_bias <= load_bias)
+    return 0;
+  // On Android 10, there was a bug in libunwindstack that would incorrectly
+  // calculate the load_bias, and thus the relative PC. This would end up in
+  // frames that made no sense. We can fix this up after the fact if we
+  // detect this situation.
+  uint64_t load_bias_correction = binary.load_bias - load_bias;
+  PERFETTO_LOG("Correcting load bias by %" PRIu64 " for %s",
+               load_bias_correction, mapping_name.c_str());
+  return load_bias_correction;
+}
+
 BinaryFinder::~BinaryFinder() = default;
 
 LocalBinaryIndexer::LocalBinaryIndexer(std::vector<std::string> roots)
@@ -521,16 +575,8 @@ std::vector<std::vector<SymbolizedFrame>> LocalSymbolizer::Symbolize(
       finder_->FindBinary(mapping_name, build_id);
   if (!binary)
     return {};
-  uint64_t load_bias_correction = 0;
-  if (binary->load_bias > load_bias) {
-    // On Android 10, there was a bug in libunwindstack that would incorrectly
-    // calculate the load_bias, and thus the relative PC. This would end up in
-    // frames that made no sense. We can fix this up after the fact if we
-    // detect this situation.
-    load_bias_correction = binary->load_bias - load_bias;
-    PERFETTO_LOG("Correcting load bias by %" PRIu64 " for %s",
-                 load_bias_correction, mapping_name.c_str());
-  }
+  uint64_t load_bias_correction =
+      GetLoadBiasCorrection(*binary, load_bias, mapping_name);
   std::vector<std::vector<SymbolizedFrame>> result;
   result.reserve(addresses.size());
   for (uint64_t address : addresses)
@@ -541,7 +587,26 @@ std::vector<std::vector<SymbolizedFrame>> LocalSymbolizer::Symbolize(
 
 LocalSymbolizer::LocalSymbolizer(const std::string& symbolizer_path,
                                  std::unique_ptr<BinaryFinder> finder)
-    : llvm_symbolizer_(symbolizer_path), finder_(std::move(finder)) {}
+    : symbolizer_path_(symbolizer_path),
+      llvm_symbolizer_(symbolizer_path),
+      finder_(std::move(finder)) {}
+
+std::string LocalSymbolizer::GetCacheKey() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  Subprocess version(symbolizer_path_, {"--version"});
+#else
+  Subprocess version(symbolizer_path_, {"llvm-symbolizer", "--version"});
+#endif
+  base::Hash hash;
+  char buf[1024];
+  for (;;) {
+    int64_t rd = version.Read(buf, sizeof(buf));
+    if (rd <= 0)
+      break;
+    hash.Update(buf, static_cast<size_t>(rd));
+  }
+  return "llvm-symbolizer-" + base::Uint64ToHexStringNoPrefix(hash.digest());
+}
 
 LocalSymbolizer::LocalSymbolizer(std::unique_ptr<BinaryFinder> finder)
     : LocalSymbolizer(kDefaultSymbolizer, std::move(finder)) {}
@@ -36,11 +36,23 @@ bool ParseLlvmSymbolizerLine(const std::string& line,
 std::vector<std::string> GetLines(
     std::function<int64_t(char*, size_t)> fn_read);
 
+// Returns the llvm-symbolizer to use: the one in the PERFETTO_LLVM_SYMBOLIZER
+// environment variable if set, otherwise the one in PATH. Returns an empty
+// string if there is none, or if PERFETTO_ELF_SYMBOLIZER=1 opts into reading
+// the binaries in-process instead.
+std::string GetLlvmSymbolizerPath();
+
 struct FoundBinary {
   std::string file_name;
   uint64_t load_bias;
 };
 
+// Returns the offset to add to the addresses of |mapping_name|, which were
+// made relative to |load_bias|, if that does not match the one of |binary|.
+uint64_t GetLoadBiasCorrection(const FoundBinary& binary,
+                               uint64_t load_bias,
+                               const std::string& mapping_name);
+
 class BinaryFinder {
  public:
   virtual ~BinaryFinder();
@@ -109,13 +121,21 @@ class LocalSymbolizer : public Symbolizer {
 
   bool BuildIdNeedsHexConversion() override { return true; }
 
+  // Includes a hash of the output of llvm-symbolizer --version.
+  std::string GetCacheKey() override;
+
   ~LocalSymbolizer() override;
 
  private:
+  const std::string symbolizer_path_;
   LLVMSymbolizerProcess llvm_symbolizer_;
   std::unique_ptr<BinaryFinder> finder_;
 };
 
+// Returns a symbolizer for the binaries found in |binary_path|, or nullptr if
+// it is empty. It runs llvm-symbolizer, see GetLlvmSymbolizerPath(), or reads
+// the binaries in-process (which does not resolve inlined functions) if there
+// is none.
 std::unique_ptr<Symbolizer> LocalSymbolizerOrDie(
     std::vector<std::string> binary_path,
     const char* mode);
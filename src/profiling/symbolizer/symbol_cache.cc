@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/symbol_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/base/proc_utils.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "src/profiling/symbolizer/scoped_read_mmap.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+namespace perfetto {
+namespace profiling {
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'F', 'S', 'Y', 'M', 'C', 'A', 'C'};
+constexpr uint32_t kVersion = 1;
+constexpr char kFileExtension[] = ".symcache";
+
+// Layout of a cache file:
+// FileHeader
+// FileEntry[num_entries], sorted by address.
+// FileFrame[num_frames]
+// char[strings_size], null-terminated strings referenced by the frames.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_entries;
+  uint32_t num_frames;
+  uint32_t strings_size;
+};
+
+struct FileEntry {
+  uint64_t address;
+  uint32_t first_frame;
+  uint32_t num_frames;
+};
+
+struct FileFrame {
+  uint32_t function_name;
+  uint32_t file_name;
+  uint32_t line;
+};
+
+static_assert(sizeof(FileHeader) == 24, "FileHeader must be packed");
+static_assert(sizeof(FileEntry) == 16, "FileEntry must be packed");
+static_assert(sizeof(FileFrame) == 12, "FileFrame must be packed");
+
+// Memory mapped cache file.
+class CacheFile {
+ public:
+  // Returns false if the file does not exist or is not a valid cache file.
+  bool Open(const std::string& path) {
+    base::Optional<size_t> size = base::GetFileSize(path);
+    if (!size || *size < sizeof(FileHeader))
+      return false;
+    map_.reset(new ScopedReadMmap(path.c_str(), *size));
+    if (!map_->IsValid())
+      return false;
+    const char* mem = static_cast<const char*>(**map_);
+    header_ = reinterpret_cast<const FileHeader*>(mem);
+    if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0 ||
+        header_->version != kVersion) {
+      return false;
+    }
+    uint64_t expected_size =
+        sizeof(FileHeader) +
+        uint64_t{header_->num_entries} * sizeof(FileEntry) +
+        uint64_t{header_->num_frames} * sizeof(FileFrame) +
+        header_->strings_size;
+    if (expected_size != *size)
+      return false;
+    entries_ = reinterpret_cast<const FileEntry*>(mem + sizeof(FileHeader));
+    frames_ = reinterpret_cast<const FileFrame*>(entries_ +
+                                                 header_->num_entries);
+    strings_ = reinterpret_cast<const char*>(frames_ + header_->num_frames);
+    // All strings are null-terminated if the last one is.
+    return header_->strings_size > 0 &&
+           strings_[header_->strings_size - 1] == '\0';
+  }
+
+  const FileEntry* Find(uint64_t address) const {
+    const FileEntry* end = entries_ + header_->num_entries;
+    const FileEntry* it = std::lower_bound(
+        entries_, end, address,
+        [](const FileEntry& entry, uint64_t a) { return entry.address < a; });
+    if (it == end || it->address != address)
+      return nullptr;
+    return it;
+  }
+
+  // Returns false if |entry| references data out of the file.
+  bool GetFrames(const FileEntry& entry,
+                 std::vector<SymbolizedFrame>* out) const {
+    if (uint64_t{entry.first_frame} + entry.num_frames > header_->num_frames)
+      return false;
+    out->clear();
+    for (uint32_t i = 0; i < entry.num_frames; ++i) {
+      const FileFrame& frame = frames_[entry.first_frame + i];
+      if (frame.function_name >= header_->strings_size ||
+          frame.file_name >= header_->strings_size) {
+        return false;
+      }
+      SymbolizedFrame symbolized;
+      symbolized.function_name = strings_ + frame.function_name;
+      symbolized.file_name = strings_ + frame.file_name;
+      symbolized.line = frame.line;
+      out->emplace_back(std::move(symbolized));
+    }
+    return true;
+  }
+
+  const FileEntry* entries_begin() const { return entries_; }
+  const FileEntry* entries_end() const {
+    return entries_ + header_->num_entries;
+  }
+
+ private:
+  std::unique_ptr<ScopedReadMmap> map_;
+  const FileHeader* header_ = nullptr;
+  const FileEntry* entries_ = nullptr;
+  const FileFrame* frames_ = nullptr;
+  const char* strings_ = nullptr;
+};
+
+// Serializes |entries| in the format of CacheFile.
+std::string Serialize(
+    const std::map<uint64_t, std::vector<SymbolizedFrame>>& entries) {
+  std::vector<FileEntry> file_entries;
+  std::vector<FileFrame> file_frames;
+  std::string strings;
+  std::map<std::string, uint32_t> string_offsets;
+  auto intern = [&strings, &string_offsets](const std::string& str) {
+    auto it_and_inserted = string_offsets.emplace(
+        str, static_cast<uint32_t>(strings.size()));
+    if (it_and_inserted.second)
+      strings.append(str.c_str(), str.size() + 1);
+    return it_and_inserted.first->second;
+  };
+  intern("");
+
+  for (const auto& address_and_frames : entries) {
+    FileEntry entry;
+    entry.address = address_and_frames.first;
+    entry.first_frame = static_cast<uint32_t>(file_frames.size());
+    entry.num_frames = static_cast<uint32_t>(address_and_frames.second.size());
+    file_entries.push_back(entry);
+    for (const SymbolizedFrame& frame : address_and_frames.second) {
+      FileFrame file_frame;
+      file_frame.function_name = intern(frame.function_name);
+      file_frame.file_name = intern(frame.file_name);
+      file_frame.line = frame.line;
+      file_frames.push_back(file_frame);
+    }
+  }
+
+  FileHeader header;
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.num_entries = static_cast<uint32_t>(file_entries.size());
+  header.num_frames = static_cast<uint32_t>(file_frames.size());
+  header.strings_size = static_cast<uint32_t>(strings.size());
+
+  std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+  data.append(reinterpret_cast<const char*>(file_entries.data()),
+              file_entries.size() * sizeof(FileEntry));
+  data.append(reinterpret_cast<const char*>(file_frames.data()),
+              file_frames.size() * sizeof(FileFrame));
+  data.append(strings);
+  return data;
+}
+
+// Marks |path| as used, for Trim().
+void Touch(const std::string& path) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  _utime(path.c_str(), nullptr);
+#else
+  utime(path.c_str(), nullptr);
+#endif
+}
+
+}  // namespace
+
+SymbolCache::SymbolCache(std::string cache_dir, uint64_t max_size_bytes)
+    : cache_dir_(std::move(cache_dir)), max_size_bytes_(max_size_bytes) {
+  // Fails if the directory already exists, which is fine.
+  base::Mkdir(cache_dir_);
+}
+
+std::string SymbolCache::GetDirPath(const std::string& symbolizer_key) const {
+  return cache_dir_ + "/" + symbolizer_key;
+}
+
+std::string SymbolCache::GetFilePath(const std::string& symbolizer_key,
+                                     const std::string& build_id,
+                                     uint64_t load_bias) const {
+  std::string path = GetDirPath(symbolizer_key) + "/" + base::ToHex(build_id);
+  if (load_bias)
+    path += "-" + base::Uint64ToHexStringNoPrefix(load_bias);
+  return path + kFileExtension;
+}
+
+std::vector<base::Optional<std::vector<SymbolizedFrame>>> SymbolCache::Lookup(
+    const std::string& symbolizer_key,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses) {
+  std::vector<base::Optional<std::vector<SymbolizedFrame>>> result(
+      addresses.size());
+  std::string path = GetFilePath(symbolizer_key, build_id, load_bias);
+  CacheFile file;
+  if (!file.Open(path)) {
+    stats_.misses += addresses.size();
+    return result;
+  }
+  Touch(path);
+
+  std::vector<SymbolizedFrame> frames;
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    const FileEntry* entry = file.Find(addresses[i]);
+    if (entry && file.GetFrames(*entry, &frames)) {
+      result[i] = std::move(frames);
+      stats_.hits++;
+    } else {
+      stats_.misses++;
+    }
+  }
+  return result;
+}
+
+void SymbolCache::Store(
+    const std::string& symbolizer_key,
+    const std::string& build_id,
+    uint64_t load_bias,
+    const std::vector<uint64_t>& addresses,
+    const std::vector<std::vector<SymbolizedFrame>>& frames) {
+  PERFETTO_DCHECK(addresses.size() == frames.size());
+  if (std::all_of(frames.begin(), frames.end(),
+                  [](const std::vector<SymbolizedFrame>& address_frames) {
+                    return address_frames.empty();
+                  })) {
+    return;
+  }
+  // Fails if the directory already exists, which is fine.
+  base::Mkdir(GetDirPath(symbolizer_key));
+  std::string path = GetFilePath(symbolizer_key, build_id, load_bias);
+
+  // Merge with the addresses that are already in the file, if any.
+  std::map<uint64_t, std::vector<SymbolizedFrame>> entries;
+  {
+    CacheFile file;
+    if (file.Open(path)) {
+      for (const FileEntry* it = file.entries_begin();
+           it != file.entries_end(); ++it) {
+        std::vector<SymbolizedFrame> existing;
+        if (file.GetFrames(*it, &existing))
+          entries.emplace(it->address, std::move(existing));
+      }
+    }
+  }
+  for (size_t i = 0; i < addresses.size(); ++i) {
+    if (!frames[i].empty())
+      entries[addresses[i]] = frames[i];
+  }
+
+  // Write to a temporary file and rename it, so that concurrent readers
+  // never see a partial file.
+  std::string data = Serialize(entries);
+  std::string tmp_path =
+      path + ".tmp" + std::to_string(base::GetProcessId());
+  {
+    base::ScopedFile fd(base::OpenFile(
+        tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (!fd) {
+      PERFETTO_PLOG("Failed to create %s", tmp_path.c_str());
+      return;
+    }
+    if (base::WriteAll(*fd, data.data(), data.size()) !=
+        static_cast<ssize_t>(data.size())) {
+      PERFETTO_PLOG("Failed to write %s", tmp_path.c_str());
+      fd.reset();
+      remove(tmp_path.c_str());
+      return;
+    }
+  }
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  // rename() does not replace existing files on Windows.
+  remove(path.c_str());
+#endif
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    PERFETTO_PLOG("Failed to rename %s", tmp_path.c_str());
+    remove(tmp_path.c_str());
+    return;
+  }
+  stats_.files_written++;
+}
+
+void SymbolCache::Trim() {
+  std::vector<std::string> files;
+  if (!base::ListFilesRecursive(cache_dir_, files).ok())
+    return;
+
+  struct CacheFileInfo {
+    std::string path;
+    uint64_t size;
+    time_t last_used;
+  };
+  std::vector<CacheFileInfo> infos;
+  uint64_t total_size = 0;
+  for (const std::string& file : files) {
+    if (!base::EndsWith(file, kFileExtension))
+      continue;
+    std::string path = cache_dir_ + "/" + file;
+    struct stat buf {};
+    if (stat(path.c_str(), &buf) != 0)
+      continue;
+    infos.push_back(
+        {path, static_cast<uint64_t>(buf.st_size), buf.st_mtime});
+    total_size += static_cast<uint64_t>(buf.st_size);
+  }
+  if (total_size <= max_size_bytes_)
+    return;
+
+  std::sort(infos.begin(), infos.end(),
+            [](const CacheFileInfo& a, const CacheFileInfo& b) {
+              return a.last_used < b.last_used;
+            });
+  for (const CacheFileInfo& info : infos) {
+    if (total_size <= max_size_bytes_)
+      break;
+    if (remove(info.path.c_str()) != 0) {
+      PERFETTO_PLOG("Failed to remove %s", info.path.c_str());
+      continue;
+    }
+    total_size -= info.size;
+    stats_.files_evicted++;
+  }
+}
+
+std::unique_ptr<SymbolCache> GetPerfettoSymbolCache() {
+  const char* cache_dir = getenv("PERFETTO_SYMBOL_CACHE_DIR");
+  if (cache_dir == nullptr || *cache_dir == '\0')
+    return nullptr;
+  uint64_t max_size_bytes = SymbolCache::kDefaultMaxSizeBytes;
+  const char* max_mb = getenv("PERFETTO_SYMBOL_CACHE_MAX_MB");
+  if (max_mb != nullptr) {
+    base::Optional<uint64_t> parsed = base::CStringToUInt64(max_mb);
+    if (parsed) {
+      max_size_bytes = *parsed * 1024 * 1024;
+    } else {
+      PERFETTO_ELOG("Invalid PERFETTO_SYMBOL_CACHE_MAX_MB: %s", max_mb);
+    }
+  }
+  return std::unique_ptr<SymbolCache>(
+      new SymbolCache(cache_dir, max_size_bytes));
+}
+
+}  // namespace profiling
+}  // namespace perfetto
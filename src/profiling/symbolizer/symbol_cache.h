@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_PROFILING_SYMBOLIZER_SYMBOL_CACHE_H_
+#define SRC_PROFILING_SYMBOLIZER_SYMBOL_CACHE_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "src/profiling/symbolizer/symbolizer.h"
+
+namespace perfetto {
+namespace profiling {
+
+// On-disk cache of symbolized addresses, shared across runs (and processes)
+// that symbolize traces of the same builds.
+//
+// There is one file per binary, named after its build id (and load bias),
+// in a subdirectory of |cache_dir| for each Symbolizer::GetCacheKey(). Each
+// file has a table of the addresses that were symbolized, sorted so that they
+// can be binary searched directly in the memory mapped file, pointing to
+// their frames and a deduplicated string table. Addresses that the symbolizer
+// could not resolve are not cached, as that can be fixed by providing the
+// missing binaries or debug info.
+//
+// When the total size of the files exceeds |max_size_bytes|, Trim() removes
+// the least recently used ones.
+class SymbolCache {
+ public:
+  struct Stats {
+    // Addresses that were found (hits) or not (misses) in the cache.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t files_written = 0;
+    uint64_t files_evicted = 0;
+  };
+
+  static constexpr uint64_t kDefaultMaxSizeBytes = 1024ull * 1024 * 1024;
+
+  SymbolCache(std::string cache_dir, uint64_t max_size_bytes);
+
+  // For each of the |addresses|, returns its cached frames, or nullopt if it
+  // is not in the cache.
+  std::vector<base::Optional<std::vector<SymbolizedFrame>>> Lookup(
+      const std::string& symbolizer_key,
+      const std::string& build_id,
+      uint64_t load_bias,
+      const std::vector<uint64_t>& addresses);
+
+  // Adds the |frames| of the |addresses| (as returned by
+  // Symbolizer::Symbolize()) to the cache file of |build_id|. Addresses with
+  // no frames are skipped.
+  void Store(const std::string& symbolizer_key,
+             const std::string& build_id,
+             uint64_t load_bias,
+             const std::vector<uint64_t>& addresses,
+             const std::vector<std::vector<SymbolizedFrame>>& frames);
+
+  // Removes the least recently used files until the cache fits in
+  // |max_size_bytes|.
+  void Trim();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  std::string GetDirPath(const std::string& symbolizer_key) const;
+  std::string GetFilePath(const std::string& symbolizer_key,
+                          const std::string& build_id,
+                          uint64_t load_bias) const;
+
+  const std::string cache_dir_;
+  const uint64_t max_size_bytes_;
+  Stats stats_;
+};
+
+// Returns the cache in the directory in the PERFETTO_SYMBOL_CACHE_DIR
+// environment variable, with the size limit in PERFETTO_SYMBOL_CACHE_MAX_MB
+// (if set). Returns nullptr if PERFETTO_SYMBOL_CACHE_DIR is not set.
+std::unique_ptr<SymbolCache> GetPerfettoSymbolCache();
+
+}  // namespace profiling
+}  // namespace perfetto
+
+#endif  // SRC_PROFILING_SYMBOLIZER_SYMBOL_CACHE_H_
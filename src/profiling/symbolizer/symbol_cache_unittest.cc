@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/profiling/symbolizer/symbol_cache.h"
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace profiling {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr char kSymbolizer[] = "symbolizer-1";
+constexpr char kOtherSymbolizer[] = "symbolizer-2";
+
+SymbolizedFrame Frame(const char* function_name,
+                      const char* file_name,
+                      uint32_t line) {
+  SymbolizedFrame frame;
+  frame.function_name = function_name;
+  frame.file_name = file_name;
+  frame.line = line;
+  return frame;
+}
+
+MATCHER_P3(IsFrame, function_name, file_name, line, "") {
+  return arg.function_name == function_name && arg.file_name == file_name &&
+         arg.line == line;
+}
+
+class SymbolCacheTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    std::vector<std::string> files;
+    ASSERT_TRUE(base::ListFilesRecursive(dir_.path(), files).ok());
+    for (const std::string& file : files)
+      remove((dir_.path() + "/" + file).c_str());
+    base::Rmdir(dir_.path() + "/" + kSymbolizer);
+    base::Rmdir(dir_.path() + "/" + kOtherSymbolizer);
+  }
+
+  size_t NumFiles() {
+    std::vector<std::string> files;
+    EXPECT_TRUE(base::ListFilesRecursive(dir_.path(), files).ok());
+    return files.size();
+  }
+
+  base::TempDir dir_ = base::TempDir::Create();
+};
+
+TEST_F(SymbolCacheTest, StoreAndLookup) {
+  SymbolCache cache(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  EXPECT_FALSE(cache.Lookup(kSymbolizer, "build-id", 0, {0x10})[0]);
+
+  cache.Store(kSymbolizer, "build-id", 0, {0x20, 0x10, 0x30},
+              {{Frame("inlined", "a.h", 1), Frame("foo", "a.cc", 10)},
+               {Frame("bar", "a.cc", 20)},
+               {}});
+
+  // Another instance, as in a later run.
+  SymbolCache other(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  auto frames = other.Lookup(kSymbolizer, "build-id", 0, {0x10, 0x15, 0x20, 0x30});
+  ASSERT_EQ(frames.size(), 4u);
+  ASSERT_TRUE(frames[0]);
+  EXPECT_THAT(*frames[0], ElementsAre(IsFrame("bar", "a.cc", 20u)));
+  EXPECT_FALSE(frames[1]);
+  ASSERT_TRUE(frames[2]);
+  EXPECT_THAT(*frames[2], ElementsAre(IsFrame("inlined", "a.h", 1u),
+                                      IsFrame("foo", "a.cc", 10u)));
+  // Addresses that could not be symbolized are not cached.
+  EXPECT_FALSE(frames[3]);
+  EXPECT_EQ(other.stats().hits, 2u);
+  EXPECT_EQ(other.stats().misses, 2u);
+
+  // Different binary, load bias or symbolizer.
+  EXPECT_FALSE(other.Lookup(kSymbolizer, "other-build-id", 0, {0x10})[0]);
+  EXPECT_FALSE(other.Lookup(kSymbolizer, "build-id", 0x1000, {0x10})[0]);
+  EXPECT_FALSE(other.Lookup(kOtherSymbolizer, "build-id", 0, {0x10})[0]);
+}
+
+TEST_F(SymbolCacheTest, DoesNotStoreEmptyFrames) {
+  SymbolCache cache(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  cache.Store(kSymbolizer, "build-id", 0, {0x10, 0x20}, {{}, {}});
+  EXPECT_EQ(cache.stats().files_written, 0u);
+  EXPECT_EQ(NumFiles(), 0u);
+  EXPECT_FALSE(cache.Lookup(kSymbolizer, "build-id", 0, {0x10})[0]);
+}
+
+TEST_F(SymbolCacheTest, StoreMergesWithExistingFile) {
+  SymbolCache cache(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  cache.Store(kSymbolizer, "build-id", 0, {0x10}, {{Frame("foo", "a.cc", 10)}});
+  cache.Store(kSymbolizer, "build-id", 0, {0x20}, {{Frame("bar", "b.cc", 20)}});
+  EXPECT_EQ(cache.stats().files_written, 2u);
+  EXPECT_EQ(NumFiles(), 1u);
+
+  auto frames = cache.Lookup(kSymbolizer, "build-id", 0, {0x10, 0x20});
+  ASSERT_EQ(frames.size(), 2u);
+  ASSERT_TRUE(frames[0]);
+  EXPECT_THAT(*frames[0], ElementsAre(IsFrame("foo", "a.cc", 10u)));
+  ASSERT_TRUE(frames[1]);
+  EXPECT_THAT(*frames[1], ElementsAre(IsFrame("bar", "b.cc", 20u)));
+}
+
+TEST_F(SymbolCacheTest, IgnoresCorruptFile) {
+  SymbolCache cache(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  cache.Store(kSymbolizer, "build-id", 0, {0x10}, {{Frame("foo", "a.cc", 10)}});
+  std::vector<std::string> files;
+  ASSERT_TRUE(base::ListFilesRecursive(dir_.path(), files).ok());
+  ASSERT_EQ(files.size(), 1u);
+  std::string path = dir_.path() + "/" + files[0];
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(path, &contents));
+  contents.resize(contents.size() - 1);
+  base::ScopedFile fd(base::OpenFile(path, O_WRONLY | O_TRUNC));
+  ASSERT_TRUE(fd);
+  base::WriteAll(*fd, contents.data(), contents.size());
+  fd.reset();
+
+  EXPECT_FALSE(cache.Lookup(kSymbolizer, "build-id", 0, {0x10})[0]);
+  // Overwritten.
+  cache.Store(kSymbolizer, "build-id", 0, {0x20}, {{Frame("bar", "b.cc", 20)}});
+  auto frames = cache.Lookup(kSymbolizer, "build-id", 0, {0x20});
+  ASSERT_EQ(frames.size(), 1u);
+  EXPECT_TRUE(frames[0]);
+}
+
+TEST_F(SymbolCacheTest, TrimEvictsFiles) {
+  SymbolCache cache(dir_.path(), /*max_size_bytes=*/1);
+  cache.Store(kSymbolizer, "a", 0, {0x10}, {{Frame("foo", "a.cc", 10)}});
+  cache.Store(kSymbolizer, "b", 0, {0x10}, {{Frame("foo", "a.cc", 10)}});
+  EXPECT_EQ(NumFiles(), 2u);
+  cache.Trim();
+  EXPECT_EQ(NumFiles(), 0u);
+  EXPECT_EQ(cache.stats().files_evicted, 2u);
+
+  SymbolCache large_cache(dir_.path(), SymbolCache::kDefaultMaxSizeBytes);
+  large_cache.Store(kSymbolizer, "a", 0, {0x10}, {{Frame("foo", "a.cc", 10)}});
+  large_cache.Trim();
+  EXPECT_EQ(NumFiles(), 1u);
+  EXPECT_EQ(large_cache.stats().files_evicted, 0u);
+}
+
+}  // namespace
+}  // namespace profiling
+}  // namespace perfetto
@@ -16,6 +16,9 @@
 
 #include "src/profiling/symbolizer/symbolize_database.h"
 
+#include <inttypes.h>
+
+#include <algorithm>
 #include <map>
 #include <utility>
 #include <vector>
@@ -24,6 +27,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/profiling/symbolizer/symbol_cache.h"
 
 #include "protos/perfetto/trace/profiling/profile_common.pbzero.h"
 #include "protos/perfetto/trace/trace.pbzero.h"
@@ -106,20 +110,95 @@ std::map<UnsymbolizedMapping, std::vector<uint64_t>> GetUnsymbolizedFrames(
   }
   return res;
 }
+
+// Symbolizes the |rel_pcs| of |mapping| that are not in |cached|, and adds
+// the ones that could be symbolized to |cache|, under |symbolizer_key|.
+// Returns the frames of all |rel_pcs|, or an empty vector if none could be
+// symbolized.
+std::vector<std::vector<SymbolizedFrame>> SymbolizeMissing(
+    Symbolizer* symbolizer,
+    SymbolCache* cache,
+    const std::string& symbolizer_key,
+    const UnsymbolizedMapping& mapping,
+    const std::vector<uint64_t>& rel_pcs,
+    std::vector<base::Optional<std::vector<SymbolizedFrame>>> cached) {
+  std::vector<uint64_t> missing_pcs;
+  for (size_t i = 0; i < rel_pcs.size(); ++i) {
+    if (!cached[i])
+      missing_pcs.push_back(rel_pcs[i]);
+  }
+  std::vector<std::vector<SymbolizedFrame>> missing;
+  if (!missing_pcs.empty()) {
+    missing = symbolizer->Symbolize(mapping.name, mapping.build_id,
+                                    mapping.load_bias, missing_pcs);
+    if (!missing.empty()) {
+      PERFETTO_DCHECK(missing.size() == missing_pcs.size());
+      cache->Store(symbolizer_key, mapping.build_id, mapping.load_bias,
+                   missing_pcs, missing);
+    }
+  }
+  if (missing.empty() && missing_pcs.size() == rel_pcs.size())
+    return {};
+
+  std::vector<std::vector<SymbolizedFrame>> res(rel_pcs.size());
+  size_t next_missing = 0;
+  for (size_t i = 0; i < rel_pcs.size(); ++i) {
+    if (cached[i]) {
+      res[i] = std::move(*cached[i]);
+    } else if (!missing.empty()) {
+      res[i] = std::move(missing[next_missing++]);
+    }
+  }
+  return res;
+}
 }  // namespace
 
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
                        Symbolizer* symbolizer,
-                       std::function<void(const std::string&)> callback) {
+                       std::function<void(const std::string&)> callback,
+                       SymbolCache* cache) {
   PERFETTO_CHECK(symbolizer);
   auto unsymbolized =
       GetUnsymbolizedFrames(tp, symbolizer->BuildIdNeedsHexConversion());
+
+  // Look up all the mappings in the cache first, so that only the ones that
+  // are not fully cached get preloaded.
+  std::map<UnsymbolizedMapping,
+           std::vector<base::Optional<std::vector<SymbolizedFrame>>>>
+      cached;
+  std::vector<NameAndBuildIdPair> names_and_build_ids;
+  const std::string symbolizer_key = cache ? symbolizer->GetCacheKey() : "";
+  for (const auto& mapping_and_pcs : unsymbolized) {
+    const UnsymbolizedMapping& mapping = mapping_and_pcs.first;
+    bool fully_cached = false;
+    if (cache) {
+      auto& mapping_cached = cached[mapping];
+      mapping_cached = cache->Lookup(symbolizer_key, mapping.build_id,
+                                     mapping.load_bias, mapping_and_pcs.second);
+      fully_cached = std::all_of(
+          mapping_cached.begin(), mapping_cached.end(),
+          [](const base::Optional<std::vector<SymbolizedFrame>>& frames) {
+            return frames.has_value();
+          });
+    }
+    if (!fully_cached)
+      names_and_build_ids.emplace_back(mapping.name, mapping.build_id);
+  }
+  symbolizer->Preload(names_and_build_ids);
+
   for (auto it = unsymbolized.cbegin(); it != unsymbolized.cend(); ++it) {
     const auto& unsymbolized_mapping = it->first;
     const std::vector<uint64_t>& rel_pcs = it->second;
-    auto res = symbolizer->Symbolize(unsymbolized_mapping.name,
-                                     unsymbolized_mapping.build_id,
-                                     unsymbolized_mapping.load_bias, rel_pcs);
+    std::vector<std::vector<SymbolizedFrame>> res;
+    if (cache) {
+      res = SymbolizeMissing(symbolizer, cache, symbolizer_key,
+                             unsymbolized_mapping, rel_pcs,
+                             std::move(cached[unsymbolized_mapping]));
+    } else {
+      res = symbolizer->Symbolize(unsymbolized_mapping.name,
+                                  unsymbolized_mapping.build_id,
+                                  unsymbolized_mapping.load_bias, rel_pcs);
+    }
     if (res.empty())
       continue;
 
@@ -141,6 +220,20 @@ void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
     }
     callback(trace.SerializeAsString());
   }
+
+  if (cache) {
+    cache->Trim();
+    const SymbolCache::Stats& stats = cache->stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    PERFETTO_LOG("Symbol cache: %" PRIu64 "/%" PRIu64
+                 " addresses found (%.1f%%), %" PRIu64
+                 " files written, %" PRIu64 " evicted",
+                 stats.hits, lookups,
+                 lookups ? 100.0 * static_cast<double>(stats.hits) /
+                               static_cast<double>(lookups)
+                         : 0.0,
+                 stats.files_written, stats.files_evicted);
+  }
 }
 
 std::vector<std::string> GetPerfettoBinaryPath() {
@@ -28,12 +28,17 @@ namespace trace_processor {
 class TraceProcessor;
 }
 namespace profiling {
+class SymbolCache;
+
 std::vector<std::string> GetPerfettoBinaryPath();
 // Generate ModuleSymbol protos for all unsymbolized frames in the database.
 // Wrap them in proto-encoded TracePackets messages and call callback.
+// If |cache| is not null, addresses are looked up there first, and the ones
+// that were not there are added to it after being symbolized.
 void SymbolizeDatabase(trace_processor::TraceProcessor* tp,
                        Symbolizer* symbolizer,
-                       std::function<void(const std::string&)> callback);
+                       std::function<void(const std::string&)> callback,
+                       SymbolCache* cache = nullptr);
 }  // namespace profiling
 }  // namespace perfetto
 
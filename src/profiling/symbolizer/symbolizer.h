@@ -19,6 +19,7 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace perfetto {
@@ -44,11 +45,23 @@ class Symbolizer {
       const std::vector<uint64_t>& address) = 0;
   virtual ~Symbolizer();
 
+  // Called with the mappings (name and build id) that are about to be
+  // symbolized, before any call to Symbolize(). Allows preparing them up
+  // front, e.g. in parallel.
+  virtual void Preload(
+      const std::vector<std::pair<std::string, std::string>>&) {}
+
   // LocalSymbolizer uses a specific conversion of a symbol file's |build_id| to
   // bytes, but BreakpadSymbolizer requires the |build_id| as given. Return true
   // if the |build_id| passed to Symbolize() requires the conversion to bytes
   // and false otherwise.
   virtual bool BuildIdNeedsHexConversion() = 0;
+
+  // Identifies the implementation of the symbolizer and its version, as they
+  // can return different frames for the same address (e.g. with or without
+  // inlined functions). SymbolCache keeps the results of each apart. Only
+  // contains characters which are valid in file names.
+  virtual std::string GetCacheKey() = 0;
 };
 
 }  // namespace profiling
@@ -16,6 +16,10 @@
 
 #include "src/protozero/filtering/message_filter.h"
 
+#include <string.h>
+
+#include <algorithm>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_utils.h"
 
@@ -123,8 +127,31 @@ MessageFilter::FilteredMessage MessageFilter::FilterMessageFragments(
   for (size_t slice_idx = 0; slice_idx < num_slices; ++slice_idx) {
     const InputSlice& slice = slices[slice_idx];
     const uint8_t* data = static_cast<const uint8_t*>(slice.data);
-    for (size_t i = 0; i < slice.len; ++i)
-      FilterOneByte(data[i]);
+    const uint8_t* const end = data + slice.len;
+    while (data < end) {
+      // Fastpath: the payload of string/bytes fields and of submessages that
+      // are not allowed doesn't need any parsing. Copy (or skip) it in bulk
+      // rather than going through FilterOneByte() for each octet. The last
+      // byte of the payload is left to FilterOneByte(), as it might complete
+      // the current message and require popping the stack. Hence this never
+      // needs to pop any state, because the submessage length has been
+      // validated against |in_bytes_limit| when the field was tokenized.
+      StackState* state = &stack_.back();
+      if (state->eat_next_bytes > 1) {
+        const size_t n =
+            std::min(static_cast<size_t>(end - data),
+                     static_cast<size_t>(state->eat_next_bytes - 1));
+        if (state->passthrough_eaten_bytes) {
+          memcpy(out_, data, n);
+          out_ += n;
+        }
+        state->eat_next_bytes -= static_cast<uint32_t>(n);
+        state->in_bytes += static_cast<uint32_t>(n);
+        data += n;
+        continue;
+      }
+      FilterOneByte(*data++);
+    }
   }
 
   // Construct the output object.
@@ -117,7 +117,9 @@ class MessageFilter {
   uint32_t root_msg_index() { return root_msg_index_; }
 
  private:
-  // This is called by FilterMessageFragments().
+  // This is called by FilterMessageFragments() for all the bytes that need to
+  // be tokenized (i.e. everything but the payloads of len-delimited fields,
+  // which are copied or skipped in bulk).
   // Inlining allows the compiler turn the per-byte call/return into a for loop,
   // while, at the same time, keeping the code easy to read and reason about.
   // It gives a 20-25% speedup (265ms vs 215ms for a 25MB trace).
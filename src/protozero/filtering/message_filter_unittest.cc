@@ -25,6 +25,7 @@
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "protos/perfetto/trace/trace.pb.h"
+#include "src/protozero/filtering/filter_bytecode_generator.h"
 #include "src/protozero/filtering/filter_util.h"
 #include "src/protozero/filtering/message_filter.h"
 
@@ -273,6 +274,61 @@ TEST(MessageFilterTest, MalformedInput) {
   }
 }
 
+// Len-delimited payloads (allowed strings, denied strings and denied
+// submessages) are copied / skipped in bulk. Check that the output doesn't
+// depend on how the input is fragmented, in particular when the payloads span
+// across several fragments.
+TEST(MessageFilterTest, LargeLenDelimFieldsAcrossFragments) {
+  FilterBytecodeGenerator gen;
+  gen.AddSimpleField(1);     // Allowed string.
+  gen.AddNestedField(3, 1);  // Allowed submessage.
+  gen.EndMessage();
+  gen.AddSimpleField(1);  // Allowed string in the nested message.
+  gen.EndMessage();
+  std::string bytecode = gen.Serialize();
+  MessageFilter flt;
+  ASSERT_TRUE(flt.LoadFilterBytecode(bytecode.data(), bytecode.size()));
+
+  std::minstd_rand0 rnd(0);
+  HeapBuffered<Message> msg;
+  for (int i = 0; i < 20; i++) {
+    std::string str(rnd() % 1000, static_cast<char>('a' + i));
+    msg->AppendString(/*field_id=*/1, str);  // Allowed.
+    msg->AppendString(/*field_id=*/2, str);  // Denied.
+    auto* nest = msg->BeginNestedMessage<Message>(/*field_id=*/3);
+    nest->AppendString(/*field_id=*/1, str);  // Allowed.
+    nest->AppendString(/*field_id=*/2, str);  // Denied.
+    nest->Finalize();
+    nest = msg->BeginNestedMessage<Message>(/*field_id=*/4);  // Denied.
+    nest->AppendString(/*field_id=*/1, str);
+    nest->Finalize();
+  }
+  std::vector<uint8_t> encoded = msg.SerializeAsArray();
+
+  auto expected = flt.FilterMessage(encoded.data(), encoded.size());
+  ASSERT_FALSE(expected.error);
+  ASSERT_LT(expected.size, encoded.size());
+
+  for (size_t max_frag_len : {1, 3, 7, 64, 512}) {
+    std::vector<MessageFilter::InputSlice> slices;
+    for (size_t off = 0; off < encoded.size();) {
+      size_t len = std::min(1 + static_cast<size_t>(rnd()) % max_frag_len,
+                            encoded.size() - off);
+      slices.push_back({&encoded[off], len});
+      off += len;
+    }
+    auto res = flt.FilterMessageFragments(slices.data(), slices.size());
+    ASSERT_FALSE(res.error);
+    ASSERT_EQ(res.size, expected.size);
+    EXPECT_EQ(memcmp(res.data.get(), expected.data.get(), res.size), 0);
+  }
+
+  // A truncated message must be detected also when the truncation happens in
+  // the middle of a bulk-copied payload.
+  auto res = flt.FilterMessage(encoded.data(), encoded.size() - 10);
+  EXPECT_TRUE(res.error);
+}
+
 // It processes a real test trace with a real filter. The filter has been
 // obtained from the full upstream perfetto proto (+ re-adding the for_testing
 // field which got removed after adding most test traces). This covers the most
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/flat_hash_map.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// A read-only, compressed copy of the values of a finished NullableVector
+// which supports random access without decoding the whole vector.
+//
+// The encoding is picked based on the data when the vector is created:
+//  * integers are either bit-packed in blocks of kBlockSize values, each
+//    relative to the smallest value of the block (i.e. frame of reference
+//    encoding; this works especially well for sorted timestamps, as the
+//    values of a block are close to each other) or run-length encoded (for
+//    low cardinality ids like cpus and track ids, which usually repeat).
+//  * doubles are dictionary encoded, with bit-packed indices into the
+//    dictionary, when they have few distinct values.
+// Other types are never compressed.
+template <typename T>
+class CompressedVector {
+ public:
+  enum class Encoding {
+    kBitPacked,
+    kRunLength,
+    kDictionary,
+  };
+
+  // The number of values which share the same reference value and bit width
+  // in the bit-packed encoding.
+  static constexpr uint32_t kBlockSize = 128;
+
+  // Returns a compressed copy of |data| or nullptr if no encoding would use
+  // less memory than |data| itself.
+  static std::unique_ptr<CompressedVector<T>> Encode(
+      const std::deque<T>& data) {
+    return Encode(data, std::is_integral<T>(), std::is_floating_point<T>());
+  }
+
+  // Returns the value at |idx|.
+  T Get(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    switch (encoding_) {
+      case Encoding::kBitPacked: {
+        const Block& block = blocks_[idx / kBlockSize];
+        uint64_t bit = block.bit_offset + (idx % kBlockSize) * block.width;
+        return FromBits(block.reference + ReadBits(bit, block.width));
+      }
+      case Encoding::kRunLength:
+        return values_[KeyOf(idx, 0)];
+      case Encoding::kDictionary:
+        return values_[KeyOf(idx, 0)];
+    }
+    PERFETTO_FATAL("For GCC");
+  }
+
+  // Run-length and dictionary encoded vectors map each index to a key (the
+  // index of the run or of the dictionary entry) and each key to a value.
+  // Scans can use this to evaluate a constraint once per key rather than once
+  // per row.
+  bool HasKeys() const { return encoding_ != Encoding::kBitPacked; }
+
+  // Returns the number of keys.
+  uint32_t key_count() const { return static_cast<uint32_t>(values_.size()); }
+
+  // Returns the value of |key|.
+  T KeyValue(uint32_t key) const { return values_[key]; }
+
+  // Returns the key of the value at |idx|. |hint| should be the key returned
+  // by the previous call: sequential scans of run-length encoded vectors
+  // avoid the binary search over the runs this way.
+  uint32_t KeyOf(uint32_t idx, uint32_t hint) const {
+    PERFETTO_DCHECK(HasKeys());
+    if (encoding_ == Encoding::kDictionary)
+      return static_cast<uint32_t>(ReadBits(uint64_t(idx) * width_, width_));
+
+    PERFETTO_DCHECK(hint < run_ends_.size());
+    if (idx < run_ends_[hint] && (hint == 0 || idx >= run_ends_[hint - 1]))
+      return hint;
+    if (hint + 1 < run_ends_.size() && idx >= run_ends_[hint] &&
+        idx < run_ends_[hint + 1]) {
+      return hint + 1;
+    }
+    auto it = std::upper_bound(run_ends_.begin(), run_ends_.end(), idx);
+    return static_cast<uint32_t>(std::distance(run_ends_.begin(), it));
+  }
+
+  // Decodes all the values, in order, into |out|.
+  void DecodeInto(std::deque<T>* out) const {
+    for (uint32_t i = 0; i < size_; ++i)
+      out->emplace_back(Get(i));
+  }
+
+  Encoding encoding() const { return encoding_; }
+  uint32_t size() const { return size_; }
+
+  // Returns the approximate number of bytes used by the encoded data.
+  size_t size_bytes() const {
+    return words_.size() * sizeof(uint64_t) + blocks_.size() * sizeof(Block) +
+           values_.size() * sizeof(T) + run_ends_.size() * sizeof(uint32_t);
+  }
+
+ private:
+  struct Block {
+    uint64_t reference;
+    uint64_t bit_offset;
+    uint32_t width;
+  };
+
+  explicit CompressedVector(Encoding encoding, uint32_t size)
+      : encoding_(encoding), size_(size) {}
+
+  static std::unique_ptr<CompressedVector<T>> Encode(const std::deque<T>& data,
+                                                     std::true_type,
+                                                     std::false_type) {
+    uint32_t size = static_cast<uint32_t>(data.size());
+    size_t raw_bytes = data.size() * sizeof(T);
+
+    uint64_t bit_packed_bits = 0;
+    uint32_t runs = 0;
+    for (uint32_t i = 0; i < size; i += kBlockSize) {
+      uint32_t end = std::min(size, i + kBlockSize);
+      uint64_t reference = MinBits(data, i, end);
+      uint32_t width = BitWidth(MaxBits(data, i, end) - reference);
+      bit_packed_bits += uint64_t(width) * (end - i);
+    }
+    for (uint32_t i = 0; i < size; ++i) {
+      if (i == 0 || data[i] != data[i - 1])
+        runs++;
+    }
+    size_t bit_packed_bytes = (bit_packed_bits + 63) / 64 * sizeof(uint64_t) +
+                              (size + kBlockSize - 1) / kBlockSize *
+                                  sizeof(Block);
+    size_t run_length_bytes = runs * (sizeof(T) + sizeof(uint32_t));
+    if (std::min(bit_packed_bytes, run_length_bytes) >= raw_bytes)
+      return nullptr;
+
+    // Random access to run-length encoded values needs a binary search over
+    // the runs, so only prefer it when it saves a lot of memory.
+    if (run_length_bytes * 2 <= bit_packed_bytes) {
+      std::unique_ptr<CompressedVector<T>> cv(
+          new CompressedVector<T>(Encoding::kRunLength, size));
+      cv->values_.reserve(runs);
+      cv->run_ends_.reserve(runs);
+      for (uint32_t i = 0; i < size; ++i) {
+        if (i == 0 || data[i] != data[i - 1]) {
+          cv->values_.push_back(data[i]);
+          cv->run_ends_.push_back(i + 1);
+        } else {
+          cv->run_ends_.back() = i + 1;
+        }
+      }
+      return cv;
+    }
+
+    std::unique_ptr<CompressedVector<T>> cv(
+        new CompressedVector<T>(Encoding::kBitPacked, size));
+    cv->words_.resize((bit_packed_bits + 63) / 64 + 1);
+    uint64_t bit = 0;
+    for (uint32_t i = 0; i < size; i += kBlockSize) {
+      uint32_t end = std::min(size, i + kBlockSize);
+      Block block;
+      block.reference = MinBits(data, i, end);
+      block.width = BitWidth(MaxBits(data, i, end) - block.reference);
+      block.bit_offset = bit;
+      for (uint32_t j = i; j < end; ++j) {
+        cv->WriteBits(bit, block.width, ToBits(data[j]) - block.reference);
+        bit += block.width;
+      }
+      cv->blocks_.push_back(block);
+    }
+    return cv;
+  }
+
+  static std::unique_ptr<CompressedVector<T>> Encode(const std::deque<T>& data,
+                                                     std::false_type,
+                                                     std::true_type) {
+    // Dictionaries larger than this are unlikely to save much memory.
+    static constexpr uint32_t kMaxDictionarySize = 1 << 16;
+
+    uint32_t size = static_cast<uint32_t>(data.size());
+    std::vector<uint32_t> codes(size);
+    std::vector<T> dictionary;
+    base::FlatHashMap<uint64_t, uint32_t> code_for_bits;
+    for (uint32_t i = 0; i < size; ++i) {
+      // Doubles are keyed by their bit pattern so that -0.0 and NaNs round
+      // trip exactly.
+      uint64_t bits;
+      static_assert(sizeof(T) == sizeof(bits), "Unexpected floating type");
+      memcpy(&bits, &data[i], sizeof(bits));
+      auto it_and_inserted = code_for_bits.Insert(
+          bits, static_cast<uint32_t>(dictionary.size()));
+      if (it_and_inserted.second) {
+        if (dictionary.size() == kMaxDictionarySize)
+          return nullptr;
+        dictionary.push_back(data[i]);
+      }
+      codes[i] = *it_and_inserted.first;
+    }
+
+    uint32_t width =
+        dictionary.empty() ? 0 : BitWidth(dictionary.size() - 1);
+    uint64_t bits = uint64_t(width) * size;
+    size_t dictionary_bytes = (bits + 63) / 64 * sizeof(uint64_t) +
+                              dictionary.size() * sizeof(T);
+    if (dictionary_bytes >= data.size() * sizeof(T))
+      return nullptr;
+
+    std::unique_ptr<CompressedVector<T>> cv(
+        new CompressedVector<T>(Encoding::kDictionary, size));
+    cv->values_ = std::move(dictionary);
+    cv->width_ = width;
+    cv->words_.resize((bits + 63) / 64 + 1);
+    for (uint32_t i = 0; i < size; ++i)
+      cv->WriteBits(uint64_t(i) * width, width, codes[i]);
+    return cv;
+  }
+
+  static std::unique_ptr<CompressedVector<T>> Encode(const std::deque<T>&,
+                                                     std::false_type,
+                                                     std::false_type) {
+    return nullptr;
+  }
+
+  // Maps integers to unsigned values with the same (wrapping) differences,
+  // so that all integer types can share the bit-packing code.
+  static uint64_t ToBits(T value) {
+    return static_cast<uint64_t>(static_cast<int64_t>(value));
+  }
+  static T FromBits(uint64_t bits) {
+    return FromBits(bits, std::is_integral<T>());
+  }
+  static T FromBits(uint64_t bits, std::true_type) {
+    return static_cast<T>(static_cast<int64_t>(bits));
+  }
+  static T FromBits(uint64_t, std::false_type) {
+    PERFETTO_FATAL("Only integers are bit-packed");
+  }
+
+  // Returns the minimum and maximum of data[start, end) as values of ToBits()
+  // which keep the ordering of T (i.e. for which the differences fit in 64
+  // bits).
+  static uint64_t MinBits(const std::deque<T>& data,
+                          uint32_t start,
+                          uint32_t end) {
+    auto begin = data.begin() + static_cast<ptrdiff_t>(start);
+    return ToBits(
+        *std::min_element(begin, begin + static_cast<ptrdiff_t>(end - start)));
+  }
+  static uint64_t MaxBits(const std::deque<T>& data,
+                          uint32_t start,
+                          uint32_t end) {
+    auto begin = data.begin() + static_cast<ptrdiff_t>(start);
+    return ToBits(
+        *std::max_element(begin, begin + static_cast<ptrdiff_t>(end - start)));
+  }
+
+  // Returns the number of bits needed to store |value|.
+  static uint32_t BitWidth(uint64_t value) {
+    uint32_t width = 0;
+    while (width < 64 && (value >> width) != 0)
+      width++;
+    return width;
+  }
+
+  uint64_t ReadBits(uint64_t bit, uint32_t width) const {
+    if (width == 0)
+      return 0;
+    uint64_t word = bit / 64;
+    uint32_t shift = static_cast<uint32_t>(bit % 64);
+    uint64_t value = words_[word] >> shift;
+    if (shift + width > 64)
+      value |= words_[word + 1] << (64 - shift);
+    return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+  }
+
+  void WriteBits(uint64_t bit, uint32_t width, uint64_t value) {
+    if (width == 0)
+      return;
+    uint64_t word = bit / 64;
+    uint32_t shift = static_cast<uint32_t>(bit % 64);
+    words_[word] |= value << shift;
+    if (shift + width > 64)
+      words_[word + 1] |= value >> (64 - shift);
+  }
+
+  Encoding encoding_;
+  uint32_t size_ = 0;
+
+  // Bit-packed values (kBitPacked) or dictionary indices (kDictionary). Has
+  // an extra trailing word so that reads never go out of bounds.
+  std::vector<uint64_t> words_;
+
+  // kBitPacked only: one entry for every kBlockSize values.
+  std::vector<Block> blocks_;
+
+  // The value of each run (kRunLength) or the dictionary (kDictionary).
+  std::vector<T> values_;
+
+  // kRunLength only: the index after the last value of each run.
+  std::vector<uint32_t> run_ends_;
+
+  // kDictionary only: the bit width of the dictionary indices.
+  uint32_t width_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_VECTOR_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/compressed_vector.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+template <typename T>
+void AssertRoundTrips(const std::deque<T>& data,
+                      const CompressedVector<T>& cv) {
+  ASSERT_EQ(cv.size(), data.size());
+  for (uint32_t i = 0; i < data.size(); ++i)
+    ASSERT_EQ(cv.Get(i), data[i]) << "at index " << i;
+
+  std::deque<T> decoded;
+  cv.DecodeInto(&decoded);
+  ASSERT_EQ(decoded, data);
+}
+
+TEST(CompressedVector, BitPackedSortedTimestamps) {
+  std::minstd_rand0 rnd_engine(42);
+  std::deque<int64_t> data;
+  int64_t ts = 1000000000000;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ts += rnd_engine() % 100000;
+    data.push_back(ts);
+  }
+
+  auto cv = CompressedVector<int64_t>::Encode(data);
+  ASSERT_NE(cv, nullptr);
+  ASSERT_EQ(cv->encoding(), CompressedVector<int64_t>::Encoding::kBitPacked);
+  ASSERT_LT(cv->size_bytes(), data.size() * sizeof(int64_t) / 2);
+  AssertRoundTrips(data, *cv);
+}
+
+TEST(CompressedVector, BitPackedFullRange) {
+  std::deque<int64_t> data;
+  for (int64_t i = 0; i < 1000; ++i)
+    data.push_back(i);
+  data[5] = std::numeric_limits<int64_t>::min();
+  data[6] = std::numeric_limits<int64_t>::max();
+  data.push_back(-1);
+
+  auto cv = CompressedVector<int64_t>::Encode(data);
+  ASSERT_NE(cv, nullptr);
+  AssertRoundTrips(data, *cv);
+}
+
+TEST(CompressedVector, RunLength) {
+  std::deque<uint32_t> data;
+  for (uint32_t cpu = 0; cpu < 8; ++cpu) {
+    for (uint32_t i = 0; i < 500 + cpu; ++i)
+      data.push_back(cpu % 3);
+  }
+
+  auto cv = CompressedVector<uint32_t>::Encode(data);
+  ASSERT_NE(cv, nullptr);
+  ASSERT_EQ(cv->encoding(), CompressedVector<uint32_t>::Encoding::kRunLength);
+  ASSERT_TRUE(cv->HasKeys());
+  ASSERT_EQ(cv->key_count(), 8u);
+  AssertRoundTrips(data, *cv);
+
+  // Sequential and random lookups of keys should agree.
+  uint32_t key = 0;
+  for (uint32_t i = 0; i < data.size(); ++i) {
+    key = cv->KeyOf(i, key);
+    ASSERT_EQ(cv->KeyValue(key), data[i]);
+    ASSERT_EQ(cv->KeyOf(i, 0), key);
+  }
+}
+
+TEST(CompressedVector, Dictionary) {
+  std::deque<double> data;
+  for (uint32_t i = 0; i < 1000; ++i)
+    data.push_back(i % 3 == 0 ? 0.5 : static_cast<double>(i % 5));
+  data.push_back(-0.0);
+
+  auto cv = CompressedVector<double>::Encode(data);
+  ASSERT_NE(cv, nullptr);
+  ASSERT_EQ(cv->encoding(), CompressedVector<double>::Encoding::kDictionary);
+  ASSERT_EQ(cv->key_count(), 7u);
+  ASSERT_LT(cv->size_bytes(), data.size() * sizeof(double) / 8);
+  AssertRoundTrips(data, *cv);
+  ASSERT_TRUE(std::signbit(cv->Get(1000)));
+}
+
+TEST(CompressedVector, Incompressible) {
+  std::minstd_rand0 rnd_engine(42);
+  std::deque<double> doubles;
+  std::deque<int32_t> ints;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    doubles.push_back(static_cast<double>(rnd_engine()) / 3);
+    ints.push_back(static_cast<int32_t>(rnd_engine() << 1));
+  }
+  ASSERT_EQ(CompressedVector<double>::Encode(doubles), nullptr);
+  ASSERT_EQ(CompressedVector<int32_t>::Encode(ints), nullptr);
+  ASSERT_EQ(CompressedVector<int32_t>::Encode(std::deque<int32_t>()), nullptr);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
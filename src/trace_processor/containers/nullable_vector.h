@@ -20,9 +20,11 @@
 #include <stdint.h>
 
 #include <deque>
+#include <memory>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/compressed_vector.h"
 #include "src/trace_processor/containers/row_map.h"
 
 namespace perfetto {
@@ -49,6 +51,9 @@ class NullableVectorBase {
 // By default, for each null value, it only uses a single bit inside the
 // BitVector at a slight cost (searching the BitVector to find the index into
 // the std::deque) when looking up the data.
+//
+// Once no more data will be added, sparse vectors can be compressed (see
+// Compress()) to reduce their memory usage.
 template <typename T>
 class NullableVector : public NullableVectorBase {
  private:
@@ -89,7 +94,7 @@ class NullableVector : public NullableVectorBase {
       return contains ? base::make_optional(data_[idx]) : base::nullopt;
     } else {
       auto opt_row = valid_.RowOf(idx);
-      return opt_row ? base::make_optional(data_[*opt_row]) : base::nullopt;
+      return opt_row ? base::make_optional(DataAt(*opt_row)) : base::nullopt;
     }
   }
 
@@ -107,13 +112,13 @@ class NullableVector : public NullableVectorBase {
     if (mode_ == Mode::kDense) {
       return data_[valid_.Get(non_null_idx)];
     } else {
-      PERFETTO_DCHECK(non_null_idx < data_.size());
-      return data_[non_null_idx];
+      return DataAt(non_null_idx);
     }
   }
 
   // Adds the given value to the NullableVector.
   void Append(T val) {
+    MaybeDecompress();
     data_.emplace_back(val);
     valid_.Insert(size_++);
   }
@@ -137,6 +142,7 @@ class NullableVector : public NullableVectorBase {
 
   // Sets the value at |idx| to the given |val|.
   void Set(uint32_t idx, T val) {
+    MaybeDecompress();
     if (mode_ == Mode::kDense) {
       if (!valid_.Contains(idx)) {
         valid_.Insert(idx);
@@ -165,12 +171,48 @@ class NullableVector : public NullableVectorBase {
   // Returns whether data in this NullableVector is stored densely.
   bool IsDense() const { return mode_ == Mode::kDense; }
 
+  // Replaces the non-null values with a compressed copy, if one would use
+  // less memory. Reads decode the values on the fly; a later Append() or Set()
+  // decompresses all the values again, so this should only be called once the
+  // vector is finished. Dense vectors, which are meant to be updated, are
+  // never compressed.
+  void Compress() {
+    if (mode_ == Mode::kDense || compressed_)
+      return;
+    compressed_ = CompressedVector<T>::Encode(data_);
+    if (compressed_)
+      std::deque<T>().swap(data_);
+  }
+
+  // Returns the compressed values or nullptr if the vector is not compressed.
+  const CompressedVector<T>* compressed() const { return compressed_.get(); }
+
+  // Returns the approximate number of bytes used to store the non-null values.
+  size_t data_size_bytes() const {
+    return compressed_ ? compressed_->size_bytes() : data_.size() * sizeof(T);
+  }
+
  private:
   explicit NullableVector(Mode mode) : mode_(mode) {}
 
+  T DataAt(uint32_t data_idx) const {
+    if (compressed_)
+      return compressed_->Get(data_idx);
+    PERFETTO_DCHECK(data_idx < data_.size());
+    return data_[data_idx];
+  }
+
+  void MaybeDecompress() {
+    if (PERFETTO_LIKELY(!compressed_))
+      return;
+    compressed_->DecodeInto(&data_);
+    compressed_.reset();
+  }
+
   Mode mode_ = Mode::kSparse;
 
   std::deque<T> data_;
+  std::unique_ptr<CompressedVector<T>> compressed_;
   RowMap valid_;
   uint32_t size_ = 0;
 };
@@ -64,3 +64,114 @@ static void BM_NullableVectorGetNonNull(benchmark::State& state) {
   }
 }
 BENCHMARK(BM_NullableVectorGetNonNull);
+
+namespace {
+
+// Fills |nv| with values resembling the columns of large trace tables: sorted
+// timestamps, low-cardinality ids which repeat in runs (e.g. cpu, track_id)
+// and doubles with few distinct values (e.g. counter values).
+void FillSortedTimestamps(
+    perfetto::trace_processor::NullableVector<int64_t>* nv) {
+  std::minstd_rand0 rnd_engine(42);
+  int64_t ts = 1000000000000;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    ts += rnd_engine() % 100000;
+    nv->Append(ts);
+  }
+}
+
+void FillIdRuns(perfetto::trace_processor::NullableVector<uint32_t>* nv) {
+  std::minstd_rand0 rnd_engine(42);
+  uint32_t id = 0;
+  for (uint32_t i = 0; i < kSize; ++i) {
+    if (rnd_engine() % 256 == 0)
+      id = rnd_engine() % 8;
+    nv->Append(id);
+  }
+}
+
+void FillFewDistinctDoubles(
+    perfetto::trace_processor::NullableVector<double>* nv) {
+  std::minstd_rand0 rnd_engine(42);
+  for (uint32_t i = 0; i < kSize; ++i)
+    nv->Append(static_cast<double>(rnd_engine() % 64) * 1.5);
+}
+
+// Benchmarks random reads from a vector filled by |fill|, compressed when
+// state.range(0) is non-zero, and reports the memory used per value.
+template <typename T>
+void RunCompressedGet(
+    benchmark::State& state,
+    void (*fill)(perfetto::trace_processor::NullableVector<T>*)) {
+  perfetto::trace_processor::NullableVector<T> nv;
+  fill(&nv);
+  if (state.range(0))
+    nv.Compress();
+
+  std::vector<uint32_t> idx_pool(kPoolSize);
+  std::minstd_rand0 rnd_engine(42);
+  for (uint32_t i = 0; i < kPoolSize; ++i)
+    idx_pool[i] = rnd_engine() % kSize;
+
+  uint32_t pool_idx = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nv.GetNonNull(idx_pool[pool_idx]));
+    pool_idx = (pool_idx + 1) % kPoolSize;
+  }
+  state.counters["bytes_per_value"] =
+      static_cast<double>(nv.data_size_bytes()) / kSize;
+}
+
+// Benchmarks sequential scans over all the values of a vector filled by
+// |fill|, compressed when state.range(0) is non-zero.
+template <typename T>
+void RunCompressedScan(
+    benchmark::State& state,
+    void (*fill)(perfetto::trace_processor::NullableVector<T>*)) {
+  perfetto::trace_processor::NullableVector<T> nv;
+  fill(&nv);
+  if (state.range(0))
+    nv.Compress();
+
+  for (auto _ : state) {
+    T sum = 0;
+    for (uint32_t i = 0; i < kSize; ++i)
+      sum += nv.GetNonNull(i);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * kSize);
+  state.counters["bytes_per_value"] =
+      static_cast<double>(nv.data_size_bytes()) / kSize;
+}
+
+}  // namespace
+
+static void BM_NullableVectorSortedTimestampsGet(benchmark::State& state) {
+  RunCompressedGet<int64_t>(state, &FillSortedTimestamps);
+}
+BENCHMARK(BM_NullableVectorSortedTimestampsGet)->Arg(0)->Arg(1);
+
+static void BM_NullableVectorSortedTimestampsScan(benchmark::State& state) {
+  RunCompressedScan<int64_t>(state, &FillSortedTimestamps);
+}
+BENCHMARK(BM_NullableVectorSortedTimestampsScan)->Arg(0)->Arg(1);
+
+static void BM_NullableVectorIdRunsGet(benchmark::State& state) {
+  RunCompressedGet<uint32_t>(state, &FillIdRuns);
+}
+BENCHMARK(BM_NullableVectorIdRunsGet)->Arg(0)->Arg(1);
+
+static void BM_NullableVectorIdRunsScan(benchmark::State& state) {
+  RunCompressedScan<uint32_t>(state, &FillIdRuns);
+}
+BENCHMARK(BM_NullableVectorIdRunsScan)->Arg(0)->Arg(1);
+
+static void BM_NullableVectorFewDistinctDoublesGet(benchmark::State& state) {
+  RunCompressedGet<double>(state, &FillFewDistinctDoubles);
+}
+BENCHMARK(BM_NullableVectorFewDistinctDoublesGet)->Arg(0)->Arg(1);
+
+static void BM_NullableVectorFewDistinctDoublesScan(benchmark::State& state) {
+  RunCompressedScan<double>(state, &FillFewDistinctDoubles);
+}
+BENCHMARK(BM_NullableVectorFewDistinctDoublesScan)->Arg(0)->Arg(1);
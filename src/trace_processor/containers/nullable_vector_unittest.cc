@@ -98,6 +98,46 @@ TEST(NullableVector, Dense) {
   ASSERT_EQ(sv.GetNonNull(2), 2);
 }
 
+TEST(NullableVector, Compress) {
+  NullableVector<int64_t> sv;
+  for (int64_t i = 0; i < 1000; ++i) {
+    if (i % 3 == 0) {
+      sv.AppendNull();
+    } else {
+      sv.Append(1000000 + i);
+    }
+  }
+  size_t uncompressed_bytes = sv.data_size_bytes();
+
+  sv.Compress();
+  ASSERT_NE(sv.compressed(), nullptr);
+  ASSERT_LT(sv.data_size_bytes(), uncompressed_bytes);
+  ASSERT_EQ(sv.size(), 1000u);
+  ASSERT_EQ(sv.Get(0), base::nullopt);
+  ASSERT_EQ(sv.Get(1), base::Optional<int64_t>(1000001));
+  ASSERT_EQ(sv.Get(998), base::Optional<int64_t>(1000998));
+  ASSERT_EQ(sv.GetNonNull(0), 1000001);
+
+  // Mutating the vector decompresses it.
+  sv.Set(0, 5);
+  sv.Append(6);
+  ASSERT_EQ(sv.compressed(), nullptr);
+  ASSERT_EQ(sv.Get(0), base::Optional<int64_t>(5));
+  ASSERT_EQ(sv.Get(1), base::Optional<int64_t>(1000001));
+  ASSERT_EQ(sv.Get(999), base::nullopt);
+  ASSERT_EQ(sv.Get(1000), base::Optional<int64_t>(6));
+}
+
+TEST(NullableVector, CompressDenseIsNoop) {
+  auto sv = NullableVector<int64_t>::Dense();
+  for (int64_t i = 0; i < 1000; ++i)
+    sv.Append(0);
+
+  sv.Compress();
+  ASSERT_EQ(sv.compressed(), nullptr);
+  ASSERT_EQ(sv.Get(999), base::Optional<int64_t>(0));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
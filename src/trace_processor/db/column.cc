@@ -73,6 +73,26 @@ Column::Column(const char* name,
   }
 }
 
+void Column::Compress() {
+  switch (type_) {
+    case ColumnType::kInt32:
+      mutable_nullable_vector<int32_t>()->Compress();
+      break;
+    case ColumnType::kUint32:
+      mutable_nullable_vector<uint32_t>()->Compress();
+      break;
+    case ColumnType::kInt64:
+      mutable_nullable_vector<int64_t>()->Compress();
+      break;
+    case ColumnType::kDouble:
+      mutable_nullable_vector<double>()->Compress();
+      break;
+    case ColumnType::kString:
+    case ColumnType::kId:
+      break;
+  }
+}
+
 Column Column::IdColumn(Table* table, uint32_t col_idx, uint32_t row_map_idx) {
   return Column("id", ColumnType::kId, kIdFlags, table, col_idx, row_map_idx,
                 nullptr, nullptr);
@@ -207,6 +227,14 @@ template <typename T, bool is_nullable, typename Comparator>
 void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
                                                  RowMap* rm,
                                                  Comparator cmp) const {
+  if (!is_nullable) {
+    const CompressedVector<T>* compressed = nullable_vector<T>().compressed();
+    if (compressed && compressed->HasKeys()) {
+      FilterIntoCompressedSlow<T>(op, rm, cmp);
+      return;
+    }
+  }
+
   switch (op) {
     case FilterOp::kLt:
       row_map().FilterInto(rm, [this, &cmp](uint32_t idx) {
@@ -268,6 +296,46 @@ void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
   }
 }
 
+template <typename T, typename Comparator>
+void Column::FilterIntoCompressedSlow(FilterOp op,
+                                      RowMap* rm,
+                                      Comparator cmp) const {
+  const CompressedVector<T>& compressed = *nullable_vector<T>().compressed();
+  std::vector<uint8_t> key_matches(compressed.key_count());
+  for (uint32_t key = 0; key < compressed.key_count(); ++key) {
+    int res = cmp(compressed.KeyValue(key));
+    switch (op) {
+      case FilterOp::kLt:
+        key_matches[key] = res < 0;
+        break;
+      case FilterOp::kEq:
+        key_matches[key] = res == 0;
+        break;
+      case FilterOp::kGt:
+        key_matches[key] = res > 0;
+        break;
+      case FilterOp::kNe:
+        key_matches[key] = res != 0;
+        break;
+      case FilterOp::kLe:
+        key_matches[key] = res <= 0;
+        break;
+      case FilterOp::kGe:
+        key_matches[key] = res >= 0;
+        break;
+      case FilterOp::kIsNull:
+      case FilterOp::kIsNotNull:
+        PERFETTO_FATAL("Should be handled above");
+    }
+  }
+
+  uint32_t key = 0;
+  row_map().FilterInto(rm, [&compressed, &key_matches, &key](uint32_t idx) {
+    key = compressed.KeyOf(idx, key);
+    return key_matches[key] != 0;
+  });
+}
+
 void Column::FilterIntoStringSlow(FilterOp op,
                                   SqlValue value,
                                   RowMap* rm) const {
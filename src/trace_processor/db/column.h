@@ -451,6 +451,9 @@ class Column {
   Column(const Column&) = delete;
   Column& operator=(const Column&) = delete;
 
+  // Compresses the data backing this column (see NullableVector::Compress).
+  void Compress();
+
   // Gets the value of the Column at the given |row|.
   SqlValue GetAtIdx(uint32_t idx) const {
     switch (type_) {
@@ -543,6 +546,14 @@ class Column {
                                            RowMap* rm,
                                            Comparator cmp) const;
 
+  // Slow path filter method for non-null numerics stored in a run-length or
+  // dictionary encoded NullableVector: evaluates the comparator once for each
+  // run or dictionary entry and then only checks the key of each row.
+  template <typename T, typename Comparator = int(T)>
+  void FilterIntoCompressedSlow(FilterOp op,
+                                RowMap* rm,
+                                Comparator cmp) const;
+
   // Slow path filter method for strings which will perform a full table scan.
   void FilterIntoStringSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
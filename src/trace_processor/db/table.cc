@@ -54,6 +54,11 @@ Table Table::Copy() const {
   return table;
 }
 
+void Table::Compress() {
+  for (Column& col : columns_)
+    col.Compress();
+}
+
 Table Table::CopyExceptRowMaps() const {
   Table table(string_pool_, nullptr);
   table.row_count_ = row_count_;
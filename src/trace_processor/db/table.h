@@ -214,6 +214,11 @@ class Table {
   // Creates a copy of this table.
   Table Copy() const;
 
+  // Compresses the data of the numeric columns of this table to reduce its
+  // memory usage. Should be called once no more rows will be added to the
+  // table: modifying a column afterwards decompresses it again.
+  void Compress();
+
   uint32_t row_count() const { return row_count_; }
   const std::vector<RowMap>& row_maps() const { return row_maps_; }
 
@@ -277,8 +277,9 @@ std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> FocusTable(
 }  // namespace
 
 ExperimentalFlamegraphGenerator::ExperimentalFlamegraphGenerator(
-    TraceProcessorContext* context)
-    : context_(context) {}
+    TraceProcessorContext* context,
+    FlamegraphCache* cache)
+    : context_(context), cache_(cache) {}
 
 ExperimentalFlamegraphGenerator::~ExperimentalFlamegraphGenerator() = default;
 
@@ -333,12 +334,10 @@ std::unique_ptr<Table> ExperimentalFlamegraphGenerator::ComputeTable(
     auto* tracker = HeapGraphTracker::GetOrCreate(context_);
     table = tracker->BuildFlamegraph(values.ts, *values.upid);
   } else if (values.profile_type == ProfileType::kNative) {
-    table = BuildNativeHeapProfileFlamegraph(context_->storage.get(),
-                                             *values.upid, values.ts);
+    table = cache_->BuildNativeHeapProfileFlamegraph(*values.upid, values.ts);
   } else if (values.profile_type == ProfileType::kPerf) {
-    table = BuildNativeCallStackSamplingFlamegraph(
-        context_->storage.get(), values.upid, values.upid_group,
-        values.time_constraints);
+    table = cache_->BuildNativeCallStackSamplingFlamegraph(
+        values.upid, values.upid_group, values.time_constraints);
   }
   if (!values.focus_str.empty()) {
     table =
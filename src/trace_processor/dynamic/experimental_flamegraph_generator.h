@@ -41,7 +41,10 @@ class ExperimentalFlamegraphGenerator
     std::string focus_str;
   };
 
-  explicit ExperimentalFlamegraphGenerator(TraceProcessorContext* context);
+  // |cache| is used for the native heap profile and perf flamegraphs, and
+  // must outlive this object.
+  ExperimentalFlamegraphGenerator(TraceProcessorContext* context,
+                                  FlamegraphCache* cache);
   virtual ~ExperimentalFlamegraphGenerator() override;
 
   Table::Schema CreateSchema() override;
@@ -53,6 +56,7 @@ class ExperimentalFlamegraphGenerator
 
  private:
   TraceProcessorContext* context_ = nullptr;
+  FlamegraphCache* cache_ = nullptr;
 };
 
 }  // namespace trace_processor
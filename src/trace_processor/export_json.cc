@@ -18,7 +18,6 @@
 #include "src/trace_processor/export_json.h"
 
 #include <stdio.h>
-#include <sstream>
 
 #include <algorithm>
 #include <cinttypes>
@@ -31,6 +30,7 @@
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
 #include "src/trace_processor/importers/json/json_utils.h"
 #include "src/trace_processor/storage/metadata.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -92,6 +92,219 @@ const char* GetNonNullString(const TraceStorage* storage,
              : storage->GetString(*id).c_str();
 }
 
+// Serializes Json::Values into a string, producing the same bytes as a
+// Json::StreamWriter with empty indentation. Unlike the latter, this doesn't
+// need a std::ostream and allows appending to an existing buffer, so that
+// events can be written out without intermediate copies.
+class JsonSerializer {
+ public:
+  explicit JsonSerializer(std::string* out) : out_(out) {}
+
+  void Append(const char* str) { out_->append(str); }
+
+  void AppendInt(int64_t value) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* pos = end;
+    uint64_t abs_value = value < 0 ? 0 - static_cast<uint64_t>(value)
+                                   : static_cast<uint64_t>(value);
+    do {
+      *--pos = static_cast<char>('0' + abs_value % 10);
+      abs_value /= 10;
+    } while (abs_value);
+    if (value < 0)
+      *--pos = '-';
+    out_->append(pos, static_cast<size_t>(end - pos));
+  }
+
+  void AppendUInt(uint64_t value) {
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* pos = end;
+    do {
+      *--pos = static_cast<char>('0' + value % 10);
+      value /= 10;
+    } while (value);
+    out_->append(pos, static_cast<size_t>(end - pos));
+  }
+
+  void AppendDouble(double value) {
+    if (std::isnan(value)) {
+      out_->append("null");
+      return;
+    }
+    if (std::isinf(value)) {
+      out_->append(value > 0 ? "1e+9999" : "-1e+9999");
+      return;
+    }
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%.17g", value);
+    PERFETTO_DCHECK(len > 0 && static_cast<size_t>(len) < sizeof(buf));
+    out_->append(buf, static_cast<size_t>(len));
+    // Like jsoncpp, make sure that the value still reads as a double.
+    if (!strpbrk(buf, ".e"))
+      out_->append(".0");
+  }
+
+  // Appends |str| as a quoted JSON string. Like jsoncpp, non-ASCII characters
+  // are escaped as \uXXXX and invalid UTF-8 is replaced by U+FFFD.
+  void AppendString(const char* str, size_t size) {
+    out_->push_back('"');
+    const char* end = str + size;
+    const char* unescaped_begin = str;
+    for (const char* c = str; c < end; ++c) {
+      unsigned char ch = static_cast<unsigned char>(*c);
+      if (PERFETTO_LIKELY(ch >= 0x20 && ch < 0x80 && ch != '"' && ch != '\\'))
+        continue;
+      out_->append(unescaped_begin, static_cast<size_t>(c - unescaped_begin));
+      switch (ch) {
+        case '"':
+          out_->append("\\\"");
+          break;
+        case '\\':
+          out_->append("\\\\");
+          break;
+        case '\b':
+          out_->append("\\b");
+          break;
+        case '\f':
+          out_->append("\\f");
+          break;
+        case '\n':
+          out_->append("\\n");
+          break;
+        case '\r':
+          out_->append("\\r");
+          break;
+        case '\t':
+          out_->append("\\t");
+          break;
+        default: {
+          uint32_t codepoint = ch < 0x80 ? ch : DecodeUtf8(&c, end);
+          if (codepoint < 0x10000) {
+            AppendUnicodeEscape(codepoint);
+          } else {
+            codepoint -= 0x10000;
+            AppendUnicodeEscape((codepoint >> 10) + 0xD800);
+            AppendUnicodeEscape((codepoint & 0x3FF) + 0xDC00);
+          }
+        }
+      }
+      unescaped_begin = c + 1;
+    }
+    out_->append(unescaped_begin, static_cast<size_t>(end - unescaped_begin));
+    out_->push_back('"');
+  }
+
+  void AppendString(const char* str) { AppendString(str, strlen(str)); }
+
+  void AppendValue(const Json::Value& value) {
+    switch (value.type()) {
+      case Json::nullValue:
+        out_->append("null");
+        break;
+      case Json::intValue:
+        AppendInt(value.asLargestInt());
+        break;
+      case Json::uintValue:
+        AppendUInt(value.asLargestUInt());
+        break;
+      case Json::realValue:
+        AppendDouble(value.asDouble());
+        break;
+      case Json::stringValue: {
+        const char* begin;
+        const char* end;
+        if (value.getString(&begin, &end))
+          AppendString(begin, static_cast<size_t>(end - begin));
+        break;
+      }
+      case Json::booleanValue:
+        out_->append(value.asBool() ? "true" : "false");
+        break;
+      case Json::arrayValue: {
+        out_->push_back('[');
+        for (Json::ArrayIndex i = 0; i < value.size(); ++i) {
+          if (i > 0)
+            out_->push_back(',');
+          AppendValue(value[i]);
+        }
+        out_->push_back(']');
+        break;
+      }
+      case Json::objectValue: {
+        out_->push_back('{');
+        for (auto it = value.begin(); it != value.end(); ++it) {
+          if (it != value.begin())
+            out_->push_back(',');
+          AppendKey(it);
+          AppendValue(*it);
+        }
+        out_->push_back('}');
+        break;
+      }
+    }
+  }
+
+  // Appends the quoted name of the member |it| points to, followed by ':'.
+  void AppendKey(const Json::Value::const_iterator& it) {
+    const char* end;
+    const char* name = it.memberName(&end);
+    AppendString(name, static_cast<size_t>(end - name));
+    out_->push_back(':');
+  }
+
+ private:
+  // Decodes the UTF-8 sequence starting at |*c|, leaving |*c| on its last
+  // byte. Mirrors jsoncpp's handling of invalid sequences.
+  static uint32_t DecodeUtf8(const char** c, const char* end) {
+    static constexpr uint32_t kReplacementCharacter = 0xFFFD;
+    const char* s = *c;
+    auto cont = [s](size_t i) {
+      return static_cast<uint32_t>(static_cast<unsigned char>(s[i]) & 0x3F);
+    };
+    uint32_t first = static_cast<unsigned char>(*s);
+    if (first < 0xE0) {
+      if (end - s < 2)
+        return kReplacementCharacter;
+      uint32_t codepoint = ((first & 0x1F) << 6) | cont(1);
+      *c += 1;
+      return codepoint < 0x80 ? kReplacementCharacter : codepoint;
+    }
+    if (first < 0xF0) {
+      if (end - s < 3)
+        return kReplacementCharacter;
+      uint32_t codepoint = ((first & 0x0F) << 12) | (cont(1) << 6) | cont(2);
+      *c += 2;
+      if (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+        return kReplacementCharacter;
+      return codepoint < 0x800 ? kReplacementCharacter : codepoint;
+    }
+    if (first < 0xF8) {
+      if (end - s < 4)
+        return kReplacementCharacter;
+      uint32_t codepoint = ((first & 0x07) << 18) | (cont(1) << 12) |
+                           (cont(2) << 6) | cont(3);
+      *c += 3;
+      return codepoint < 0x10000 ? kReplacementCharacter : codepoint;
+    }
+    return kReplacementCharacter;
+  }
+
+  void AppendUnicodeEscape(uint32_t codepoint) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    char buf[6] = {'\\',
+                   'u',
+                   kHex[(codepoint >> 12) & 0xF],
+                   kHex[(codepoint >> 8) & 0xF],
+                   kHex[(codepoint >> 4) & 0xF],
+                   kHex[codepoint & 0xF]};
+    out_->append(buf, sizeof(buf));
+  }
+
+  std::string* out_;
+};
+
 class JsonExporter {
  public:
   JsonExporter(const TraceStorage* storage,
@@ -152,6 +365,30 @@ class JsonExporter {
   }
 
  private:
+  // A trace event for a slice. Slices make up the bulk of most traces, so
+  // they are written out directly rather than through a Json::Value, which
+  // would also need a copy of the slice's args.
+  struct SliceEvent {
+    int64_t ts = 0;
+    const char* cat = "";
+    const char* name = "";
+    int32_t pid = 0;
+    int32_t tid = 0;
+    std::string ph;
+    // Not owned. The legacy event args are not exported. Null for no args.
+    const Json::Value* args = nullptr;
+    base::Optional<int64_t> dur;
+    base::Optional<int64_t> tts;
+    base::Optional<int64_t> tdur;
+    base::Optional<int64_t> ticount;
+    base::Optional<int64_t> tidelta;
+    const char* s = nullptr;
+    std::string scope;
+    std::string id;
+    std::string id2_local;
+    bool use_async_tts = false;
+  };
+
   class TraceFormatWriter {
    public:
     TraceFormatWriter(OutputWriter* output,
@@ -163,9 +400,7 @@ class JsonExporter {
           metadata_filter_(metadata_filter),
           label_filter_(label_filter),
           first_event_(true) {
-      Json::StreamWriterBuilder b;
-      b.settings_["indentation"] = "";
-      writer_.reset(b.newStreamWriter());
+      buffer_.reserve(kFlushThreshold);
       WriteHeader();
     }
 
@@ -178,25 +413,32 @@ class JsonExporter {
       DoWriteEvent(event);
     }
 
-    void AddAsyncBeginEvent(const Json::Value& event) {
+    void WriteCommonEvent(const SliceEvent& event) {
+      if (label_filter_ && !label_filter_("traceEvents"))
+        return;
+
+      DoWriteEvent(event);
+    }
+
+    void AddAsyncBeginEvent(const SliceEvent& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_begin_events_.push_back(event);
+      async_begin_events_.push_back(SerializeAsyncEvent(event));
     }
 
-    void AddAsyncInstantEvent(const Json::Value& event) {
+    void AddAsyncInstantEvent(const SliceEvent& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_instant_events_.push_back(event);
+      async_instant_events_.push_back(SerializeAsyncEvent(event));
     }
 
-    void AddAsyncEndEvent(const Json::Value& event) {
+    void AddAsyncEndEvent(const SliceEvent& event) {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      async_end_events_.push_back(event);
+      async_end_events_.push_back(SerializeAsyncEvent(event));
     }
 
     void SortAndEmitAsyncEvents() {
@@ -212,8 +454,8 @@ class JsonExporter {
       // the same timestamp. To accomplish this, we perform a stable sort in
       // descending order and later iterate via reverse iterators.
       struct {
-        bool operator()(const Json::Value& a, const Json::Value& b) const {
-          return a["ts"].asInt64() > b["ts"].asInt64();
+        bool operator()(const AsyncEvent& a, const AsyncEvent& b) const {
+          return a.ts > b.ts;
         }
       } CompareEvents;
       std::stable_sort(async_end_events_.begin(), async_end_events_.end(),
@@ -232,25 +474,24 @@ class JsonExporter {
       auto has_begin_event = begin_event_it != async_begin_events_.end();
 
       auto emit_next_instant = [&instant_event_it, &has_instant_event, this]() {
-        DoWriteEvent(*instant_event_it);
+        WriteSerializedEvent(instant_event_it->json);
         instant_event_it++;
         has_instant_event = instant_event_it != async_instant_events_.end();
       };
       auto emit_next_end = [&end_event_it, &has_end_event, this]() {
-        DoWriteEvent(*end_event_it);
+        WriteSerializedEvent(end_event_it->json);
         end_event_it++;
         has_end_event = end_event_it != async_end_events_.rend();
       };
       auto emit_next_begin = [&begin_event_it, &has_begin_event, this]() {
-        DoWriteEvent(*begin_event_it);
+        WriteSerializedEvent(begin_event_it->json);
         begin_event_it++;
         has_begin_event = begin_event_it != async_begin_events_.end();
       };
 
       auto emit_next_instant_or_end = [&instant_event_it, &end_event_it,
                                        &emit_next_instant, &emit_next_end]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_end();
@@ -259,8 +500,7 @@ class JsonExporter {
       auto emit_next_instant_or_begin = [&instant_event_it, &begin_event_it,
                                          &emit_next_instant,
                                          &emit_next_begin]() {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= begin_event_it->ts) {
           emit_next_instant();
         } else {
           emit_next_begin();
@@ -268,8 +508,7 @@ class JsonExporter {
       };
       auto emit_next_end_or_begin = [&end_event_it, &begin_event_it,
                                      &emit_next_end, &emit_next_begin]() {
-        if ((*end_event_it)["ts"].asInt64() <=
-            (*begin_event_it)["ts"].asInt64()) {
+        if (end_event_it->ts <= begin_event_it->ts) {
           emit_next_end();
         } else {
           emit_next_begin();
@@ -278,8 +517,7 @@ class JsonExporter {
 
       // While we still have events in all iterators, consider each.
       while (has_instant_event && has_end_event && has_begin_event) {
-        if ((*instant_event_it)["ts"].asInt64() <=
-            (*end_event_it)["ts"].asInt64()) {
+        if (instant_event_it->ts <= end_event_it->ts) {
           emit_next_instant_or_begin();
         } else {
           emit_next_end_or_begin();
@@ -325,25 +563,24 @@ class JsonExporter {
       if (label_filter_ && !label_filter_("traceEvents"))
         return;
 
-      std::ostringstream ss;
+      // Written directly rather than through a Json::Value, with the keys in
+      // the same (sorted) order.
       if (!first_event_)
-        ss << ",\n";
-
-      Json::Value value;
-      value["ph"] = "M";
-      value["cat"] = "__metadata";
-      value["ts"] = 0;
-      value["name"] = metadata_type;
-      value["pid"] = Json::Int(pid);
-      value["tid"] = Json::Int(tid);
-
-      Json::Value args;
-      args[metadata_arg_name] = metadata_arg_value;
-      value["args"] = args;
-
-      writer_->write(value, &ss);
-      output_->AppendString(ss.str());
+        buffer_ += ",\n";
+      JsonSerializer serializer(&buffer_);
+      serializer.Append("{\"args\":{");
+      serializer.AppendString(metadata_arg_name);
+      serializer.Append(":");
+      serializer.AppendString(metadata_arg_value);
+      serializer.Append("},\"cat\":\"__metadata\",\"name\":");
+      serializer.AppendString(metadata_type);
+      serializer.Append(",\"ph\":\"M\",\"pid\":");
+      serializer.AppendInt(static_cast<int32_t>(pid));
+      serializer.Append(",\"tid\":");
+      serializer.AppendInt(static_cast<int32_t>(tid));
+      serializer.Append(",\"ts\":0}");
       first_event_ = false;
+      MaybeFlush();
     }
 
     void MergeMetadata(const Json::Value& value) {
@@ -403,9 +640,21 @@ class JsonExporter {
     }
 
    private:
+    // Async events are buffered until the end of the export to be sorted, so
+    // they are kept in their serialized form which is much more compact than
+    // a Json::Value.
+    struct AsyncEvent {
+      int64_t ts;
+      std::string json;
+    };
+
+    // The output is handed to the OutputWriter in chunks of at least this
+    // size, rather than once per event.
+    static constexpr size_t kFlushThreshold = 1024 * 1024;
+
     void WriteHeader() {
       if (!label_filter_)
-        output_->AppendString("{\"traceEvents\":[\n");
+        buffer_ += "{\"traceEvents\":[\n";
     }
 
     void WriteFooter() {
@@ -440,55 +689,198 @@ class JsonExporter {
         }
       }
 
-      std::ostringstream ss;
+      JsonSerializer serializer(&buffer_);
       if (!label_filter_)
-        ss << "]";
+        serializer.Append("]");
 
       if ((!label_filter_ || label_filter_("systemTraceEvents")) &&
           !system_trace_data_.empty()) {
-        ss << ",\"systemTraceEvents\":\n";
-        writer_->write(Json::Value(system_trace_data_), &ss);
+        serializer.Append(",\"systemTraceEvents\":\n");
+        serializer.AppendString(system_trace_data_.data(),
+                                system_trace_data_.size());
       }
 
       if ((!label_filter_ || label_filter_("metadata")) && !metadata_.empty()) {
-        ss << ",\"metadata\":\n";
-        writer_->write(metadata_, &ss);
+        serializer.Append(",\"metadata\":\n");
+        serializer.AppendValue(metadata_);
       }
 
       if (!label_filter_)
-        ss << "}";
+        serializer.Append("}");
 
-      output_->AppendString(ss.str());
+      Flush();
     }
 
-    void DoWriteEvent(const Json::Value& event) {
-      std::ostringstream ss;
+    template <typename Event>
+    void DoWriteEvent(const Event& event) {
       if (!first_event_)
-        ss << ",\n";
+        buffer_ += ",\n";
+      SerializeEvent(event, &buffer_);
+      first_event_ = false;
+      MaybeFlush();
+    }
 
+    void WriteSerializedEvent(const std::string& json) {
+      if (!first_event_)
+        buffer_ += ",\n";
+      buffer_ += json;
+      first_event_ = false;
+      MaybeFlush();
+    }
+
+    AsyncEvent SerializeAsyncEvent(const SliceEvent& event) {
+      AsyncEvent async_event;
+      async_event.ts = event.ts;
+      SerializeEvent(event, &async_event.json);
+      return async_event;
+    }
+
+    // Appends |event| to |out|, applying the argument filter while
+    // serializing rather than on a copy of the event.
+    void SerializeEvent(const Json::Value& event, std::string* out) {
+      JsonSerializer serializer(out);
       ArgumentNameFilterPredicate argument_name_filter;
       bool strip_args =
           argument_filter_ &&
           !argument_filter_(event["cat"].asCString(), event["name"].asCString(),
                             &argument_name_filter);
-      if ((strip_args || argument_name_filter) && event.isMember("args")) {
-        Json::Value event_copy = event;
-        if (strip_args) {
-          event_copy["args"] = kStrippedArgument;
+      if (!strip_args && !argument_name_filter) {
+        serializer.AppendValue(event);
+        return;
+      }
+
+      serializer.Append("{");
+      for (auto it = event.begin(); it != event.end(); ++it) {
+        if (it != event.begin())
+          serializer.Append(",");
+        serializer.AppendKey(it);
+        const char* key_end;
+        const char* key = it.memberName(&key_end);
+        if (base::StringView(key, static_cast<size_t>(key_end - key)) !=
+            "args") {
+          serializer.AppendValue(*it);
+        } else if (strip_args) {
+          serializer.AppendString(kStrippedArgument);
+        } else if (!it->isObject()) {
+          serializer.AppendValue(*it);
         } else {
-          auto& args = event_copy["args"];
-          for (const auto& member : event["args"].getMemberNames()) {
-            if (!argument_name_filter(member.c_str()))
-              args[member] = kStrippedArgument;
+          serializer.Append("{");
+          for (auto arg = it->begin(); arg != it->end(); ++arg) {
+            if (arg != it->begin())
+              serializer.Append(",");
+            serializer.AppendKey(arg);
+            const char* arg_name_end;
+            if (argument_name_filter(arg.memberName(&arg_name_end))) {
+              serializer.AppendValue(*arg);
+            } else {
+              serializer.AppendString(kStrippedArgument);
+            }
           }
+          serializer.Append("}");
         }
-        writer_->write(event_copy, &ss);
+      }
+      serializer.Append("}");
+    }
+
+    void SerializeEvent(const SliceEvent& event, std::string* out) {
+      JsonSerializer serializer(out);
+      ArgumentNameFilterPredicate argument_name_filter;
+      bool strip_args =
+          argument_filter_ &&
+          !argument_filter_(event.cat, event.name, &argument_name_filter);
+
+      // Members are written in the same (sorted) order as for a Json::Value.
+      serializer.Append("{\"args\":");
+      if (strip_args) {
+        serializer.AppendString(kStrippedArgument);
       } else {
-        writer_->write(event, &ss);
+        serializer.Append("{");
+        bool first_arg = true;
+        if (event.args) {
+          for (auto it = event.args->begin(); it != event.args->end(); ++it) {
+            const char* key_end;
+            const char* key = it.memberName(&key_end);
+            if (base::StringView(key, static_cast<size_t>(key_end - key)) ==
+                kLegacyEventArgsKey) {
+              continue;
+            }
+            if (!first_arg)
+              serializer.Append(",");
+            first_arg = false;
+            serializer.AppendKey(it);
+            if (!argument_name_filter || argument_name_filter(key)) {
+              serializer.AppendValue(*it);
+            } else {
+              serializer.AppendString(kStrippedArgument);
+            }
+          }
+        }
+        serializer.Append("}");
       }
-      first_event_ = false;
+      serializer.Append(",\"cat\":");
+      serializer.AppendString(event.cat);
+      if (event.dur) {
+        serializer.Append(",\"dur\":");
+        serializer.AppendInt(*event.dur);
+      }
+      if (!event.id.empty()) {
+        serializer.Append(",\"id\":");
+        serializer.AppendString(event.id.data(), event.id.size());
+      }
+      if (!event.id2_local.empty()) {
+        serializer.Append(",\"id2\":{\"local\":");
+        serializer.AppendString(event.id2_local.data(), event.id2_local.size());
+        serializer.Append("}");
+      }
+      serializer.Append(",\"name\":");
+      serializer.AppendString(event.name);
+      serializer.Append(",\"ph\":");
+      serializer.AppendString(event.ph.data(), event.ph.size());
+      serializer.Append(",\"pid\":");
+      serializer.AppendInt(event.pid);
+      if (event.s) {
+        serializer.Append(",\"s\":");
+        serializer.AppendString(event.s);
+      }
+      if (!event.scope.empty()) {
+        serializer.Append(",\"scope\":");
+        serializer.AppendString(event.scope.data(), event.scope.size());
+      }
+      if (event.tdur) {
+        serializer.Append(",\"tdur\":");
+        serializer.AppendInt(*event.tdur);
+      }
+      if (event.ticount) {
+        serializer.Append(",\"ticount\":");
+        serializer.AppendInt(*event.ticount);
+      }
+      serializer.Append(",\"tid\":");
+      serializer.AppendInt(event.tid);
+      if (event.tidelta) {
+        serializer.Append(",\"tidelta\":");
+        serializer.AppendInt(*event.tidelta);
+      }
+      serializer.Append(",\"ts\":");
+      serializer.AppendInt(event.ts);
+      if (event.tts) {
+        serializer.Append(",\"tts\":");
+        serializer.AppendInt(*event.tts);
+      }
+      if (event.use_async_tts)
+        serializer.Append(",\"use_async_tts\":1");
+      serializer.Append("}");
+    }
 
-      output_->AppendString(ss.str());
+    void MaybeFlush() {
+      if (buffer_.size() >= kFlushThreshold)
+        Flush();
+    }
+
+    void Flush() {
+      if (buffer_.empty())
+        return;
+      output_->AppendString(buffer_);
+      buffer_.clear();
     }
 
     OutputWriter* output_;
@@ -496,14 +888,14 @@ class JsonExporter {
     MetadataFilterPredicate metadata_filter_;
     LabelFilterPredicate label_filter_;
 
-    std::unique_ptr<Json::StreamWriter> writer_;
+    std::string buffer_;
     bool first_event_;
     Json::Value metadata_;
     std::string system_trace_data_;
     std::string user_trace_data_;
-    std::vector<Json::Value> async_begin_events_;
-    std::vector<Json::Value> async_instant_events_;
-    std::vector<Json::Value> async_end_events_;
+    std::vector<AsyncEvent> async_begin_events_;
+    std::vector<AsyncEvent> async_instant_events_;
+    std::vector<AsyncEvent> async_end_events_;
   };
 
   class ArgsBuilder {
@@ -578,9 +970,7 @@ class JsonExporter {
       PERFETTO_FATAL("Not reached");  // For gcc.
     }
 
-    void AppendArg(ArgSetId set_id,
-                   const std::string& key,
-                   const Json::Value& value) {
+    void AppendArg(ArgSetId set_id, const std::string& key, Json::Value value) {
       Json::Value* target = &args_sets_[set_id];
       for (base::StringSplitter parts(key, '.'); parts.Next();) {
         if (PERFETTO_UNLIKELY(!target->isNull() && !target->isObject())) {
@@ -619,17 +1009,17 @@ class JsonExporter {
           }
         }
       }
-      *target = value;
+      target->swap(value);
     }
 
     void PostprocessArgs() {
       for (Json::Value& args : args_sets_) {
         // Move all fields from "debug" key to upper level.
         if (args.isMember("debug")) {
-          Json::Value debug = args["debug"];
-          args.removeMember("debug");
+          Json::Value debug;
+          args.removeMember("debug", &debug);
           for (const auto& member : debug.getMemberNames()) {
-            args[member] = debug[member];
+            args[member].swap(debug[member]);
           }
         }
 
@@ -786,20 +1176,18 @@ class JsonExporter {
       if (cat.c_str() == nullptr || cat == "binder")
         continue;
 
-      Json::Value event;
-      event["ts"] = Json::Int64(slices.ts()[i] / 1000);
-      event["cat"] = GetNonNullString(storage_, slices.category()[i]);
-      event["name"] = GetNonNullString(storage_, slices.name()[i]);
-      event["pid"] = 0;
-      event["tid"] = 0;
+      SliceEvent event;
+      event.ts = slices.ts()[i] / 1000;
+      event.cat = GetNonNullString(storage_, slices.category()[i]);
+      event.name = GetNonNullString(storage_, slices.name()[i]);
 
       base::Optional<UniqueTid> legacy_utid;
       std::string legacy_phase;
 
-      event["args"] =
-          args_builder_.GetArgs(slices.arg_set_id()[i]);  // Makes a copy.
-      if (event["args"].isMember(kLegacyEventArgsKey)) {
-        const auto& legacy_args = event["args"][kLegacyEventArgsKey];
+      // The legacy event args are skipped when the event is written.
+      event.args = &args_builder_.GetArgs(slices.arg_set_id()[i]);
+      if (event.args->isMember(kLegacyEventArgsKey)) {
+        const auto& legacy_args = (*event.args)[kLegacyEventArgsKey];
 
         if (legacy_args.isMember(kLegacyEventPassthroughUtidKey)) {
           legacy_utid = legacy_args[kLegacyEventPassthroughUtidKey].asUInt();
@@ -807,8 +1195,6 @@ class JsonExporter {
         if (legacy_args.isMember(kLegacyEventPhaseKey)) {
           legacy_phase = legacy_args[kLegacyEventPhaseKey].asString();
         }
-
-        event["args"].removeMember(kLegacyEventArgsKey);
       }
 
       // To prevent duplicate export of slices, only export slices on descriptor
@@ -875,44 +1261,44 @@ class JsonExporter {
         // Synchronous (thread) slice or instant event.
         UniqueTid utid = thread_track.utid()[*opt_thread_track_row];
         auto pid_and_tid = UtidToPidAndTid(utid);
-        event["pid"] = Json::Int(pid_and_tid.first);
-        event["tid"] = Json::Int(pid_and_tid.second);
+        event.pid = static_cast<int32_t>(pid_and_tid.first);
+        event.tid = static_cast<int32_t>(pid_and_tid.second);
 
         if (duration_ns == 0) {
           if (legacy_phase.empty()) {
             // Use "I" instead of "i" phase for backwards-compat with old
             // consumers.
-            event["ph"] = "I";
+            event.ph = "I";
           } else {
-            event["ph"] = legacy_phase;
+            event.ph = legacy_phase;
           }
           if (thread_ts_ns && thread_ts_ns > 0) {
-            event["tts"] = Json::Int64(*thread_ts_ns / 1000);
+            event.tts = *thread_ts_ns / 1000;
           }
           if (thread_instruction_count && *thread_instruction_count > 0) {
-            event["ticount"] = Json::Int64(*thread_instruction_count);
+            event.ticount = *thread_instruction_count;
           }
-          event["s"] = "t";
+          event.s = "t";
         } else {
           if (duration_ns > 0) {
-            event["ph"] = "X";
-            event["dur"] = Json::Int64(duration_ns / 1000);
+            event.ph = "X";
+            event.dur = duration_ns / 1000;
           } else {
             // If the slice didn't finish, the duration may be negative. Only
             // write a begin event without end event in this case.
-            event["ph"] = "B";
+            event.ph = "B";
           }
           if (thread_ts_ns && *thread_ts_ns > 0) {
-            event["tts"] = Json::Int64(*thread_ts_ns / 1000);
+            event.tts = *thread_ts_ns / 1000;
             // Only write thread duration for completed events.
             if (duration_ns > 0 && thread_duration_ns)
-              event["tdur"] = Json::Int64(*thread_duration_ns / 1000);
+              event.tdur = *thread_duration_ns / 1000;
           }
           if (thread_instruction_count && *thread_instruction_count > 0) {
-            event["ticount"] = Json::Int64(*thread_instruction_count);
+            event.ticount = *thread_instruction_count;
             // Only write thread instruction delta for completed events.
             if (duration_ns > 0 && thread_instruction_delta)
-              event["tidelta"] = Json::Int64(*thread_instruction_delta);
+              event.tidelta = *thread_instruction_delta;
           }
         }
         writer_.WriteCommonEvent(event);
@@ -926,10 +1312,10 @@ class JsonExporter {
           PERFETTO_DCHECK(track_args);
           uint32_t upid = process_track.upid()[*opt_process_row];
           uint32_t exported_pid = UpidToPid(upid);
-          event["pid"] = Json::Int(exported_pid);
-          event["tid"] =
-              Json::Int(legacy_utid ? UtidToPidAndTid(*legacy_utid).second
-                                    : exported_pid);
+          event.pid = static_cast<int32_t>(exported_pid);
+          event.tid = static_cast<int32_t>(
+              legacy_utid ? UtidToPidAndTid(*legacy_utid).second
+                          : exported_pid);
 
           // Preserve original event IDs for legacy tracks. This is so that e.g.
           // memory dump IDs show up correctly in the JSON trace.
@@ -940,85 +1326,84 @@ class JsonExporter {
               static_cast<uint64_t>((*track_args)["source_id"].asInt64());
           std::string source_scope = (*track_args)["source_scope"].asString();
           if (!source_scope.empty())
-            event["scope"] = source_scope;
+            event.scope = source_scope;
           bool source_id_is_process_scoped =
               (*track_args)["source_id_is_process_scoped"].asBool();
           if (source_id_is_process_scoped) {
-            event["id2"]["local"] = base::Uint64ToHexString(source_id);
+            event.id2_local = base::Uint64ToHexString(source_id);
           } else {
             // Some legacy importers don't understand "id2" fields, so we use
             // the "usually" global "id" field instead. This works as long as
             // the event phase is not in {'N', 'D', 'O', '(', ')'}, see
             // "LOCAL_ID_PHASES" in catapult.
-            event["id"] = base::Uint64ToHexString(source_id);
+            event.id = base::Uint64ToHexString(source_id);
           }
         } else {
           if (opt_thread_track_row) {
             UniqueTid utid = thread_track.utid()[*opt_thread_track_row];
             auto pid_and_tid = UtidToPidAndTid(utid);
-            event["pid"] = Json::Int(pid_and_tid.first);
-            event["tid"] = Json::Int(pid_and_tid.second);
-            event["id2"]["local"] = base::Uint64ToHexString(track_id.value);
+            event.pid = static_cast<int32_t>(pid_and_tid.first);
+            event.tid = static_cast<int32_t>(pid_and_tid.second);
+            event.id2_local = base::Uint64ToHexString(track_id.value);
           } else if (opt_process_row) {
             uint32_t upid = process_track.upid()[*opt_process_row];
             uint32_t exported_pid = UpidToPid(upid);
-            event["pid"] = Json::Int(exported_pid);
-            event["tid"] =
-                Json::Int(legacy_utid ? UtidToPidAndTid(*legacy_utid).second
-                                      : exported_pid);
-            event["id2"]["local"] = base::Uint64ToHexString(track_id.value);
+            event.pid = static_cast<int32_t>(exported_pid);
+            event.tid = static_cast<int32_t>(
+                legacy_utid ? UtidToPidAndTid(*legacy_utid).second
+                            : exported_pid);
+            event.id2_local = base::Uint64ToHexString(track_id.value);
           } else {
             if (legacy_utid) {
               auto pid_and_tid = UtidToPidAndTid(*legacy_utid);
-              event["pid"] = Json::Int(pid_and_tid.first);
-              event["tid"] = Json::Int(pid_and_tid.second);
+              event.pid = static_cast<int32_t>(pid_and_tid.first);
+              event.tid = static_cast<int32_t>(pid_and_tid.second);
             }
 
             // Some legacy importers don't understand "id2" fields, so we use
             // the "usually" global "id" field instead. This works as long as
             // the event phase is not in {'N', 'D', 'O', '(', ')'}, see
             // "LOCAL_ID_PHASES" in catapult.
-            event["id"] = base::Uint64ToHexString(track_id.value);
+            event.id = base::Uint64ToHexString(track_id.value);
           }
         }
 
         if (thread_ts_ns && *thread_ts_ns > 0) {
-          event["tts"] = Json::Int64(*thread_ts_ns / 1000);
-          event["use_async_tts"] = Json::Int(1);
+          event.tts = *thread_ts_ns / 1000;
+          event.use_async_tts = true;
         }
         if (thread_instruction_count && *thread_instruction_count > 0) {
-          event["ticount"] = Json::Int64(*thread_instruction_count);
-          event["use_async_tts"] = Json::Int(1);
+          event.ticount = *thread_instruction_count;
+          event.use_async_tts = true;
         }
 
         if (duration_ns == 0) {
           if (legacy_phase.empty()) {
             // Instant async event.
-            event["ph"] = "n";
+            event.ph = "n";
             writer_.AddAsyncInstantEvent(event);
           } else {
             // Async step events.
-            event["ph"] = legacy_phase;
+            event.ph = legacy_phase;
             writer_.AddAsyncBeginEvent(event);
           }
         } else {  // Async start and end.
-          event["ph"] = legacy_phase.empty() ? "b" : legacy_phase;
+          event.ph = legacy_phase.empty() ? "b" : legacy_phase;
           writer_.AddAsyncBeginEvent(event);
           // If the slice didn't finish, the duration may be negative. Don't
           // write the end event in this case.
           if (duration_ns > 0) {
-            event["ph"] = legacy_phase.empty() ? "e" : "F";
-            event["ts"] = Json::Int64((slices.ts()[i] + duration_ns) / 1000);
+            event.ph = legacy_phase.empty() ? "e" : "F";
+            event.ts = (slices.ts()[i] + duration_ns) / 1000;
             if (thread_ts_ns && thread_duration_ns && *thread_ts_ns > 0) {
-              event["tts"] =
-                  Json::Int64((*thread_ts_ns + *thread_duration_ns) / 1000);
+              event.tts = (*thread_ts_ns + *thread_duration_ns) / 1000;
             }
             if (thread_instruction_count && thread_instruction_delta &&
                 *thread_instruction_count > 0) {
-              event["ticount"] = Json::Int64(
-                  (*thread_instruction_count + *thread_instruction_delta));
+              event.ticount =
+                  *thread_instruction_count + *thread_instruction_delta;
             }
-            event["args"].clear();
+            event.args = nullptr;
             writer_.AddAsyncEndEvent(event);
           }
         }
@@ -1034,22 +1419,22 @@ class JsonExporter {
           if (legacy_phase.empty()) {
             // Use "I" instead of "i" phase for backwards-compat with old
             // consumers.
-            event["ph"] = "I";
+            event.ph = "I";
           } else {
-            event["ph"] = legacy_phase;
+            event.ph = legacy_phase;
           }
 
           auto opt_process_row = process_track.id().IndexOf(TrackId{track_id});
           if (opt_process_row.has_value()) {
             uint32_t upid = process_track.upid()[*opt_process_row];
             uint32_t exported_pid = UpidToPid(upid);
-            event["pid"] = Json::Int(exported_pid);
-            event["tid"] =
-                Json::Int(legacy_utid ? UtidToPidAndTid(*legacy_utid).second
-                                      : exported_pid);
-            event["s"] = "p";
+            event.pid = static_cast<int32_t>(exported_pid);
+            event.tid = static_cast<int32_t>(
+                legacy_utid ? UtidToPidAndTid(*legacy_utid).second
+                            : exported_pid);
+            event.s = "p";
           } else {
-            event["s"] = "g";
+            event.s = "g";
           }
           writer_.WriteCommonEvent(event);
         }
@@ -1933,6 +2318,12 @@ util::Status ExportJson(const TraceStorage* storage, FILE* output) {
   return ExportJson(storage, &writer, nullptr, nullptr, nullptr);
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
+void AppendJsonValueForTesting(const Json::Value& value, std::string* out) {
+  JsonSerializer(out).AppendValue(value);
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
+
 }  // namespace json
 }  // namespace trace_processor
 }  // namespace perfetto
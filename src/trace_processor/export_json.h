@@ -19,10 +19,19 @@
 
 #include <stdio.h>
 
+#include <string>
+
+#include "perfetto/base/build_config.h"
 #include "perfetto/ext/trace_processor/export_json.h"
 #include "perfetto/trace_processor/status.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
+namespace Json {
+class Value;
+}
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace json {
@@ -37,6 +46,11 @@ util::Status ExportJson(const TraceStorage* storage,
                         MetadataFilterPredicate = nullptr,
                         LabelFilterPredicate = nullptr);
 
+#if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
+// For testing. Appends |value| to |out| the way the exporter writes JSON.
+void AppendJsonValueForTesting(const Json::Value& value, std::string* out);
+#endif
+
 }  // namespace json
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -0,0 +1,141 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/ext/trace_processor/export_json.h"
+#include "src/trace_processor/export_json.h"
+#include "src/trace_processor/importers/common/args_tracker.h"
+#include "src/trace_processor/importers/common/global_args_tracker.h"
+#include "src/trace_processor/importers/common/process_tracker.h"
+#include "src/trace_processor/importers/common/track_tracker.h"
+#include "src/trace_processor/importers/proto/metadata_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1024);
+  } else {
+    b->Arg(256 * 1024);
+  }
+}
+
+// Discards the output, only counting its size.
+class CountingOutputWriter : public json::OutputWriter {
+ public:
+  util::Status AppendString(const std::string& str) override {
+    size_ += str.size();
+    return util::OkStatus();
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  size_t size_ = 0;
+};
+
+// Fills the storage with thread slices and legacy async slices, with a few
+// debug args each, similar to a Chrome trace.
+void PopulateStorage(TraceProcessorContext* context, uint32_t num_slices) {
+  static constexpr uint32_t kRandomSeed = 42;
+  static constexpr uint32_t kNumThreads = 64;
+  static constexpr uint32_t kNumNames = 100;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  TraceStorage* storage = context->storage.get();
+
+  std::vector<TrackId> thread_tracks;
+  for (uint32_t tid = 1; tid <= kNumThreads; ++tid) {
+    UniqueTid utid = context->process_tracker->UpdateThread(tid, 1);
+    thread_tracks.push_back(context->track_tracker->InternThreadTrack(utid));
+  }
+  UniquePid upid = context->process_tracker->GetOrCreateProcess(1);
+  std::vector<TrackId> async_tracks;
+  for (int64_t source_id = 0; source_id < 16; ++source_id) {
+    async_tracks.push_back(context->track_tracker->InternLegacyChromeAsyncTrack(
+        kNullStringId, upid, source_id, false, kNullStringId));
+  }
+  context->args_tracker->Flush();
+
+  StringId cat = storage->InternString("cat");
+  std::vector<StringId> names;
+  for (uint32_t i = 0; i < kNumNames; ++i) {
+    names.push_back(
+        storage->InternString(base::StringView("slice \"" + std::to_string(i))));
+  }
+  StringId int_key = storage->InternString("debug.count");
+  StringId string_key = storage->InternString("debug.url");
+  StringId real_key = storage->InternString("debug.ratio");
+  StringId url = storage->InternString("https://example.com/path?q=1\n");
+
+  auto* slices = storage->mutable_slice_table();
+  for (uint32_t i = 0; i < num_slices; ++i) {
+    bool is_async = rnd_engine() % 8 == 0;
+    TrackId track = is_async ? async_tracks[rnd_engine() % async_tracks.size()]
+                             : thread_tracks[rnd_engine() % kNumThreads];
+    int64_t ts = static_cast<int64_t>(i) * 1000;
+    int64_t dur = static_cast<int64_t>(rnd_engine() % 100000);
+
+    std::vector<GlobalArgsTracker::Arg> args(3);
+    args[0].flat_key = args[0].key = int_key;
+    args[0].value = Variadic::Integer(rnd_engine() % 1000);
+    args[1].flat_key = args[1].key = string_key;
+    args[1].value = Variadic::String(url);
+    args[2].flat_key = args[2].key = real_key;
+    args[2].value = Variadic::Real(static_cast<double>(rnd_engine() % 1000) / 7);
+    ArgSetId arg_set_id = context->global_args_tracker->AddArgSet(args, 0, 3);
+
+    tables::SliceTable::Row row(ts, dur, track, cat,
+                                names[rnd_engine() % kNumNames]);
+    row.arg_set_id = arg_set_id;
+    slices->Insert(row);
+  }
+}
+
+void BM_ExportJson(benchmark::State& state) {
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  context.global_args_tracker.reset(new GlobalArgsTracker(&context));
+  context.args_tracker.reset(new ArgsTracker(&context));
+  context.track_tracker.reset(new TrackTracker(&context));
+  context.process_tracker.reset(new ProcessTracker(&context));
+  context.metadata_tracker.reset(new MetadataTracker(&context));
+  PopulateStorage(&context, static_cast<uint32_t>(state.range(0)));
+
+  size_t bytes = 0;
+  for (auto _ : state) {
+    CountingOutputWriter writer;
+    util::Status status = json::ExportJson(context.storage.get(), &writer,
+                                           nullptr, nullptr, nullptr);
+    PERFETTO_CHECK(status.ok());
+    bytes += writer.size();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_ExportJson)->Apply(BenchmarkArgs);
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
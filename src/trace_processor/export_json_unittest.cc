@@ -23,6 +23,7 @@
 
 #include <json/reader.h>
 #include <json/value.h>
+#include <json/writer.h>
 
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/temp_file.h"
@@ -67,6 +68,133 @@ class StringOutputWriter : public OutputWriter {
   std::string str_;
 };
 
+// The exporter's serializer must produce the same bytes as the jsoncpp writer
+// it replaced.
+std::string ToJsoncppString(const Json::Value& value) {
+  Json::StreamWriterBuilder builder;
+  builder["indentation"] = "";
+  return Json::writeString(builder, value);
+}
+
+void ExpectLikeJsoncpp(const Json::Value& value) {
+  std::string serialized;
+  AppendJsonValueForTesting(value, &serialized);
+  EXPECT_EQ(serialized, ToJsoncppString(value));
+}
+
+void ExpectStringLikeJsoncpp(const std::string& str) {
+  SCOPED_TRACE(base::ToHex(str));
+  ExpectLikeJsoncpp(Json::Value(str.data(), str.data() + str.size()));
+}
+
+TEST(JsonSerializerTest, ControlCharacters) {
+  for (int c = 0; c < 0x80; c++)
+    ExpectStringLikeJsoncpp(std::string(1, static_cast<char>(c)));
+  const char kEscaped[] = "a\0b\x1f\"\\\b\f\n\r\t/";
+  ExpectStringLikeJsoncpp(std::string(kEscaped, sizeof(kEscaped) - 1));
+}
+
+TEST(JsonSerializerTest, NonAsciiText) {
+  ExpectStringLikeJsoncpp("caf\xc3\xa9");               // U+00E9
+  ExpectStringLikeJsoncpp("\xe6\x97\xa5\xe6\x9c\xac");  // U+65E5 U+672C
+  ExpectStringLikeJsoncpp("\xef\xbf\xbd\xef\xbf\xbf");  // U+FFFD U+FFFF
+  ExpectStringLikeJsoncpp("\xdf\xbf\xe0\xa0\x80");      // U+07FF U+0800
+}
+
+TEST(JsonSerializerTest, FourByteCodePoints) {
+  ExpectStringLikeJsoncpp("\xf0\x9f\x98\x80");  // U+1F600
+  ExpectStringLikeJsoncpp("\xf0\x90\x80\x80");  // U+10000
+  ExpectStringLikeJsoncpp("\xf4\x8f\xbf\xbf");  // U+10FFFF
+  ExpectStringLikeJsoncpp("a\xf0\x9f\x98\x80" "b\xf0\x9f\x98\x81");
+}
+
+TEST(JsonSerializerTest, InvalidUtf8) {
+  // Stray continuation bytes and invalid lead bytes.
+  ExpectStringLikeJsoncpp("\x80");
+  ExpectStringLikeJsoncpp("a\xbf" "b");
+  ExpectStringLikeJsoncpp("\xf8\x88\x80\x80\x80");
+  ExpectStringLikeJsoncpp("\xff\xfe");
+  // Sequences truncated by the end of the string, or by another character.
+  ExpectStringLikeJsoncpp("\xc3");
+  ExpectStringLikeJsoncpp("\xe6\x97");
+  ExpectStringLikeJsoncpp("\xf0\x9f\x98");
+  ExpectStringLikeJsoncpp("\xc3" "a");
+  ExpectStringLikeJsoncpp("\xe6\x97" "ab");
+}
+
+TEST(JsonSerializerTest, OverlongUtf8) {
+  ExpectStringLikeJsoncpp("\xc0\xaf");          // '/'
+  ExpectStringLikeJsoncpp("\xc1\xbf");          // U+007F
+  ExpectStringLikeJsoncpp("\xe0\x80\xaf");      // '/'
+  ExpectStringLikeJsoncpp("\xe0\x9f\xbf");      // U+07FF
+  ExpectStringLikeJsoncpp("\xf0\x80\x80\xaf");  // '/'
+  ExpectStringLikeJsoncpp("\xf0\x8f\xbf\xbf");  // U+FFFF
+}
+
+TEST(JsonSerializerTest, LoneSurrogates) {
+  ExpectStringLikeJsoncpp("\xed\xa0\x80");  // U+D800
+  ExpectStringLikeJsoncpp("\xed\xbf\xbf");  // U+DFFF
+  // A surrogate pair encoded as two 3-byte sequences (CESU-8).
+  ExpectStringLikeJsoncpp("\xed\xa0\xbd\xed\xb8\x80");
+}
+
+TEST(JsonSerializerTest, Doubles) {
+  const double kValues[] = {0.0,
+                            -0.0,
+                            1.0,
+                            -1.5,
+                            0.1,
+                            1e300,
+                            -1e-300,
+                            123456789012345678.0,
+                            std::numeric_limits<double>::min(),
+                            std::numeric_limits<double>::max(),
+                            std::numeric_limits<double>::denorm_min(),
+                            std::numeric_limits<double>::quiet_NaN(),
+                            std::numeric_limits<double>::infinity(),
+                            -std::numeric_limits<double>::infinity()};
+  for (double value : kValues) {
+    SCOPED_TRACE(value);
+    ExpectLikeJsoncpp(Json::Value(value));
+  }
+}
+
+TEST(JsonSerializerTest, Integers) {
+  const int64_t kInts[] = {0,
+                           -1,
+                           1,
+                           std::numeric_limits<int32_t>::min(),
+                           std::numeric_limits<int32_t>::max(),
+                           std::numeric_limits<int64_t>::min(),
+                           std::numeric_limits<int64_t>::min() + 1,
+                           std::numeric_limits<int64_t>::max()};
+  for (int64_t value : kInts) {
+    SCOPED_TRACE(value);
+    ExpectLikeJsoncpp(Json::Value(static_cast<Json::Int64>(value)));
+  }
+  const uint64_t kUInts[] = {0, 1, std::numeric_limits<uint32_t>::max(),
+                             std::numeric_limits<uint64_t>::max()};
+  for (uint64_t value : kUInts) {
+    SCOPED_TRACE(value);
+    ExpectLikeJsoncpp(Json::Value(static_cast<Json::UInt64>(value)));
+  }
+}
+
+TEST(JsonSerializerTest, NestedValues) {
+  Json::Value value;
+  value["z"] = Json::Value(Json::nullValue);
+  value["a\xc3\xa9\n"] = true;
+  value["list"].append(false);
+  value["list"].append(std::numeric_limits<int64_t>::min());
+  value["list"].append(Json::Value(Json::arrayValue));
+  value["list"].append(Json::Value(Json::objectValue));
+  value["list"].append(-0.0);
+  value["obj"]["\xed\xa0\x80"] = "\xf0\x9f\x98\x80";
+  ExpectLikeJsoncpp(value);
+  ExpectLikeJsoncpp(Json::Value(Json::arrayValue));
+  ExpectLikeJsoncpp(Json::Value(Json::objectValue));
+}
+
 class ExportJsonTest : public ::testing::Test {
  public:
   ExportJsonTest() {
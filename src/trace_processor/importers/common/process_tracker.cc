@@ -225,9 +225,10 @@ void ProcessTracker::UpdateTrustedPid(uint32_t trusted_pid, uint64_t uuid) {
 }
 
 base::Optional<uint32_t> ProcessTracker::GetTrustedPid(uint64_t uuid) {
-  if (trusted_pids_.find(uuid) == trusted_pids_.end())
+  uint32_t* trusted_pid = trusted_pids_.Find(uuid);
+  if (!trusted_pid)
     return base::nullopt;
-  return trusted_pids_[uuid];
+  return *trusted_pid;
 }
 
 base::Optional<uint32_t> ProcessTracker::ResolveNamespacedTid(
@@ -238,12 +239,13 @@ base::Optional<uint32_t> ProcessTracker::ResolveNamespacedTid(
 
   // If the process doesn't run in a namespace (or traced_probes doesn't observe
   // that), return base::nullopt as failure to resolve.
-  auto process_it = namespaced_processes_.find(root_level_pid);
-  if (process_it == namespaced_processes_.end())
+  const NamespacedProcess* process_it =
+      namespaced_processes_.Find(root_level_pid);
+  if (!process_it)
     return base::nullopt;
 
   // Check if it's the main thread.
-  const auto& process = process_it->second;
+  const auto& process = *process_it;
   auto ns_level = process.nspid.size() - 1;
   auto pid_local = process.nspid.back();
   if (pid_local == tid)
@@ -251,7 +253,10 @@ base::Optional<uint32_t> ProcessTracker::ResolveNamespacedTid(
 
   // Check if any non-main thread has a matching ns-local thread ID.
   for (const auto& root_level_tid : process.threads) {
-    const auto& thread = namespaced_threads_[root_level_tid];
+    const NamespacedThread* thread_it =
+        namespaced_threads_.Find(root_level_tid);
+    PERFETTO_DCHECK(thread_it);
+    const auto& thread = *thread_it;
     PERFETTO_DCHECK(thread.nstid.size() > ns_level);
     auto tid_ns_local = thread.nstid[ns_level];
     if (tid_ns_local == tid)
@@ -526,8 +531,7 @@ void ProcessTracker::UpdateNamespacedProcess(uint32_t pid,
 void ProcessTracker::UpdateNamespacedThread(uint32_t pid,
                                             uint32_t tid,
                                             std::vector<uint32_t> nstid) {
-  PERFETTO_DCHECK(namespaced_processes_.find(pid) !=
-                  namespaced_processes_.end());
+  PERFETTO_DCHECK(namespaced_processes_.Find(pid));
   auto& process = namespaced_processes_[pid];
   process.threads.emplace(tid);
 
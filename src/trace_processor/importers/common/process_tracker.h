@@ -235,7 +235,7 @@ class ProcessTracker {
   std::vector<ThreadNamePriority> thread_name_priorities_;
 
   // A mapping from track UUIDs to trusted pids.
-  std::unordered_map<uint64_t, uint32_t> trusted_pids_;
+  base::FlatHashMap<uint64_t, uint32_t> trusted_pids_;
 
   struct NamespacedThread {
     uint32_t pid;                 // Root-level pid.
@@ -243,7 +243,7 @@ class ProcessTracker {
     std::vector<uint32_t> nstid;  // Namespace-local tids.
   };
   // Keeps track of pid-namespaced threads, keyed by root-level thread ids.
-  std::unordered_map<uint32_t /* tid */, NamespacedThread> namespaced_threads_;
+  base::FlatHashMap<uint32_t /* tid */, NamespacedThread> namespaced_threads_;
 
   struct NamespacedProcess {
     uint32_t pid;                          // Root-level pid.
@@ -251,7 +251,7 @@ class ProcessTracker {
     std::unordered_set<uint32_t> threads;  // Root-level thread IDs.
   };
   // Keeps track pid-namespaced processes, keyed by root-level pids.
-  std::unordered_map<uint32_t /* pid (aka tgid) */, NamespacedProcess>
+  base::FlatHashMap<uint32_t /* pid (aka tgid) */, NamespacedProcess>
       namespaced_processes_;
 };
 
@@ -43,9 +43,10 @@ base::Optional<SliceId> SliceTracker::Begin(int64_t timestamp,
                                             SetArgsCallback args_callback) {
   tables::SliceTable::Row row(timestamp, kPendingDuration, track_id, category,
                               name);
-  return StartSlice(timestamp, track_id, args_callback, [this, &row]() {
+  auto inserter = [this, &row]() {
     return context_->storage->mutable_slice_table()->Insert(row).id;
-  });
+  };
+  return StartSlice(timestamp, track_id, args_callback, inserter);
 }
 
 void SliceTracker::BeginLegacyUnnestable(tables::SliceTable::Row row,
@@ -57,16 +58,18 @@ void SliceTracker::BeginLegacyUnnestable(tables::SliceTable::Row row,
   // Double check that if we've seen this track in the past, it was also
   // marked as unnestable then.
 #if PERFETTO_DCHECK_IS_ON()
-  auto* it = stacks_.Find(row.track_id);
-  PERFETTO_DCHECK(!it || it->is_legacy_unnestable);
+  const TrackInfo* info = FindTrackInfo(row.track_id);
+  PERFETTO_DCHECK(!info || info->is_legacy_unnestable ||
+                  info->slice_stack.empty());
 #endif
 
   // Ensure that StartSlice knows that this track is unnestable.
-  stacks_[row.track_id].is_legacy_unnestable = true;
+  GetOrCreateTrackInfo(row.track_id)->is_legacy_unnestable = true;
 
-  StartSlice(row.ts, row.track_id, args_callback, [this, &row]() {
+  auto inserter = [this, &row]() {
     return context_->storage->mutable_slice_table()->Insert(row).id;
-  });
+  };
+  StartSlice(row.ts, row.track_id, args_callback, inserter);
 }
 
 base::Optional<SliceId> SliceTracker::Scoped(int64_t timestamp,
@@ -78,9 +81,10 @@ base::Optional<SliceId> SliceTracker::Scoped(int64_t timestamp,
   PERFETTO_DCHECK(duration >= 0);
 
   tables::SliceTable::Row row(timestamp, duration, track_id, category, name);
-  return StartSlice(timestamp, track_id, args_callback, [this, &row]() {
+  auto inserter = [this, &row]() {
     return context_->storage->mutable_slice_table()->Insert(row).id;
-  });
+  };
+  return StartSlice(timestamp, track_id, args_callback, inserter);
 }
 
 base::Optional<SliceId> SliceTracker::End(int64_t timestamp,
@@ -98,11 +102,11 @@ base::Optional<uint32_t> SliceTracker::AddArgs(TrackId track_id,
                                                StringId category,
                                                StringId name,
                                                SetArgsCallback args_callback) {
-  auto* it = stacks_.Find(track_id);
-  if (!it)
+  TrackInfo* track_info = FindTrackInfo(track_id);
+  if (!track_info)
     return base::nullopt;
 
-  auto& stack = it->slice_stack;
+  auto& stack = track_info->slice_stack;
   if (stack.empty())
     return base::nullopt;
 
@@ -124,7 +128,7 @@ base::Optional<SliceId> SliceTracker::StartSlice(
     int64_t timestamp,
     TrackId track_id,
     SetArgsCallback args_callback,
-    std::function<SliceId()> inserter) {
+    SliceInserter inserter) {
   // At this stage all events should be globally timestamp ordered.
   if (timestamp < prev_timestamp_) {
     context_->storage->IncrementStats(stats::slice_out_of_order);
@@ -132,7 +136,7 @@ base::Optional<SliceId> SliceTracker::StartSlice(
   }
   prev_timestamp_ = timestamp;
 
-  auto* track_info = &stacks_[track_id];
+  auto* track_info = GetOrCreateTrackInfo(track_id);
   auto* stack = &track_info->slice_stack;
 
   if (track_info->is_legacy_unnestable) {
@@ -182,11 +186,12 @@ base::Optional<SliceId> SliceTracker::StartSlice(
   return id;
 }
 
+template <typename Finder>
 base::Optional<SliceId> SliceTracker::CompleteSlice(
     int64_t timestamp,
     TrackId track_id,
     SetArgsCallback args_callback,
-    std::function<base::Optional<uint32_t>(const SlicesStack&)> finder) {
+    Finder finder) {
   // At this stage all events should be globally timestamp ordered.
   if (timestamp < prev_timestamp_) {
     context_->storage->IncrementStats(stats::slice_out_of_order);
@@ -194,7 +199,7 @@ base::Optional<SliceId> SliceTracker::CompleteSlice(
   }
   prev_timestamp_ = timestamp;
 
-  auto it = stacks_.Find(track_id);
+  TrackInfo* it = FindTrackInfo(track_id);
   if (!it)
     return base::nullopt;
 
@@ -275,7 +280,7 @@ void SliceTracker::FlushPendingSlices() {
   // TODO(eseckler): Reconsider whether we want to close pending slices by
   // setting their duration to |trace_end - event_start|. Might still want some
   // additional way of flagging these events as "incomplete" to the UI.
-  stacks_.Clear();
+  stacks_.clear();
 }
 
 void SliceTracker::SetOnSliceBeginCallback(OnSliceBeginCallback callback) {
@@ -284,7 +289,7 @@ void SliceTracker::SetOnSliceBeginCallback(OnSliceBeginCallback callback) {
 
 base::Optional<SliceId> SliceTracker::GetTopmostSliceOnTrack(
     TrackId track_id) const {
-  const auto* iter = stacks_.Find(track_id);
+  const auto* iter = FindTrackInfo(track_id);
   if (!iter)
     return base::nullopt;
   const auto& stack = iter->slice_stack;
@@ -374,11 +379,11 @@ int64_t SliceTracker::GetStackHash(const SlicesStack& stack) {
 }
 
 void SliceTracker::StackPop(TrackId track_id) {
-  stacks_[track_id].slice_stack.pop_back();
+  stacks_[track_id.value].slice_stack.pop_back();
 }
 
 void SliceTracker::StackPush(TrackId track_id, uint32_t slice_idx) {
-  stacks_[track_id].slice_stack.push_back(
+  stacks_[track_id.value].slice_stack.push_back(
       SliceInfo{slice_idx, ArgsTracker(context_)});
 
   const auto& slices = context_->storage->slice_table();
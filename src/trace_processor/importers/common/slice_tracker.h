@@ -19,7 +19,10 @@
 
 #include <stdint.h>
 
-#include "perfetto/ext/base/flat_hash_map.h"
+#include <functional>
+#include <vector>
+
+#include "perfetto/ext/base/function_ref.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
 
@@ -31,7 +34,10 @@ class TraceProcessorContext;
 
 class SliceTracker {
  public:
-  using SetArgsCallback = std::function<void(ArgsTracker::BoundInserter*)>;
+  // Not owning: the callback is only invoked before the method it is passed
+  // to returns, so callers can pass lambdas without a heap-allocated closure.
+  using SetArgsCallback = base::FunctionRef<void(ArgsTracker::BoundInserter*)>;
+  using SliceInserter = base::FunctionRef<SliceId()>;
   using OnSliceBeginCallback = std::function<void(TrackId, SliceId)>;
 
   explicit SliceTracker(TraceProcessorContext*);
@@ -61,8 +67,8 @@ class SliceTracker {
       SetArgsCallback args_callback = SetArgsCallback()) {
     // Ensure that the duration is pending for this row.
     row.dur = kPendingDuration;
-    return StartSlice(row.ts, row.track_id, args_callback,
-                      [table, &row]() { return table->Insert(row).id; });
+    auto inserter = [table, &row]() { return table->Insert(row).id; };
+    return StartSlice(row.ts, row.track_id, args_callback, inserter);
   }
 
   // virtual for testing
@@ -80,8 +86,8 @@ class SliceTracker {
       const typename Table::Row& row,
       SetArgsCallback args_callback = SetArgsCallback()) {
     PERFETTO_DCHECK(row.dur >= 0);
-    return StartSlice(row.ts, row.track_id, args_callback,
-                      [table, &row]() { return table->Insert(row).id; });
+    auto inserter = [table, &row]() { return table->Insert(row).id; };
+    return StartSlice(row.ts, row.track_id, args_callback, inserter);
   }
 
   // virtual for testing
@@ -125,19 +131,38 @@ class SliceTracker {
     uint32_t legacy_unnestable_begin_count = 0;
     int64_t legacy_unnestable_last_begin_ts = 0;
   };
-  using StackMap = base::FlatHashMap<TrackId, TrackInfo>;
+  // Indexed by TrackId: track ids are dense, so this is cheaper than a hash
+  // map lookup for every begin/end event.
+  using StackMap = std::vector<TrackInfo>;
 
   // virtual for testing.
   virtual base::Optional<SliceId> StartSlice(int64_t timestamp,
                                              TrackId track_id,
                                              SetArgsCallback args_callback,
-                                             std::function<SliceId()> inserter);
-
-  base::Optional<SliceId> CompleteSlice(
-      int64_t timestamp,
-      TrackId track_id,
-      SetArgsCallback args_callback,
-      std::function<base::Optional<uint32_t>(const SlicesStack&)> finder);
+                                             SliceInserter inserter);
+
+  // |finder| returns the index in the stack of the slice to complete.
+  template <typename Finder>
+  base::Optional<SliceId> CompleteSlice(int64_t timestamp,
+                                        TrackId track_id,
+                                        SetArgsCallback args_callback,
+                                        Finder finder);
+
+  // Returns nullptr if |track_id| is larger than any track a slice was started
+  // on. Otherwise the TrackInfo exists, but may be empty.
+  TrackInfo* FindTrackInfo(TrackId track_id) {
+    return track_id.value < stacks_.size() ? &stacks_[track_id.value]
+                                           : nullptr;
+  }
+  const TrackInfo* FindTrackInfo(TrackId track_id) const {
+    return track_id.value < stacks_.size() ? &stacks_[track_id.value]
+                                           : nullptr;
+  }
+  TrackInfo* GetOrCreateTrackInfo(TrackId track_id) {
+    if (track_id.value >= stacks_.size())
+      stacks_.resize(track_id.value + 1);
+    return &stacks_[track_id.value];
+  }
 
   void MaybeCloseStack(int64_t end_ts, SlicesStack*, TrackId track_id);
 
@@ -0,0 +1,126 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/importers/common/args_tracker.h"
+#include "src/trace_processor/importers/common/global_args_tracker.h"
+#include "src/trace_processor/importers/common/slice_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1);
+  } else {
+    b->Arg(1);
+    b->Arg(64);
+    b->Arg(4096);
+  }
+}
+
+struct Event {
+  TrackId track_id;
+  bool is_begin;
+};
+
+// A stream of properly nested begin/end events interleaved across
+// |num_tracks| tracks, similar to the thread slices of a Chrome trace.
+std::vector<Event> CreateEvents(uint32_t num_slices, uint32_t num_tracks) {
+  static constexpr uint32_t kRandomSeed = 42;
+  static constexpr size_t kMaxDepth = 16;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  std::vector<size_t> depths(num_tracks);
+  std::vector<Event> events;
+  uint32_t begins = 0;
+  while (begins < num_slices) {
+    uint32_t track = rnd_engine() % num_tracks;
+    size_t& depth = depths[track];
+    bool is_begin = depth == 0 || (depth < kMaxDepth && rnd_engine() % 2);
+    events.push_back(Event{TrackId{track}, is_begin});
+    if (is_begin) {
+      depth++;
+      begins++;
+    } else {
+      depth--;
+    }
+  }
+  for (uint32_t track = 0; track < num_tracks; ++track) {
+    for (; depths[track] > 0; depths[track]--)
+      events.push_back(Event{TrackId{track}, false});
+  }
+  return events;
+}
+
+void BM_SliceTrackerBeginEnd(benchmark::State& state) {
+  static constexpr uint32_t kNumSlices = 100000;
+  const uint32_t num_tracks = static_cast<uint32_t>(state.range(0));
+  std::vector<Event> events = CreateEvents(kNumSlices, num_tracks);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    context.global_args_tracker.reset(new GlobalArgsTracker(&context));
+    context.slice_tracker.reset(new SliceTracker(&context));
+    StringId cat = context.storage->InternString("cat");
+    StringId name = context.storage->InternString("name");
+    StringId arg_key = context.storage->InternString("arg");
+    state.ResumeTiming();
+
+    int64_t ts = 0;
+    for (const Event& event : events) {
+      // Captures more than fits in the inline storage of a std::function.
+      auto args_callback = [arg_key, ts, &event,
+                            &context](ArgsTracker::BoundInserter* inserter) {
+        inserter->AddArg(arg_key, Variadic::Integer(ts + event.track_id.value));
+        benchmark::DoNotOptimize(&context);
+      };
+      if (event.is_begin) {
+        context.slice_tracker->Begin(ts, event.track_id, cat, name,
+                                     args_callback);
+      } else {
+        context.slice_tracker->End(ts, event.track_id, cat, name,
+                                   args_callback);
+      }
+      ts++;
+    }
+    context.slice_tracker->FlushPendingSlices();
+    benchmark::ClobberMemory();
+
+    state.PauseTiming();
+    context.slice_tracker.reset();
+    context.storage.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kNumSlices);
+}
+BENCHMARK(BM_SliceTrackerBeginEnd)->Apply(BenchmarkArgs);
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
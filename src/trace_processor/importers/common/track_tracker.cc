@@ -34,26 +34,26 @@ TrackTracker::TrackTracker(TraceProcessorContext* context)
       context_(context) {}
 
 TrackId TrackTracker::InternThreadTrack(UniqueTid utid) {
-  auto it = thread_tracks_.find(utid);
-  if (it != thread_tracks_.end())
-    return it->second;
+  base::Optional<TrackId>* track = FindOrInsertDense(&thread_tracks_, utid);
+  if (*track)
+    return **track;
 
   tables::ThreadTrackTable::Row row;
   row.utid = utid;
   auto id = context_->storage->mutable_thread_track_table()->Insert(row).id;
-  thread_tracks_[utid] = id;
+  *track = id;
   return id;
 }
 
 TrackId TrackTracker::InternProcessTrack(UniquePid upid) {
-  auto it = process_tracks_.find(upid);
-  if (it != process_tracks_.end())
-    return it->second;
+  base::Optional<TrackId>* track = FindOrInsertDense(&process_tracks_, upid);
+  if (*track)
+    return **track;
 
   tables::ProcessTrackTable::Row row;
   row.upid = upid;
   auto id = context_->storage->mutable_process_track_table()->Insert(row).id;
-  process_tracks_[upid] = id;
+  *track = id;
   return id;
 }
 
@@ -65,10 +65,9 @@ TrackId TrackTracker::InternFuchsiaAsyncTrack(StringId name,
 }
 
 TrackId TrackTracker::InternCpuTrack(StringId name, uint32_t cpu) {
-  auto it = cpu_tracks_.find(std::make_pair(name, cpu));
-  if (it != cpu_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = cpu_tracks_.Find(std::make_pair(name, cpu));
+  if (it)
+    return *it;
 
   tables::TrackTable::Row row(name);
   auto id = context_->storage->mutable_track_table()->Insert(row).id;
@@ -80,9 +79,9 @@ TrackId TrackTracker::InternCpuTrack(StringId name, uint32_t cpu) {
 TrackId TrackTracker::InternGpuTrack(const tables::GpuTrackTable::Row& row) {
   GpuTrackTuple tuple{row.name, row.scope, row.context_id.value_or(0)};
 
-  auto it = gpu_tracks_.find(tuple);
-  if (it != gpu_tracks_.end())
-    return it->second;
+  auto* it = gpu_tracks_.Find(tuple);
+  if (it)
+    return *it;
 
   auto id = context_->storage->mutable_gpu_track_table()->Insert(row).id;
   gpu_tracks_[tuple] = id;
@@ -101,17 +100,17 @@ TrackId TrackTracker::InternLegacyChromeAsyncTrack(
   tuple.source_id = source_id;
   tuple.source_scope = source_scope;
 
-  auto it = chrome_tracks_.find(tuple);
-  if (it != chrome_tracks_.end()) {
+  auto* it = chrome_tracks_.Find(tuple);
+  if (it) {
     if (name != kNullStringId) {
       // The track may have been created for an end event without name. In that
       // case, update it with this event's name.
       auto* tracks = context_->storage->mutable_track_table();
-      uint32_t track_row = *tracks->id().IndexOf(it->second);
+      uint32_t track_row = *tracks->id().IndexOf(*it);
       if (tracks->name()[track_row] == kNullStringId)
         tracks->mutable_name()->Set(track_row, name);
     }
-    return it->second;
+    return *it;
   }
 
   // Legacy async tracks are always drawn in the context of a process, even if
@@ -156,14 +155,15 @@ TrackId TrackTracker::CreateProcessAsyncTrack(StringId name,
 }
 
 TrackId TrackTracker::InternLegacyChromeProcessInstantTrack(UniquePid upid) {
-  auto it = chrome_process_instant_tracks_.find(upid);
-  if (it != chrome_process_instant_tracks_.end())
-    return it->second;
+  base::Optional<TrackId>* track =
+      FindOrInsertDense(&chrome_process_instant_tracks_, upid);
+  if (*track)
+    return **track;
 
   tables::ProcessTrackTable::Row row;
   row.upid = upid;
   auto id = context_->storage->mutable_process_track_table()->Insert(row).id;
-  chrome_process_instant_tracks_[upid] = id;
+  *track = id;
 
   context_->args_tracker->AddArgsTo(id).AddArg(
       source_key_, Variadic::String(chrome_source_));
@@ -195,10 +195,9 @@ TrackId TrackTracker::GetOrCreateTriggerTrack() {
 TrackId TrackTracker::InternGlobalCounterTrack(StringId name,
                                                StringId unit,
                                                StringId description) {
-  auto it = global_counter_tracks_by_name_.find(name);
-  if (it != global_counter_tracks_by_name_.end()) {
-    return it->second;
-  }
+  auto* it = global_counter_tracks_by_name_.Find(name);
+  if (it)
+    return *it;
 
   tables::CounterTrackTable::Row row(name);
   row.unit = unit;
@@ -210,10 +209,9 @@ TrackId TrackTracker::InternGlobalCounterTrack(StringId name,
 }
 
 TrackId TrackTracker::InternCpuCounterTrack(StringId name, uint32_t cpu) {
-  auto it = cpu_counter_tracks_.find(std::make_pair(name, cpu));
-  if (it != cpu_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = cpu_counter_tracks_.Find(std::make_pair(name, cpu));
+  if (it)
+    return *it;
 
   tables::CpuCounterTrackTable::Row row(name);
   row.cpu = cpu;
@@ -225,10 +223,9 @@ TrackId TrackTracker::InternCpuCounterTrack(StringId name, uint32_t cpu) {
 }
 
 TrackId TrackTracker::InternThreadCounterTrack(StringId name, UniqueTid utid) {
-  auto it = utid_counter_tracks_.find(std::make_pair(name, utid));
-  if (it != utid_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = utid_counter_tracks_.Find(std::make_pair(name, utid));
+  if (it)
+    return *it;
 
   tables::ThreadCounterTrackTable::Row row(name);
   row.utid = utid;
@@ -243,10 +240,9 @@ TrackId TrackTracker::InternProcessCounterTrack(StringId name,
                                                 UniquePid upid,
                                                 StringId unit,
                                                 StringId description) {
-  auto it = upid_counter_tracks_.find(std::make_pair(name, upid));
-  if (it != upid_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = upid_counter_tracks_.Find(std::make_pair(name, upid));
+  if (it)
+    return *it;
 
   tables::ProcessCounterTrackTable::Row row(name);
   row.upid = upid;
@@ -260,10 +256,9 @@ TrackId TrackTracker::InternProcessCounterTrack(StringId name,
 }
 
 TrackId TrackTracker::InternIrqCounterTrack(StringId name, int32_t irq) {
-  auto it = irq_counter_tracks_.find(std::make_pair(name, irq));
-  if (it != irq_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = irq_counter_tracks_.Find(std::make_pair(name, irq));
+  if (it)
+    return *it;
 
   tables::IrqCounterTrackTable::Row row(name);
   row.irq = irq;
@@ -276,10 +271,9 @@ TrackId TrackTracker::InternIrqCounterTrack(StringId name, int32_t irq) {
 
 TrackId TrackTracker::InternSoftirqCounterTrack(StringId name,
                                                 int32_t softirq) {
-  auto it = softirq_counter_tracks_.find(std::make_pair(name, softirq));
-  if (it != softirq_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = softirq_counter_tracks_.Find(std::make_pair(name, softirq));
+  if (it)
+    return *it;
 
   tables::SoftirqCounterTrackTable::Row row(name);
   row.softirq = softirq;
@@ -291,10 +285,9 @@ TrackId TrackTracker::InternSoftirqCounterTrack(StringId name,
 }
 
 TrackId TrackTracker::InternGpuCounterTrack(StringId name, uint32_t gpu_id) {
-  auto it = gpu_counter_tracks_.find(std::make_pair(name, gpu_id));
-  if (it != gpu_counter_tracks_.end()) {
-    return it->second;
-  }
+  auto* it = gpu_counter_tracks_.Find(std::make_pair(name, gpu_id));
+  if (it)
+    return *it;
   TrackId track = CreateGpuCounterTrack(name, gpu_id);
   gpu_counter_tracks_[std::make_pair(name, gpu_id)] = track;
   return track;
@@ -17,6 +17,12 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_TRACK_TRACKER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_COMMON_TRACK_TRACKER_H_
 
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -119,8 +125,8 @@ class TrackTracker {
     StringId scope;
     int64_t context_id;
 
-    friend bool operator<(const GpuTrackTuple& l, const GpuTrackTuple& r) {
-      return std::tie(l.track_name, l.scope, l.context_id) <
+    friend bool operator==(const GpuTrackTuple& l, const GpuTrackTuple& r) {
+      return std::tie(l.track_name, l.scope, l.context_id) ==
              std::tie(r.track_name, r.scope, r.context_id);
     }
   };
@@ -129,30 +135,73 @@ class TrackTracker {
     int64_t source_id = 0;
     StringId source_scope = StringId::Null();
 
-    friend bool operator<(const ChromeTrackTuple& l,
-                          const ChromeTrackTuple& r) {
-      return std::tie(l.source_id, l.upid, l.source_scope) <
+    friend bool operator==(const ChromeTrackTuple& l,
+                           const ChromeTrackTuple& r) {
+      return std::tie(l.source_id, l.upid, l.source_scope) ==
              std::tie(r.source_id, r.upid, r.source_scope);
     }
   };
 
-  std::map<UniqueTid, TrackId> thread_tracks_;
-  std::map<UniquePid, TrackId> process_tracks_;
-  std::map<int64_t /* correlation_id */, TrackId> fuchsia_async_tracks_;
-
-  std::map<std::pair<StringId, uint32_t /* cpu */>, TrackId> cpu_tracks_;
-
-  std::map<GpuTrackTuple, TrackId> gpu_tracks_;
-  std::map<ChromeTrackTuple, TrackId> chrome_tracks_;
-  std::map<UniquePid, TrackId> chrome_process_instant_tracks_;
-
-  std::map<StringId, TrackId> global_counter_tracks_by_name_;
-  std::map<std::pair<StringId, uint32_t>, TrackId> cpu_counter_tracks_;
-  std::map<std::pair<StringId, UniqueTid>, TrackId> utid_counter_tracks_;
-  std::map<std::pair<StringId, UniquePid>, TrackId> upid_counter_tracks_;
-  std::map<std::pair<StringId, int32_t>, TrackId> irq_counter_tracks_;
-  std::map<std::pair<StringId, int32_t>, TrackId> softirq_counter_tracks_;
-  std::map<std::pair<StringId, uint32_t>, TrackId> gpu_counter_tracks_;
+  // Hasher for all the keys of the maps below. std::hash of integers is the
+  // identity, which clusters badly in FlatHashMap for small ids.
+  struct KeyHash {
+    size_t operator()(StringId name) const {
+      base::Hash hash;
+      hash.Update(name.raw_id());
+      return static_cast<size_t>(hash.digest());
+    }
+    template <typename T>
+    size_t operator()(const std::pair<StringId, T>& key) const {
+      base::Hash hash;
+      hash.Update(key.first.raw_id());
+      hash.Update(key.second);
+      return static_cast<size_t>(hash.digest());
+    }
+    size_t operator()(const GpuTrackTuple& key) const {
+      base::Hash hash;
+      hash.Update(key.track_name.raw_id());
+      hash.Update(key.scope.raw_id());
+      hash.Update(key.context_id);
+      return static_cast<size_t>(hash.digest());
+    }
+    size_t operator()(const ChromeTrackTuple& key) const {
+      base::Hash hash;
+      hash.Update(key.upid.has_value());
+      hash.Update(key.upid.value_or(0));
+      hash.Update(key.source_id);
+      hash.Update(key.source_scope.raw_id());
+      return static_cast<size_t>(hash.digest());
+    }
+  };
+  template <typename Key>
+  using TrackMap = base::FlatHashMap<Key, TrackId, KeyHash>;
+
+  // Tracks keyed by a utid or upid. These are dense, so are stored in a
+  // vector indexed by the id rather than in a map.
+  using DenseTrackMap = std::vector<base::Optional<TrackId>>;
+  static base::Optional<TrackId>* FindOrInsertDense(DenseTrackMap* map,
+                                                    uint32_t id) {
+    if (id >= map->size())
+      map->resize(id + 1);
+    return &(*map)[id];
+  }
+
+  DenseTrackMap thread_tracks_;
+  DenseTrackMap process_tracks_;
+
+  TrackMap<std::pair<StringId, uint32_t /* cpu */>> cpu_tracks_;
+
+  TrackMap<GpuTrackTuple> gpu_tracks_;
+  TrackMap<ChromeTrackTuple> chrome_tracks_;
+  DenseTrackMap chrome_process_instant_tracks_;
+
+  TrackMap<StringId> global_counter_tracks_by_name_;
+  TrackMap<std::pair<StringId, uint32_t>> cpu_counter_tracks_;
+  TrackMap<std::pair<StringId, UniqueTid>> utid_counter_tracks_;
+  TrackMap<std::pair<StringId, UniquePid>> upid_counter_tracks_;
+  TrackMap<std::pair<StringId, int32_t>> irq_counter_tracks_;
+  TrackMap<std::pair<StringId, int32_t>> softirq_counter_tracks_;
+  TrackMap<std::pair<StringId, uint32_t>> gpu_counter_tracks_;
 
   base::Optional<TrackId> chrome_global_instant_track_id_;
   base::Optional<TrackId> trigger_track_id_;
@@ -0,0 +1,153 @@
+// Copyright (C) 2022 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/importers/common/event_tracker.h"
+#include "src/trace_processor/importers/common/process_tracker.h"
+#include "src/trace_processor/importers/common/track_tracker.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void BenchmarkArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(16);
+  } else {
+    b->Arg(16);
+    b->Arg(1024);
+  }
+}
+
+enum class CounterKind { kCpu, kProcess, kThread, kGpu, kIrq };
+
+struct CounterEvent {
+  CounterKind kind;
+  uint32_t name_idx;
+  uint32_t id;
+};
+
+// A stream of counter events resembling a trace dominated by cpufreq and
+// cpuidle (per cpu), rss_stat (per process), GPU counters and irq counts.
+std::vector<CounterEvent> CreateEvents(uint32_t num_events,
+                                       uint32_t num_processes) {
+  static constexpr uint32_t kRandomSeed = 42;
+  static constexpr uint32_t kNumCpus = 8;
+  static constexpr uint32_t kNumNames = 5;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  std::vector<CounterEvent> events(num_events);
+  for (CounterEvent& event : events) {
+    uint32_t r = rnd_engine() % 10;
+    event.name_idx = rnd_engine() % kNumNames;
+    if (r < 4) {
+      event.kind = CounterKind::kCpu;
+      event.id = rnd_engine() % kNumCpus;
+    } else if (r < 7) {
+      event.kind = CounterKind::kProcess;
+      event.id = 1 + rnd_engine() % num_processes;
+    } else if (r < 8) {
+      event.kind = CounterKind::kThread;
+      event.id = 1 + rnd_engine() % num_processes;
+    } else if (r < 9) {
+      event.kind = CounterKind::kGpu;
+      event.id = rnd_engine() % 2;
+    } else {
+      event.kind = CounterKind::kIrq;
+      event.id = rnd_engine() % 64;
+    }
+  }
+  return events;
+}
+
+void BM_TrackTrackerCounterIngestion(benchmark::State& state) {
+  static constexpr uint32_t kNumEvents = 200000;
+  const uint32_t num_processes = static_cast<uint32_t>(state.range(0));
+  std::vector<CounterEvent> events = CreateEvents(kNumEvents, num_processes);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    TraceProcessorContext context;
+    context.storage.reset(new TraceStorage());
+    context.process_tracker.reset(new ProcessTracker(&context));
+    context.track_tracker.reset(new TrackTracker(&context));
+    context.event_tracker.reset(new EventTracker(&context));
+    std::vector<StringId> names;
+    for (uint32_t i = 0; i < 5; ++i) {
+      names.push_back(context.storage->InternString(
+          base::StringView("counter_" + std::to_string(i))));
+    }
+    std::vector<UniquePid> upids;
+    std::vector<UniqueTid> utids;
+    for (uint32_t pid = 1; pid <= num_processes; ++pid) {
+      upids.push_back(context.process_tracker->GetOrCreateProcess(pid));
+      utids.push_back(context.process_tracker->UpdateThread(pid, pid));
+    }
+    state.ResumeTiming();
+
+    TrackTracker* track_tracker = context.track_tracker.get();
+    int64_t ts = 0;
+    for (const CounterEvent& event : events) {
+      StringId name = names[event.name_idx];
+      TrackId track_id;
+      switch (event.kind) {
+        case CounterKind::kCpu:
+          track_id = track_tracker->InternCpuCounterTrack(name, event.id);
+          break;
+        case CounterKind::kProcess:
+          track_id = track_tracker->InternProcessCounterTrack(
+              name, upids[event.id - 1]);
+          break;
+        case CounterKind::kThread:
+          track_id = track_tracker->InternThreadCounterTrack(
+              name, utids[event.id - 1]);
+          break;
+        case CounterKind::kGpu:
+          track_id = track_tracker->InternGpuCounterTrack(name, event.id);
+          break;
+        case CounterKind::kIrq:
+          track_id = track_tracker->InternIrqCounterTrack(
+              name, static_cast<int32_t>(event.id));
+          break;
+      }
+      context.event_tracker->PushCounter(ts++, 1.0, track_id);
+    }
+    benchmark::ClobberMemory();
+
+    state.PauseTiming();
+    context.event_tracker.reset();
+    context.track_tracker.reset();
+    context.process_tracker.reset();
+    context.storage.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          kNumEvents);
+}
+BENCHMARK(BM_TrackTrackerCounterIngestion)->Apply(BenchmarkArgs);
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
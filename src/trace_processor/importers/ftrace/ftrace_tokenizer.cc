@@ -16,9 +16,15 @@
 
 #include "src/trace_processor/importers/ftrace/ftrace_tokenizer.h"
 
+#include <string.h>
+
+#include <limits>
+
 #include "perfetto/base/logging.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_blob.h"
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/trace_sorter.h"
@@ -26,6 +32,7 @@
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
 #include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/generic.pbzero.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -37,11 +44,46 @@ using protozero::proto_utils::ParseVarInt;
 using protos::pbzero::BuiltinClock;
 using protos::pbzero::FtraceClock;
 using protos::pbzero::FtraceEventBundle;
+using protos::pbzero::GenericFtraceEvent;
+using RawFormatsProto = protos::pbzero::FtraceEventBundle::RawFormats;
 
 namespace {
 
 static constexpr uint32_t kFtraceGlobalClockIdForOldKernels = 64;
 
+// Constants of the kernel ring buffer format, see the comments in
+// src/traced/probes/ftrace/cpu_reader.cc, which decodes the same pages
+// on-device when FtraceConfig.raw_pages is not set.
+constexpr uint64_t kPageDataSizeMask = (1ull << 27) - 1;
+constexpr uint32_t kTypeDataTypeLengthMax = 28;
+constexpr uint32_t kTypePadding = 29;
+constexpr uint32_t kTypeTimeExtend = 30;
+constexpr uint32_t kTypeTimeStamp = 31;
+
+template <typename T>
+bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
+  if (static_cast<size_t>(end - *ptr) < sizeof(T))
+    return false;
+  memcpy(out, *ptr, sizeof(T));
+  *ptr += sizeof(T);
+  return true;
+}
+
+// Reads a little endian integer of |size| <= 8 bytes.
+uint64_t ReadUnsigned(const uint8_t* ptr, uint32_t size) {
+  uint64_t value = 0;
+  memcpy(&value, ptr, size);
+  return value;
+}
+
+void AppendCString(const uint8_t* start,
+                   size_t max_len,
+                   uint32_t field_id,
+                   protozero::Message* out) {
+  const char* str = reinterpret_cast<const char*>(start);
+  out->AppendBytes(field_id, str, strnlen(str, max_len));
+}
+
 PERFETTO_ALWAYS_INLINE base::Optional<int64_t> ResolveTraceTime(
     TraceProcessorContext* context,
     ClockTracker::ClockId clock_id,
@@ -99,9 +141,308 @@ base::Status FtraceTokenizer::TokenizeFtraceBundle(
     TokenizeFtraceEvent(cpu, clock_id, bundle.slice(it->data(), it->size()),
                         state);
   }
+
+  if (decoder.has_raw_formats())
+    TokenizeFtraceRawFormats(packet_sequence_id, decoder.raw_formats());
+
+  if (decoder.has_raw_page()) {
+    auto formats_it = raw_formats_.find(packet_sequence_id);
+    const RawFormats* raw_formats =
+        formats_it == raw_formats_.end() ? nullptr : formats_it->second.get();
+    for (auto it = decoder.raw_page(); it; ++it)
+      TokenizeFtraceRawPage(raw_formats, cpu, clock_id, *it, state);
+  }
   return base::OkStatus();
 }
 
+// The formats are incremental state of the packet sequence: they depend on the
+// events enabled by each data source, and the pages which follow them have
+// SEQ_NEEDS_INCREMENTAL_STATE, so that they are dropped by ProtoTraceReader
+// when the formats were lost.
+void FtraceTokenizer::TokenizeFtraceRawFormats(uint32_t packet_sequence_id,
+                                               protozero::ConstBytes blob) {
+  RawFormatsProto::Decoder decoder(blob);
+  std::unique_ptr<RawFormats> formats(new RawFormats());
+  formats->page_header_size_len = decoder.page_header_size_len();
+
+  auto parse_field = [](protozero::ConstBytes field_blob) {
+    RawFormatsProto::Field::Decoder field(field_blob);
+    RawField raw_field;
+    raw_field.offset = field.offset();
+    raw_field.size = field.size();
+    // Unknown encodings fail in DecodeRawField().
+    raw_field.encoding =
+        static_cast<RawFormatsProto::Encoding>(field.encoding());
+    raw_field.proto_field_id = field.proto_field_id();
+    raw_field.name = field.name().ToStdString();
+    return raw_field;
+  };
+
+  for (auto it = decoder.common_field(); it; ++it)
+    formats->common_fields.emplace_back(parse_field(*it));
+
+  for (auto it = decoder.event(); it; ++it) {
+    RawFormatsProto::Event::Decoder event(*it);
+    uint32_t ftrace_id = event.ftrace_id();
+    // Ids are 16 bits in the ring buffer, anything else is garbage.
+    if (ftrace_id > std::numeric_limits<uint16_t>::max())
+      continue;
+    if (ftrace_id >= formats->events.size())
+      formats->events.resize(ftrace_id + 1);
+    RawEvent& raw_event = formats->events[ftrace_id];
+    raw_event.proto_field_id = event.proto_field_id();
+    raw_event.size = event.size();
+    raw_event.name = event.name().ToStdString();
+    for (auto field_it = event.field(); field_it; ++field_it)
+      raw_event.fields.emplace_back(parse_field(*field_it));
+  }
+
+  for (auto it = decoder.printk_format(); it; ++it) {
+    RawFormatsProto::PrintkFormat::Decoder printk_format(*it);
+    formats->printk_formats[printk_format.address()] =
+        printk_format.str().ToStdString();
+  }
+  raw_formats_[packet_sequence_id] = std::move(formats);
+}
+
+// Decodes the events of the page into FtraceEvent protos, exactly like
+// CpuReader would have done on the device, and tokenizes them as such.
+void FtraceTokenizer::TokenizeFtraceRawPage(const RawFormats* raw_formats,
+                                            uint32_t cpu,
+                                            ClockTracker::ClockId clock_id,
+                                            protozero::ConstBytes page,
+                                            PacketSequenceState* state) {
+  const uint8_t* ptr = page.data;
+  const uint8_t* const end_of_page = page.data + page.size;
+  uint64_t page_timestamp = 0;
+  uint32_t size_and_flags = 0;
+  if (!raw_formats ||
+      (raw_formats->page_header_size_len != 4 &&
+       raw_formats->page_header_size_len != 8) ||
+      !ReadAndAdvance(&ptr, end_of_page, &page_timestamp) ||
+      !ReadAndAdvance(&ptr, end_of_page, &size_and_flags)) {
+    context_->storage->IncrementStats(stats::ftrace_raw_page_errors);
+    return;
+  }
+  // Skip the upper half of the commit field on 64 bit kernels.
+  const size_t commit_padding = raw_formats->page_header_size_len - 4u;
+  const uint64_t payload_size = size_and_flags & kPageDataSizeMask;
+  if (commit_padding > static_cast<size_t>(end_of_page - ptr) ||
+      payload_size >
+          static_cast<uint64_t>(end_of_page - ptr) - commit_padding) {
+    context_->storage->IncrementStats(stats::ftrace_raw_page_errors);
+    return;
+  }
+  ptr += commit_padding;
+
+  protozero::HeapBuffered<FtraceEventBundle> decoded;
+  if (!DecodeRawPagePayload(*raw_formats, ptr, ptr + payload_size,
+                            page_timestamp, decoded.get())) {
+    // Keep the events decoded up to the error, like CpuReader would.
+    context_->storage->IncrementStats(stats::ftrace_raw_page_errors);
+  }
+
+  std::vector<uint8_t> buf = decoded.SerializeAsArray();
+  TraceBlobView blob(TraceBlob::CopyFrom(buf.data(), buf.size()));
+  FtraceEventBundle::Decoder decoder(blob.data(), blob.length());
+  for (auto it = decoder.event(); it; ++it) {
+    TokenizeFtraceEvent(cpu, clock_id, blob.slice(it->data(), it->size()),
+                        state);
+  }
+}
+
+bool FtraceTokenizer::DecodeRawPagePayload(const RawFormats& raw_formats,
+                                           const uint8_t* ptr,
+                                           const uint8_t* end,
+                                           uint64_t timestamp,
+                                           FtraceEventBundle* out) {
+  struct EventHeader {
+    uint32_t type_or_length : 5;
+    uint32_t time_delta : 27;
+  };
+
+  while (ptr < end) {
+    EventHeader event_header;
+    if (!ReadAndAdvance(&ptr, end, &event_header))
+      return false;
+    timestamp += event_header.time_delta;
+
+    switch (event_header.type_or_length) {
+      case kTypePadding: {
+        uint32_t length = 0;
+        if (event_header.time_delta == 0 ||
+            !ReadAndAdvance(&ptr, end, &length) || length < 4 ||
+            length - 4 > static_cast<size_t>(end - ptr)) {
+          return false;
+        }
+        ptr += length - 4;
+        break;
+      }
+      case kTypeTimeExtend: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance(&ptr, end, &time_delta_ext))
+          return false;
+        timestamp += static_cast<uint64_t>(time_delta_ext) << 27;
+        break;
+      }
+      case kTypeTimeStamp: {
+        uint32_t time_delta_ext = 0;
+        if (!ReadAndAdvance(&ptr, end, &time_delta_ext))
+          return false;
+        timestamp = event_header.time_delta +
+                    (static_cast<uint64_t>(time_delta_ext) << 27);
+        break;
+      }
+      default: {
+        PERFETTO_DCHECK(event_header.type_or_length <= kTypeDataTypeLengthMax);
+        uint32_t event_size = 0;
+        if (event_header.type_or_length == 0) {
+          if (!ReadAndAdvance(&ptr, end, &event_size) || event_size < 4)
+            return false;
+          event_size -= 4;
+        } else {
+          event_size = 4 * event_header.type_or_length;
+        }
+        const uint8_t* start = ptr;
+        if (event_size > static_cast<size_t>(end - start))
+          return false;
+        const uint8_t* next = start + event_size;
+
+        uint16_t ftrace_id = 0;
+        if (!ReadAndAdvance(&ptr, next, &ftrace_id))
+          return false;
+
+        // Events not described in the formats were enabled by other tracing
+        // sessions: skip them, as CpuReader would.
+        if (ftrace_id < raw_formats.events.size() &&
+            raw_formats.events[ftrace_id].proto_field_id) {
+          protos::pbzero::FtraceEvent* event = out->add_event();
+          event->set_timestamp(timestamp);
+          if (!DecodeRawEvent(raw_formats, raw_formats.events[ftrace_id], start,
+                              next, event)) {
+            return false;
+          }
+        }
+        ptr = next;
+      }
+    }
+  }
+  return true;
+}
+
+// Mirrors CpuReader::ParseEvent().
+bool FtraceTokenizer::DecodeRawEvent(const RawFormats& raw_formats,
+                                     const RawEvent& raw_event,
+                                     const uint8_t* start,
+                                     const uint8_t* end,
+                                     protos::pbzero::FtraceEvent* out) {
+  if (raw_event.size > static_cast<size_t>(end - start))
+    return false;
+
+  bool success = true;
+  for (const RawField& field : raw_formats.common_fields)
+    success &= DecodeRawField(raw_formats, field, start, end, out);
+
+  protozero::Message* nested =
+      out->BeginNestedMessage<protozero::Message>(raw_event.proto_field_id);
+  if (raw_event.proto_field_id ==
+      protos::pbzero::FtraceEvent::kGenericFieldNumber) {
+    nested->AppendString(GenericFtraceEvent::kEventNameFieldNumber,
+                         raw_event.name);
+    for (const RawField& field : raw_event.fields) {
+      auto* generic_field = nested->BeginNestedMessage<protozero::Message>(
+          GenericFtraceEvent::kFieldFieldNumber);
+      generic_field->AppendString(GenericFtraceEvent::Field::kNameFieldNumber,
+                                  field.name);
+      success &= DecodeRawField(raw_formats, field, start, end, generic_field);
+    }
+  } else {
+    for (const RawField& field : raw_event.fields)
+      success &= DecodeRawField(raw_formats, field, start, end, nested);
+  }
+  return success;
+}
+
+// Mirrors CpuReader::ParseField().
+bool FtraceTokenizer::DecodeRawField(const RawFormats& raw_formats,
+                                     const RawField& field,
+                                     const uint8_t* start,
+                                     const uint8_t* end,
+                                     protozero::Message* out) {
+  if (field.offset > static_cast<size_t>(end - start) ||
+      field.size > static_cast<size_t>(end - start) - field.offset) {
+    return false;
+  }
+  const uint8_t* field_start = start + field.offset;
+  const uint32_t field_id = field.proto_field_id;
+
+  switch (field.encoding) {
+    case RawFormatsProto::ENCODING_UINT:
+      if (field.size > sizeof(uint64_t))
+        return false;
+      out->AppendVarInt(field_id, ReadUnsigned(field_start, field.size));
+      return true;
+    case RawFormatsProto::ENCODING_INT: {
+      if (field.size == 0 || field.size > sizeof(uint64_t))
+        return false;
+      // Sign-extend from the width of the field.
+      uint64_t value = ReadUnsigned(field_start, field.size);
+      const uint32_t shift = 64 - 8 * field.size;
+      out->AppendVarInt(field_id,
+                        static_cast<int64_t>(value << shift) >> shift);
+      return true;
+    }
+    case RawFormatsProto::ENCODING_FIXED_CSTRING:
+      AppendCString(field_start, field.size, field_id, out);
+      return true;
+    case RawFormatsProto::ENCODING_CSTRING:
+      AppendCString(field_start, static_cast<size_t>(end - field_start),
+                    field_id, out);
+      return true;
+    case RawFormatsProto::ENCODING_STRING_PTR: {
+      if (field.size > sizeof(uint64_t))
+        return false;
+      auto it = raw_formats.printk_formats.find(
+          ReadUnsigned(field_start, field.size));
+      if (it == raw_formats.printk_formats.end()) {
+        out->AppendBytes(field_id, "", 0);
+      } else {
+        out->AppendBytes(field_id, it->second.data(), it->second.size());
+      }
+      return true;
+    }
+    case RawFormatsProto::ENCODING_DATA_LOC: {
+      if (field.size != 4)
+        return false;
+      uint32_t data = static_cast<uint32_t>(ReadUnsigned(field_start, 4));
+      const uint32_t offset = data & 0xffff;
+      const uint32_t len = (data >> 16) & 0xffff;
+      if (offset == 0 || offset > static_cast<size_t>(end - start) ||
+          len > static_cast<size_t>(end - start) - offset) {
+        return false;
+      }
+      AppendCString(start + offset, len, field_id, out);
+      return true;
+    }
+    case RawFormatsProto::ENCODING_DEV_ID: {
+      if (field.size != 4 && field.size != 8)
+        return false;
+      // Same as CpuReader::TranslateBlockDeviceIDToUserspace().
+      uint64_t kernel_dev = ReadUnsigned(field_start, field.size);
+      uint64_t maj = kernel_dev >> 20;
+      uint64_t min = kernel_dev & ((1U << 20) - 1);
+      out->AppendVarInt(field_id, ((maj & 0xfffff000ULL) << 32) |
+                                      ((maj & 0xfffULL) << 8) |
+                                      ((min & 0xffffff00ULL) << 12) |
+                                      ((min & 0xffULL)));
+      return true;
+    }
+    case RawFormatsProto::ENCODING_UNSPECIFIED:
+      break;
+  }
+  return false;
+}
+
 PERFETTO_ALWAYS_INLINE
 void FtraceTokenizer::TokenizeFtraceEvent(uint32_t cpu,
                                           ClockTracker::ClockId clock_id,
@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_TOKENIZER_H_
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/importers/common/clock_tracker.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -39,6 +44,29 @@ class FtraceTokenizer {
                                     uint32_t packet_sequence_id);
 
  private:
+  // Layout of the events in the raw ftrace pages, from the last
+  // FtraceEventBundle.RawFormats seen on a packet sequence. See
+  // FtraceConfig.raw_pages.
+  struct RawField {
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    protos::pbzero::FtraceEventBundle::RawFormats::Encoding encoding{};
+    uint32_t proto_field_id = 0;
+    std::string name;  // Only for generic events.
+  };
+  struct RawEvent {
+    uint32_t proto_field_id = 0;  // 0 if the event is not described.
+    uint32_t size = 0;
+    std::string name;  // Only for generic events.
+    std::vector<RawField> fields;
+  };
+  struct RawFormats {
+    uint32_t page_header_size_len = 0;
+    std::vector<RawField> common_fields;
+    std::vector<RawEvent> events;  // Indexed by ftrace event id.
+    std::unordered_map<uint64_t, std::string> printk_formats;
+  };
+
   void TokenizeFtraceEvent(uint32_t cpu,
                            ClockTracker::ClockId,
                            TraceBlobView event,
@@ -57,11 +85,37 @@ class FtraceTokenizer {
       const protos::pbzero::FtraceEventBundle::CompactSched::Decoder& compact,
       const std::vector<StringId>& string_table);
 
+  void TokenizeFtraceRawFormats(uint32_t packet_sequence_id,
+                                protozero::ConstBytes);
+  void TokenizeFtraceRawPage(const RawFormats*,
+                             uint32_t cpu,
+                             ClockTracker::ClockId,
+                             protozero::ConstBytes page,
+                             PacketSequenceState* state);
+  bool DecodeRawPagePayload(const RawFormats&,
+                            const uint8_t* start,
+                            const uint8_t* end,
+                            uint64_t page_timestamp,
+                            protos::pbzero::FtraceEventBundle* out);
+  bool DecodeRawEvent(const RawFormats&,
+                      const RawEvent&,
+                      const uint8_t* start,
+                      const uint8_t* end,
+                      protos::pbzero::FtraceEvent* out);
+  bool DecodeRawField(const RawFormats&,
+                      const RawField&,
+                      const uint8_t* start,
+                      const uint8_t* end,
+                      protozero::Message* out);
+
   void HandleFtraceClockSnapshot(int64_t ftrace_ts,
                                  int64_t boot_ts,
                                  uint32_t packet_sequence_id);
 
   int64_t latest_ftrace_clock_snapshot_ts_ = 0;
+  // Keyed by packet sequence id: each sequence writes its own formats, see
+  // FtraceEventBundle.raw_formats.
+  std::unordered_map<uint32_t, std::unique_ptr<RawFormats>> raw_formats_;
   TraceProcessorContext* context_;
 };
 
@@ -59,6 +59,13 @@ class FuchsiaRecord {
 
   TraceBlobView* record_view() { return &record_view_; }
 
+  const std::vector<StringTableEntry>& string_entries() const {
+    return string_entries_;
+  }
+  const std::vector<ThreadTableEntry>& thread_entries() const {
+    return thread_entries_;
+  }
+
  private:
   TraceBlobView record_view_;
 
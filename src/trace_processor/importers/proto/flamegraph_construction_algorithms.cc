@@ -16,8 +16,9 @@
 
 #include "flamegraph_construction_algorithms.h"
 
-#include <set>
-#include <unordered_set>
+#include <algorithm>
+#include <limits>
+#include <tuple>
 
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
@@ -38,11 +39,6 @@ struct MergedCallsite {
   }
 };
 
-struct FlamegraphTableAndMergedCallsites {
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl;
-  std::vector<uint32_t> callsite_to_merged_callsite;
-};
-
 std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
                                                uint32_t callstack_row) {
   const tables::StackProfileCallsiteTable& callsites_tbl =
@@ -87,26 +83,78 @@ std::vector<MergedCallsite> GetMergedCallsites(TraceStorage* storage,
   std::reverse(result.begin(), result.end());
   return result;
 }
+
+// The values of a sample, or the sum of the values of several samples.
+struct SampleValues {
+  int64_t size = 0;
+  int64_t count = 0;
+  int64_t alloc_size = 0;
+  int64_t alloc_count = 0;
+
+  void Add(const SampleValues& other) {
+    size += other.size;
+    count += other.count;
+    alloc_size += other.alloc_size;
+    alloc_count += other.alloc_count;
+  }
+
+  void Subtract(const SampleValues& other) {
+    size -= other.size;
+    count -= other.count;
+    alloc_size -= other.alloc_size;
+    alloc_count -= other.alloc_count;
+  }
+};
+
+struct Sample {
+  uint32_t callsite_row;
+  int64_t ts;
+  SampleValues values;
+};
+
+// Bounds the memory used by the indices of arbitrary groups of processes.
+constexpr size_t kMaxCachedPerfSampleIndices = 8;
+
 }  // namespace
 
-static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
-    TraceStorage* storage,
-    base::Optional<UniquePid> upid,
-    base::Optional<std::string> upid_group,
-    int64_t default_timestamp,
-    StringId profile_type) {
+struct FlamegraphCache::MergedCallsiteTree {
+  struct Node {
+    StringId name;
+    StringId map_name;
+    base::Optional<StringId> source_file;
+    base::Optional<uint32_t> line_number;
+    // Invariant: parent < index of this node.
+    base::Optional<uint32_t> parent;
+    uint32_t depth = 0;
+  };
+  std::vector<Node> nodes;
+  // Node of each row of the stack_profile_callsite table.
+  std::vector<uint32_t> callsite_to_node;
+};
+
+struct FlamegraphCache::SampleIndex {
+  // Rows of the stack_profile_callsite table that have samples. The samples
+  // of callsite_rows[i] are [offsets[i], offsets[i + 1]) in the arrays below.
+  std::vector<uint32_t> callsite_rows;
+  std::vector<uint32_t> offsets{0};
+  // Sorted within the samples of each callsite.
+  std::vector<int64_t> ts;
+  // Prefix sums of the values of the samples: the sum of the values of the
+  // samples [i, j) is sums[j] - sums[i]. Empty if the samples have no values.
+  std::vector<SampleValues> sums;
+};
+
+namespace {
+
+FlamegraphCache::MergedCallsiteTree BuildMergedCallsiteTree(
+    TraceStorage* storage) {
   const tables::StackProfileCallsiteTable& callsites_tbl =
       storage->stack_profile_callsite_table();
 
-  std::vector<uint32_t> callsite_to_merged_callsite(callsites_tbl.row_count(),
-                                                    0);
-  std::map<MergedCallsite, uint32_t> merged_callsites_to_table_idx;
-
-  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
-      new tables::ExperimentalFlamegraphNodesTable(
-          storage->mutable_string_pool(), nullptr));
+  FlamegraphCache::MergedCallsiteTree tree;
+  tree.callsite_to_node.resize(callsites_tbl.row_count());
+  std::map<MergedCallsite, uint32_t> merged_callsites_to_node;
 
-  // FORWARD PASS:
   // Aggregate callstacks by frame name / mapping name. Use symbolization
   // data.
   for (uint32_t i = 0; i < callsites_tbl.row_count(); ++i) {
@@ -117,295 +165,307 @@ static FlamegraphTableAndMergedCallsites BuildFlamegraphTableTreeStructure(
       parent_idx = callsites_tbl.id().IndexOf(*opt_parent_id);
       // Make sure what we index into has been populated already.
       PERFETTO_CHECK(*parent_idx < i);
-      parent_idx = callsite_to_merged_callsite[*parent_idx];
+      parent_idx = tree.callsite_to_node[*parent_idx];
     }
 
     auto callsites = GetMergedCallsites(storage, i);
     // Loop below needs to run at least once for parent_idx to get updated.
     PERFETTO_CHECK(!callsites.empty());
-    std::map<MergedCallsite, uint32_t> callsites_to_rowid;
     for (MergedCallsite& merged_callsite : callsites) {
       merged_callsite.parent_idx = parent_idx;
-      auto it = merged_callsites_to_table_idx.find(merged_callsite);
-      if (it == merged_callsites_to_table_idx.end()) {
-        std::tie(it, std::ignore) = merged_callsites_to_table_idx.emplace(
-            merged_callsite, merged_callsites_to_table_idx.size());
-        tables::ExperimentalFlamegraphNodesTable::Row row{};
-        if (parent_idx) {
-          row.depth = tbl->depth()[*parent_idx] + 1;
-        } else {
-          row.depth = 0;
-        }
-
-        // The 'ts' column is given a default value, taken from the query.
-        // So if the query is:
-        // `select * form experimental_flamegraph
-        //  where ts = 605908369259172
-        //  and upid = 1
-        //  and profile_type = 'native'`
-        // then row.ts == 605908369259172, for all rows
-        // This is not accurate. However, at present there is no other
-        // straightforward way of assigning timestamps to non-leaf nodes in the
-        // flamegraph tree. Non-leaf nodes would have to be assigned >= 1
-        // timestamps, which would increase data size without an advantage.
-        row.ts = default_timestamp;
-        if (upid) {
-          row.upid = *upid;
-        }
-        if (upid_group) {
-          row.upid_group = storage->InternString(base::StringView(*upid_group));
-        }
-        row.profile_type = profile_type;
-        row.name = merged_callsite.frame_name;
-        row.map_name = merged_callsite.mapping_name;
-        if (parent_idx)
-          row.parent_id = tbl->id()[*parent_idx];
-        tbl->Insert(row);
-        callsites_to_rowid[merged_callsite] =
-            static_cast<uint32_t>(merged_callsites_to_table_idx.size() - 1);
-
-        PERFETTO_CHECK(merged_callsites_to_table_idx.size() ==
-                       tbl->row_count());
-      } else {
-        MergedCallsite saved_callsite = it->first;
-        callsites_to_rowid.erase(saved_callsite);
-        if (saved_callsite.source_file != merged_callsite.source_file) {
-          saved_callsite.source_file = base::nullopt;
-        }
-        if (saved_callsite.line_number != merged_callsite.line_number) {
-          saved_callsite.line_number = base::nullopt;
-        }
-        callsites_to_rowid[saved_callsite] = it->second;
+      auto it = merged_callsites_to_node.find(merged_callsite);
+      if (it == merged_callsites_to_node.end()) {
+        std::tie(it, std::ignore) = merged_callsites_to_node.emplace(
+            merged_callsite, static_cast<uint32_t>(tree.nodes.size()));
+        FlamegraphCache::MergedCallsiteTree::Node node;
+        node.name = merged_callsite.frame_name;
+        node.map_name = merged_callsite.mapping_name;
+        // Callsites merged into this node later can have a different source
+        // location: the one of the first callsite is kept.
+        node.source_file = merged_callsite.source_file;
+        node.line_number = merged_callsite.line_number;
+        node.parent = parent_idx;
+        node.depth = parent_idx ? tree.nodes[*parent_idx].depth + 1 : 0;
+        tree.nodes.push_back(node);
       }
       parent_idx = it->second;
     }
 
-    for (const auto& it : callsites_to_rowid) {
-      if (it.first.source_file) {
-        tbl->mutable_source_file()->Set(it.second, *it.first.source_file);
-      }
-      if (it.first.line_number) {
-        tbl->mutable_line_number()->Set(it.second, *it.first.line_number);
-      }
+    PERFETTO_CHECK(parent_idx);
+    tree.callsite_to_node[i] = *parent_idx;
+  }
+  return tree;
+}
+
+// Groups |samples| by callsite, sorted by timestamp within each callsite.
+std::unique_ptr<FlamegraphCache::SampleIndex> BuildSampleIndex(
+    std::vector<Sample> samples,
+    bool with_values) {
+  std::sort(samples.begin(), samples.end(),
+            [](const Sample& a, const Sample& b) {
+              return std::tie(a.callsite_row, a.ts) <
+                     std::tie(b.callsite_row, b.ts);
+            });
+  std::unique_ptr<FlamegraphCache::SampleIndex> index(
+      new FlamegraphCache::SampleIndex());
+  index->ts.reserve(samples.size());
+  SampleValues sum;
+  if (with_values) {
+    index->sums.reserve(samples.size() + 1);
+    index->sums.push_back(sum);
+  }
+  for (size_t i = 0; i < samples.size(); ++i) {
+    if (i == 0 || samples[i].callsite_row != samples[i - 1].callsite_row) {
+      if (i != 0)
+        index->offsets.push_back(static_cast<uint32_t>(i));
+      index->callsite_rows.push_back(samples[i].callsite_row);
+    }
+    index->ts.push_back(samples[i].ts);
+    if (with_values) {
+      sum.Add(samples[i].values);
+      index->sums.push_back(sum);
     }
+  }
+  if (!samples.empty())
+    index->offsets.push_back(static_cast<uint32_t>(samples.size()));
+  return index;
+}
 
-    PERFETTO_CHECK(parent_idx);
-    callsite_to_merged_callsite[i] = *parent_idx;
+std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> BuildTable(
+    TraceStorage* storage,
+    const FlamegraphCache::MergedCallsiteTree& tree,
+    const std::vector<SampleValues>& values,
+    const std::vector<int64_t>& ts,
+    base::Optional<UniquePid> upid,
+    const base::Optional<std::string>& upid_group,
+    StringId profile_type) {
+  // BACKWARD PASS:
+  // Propagate values to parents.
+  std::vector<SampleValues> cumulative(values);
+  for (size_t i = tree.nodes.size(); i-- > 0;) {
+    base::Optional<uint32_t> parent = tree.nodes[i].parent;
+    if (parent)
+      cumulative[*parent].Add(cumulative[i]);
   }
 
-  return {std::move(tbl), callsite_to_merged_callsite};
+  base::Optional<StringId> upid_group_id;
+  if (upid_group)
+    upid_group_id = storage->InternString(base::StringView(*upid_group));
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl(
+      new tables::ExperimentalFlamegraphNodesTable(
+          storage->mutable_string_pool(), nullptr));
+  std::vector<tables::ExperimentalFlamegraphNodesTable::Id> node_to_id;
+  node_to_id.reserve(tree.nodes.size());
+  for (uint32_t i = 0; i < tree.nodes.size(); ++i) {
+    const FlamegraphCache::MergedCallsiteTree::Node& node = tree.nodes[i];
+
+    // The 'ts' column is given a default value, taken from the query.
+    // So if the query is:
+    // `select * form experimental_flamegraph
+    //  where ts = 605908369259172
+    //  and upid = 1
+    //  and profile_type = 'native'`
+    // then row.ts == 605908369259172, for all rows
+    // This is not accurate. However, at present there is no other
+    // straightforward way of assigning timestamps to non-leaf nodes in the
+    // flamegraph tree. Non-leaf nodes would have to be assigned >= 1
+    // timestamps, which would increase data size without an advantage.
+    tables::ExperimentalFlamegraphNodesTable::Row row{};
+    row.ts = ts[i];
+    if (upid)
+      row.upid = *upid;
+    row.upid_group = upid_group_id;
+    row.profile_type = profile_type;
+    row.depth = node.depth;
+    row.name = node.name;
+    row.map_name = node.map_name;
+    row.source_file = node.source_file;
+    row.line_number = node.line_number;
+    if (node.parent)
+      row.parent_id = node_to_id[*node.parent];
+    row.size = values[i].size;
+    row.count = values[i].count;
+    row.alloc_size = values[i].alloc_size;
+    row.alloc_count = values[i].alloc_count;
+    row.cumulative_size = cumulative[i].size;
+    row.cumulative_count = cumulative[i].count;
+    row.cumulative_alloc_size = cumulative[i].alloc_size;
+    row.cumulative_alloc_count = cumulative[i].alloc_count;
+    node_to_id.push_back(tbl->Insert(row).id);
+  }
+  return tbl;
+}
+
+}  // namespace
+
+FlamegraphCache::FlamegraphCache(TraceStorage* storage) : storage_(storage) {}
+
+FlamegraphCache::~FlamegraphCache() = default;
+
+void FlamegraphCache::Invalidate() {
+  tree_.reset();
+  heap_profile_indices_.clear();
+  perf_sample_indices_.clear();
+}
+
+const FlamegraphCache::MergedCallsiteTree&
+FlamegraphCache::GetMergedCallsiteTree() {
+  if (!tree_)
+    tree_.reset(new MergedCallsiteTree(BuildMergedCallsiteTree(storage_)));
+  return *tree_;
 }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableHeapSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t size =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::size))
-            .long_value;
-    int64_t count =
-        it.Get(static_cast<uint32_t>(
-                   tables::HeapProfileAllocationTable::ColumnIndex::count))
-            .long_value;
-    int64_t callsite_id =
-        it
-            .Get(static_cast<uint32_t>(
-                tables::HeapProfileAllocationTable::ColumnIndex::callsite_id))
-            .long_value;
+const FlamegraphCache::SampleIndex& FlamegraphCache::GetHeapProfileIndex(
+    UniquePid upid) {
+  std::unique_ptr<SampleIndex>& index = heap_profile_indices_[upid];
+  if (index)
+    return *index;
 
+  const tables::HeapProfileAllocationTable& allocation_tbl =
+      storage_->heap_profile_allocation_table();
+  const tables::StackProfileCallsiteTable& callsites_tbl =
+      storage_->stack_profile_callsite_table();
+  std::vector<Sample> samples;
+  for (uint32_t i = 0; i < allocation_tbl.row_count(); ++i) {
+    if (allocation_tbl.upid()[i] != upid)
+      continue;
+    int64_t size = allocation_tbl.size()[i];
+    int64_t count = allocation_tbl.count()[i];
     PERFETTO_CHECK((size <= 0 && count <= 0) || (size >= 0 && count >= 0));
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
+
+    Sample sample;
+    sample.callsite_row =
+        *callsites_tbl.id().IndexOf(allocation_tbl.callsite_id()[i]);
+    sample.ts = allocation_tbl.ts()[i];
+    sample.values.size = size;
+    sample.values.count = count;
     // On old heapprofd producers, the count field is incorrectly set and we
     // zero it in proto_trace_parser.cc.
     // As such, we cannot depend on count == 0 to imply size == 0, so we check
     // for both of them separately.
-    if (size > 0) {
-      tbl->mutable_alloc_size()->Set(merged_idx,
-                                     tbl->alloc_size()[merged_idx] + size);
-    }
-    if (count > 0) {
-      tbl->mutable_alloc_count()->Set(merged_idx,
-                                      tbl->alloc_count()[merged_idx] + count);
-    }
-
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + size);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + count);
-  }
-
-  // BACKWARD PASS:
-  // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    tbl->mutable_cumulative_alloc_size()->Set(
-        idx, tbl->cumulative_alloc_size()[idx] + tbl->alloc_size()[idx]);
-    tbl->mutable_cumulative_alloc_count()->Set(
-        idx, tbl->cumulative_alloc_count()[idx] + tbl->alloc_count()[idx]);
-
-    auto parent = tbl->parent_id()[idx];
-    if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
-
-      tbl->mutable_cumulative_alloc_size()->Set(
-          parent_idx, tbl->cumulative_alloc_size()[parent_idx] +
-                          tbl->cumulative_alloc_size()[idx]);
-      tbl->mutable_cumulative_alloc_count()->Set(
-          parent_idx, tbl->cumulative_alloc_count()[parent_idx] +
-                          tbl->cumulative_alloc_count()[idx]);
-    }
+    sample.values.alloc_size = size > 0 ? size : 0;
+    sample.values.alloc_count = count > 0 ? count : 0;
+    samples.push_back(sample);
   }
-
-  return tbl;
+  index = BuildSampleIndex(std::move(samples), /*with_values=*/true);
+  return *index;
 }
 
-static std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildFlamegraphTableCallstackSizeAndCount(
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> tbl,
-    const std::vector<uint32_t>& callsite_to_merged_callsite,
-    const Table& filtered) {
-  for (auto it = filtered.IterateRows(); it; it.Next()) {
-    int64_t callsite_id =
-        it.Get(static_cast<uint32_t>(
-                   tables::PerfSampleTable::ColumnIndex::callsite_id))
-            .long_value;
-    int64_t ts =
-        it.Get(static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts))
-            .long_value;
-
-    uint32_t merged_idx =
-        callsite_to_merged_callsite[static_cast<unsigned long>(callsite_id)];
-    tbl->mutable_size()->Set(merged_idx, tbl->size()[merged_idx] + 1);
-    tbl->mutable_count()->Set(merged_idx, tbl->count()[merged_idx] + 1);
-    tbl->mutable_ts()->Set(merged_idx, ts);
+const FlamegraphCache::SampleIndex& FlamegraphCache::GetPerfSampleIndex(
+    const std::vector<UniquePid>& upids) {
+  auto it = perf_sample_indices_.find(upids);
+  if (it != perf_sample_indices_.end())
+    return *it->second;
+  if (perf_sample_indices_.size() >= kMaxCachedPerfSampleIndices)
+    perf_sample_indices_.clear();
+
+  // Threads of the requested processes, indexed by utid.
+  const tables::ThreadTable& thread_tbl = storage_->thread_table();
+  std::vector<bool> is_selected_utid(thread_tbl.row_count());
+  for (uint32_t i = 0; i < thread_tbl.row_count(); ++i) {
+    base::Optional<uint32_t> row_upid = thread_tbl.upid()[i];
+    if (row_upid && std::binary_search(upids.begin(), upids.end(), *row_upid))
+      is_selected_utid[thread_tbl.id()[i].value] = true;
   }
 
-  // BACKWARD PASS:
-  // Propagate sizes to parents.
-  for (int64_t i = tbl->row_count() - 1; i >= 0; --i) {
-    auto idx = static_cast<uint32_t>(i);
-
-    tbl->mutable_cumulative_size()->Set(
-        idx, tbl->cumulative_size()[idx] + tbl->size()[idx]);
-    tbl->mutable_cumulative_count()->Set(
-        idx, tbl->cumulative_count()[idx] + tbl->count()[idx]);
-
-    auto parent = tbl->parent_id()[idx];
-    if (parent) {
-      uint32_t parent_idx = *tbl->id().IndexOf(
-          tables::ExperimentalFlamegraphNodesTable::Id(*parent));
-      tbl->mutable_cumulative_size()->Set(
-          parent_idx,
-          tbl->cumulative_size()[parent_idx] + tbl->cumulative_size()[idx]);
-      tbl->mutable_cumulative_count()->Set(
-          parent_idx,
-          tbl->cumulative_count()[parent_idx] + tbl->cumulative_count()[idx]);
+  const tables::PerfSampleTable& sample_tbl = storage_->perf_sample_table();
+  const tables::StackProfileCallsiteTable& callsites_tbl =
+      storage_->stack_profile_callsite_table();
+  std::vector<Sample> samples;
+  for (uint32_t i = 0; i < sample_tbl.row_count(); ++i) {
+    uint32_t utid = sample_tbl.utid()[i];
+    base::Optional<CallsiteId> callsite_id = sample_tbl.callsite_id()[i];
+    if (utid >= is_selected_utid.size() || !is_selected_utid[utid] ||
+        !callsite_id) {
+      continue;
     }
+    Sample sample;
+    sample.callsite_row = *callsites_tbl.id().IndexOf(*callsite_id);
+    sample.ts = sample_tbl.ts()[i];
+    samples.push_back(sample);
   }
-  return tbl;
+  std::unique_ptr<SampleIndex>& index = perf_sample_indices_[upids];
+  index = BuildSampleIndex(std::move(samples), /*with_values=*/false);
+  return *index;
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildNativeHeapProfileFlamegraph(TraceStorage* storage,
-                                 UniquePid upid,
-                                 int64_t timestamp) {
-  const tables::HeapProfileAllocationTable& allocation_tbl =
-      storage->heap_profile_allocation_table();
+FlamegraphCache::BuildNativeHeapProfileFlamegraph(UniquePid upid,
+                                                  int64_t timestamp) {
+  const SampleIndex& index = GetHeapProfileIndex(upid);
+
   // PASS OVER ALLOCATIONS:
-  // Aggregate allocations into the newly built tree.
-  auto filtered = allocation_tbl.Filter(
-      {allocation_tbl.ts().le(timestamp), allocation_tbl.upid().eq(upid)});
-  if (filtered.row_count() == 0) {
+  // Sum the allocations up to |timestamp| of each callsite.
+  const MergedCallsiteTree& tree = GetMergedCallsiteTree();
+  std::vector<SampleValues> values(tree.nodes.size());
+  bool has_allocations = false;
+  for (size_t i = 0; i < index.callsite_rows.size(); ++i) {
+    auto begin = index.ts.begin() + index.offsets[i];
+    auto end = index.ts.begin() + index.offsets[i + 1];
+    auto last = std::upper_bound(begin, end, timestamp);
+    if (last == begin)
+      continue;
+    has_allocations = true;
+    SampleValues& node_values =
+        values[tree.callsite_to_node[index.callsite_rows[i]]];
+    node_values.Add(index.sums[static_cast<size_t>(last - index.ts.begin())]);
+    node_values.Subtract(index.sums[index.offsets[i]]);
+  }
+  if (!has_allocations) {
     return nullptr;
   }
-  StringId profile_type = storage->InternString("native");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, base::nullopt, timestamp,
-                                        profile_type);
-  return BuildFlamegraphTableHeapSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+  StringId profile_type = storage_->InternString("native");
+  return BuildTable(storage_, tree, values,
+                    std::vector<int64_t>(tree.nodes.size(), timestamp), upid,
+                    base::nullopt, profile_type);
 }
 
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
-BuildNativeCallStackSamplingFlamegraph(
-    TraceStorage* storage,
+FlamegraphCache::BuildNativeCallStackSamplingFlamegraph(
     base::Optional<UniquePid> upid,
     base::Optional<std::string> upid_group,
     const std::vector<TimeConstraints>& time_constraints) {
   // 1.Extract required upids from input.
-  std::unordered_set<UniquePid> upids;
+  std::vector<UniquePid> upids;
   if (upid) {
-    upids.insert(*upid);
+    upids.push_back(*upid);
   } else {
     for (base::StringSplitter sp(*upid_group, ','); sp.Next();) {
       base::Optional<uint32_t> maybe = base::CStringToUInt32(sp.cur_token());
       if (maybe) {
-        upids.insert(*maybe);
+        upids.push_back(*maybe);
       }
     }
   }
+  std::sort(upids.begin(), upids.end());
+  upids.erase(std::unique(upids.begin(), upids.end()), upids.end());
 
-  // 2.Create set of all utids mapped to the given vector of upids
-  std::set<tables::ThreadTable::Id> utids;
-  RowMap threads_in_pid_rm;
-  for (uint32_t i = 0; i < storage->thread_table().row_count(); ++i) {
-    base::Optional<uint32_t> row_upid = storage->thread_table().upid()[i];
-    if (row_upid && upids.count(*row_upid) > 0) {
-      threads_in_pid_rm.Insert(i);
-    }
-  }
-
-  for (auto it = threads_in_pid_rm.IterateRows(); it; it.Next()) {
-    utids.insert(storage->thread_table().id()[it.index()]);
-  }
-
-  // 3.Get all row indices in perf_sample that correspond to the requested utids
-  std::vector<uint32_t> cs_rows;
-  for (uint32_t i = 0; i < storage->perf_sample_table().row_count(); ++i) {
-    if (utids.find(static_cast<tables::ThreadTable::Id>(
-            storage->perf_sample_table().utid()[i])) != utids.end()) {
-      cs_rows.push_back(i);
-    }
-  }
-
-  // 4.Filter rows that correspond to the selected utids
-  RowMap filtered_rm = RowMap(std::move(cs_rows));
-  Table filtered = storage->perf_sample_table().Apply(std::move(filtered_rm));
-
-  // 5.Filter rows by time constraints
+  // 2.Turn the time constraints into an inclusive range.
+  int64_t min_ts = std::numeric_limits<int64_t>::min();
+  int64_t max_ts = std::numeric_limits<int64_t>::max();
+  bool empty_range = false;
   for (const auto& tc : time_constraints) {
-    if (!(tc.op == FilterOp::kGt || tc.op == FilterOp::kLt ||
-          tc.op == FilterOp::kGe || tc.op == FilterOp::kLe)) {
+    if (tc.op == FilterOp::kGt) {
+      if (tc.value == std::numeric_limits<int64_t>::max())
+        empty_range = true;
+      else
+        min_ts = std::max(min_ts, tc.value + 1);
+    } else if (tc.op == FilterOp::kGe) {
+      min_ts = std::max(min_ts, tc.value);
+    } else if (tc.op == FilterOp::kLt) {
+      if (tc.value == std::numeric_limits<int64_t>::min())
+        empty_range = true;
+      else
+        max_ts = std::min(max_ts, tc.value - 1);
+    } else if (tc.op == FilterOp::kLe) {
+      max_ts = std::min(max_ts, tc.value);
+    } else {
       PERFETTO_FATAL("Filter operation %d not permitted for perf.",
                      static_cast<int>(tc.op));
     }
-    Constraint cs = Constraint{
-        static_cast<uint32_t>(tables::PerfSampleTable::ColumnIndex::ts), tc.op,
-        SqlValue::Long(tc.value)};
-    filtered = filtered.Filter({cs});
-  }
-  if (filtered.row_count() == 0) {
-    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> empty_tbl(
-        new tables::ExperimentalFlamegraphNodesTable(
-            storage->mutable_string_pool(), nullptr));
-    return empty_tbl;
   }
+  empty_range = empty_range || min_ts > max_ts;
 
   // The logic underneath is selecting a default timestamp to be used by all
   // frames which do not have a timestamp. The timestamp is taken from the query
@@ -415,21 +475,67 @@ BuildNativeCallStackSamplingFlamegraph(
   int64_t default_timestamp = 0;
   if (!time_constraints.empty()) {
     auto& tc = time_constraints[0];
-    if (tc.op == FilterOp::kGt) {
+    // The range is empty at the limits, only avoid overflowing there.
+    if (tc.op == FilterOp::kGt &&
+        tc.value != std::numeric_limits<int64_t>::max()) {
       default_timestamp = tc.value + 1;
-    } else if (tc.op == FilterOp::kLt) {
+    } else if (tc.op == FilterOp::kLt &&
+               tc.value != std::numeric_limits<int64_t>::min()) {
       default_timestamp = tc.value - 1;
     } else {
       default_timestamp = tc.value;
     }
   }
-  StringId profile_type = storage->InternString("perf");
-  FlamegraphTableAndMergedCallsites table_and_callsites =
-      BuildFlamegraphTableTreeStructure(storage, upid, upid_group,
-                                        default_timestamp, profile_type);
-  return BuildFlamegraphTableCallstackSizeAndCount(
-      std::move(table_and_callsites.tbl),
-      table_and_callsites.callsite_to_merged_callsite, filtered);
+
+  // 3.Count the samples of each callsite in the range. Nodes with samples get
+  // the timestamp of their last sample.
+  const SampleIndex& index = GetPerfSampleIndex(upids);
+  const MergedCallsiteTree& tree = GetMergedCallsiteTree();
+  std::vector<SampleValues> values(tree.nodes.size());
+  std::vector<int64_t> ts(tree.nodes.size(), default_timestamp);
+  bool has_samples = false;
+  for (size_t i = 0; !empty_range && i < index.callsite_rows.size(); ++i) {
+    auto begin = std::lower_bound(index.ts.begin() + index.offsets[i],
+                                  index.ts.begin() + index.offsets[i + 1],
+                                  min_ts);
+    auto end = std::upper_bound(begin, index.ts.begin() + index.offsets[i + 1],
+                                max_ts);
+    if (begin == end)
+      continue;
+    has_samples = true;
+    uint32_t node = tree.callsite_to_node[index.callsite_rows[i]];
+    int64_t last_ts = *(end - 1);
+    ts[node] = values[node].count == 0 ? last_ts : std::max(ts[node], last_ts);
+    values[node].size += end - begin;
+    values[node].count += end - begin;
+  }
+  if (!has_samples) {
+    std::unique_ptr<tables::ExperimentalFlamegraphNodesTable> empty_tbl(
+        new tables::ExperimentalFlamegraphNodesTable(
+            storage_->mutable_string_pool(), nullptr));
+    return empty_tbl;
+  }
+  StringId profile_type = storage_->InternString("perf");
+  return BuildTable(storage_, tree, values, ts, upid, upid_group,
+                    profile_type);
+}
+
+std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+BuildNativeHeapProfileFlamegraph(TraceStorage* storage,
+                                 UniquePid upid,
+                                 int64_t timestamp) {
+  return FlamegraphCache(storage).BuildNativeHeapProfileFlamegraph(upid,
+                                                                   timestamp);
+}
+
+std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+BuildNativeCallStackSamplingFlamegraph(
+    TraceStorage* storage,
+    base::Optional<UniquePid> upid,
+    base::Optional<std::string> upid_group,
+    const std::vector<TimeConstraints>& time_constraints) {
+  return FlamegraphCache(storage).BuildNativeCallStackSamplingFlamegraph(
+      upid, upid_group, time_constraints);
 }
 
 }  // namespace trace_processor
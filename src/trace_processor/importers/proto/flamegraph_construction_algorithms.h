@@ -17,6 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_FLAMEGRAPH_CONSTRUCTION_ALGORITHMS_H_
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "src/trace_processor/storage/trace_storage.h"
 
 namespace perfetto {
@@ -28,6 +33,47 @@ struct TimeConstraints {
   int64_t value;
 };
 
+// Builds native heap profile and perf flamegraphs, caching what does not
+// depend on the time window of the query: the callsites merged by frame name
+// and, for each (set of) process, the samples grouped by callsite and sorted
+// by time. A flamegraph is then computed in time proportional to the number of
+// callsites, not of samples, which makes zooming and panning in the UI cheap.
+class FlamegraphCache {
+ public:
+  explicit FlamegraphCache(TraceStorage* storage);
+  ~FlamegraphCache();
+
+  // Drops the cached data. Must be called when more of the trace is parsed,
+  // as that can add samples, and symbolize or deobfuscate frames.
+  void Invalidate();
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+  BuildNativeHeapProfileFlamegraph(UniquePid upid, int64_t timestamp);
+
+  std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
+  BuildNativeCallStackSamplingFlamegraph(
+      base::Optional<UniquePid> upid,
+      base::Optional<std::string> upid_group,
+      const std::vector<TimeConstraints>& time_constraints);
+
+  // Defined in the .cc file.
+  struct MergedCallsiteTree;
+  struct SampleIndex;
+
+ private:
+  const MergedCallsiteTree& GetMergedCallsiteTree();
+  const SampleIndex& GetHeapProfileIndex(UniquePid upid);
+  const SampleIndex& GetPerfSampleIndex(const std::vector<UniquePid>& upids);
+
+  TraceStorage* const storage_;
+  std::unique_ptr<MergedCallsiteTree> tree_;
+  std::map<UniquePid, std::unique_ptr<SampleIndex>> heap_profile_indices_;
+  std::map<std::vector<UniquePid>, std::unique_ptr<SampleIndex>>
+      perf_sample_indices_;
+};
+
+// One-off versions of the FlamegraphCache methods, which do not keep the
+// cached data around.
 std::unique_ptr<tables::ExperimentalFlamegraphNodesTable>
 BuildNativeHeapProfileFlamegraph(TraceStorage* storage,
                                  UniquePid upid,
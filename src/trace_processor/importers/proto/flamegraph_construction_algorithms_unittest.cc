@@ -0,0 +1,611 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/flamegraph_construction_algorithms.h"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+#include <utility>
+
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/string_utils.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr int64_t kMinTs = std::numeric_limits<int64_t>::min();
+constexpr int64_t kMaxTs = std::numeric_limits<int64_t>::max();
+
+constexpr uint32_t kNames = 6;
+constexpr uint32_t kMappings = 2;
+constexpr uint32_t kThreads = 5;
+constexpr UniquePid kProcesses = 3;
+
+// A node of a flamegraph is identified by the (name, mapping name) of the
+// frames from the root to it.
+using Path = std::vector<std::pair<uint32_t, uint32_t>>;
+
+struct Values {
+  int64_t size = 0;
+  int64_t count = 0;
+  int64_t alloc_size = 0;
+  int64_t alloc_count = 0;
+  int64_t cumulative_size = 0;
+  int64_t cumulative_count = 0;
+  int64_t cumulative_alloc_size = 0;
+  int64_t cumulative_alloc_count = 0;
+  // Largest timestamp of the samples of this node, if any.
+  base::Optional<int64_t> ts;
+};
+
+// Brute force version of the flamegraph construction: every sample is
+// filtered and attributed to its path, and to all the prefixes of its path,
+// without any index.
+class ReferenceFlamegraph {
+ public:
+  explicit ReferenceFlamegraph(TraceStorage* storage) : storage_(storage) {
+    const auto& callsites_tbl = storage_->stack_profile_callsite_table();
+    for (uint32_t i = 0; i < callsites_tbl.row_count(); ++i) {
+      Path path;
+      auto parent_id = callsites_tbl.parent_id()[i];
+      if (parent_id)
+        path = callsite_paths_[*callsites_tbl.id().IndexOf(*parent_id)];
+      Path frames = FramePath(callsites_tbl.frame_id()[i]);
+      path.insert(path.end(), frames.begin(), frames.end());
+      callsite_paths_.push_back(path);
+      // The flamegraph has a node for every callsite, sampled or not.
+      for (size_t len = 1; len <= path.size(); ++len)
+        nodes_[Path(path.begin(), path.begin() + static_cast<long>(len))];
+    }
+  }
+
+  // Returns false if the process has no allocation up to |timestamp|.
+  bool HeapProfile(UniquePid upid,
+                   int64_t timestamp,
+                   std::map<Path, Values>* nodes) const {
+    *nodes = nodes_;
+    const auto& allocation_tbl = storage_->heap_profile_allocation_table();
+    const auto& callsites_tbl = storage_->stack_profile_callsite_table();
+    bool has_allocations = false;
+    for (uint32_t i = 0; i < allocation_tbl.row_count(); ++i) {
+      if (allocation_tbl.upid()[i] != upid ||
+          allocation_tbl.ts()[i] > timestamp) {
+        continue;
+      }
+      has_allocations = true;
+      Values values;
+      values.size = allocation_tbl.size()[i];
+      values.count = allocation_tbl.count()[i];
+      values.alloc_size = std::max<int64_t>(values.size, 0);
+      values.alloc_count = std::max<int64_t>(values.count, 0);
+      uint32_t row =
+          *callsites_tbl.id().IndexOf(allocation_tbl.callsite_id()[i]);
+      AddSample(callsite_paths_[row], values, nodes);
+    }
+    return has_allocations;
+  }
+
+  // Returns false if no sample of the processes is in the time range.
+  bool PerfSamples(const std::set<UniquePid>& upids,
+                   const std::vector<TimeConstraints>& time_constraints,
+                   std::map<Path, Values>* nodes) const {
+    *nodes = nodes_;
+    const auto& sample_tbl = storage_->perf_sample_table();
+    const auto& thread_tbl = storage_->thread_table();
+    const auto& callsites_tbl = storage_->stack_profile_callsite_table();
+    bool has_samples = false;
+    for (uint32_t i = 0; i < sample_tbl.row_count(); ++i) {
+      auto callsite_id = sample_tbl.callsite_id()[i];
+      auto upid = thread_tbl.upid()[sample_tbl.utid()[i]];
+      if (!callsite_id || !upid || upids.count(*upid) == 0)
+        continue;
+      int64_t ts = sample_tbl.ts()[i];
+      bool in_range = true;
+      for (const TimeConstraints& tc : time_constraints) {
+        switch (tc.op) {
+          case FilterOp::kGt:
+            in_range = in_range && ts > tc.value;
+            break;
+          case FilterOp::kGe:
+            in_range = in_range && ts >= tc.value;
+            break;
+          case FilterOp::kLt:
+            in_range = in_range && ts < tc.value;
+            break;
+          case FilterOp::kLe:
+            in_range = in_range && ts <= tc.value;
+            break;
+          default:
+            PERFETTO_FATAL("Unexpected filter op");
+        }
+      }
+      if (!in_range)
+        continue;
+      has_samples = true;
+      Values values;
+      values.size = 1;
+      values.count = 1;
+      values.ts = ts;
+      AddSample(callsite_paths_[*callsites_tbl.id().IndexOf(*callsite_id)],
+                values, nodes);
+    }
+    return has_samples;
+  }
+
+ private:
+  Path FramePath(tables::StackProfileFrameTable::Id frame_id) const {
+    const auto& frames_tbl = storage_->stack_profile_frame_table();
+    const auto& mapping_tbl = storage_->stack_profile_mapping_table();
+    const auto& symbols_tbl = storage_->symbol_table();
+    uint32_t frame = *frames_tbl.id().IndexOf(frame_id);
+    uint32_t mapping =
+        *mapping_tbl.id().IndexOf(frames_tbl.mapping()[frame]);
+    uint32_t mapping_name = mapping_tbl.name()[mapping].raw_id();
+    auto symbol_set_id = frames_tbl.symbol_set_id()[frame];
+    if (!symbol_set_id) {
+      auto deobfuscated_name = frames_tbl.deobfuscated_name()[frame];
+      StringId name = deobfuscated_name ? *deobfuscated_name
+                                        : frames_tbl.name()[frame];
+      return {{name.raw_id(), mapping_name}};
+    }
+    // Symbols are stored innermost (i.e. inlined) first.
+    Path path;
+    for (uint32_t i = 0; i < symbols_tbl.row_count(); ++i) {
+      if (symbols_tbl.symbol_set_id()[i] == *symbol_set_id)
+        path.emplace_back(symbols_tbl.name()[i].raw_id(), mapping_name);
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+  }
+
+  static void AddSample(const Path& path,
+                        const Values& sample,
+                        std::map<Path, Values>* nodes) {
+    Values& self = (*nodes)[path];
+    self.size += sample.size;
+    self.count += sample.count;
+    self.alloc_size += sample.alloc_size;
+    self.alloc_count += sample.alloc_count;
+    if (sample.ts)
+      self.ts = self.ts ? std::max(*self.ts, *sample.ts) : *sample.ts;
+    for (size_t len = 1; len <= path.size(); ++len) {
+      Values& node =
+          (*nodes)[Path(path.begin(), path.begin() + static_cast<long>(len))];
+      node.cumulative_size += sample.size;
+      node.cumulative_count += sample.count;
+      node.cumulative_alloc_size += sample.alloc_size;
+      node.cumulative_alloc_count += sample.alloc_count;
+    }
+  }
+
+  TraceStorage* const storage_;
+  std::vector<Path> callsite_paths_;
+  std::map<Path, Values> nodes_;
+};
+
+// Checks that |tbl| has exactly one row per node of |expected|, with the same
+// values. Nodes without samples have the timestamp |default_ts|.
+void ExpectFlamegraph(const tables::ExperimentalFlamegraphNodesTable& tbl,
+                      const std::map<Path, Values>& expected,
+                      int64_t default_ts) {
+  ASSERT_EQ(tbl.row_count(), expected.size());
+  std::vector<Path> row_paths;
+  std::set<Path> seen;
+  for (uint32_t i = 0; i < tbl.row_count(); ++i) {
+    Path path;
+    auto parent_id = tbl.parent_id()[i];
+    if (parent_id) {
+      uint32_t parent_row = *tbl.id().IndexOf(*parent_id);
+      ASSERT_LT(parent_row, i);
+      path = row_paths[parent_row];
+    }
+    path.emplace_back(tbl.name()[i].raw_id(), tbl.map_name()[i].raw_id());
+    row_paths.push_back(path);
+    ASSERT_TRUE(seen.insert(path).second) << "duplicate node at row " << i;
+
+    auto it = expected.find(path);
+    ASSERT_NE(it, expected.end()) << "unexpected node at row " << i;
+    const Values& values = it->second;
+    EXPECT_EQ(tbl.depth()[i], path.size() - 1);
+    EXPECT_EQ(tbl.size()[i], values.size);
+    EXPECT_EQ(tbl.count()[i], values.count);
+    EXPECT_EQ(tbl.alloc_size()[i], values.alloc_size);
+    EXPECT_EQ(tbl.alloc_count()[i], values.alloc_count);
+    EXPECT_EQ(tbl.cumulative_size()[i], values.cumulative_size);
+    EXPECT_EQ(tbl.cumulative_count()[i], values.cumulative_count);
+    EXPECT_EQ(tbl.cumulative_alloc_size()[i], values.cumulative_alloc_size);
+    EXPECT_EQ(tbl.cumulative_alloc_count()[i], values.cumulative_alloc_count);
+    EXPECT_EQ(tbl.ts()[i], values.ts ? *values.ts : default_ts);
+  }
+}
+
+// Mirrors the default timestamp of the rows of the perf flamegraph.
+int64_t DefaultPerfTs(const std::vector<TimeConstraints>& time_constraints) {
+  if (time_constraints.empty())
+    return 0;
+  const TimeConstraints& tc = time_constraints[0];
+  if (tc.op == FilterOp::kGt && tc.value != kMaxTs)
+    return tc.value + 1;
+  if (tc.op == FilterOp::kLt && tc.value != kMinTs)
+    return tc.value - 1;
+  return tc.value;
+}
+
+class FlamegraphCacheTest : public ::testing::Test {
+ protected:
+  FlamegraphCacheTest() : rnd_engine_(42) {
+    for (uint32_t i = 0; i < kNames; ++i) {
+      names_.push_back(
+          storage_.InternString(base::StringView("f" + std::to_string(i))));
+    }
+    for (uint32_t i = 0; i < kMappings; ++i) {
+      tables::StackProfileMappingTable::Row row;
+      row.name = names_[i];
+      storage_.mutable_stack_profile_mapping_table()->Insert(row);
+    }
+    // The first thread has no process.
+    for (uint32_t i = 0; i < kThreads; ++i) {
+      tables::ThreadTable::Row row;
+      if (i != 0)
+        row.upid = i % kProcesses;
+      storage_.mutable_thread_table()->Insert(row);
+    }
+  }
+
+  uint32_t Rand(uint32_t n) { return rnd_engine_() % n; }
+
+  StringId RandName() { return names_[Rand(kNames)]; }
+
+  // Appends frames, callsites below the existing ones or new roots, heap
+  // profile allocations and perf samples, as parsing more of a trace would.
+  void AddRandomProfile() {
+    auto* frames = storage_.mutable_stack_profile_frame_table();
+    auto* symbols = storage_.mutable_symbol_table();
+    for (uint32_t i = 0; i < 10; ++i) {
+      tables::StackProfileFrameTable::Row row;
+      row.name = RandName();
+      row.mapping = tables::StackProfileMappingTable::Id(Rand(kMappings));
+      if (Rand(3) == 0) {
+        // The id of the first symbol of a set is the id of the set.
+        uint32_t symbol_set_id = symbols->row_count();
+        for (uint32_t j = 0, n = 1 + Rand(3); j < n; ++j) {
+          tables::SymbolTable::Row symbol;
+          symbol.symbol_set_id = symbol_set_id;
+          symbol.name = RandName();
+          symbol.source_file = RandName();
+          symbol.line_number = Rand(3);
+          symbols->Insert(symbol);
+        }
+        row.symbol_set_id = symbol_set_id;
+      } else if (Rand(4) == 0) {
+        row.deobfuscated_name = RandName();
+      }
+      frames->Insert(row);
+    }
+
+    auto* callsites = storage_.mutable_stack_profile_callsite_table();
+    for (uint32_t i = 0; i < 40; ++i) {
+      tables::StackProfileCallsiteTable::Row row;
+      uint32_t count = callsites->row_count();
+      if (count > 0 && Rand(4) != 0) {
+        uint32_t parent = Rand(count);
+        row.parent_id = callsites->id()[parent];
+        row.depth = callsites->depth()[parent] + 1;
+      }
+      row.frame_id = frames->id()[Rand(frames->row_count())];
+      callsites->Insert(row);
+    }
+
+    for (uint32_t i = 0; i < 200; ++i) {
+      tables::HeapProfileAllocationTable::Row row;
+      row.ts = Rand(100);
+      row.upid = Rand(kProcesses);
+      row.callsite_id = callsites->id()[Rand(callsites->row_count())];
+      // Frees have negative values.
+      int64_t sign = Rand(3) == 0 ? -1 : 1;
+      row.size = sign * Rand(50);
+      row.count = sign * Rand(3);
+      storage_.mutable_heap_profile_allocation_table()->Insert(row);
+    }
+
+    // Perf samples are sorted by timestamp, and several can have the same.
+    for (uint32_t i = 0; i < 200; ++i) {
+      tables::PerfSampleTable::Row row;
+      perf_ts_ += Rand(2);
+      row.ts = perf_ts_;
+      row.utid = Rand(kThreads);
+      if (Rand(10) != 0)
+        row.callsite_id = callsites->id()[Rand(callsites->row_count())];
+      storage_.mutable_perf_sample_table()->Insert(row);
+    }
+  }
+
+  // A timestamp at, next to, or away from the timestamp of a sample.
+  int64_t RandTs(int64_t last_ts) {
+    switch (Rand(8)) {
+      case 0:
+        return kMinTs;
+      case 1:
+        return kMaxTs;
+      case 2:
+        return -1;
+      case 3:
+        return last_ts + 1;
+      default:
+        return static_cast<int64_t>(Rand(static_cast<uint32_t>(last_ts + 1)));
+    }
+  }
+
+  std::vector<TimeConstraints> RandTimeConstraints() {
+    static constexpr FilterOp kOps[] = {FilterOp::kGt, FilterOp::kGe,
+                                        FilterOp::kLt, FilterOp::kLe};
+    std::vector<TimeConstraints> time_constraints;
+    for (uint32_t i = 0, n = Rand(3); i < n; ++i)
+      time_constraints.push_back({kOps[Rand(4)], RandTs(perf_ts_)});
+    return time_constraints;
+  }
+
+  void CheckHeapProfile(FlamegraphCache* cache,
+                        UniquePid upid,
+                        int64_t timestamp) {
+    SCOPED_TRACE(testing::Message() << "upid " << upid << " ts " << timestamp);
+    std::map<Path, Values> expected;
+    bool has_allocations = ReferenceFlamegraph(&storage_).HeapProfile(
+        upid, timestamp, &expected);
+    auto tbl = cache->BuildNativeHeapProfileFlamegraph(upid, timestamp);
+    if (!has_allocations) {
+      EXPECT_EQ(tbl, nullptr);
+      return;
+    }
+    ASSERT_NE(tbl, nullptr);
+    ExpectFlamegraph(*tbl, expected, timestamp);
+    for (uint32_t i = 0; i < tbl->row_count(); ++i) {
+      EXPECT_EQ(tbl->upid()[i], upid);
+      EXPECT_EQ(tbl->profile_type()[i], storage_.InternString("native"));
+    }
+  }
+
+  void CheckPerfSamples(FlamegraphCache* cache,
+                        base::Optional<UniquePid> upid,
+                        base::Optional<std::string> upid_group,
+                        const std::vector<TimeConstraints>& time_constraints) {
+    testing::Message msg;
+    msg << "upid " << (upid ? std::to_string(*upid) : "null") << " group "
+        << (upid_group ? *upid_group : "null");
+    for (const TimeConstraints& tc : time_constraints)
+      msg << " op " << static_cast<int>(tc.op) << " " << tc.value;
+    SCOPED_TRACE(msg);
+
+    std::set<UniquePid> upids;
+    if (upid) {
+      upids.insert(*upid);
+    } else {
+      for (base::StringSplitter sp(*upid_group, ','); sp.Next();)
+        upids.insert(*base::CStringToUInt32(sp.cur_token()));
+    }
+    std::map<Path, Values> expected;
+    bool has_samples = ReferenceFlamegraph(&storage_).PerfSamples(
+        upids, time_constraints, &expected);
+    auto tbl = cache->BuildNativeCallStackSamplingFlamegraph(upid, upid_group,
+                                                             time_constraints);
+    ASSERT_NE(tbl, nullptr);
+    if (!has_samples) {
+      EXPECT_EQ(tbl->row_count(), 0u);
+      return;
+    }
+    ExpectFlamegraph(*tbl, expected, DefaultPerfTs(time_constraints));
+    base::Optional<StringId> upid_group_id;
+    if (upid_group)
+      upid_group_id = storage_.InternString(base::StringView(*upid_group));
+    for (uint32_t i = 0; i < tbl->row_count(); ++i) {
+      EXPECT_EQ(tbl->upid()[i], upid ? *upid : 0u);
+      EXPECT_EQ(tbl->upid_group()[i], upid_group_id);
+      EXPECT_EQ(tbl->profile_type()[i], storage_.InternString("perf"));
+    }
+  }
+
+  void CheckRandomPerfSamples(FlamegraphCache* cache) {
+    base::Optional<UniquePid> upid;
+    base::Optional<std::string> upid_group;
+    if (Rand(2) == 0) {
+      upid = Rand(kProcesses + 1);
+    } else {
+      upid_group = std::to_string(Rand(kProcesses + 1)) + "," +
+                   std::to_string(Rand(kProcesses + 1));
+    }
+    CheckPerfSamples(cache, upid, upid_group, RandTimeConstraints());
+  }
+
+  TraceStorage storage_;
+  std::minstd_rand0 rnd_engine_;
+  std::vector<StringId> names_;
+  int64_t perf_ts_ = 0;
+};
+
+TEST_F(FlamegraphCacheTest, HeapProfileMatchesReference) {
+  for (uint32_t i = 0; i < 5; ++i) {
+    AddRandomProfile();
+    FlamegraphCache cache(&storage_);
+    for (uint32_t j = 0; j < 50; ++j)
+      CheckHeapProfile(&cache, Rand(kProcesses + 1), RandTs(100));
+  }
+}
+
+TEST_F(FlamegraphCacheTest, HeapProfileAtSampleTimestamps) {
+  AddRandomProfile();
+  FlamegraphCache cache(&storage_);
+  // Every window boundary of the prefix sums: before, at and after the
+  // timestamp of each allocation.
+  for (UniquePid upid = 0; upid < kProcesses; ++upid) {
+    for (int64_t ts = -1; ts <= 100; ++ts)
+      CheckHeapProfile(&cache, upid, ts);
+    CheckHeapProfile(&cache, upid, kMinTs);
+    CheckHeapProfile(&cache, upid, kMaxTs);
+  }
+}
+
+TEST_F(FlamegraphCacheTest, PerfSamplesMatchReference) {
+  for (uint32_t i = 0; i < 5; ++i) {
+    AddRandomProfile();
+    FlamegraphCache cache(&storage_);
+    for (uint32_t j = 0; j < 100; ++j)
+      CheckRandomPerfSamples(&cache);
+  }
+}
+
+TEST_F(FlamegraphCacheTest, PerfSamplesAtSampleTimestamps) {
+  AddRandomProfile();
+  FlamegraphCache cache(&storage_);
+  for (int64_t ts = -1; ts <= perf_ts_ + 1; ++ts) {
+    for (FilterOp op :
+         {FilterOp::kGt, FilterOp::kGe, FilterOp::kLt, FilterOp::kLe}) {
+      CheckPerfSamples(&cache, 1u, base::nullopt, {{op, ts}});
+    }
+    // A window of a single timestamp.
+    CheckPerfSamples(&cache, base::nullopt, std::string("1,2"),
+                     {{FilterOp::kGe, ts}, {FilterOp::kLe, ts}});
+    CheckPerfSamples(&cache, base::nullopt, std::string("1,2"),
+                     {{FilterOp::kGt, ts - 1}, {FilterOp::kLt, ts + 1}});
+  }
+}
+
+TEST_F(FlamegraphCacheTest, PerfSamplesTimeConstraintsAtLimits) {
+  AddRandomProfile();
+  FlamegraphCache cache(&storage_);
+  // No timestamp is > INT64_MAX or < INT64_MIN: these must not wrap around
+  // and select every sample.
+  for (FilterOp op :
+       {FilterOp::kGt, FilterOp::kGe, FilterOp::kLt, FilterOp::kLe}) {
+    CheckPerfSamples(&cache, 1u, base::nullopt, {{op, kMinTs}});
+    CheckPerfSamples(&cache, 1u, base::nullopt, {{op, kMaxTs}});
+  }
+  CheckPerfSamples(&cache, 1u, base::nullopt,
+                   {{FilterOp::kGt, kMinTs}, {FilterOp::kLt, kMaxTs}});
+  CheckPerfSamples(&cache, 1u, base::nullopt,
+                   {{FilterOp::kGe, kMaxTs}, {FilterOp::kLe, kMinTs}});
+  CheckPerfSamples(&cache, 1u, base::nullopt,
+                   {{FilterOp::kLe, kMaxTs}, {FilterOp::kGt, kMaxTs}});
+
+  auto tbl = cache.BuildNativeCallStackSamplingFlamegraph(
+      1u, base::nullopt, {{FilterOp::kGt, kMaxTs}});
+  ASSERT_NE(tbl, nullptr);
+  EXPECT_EQ(tbl->row_count(), 0u);
+  tbl = cache.BuildNativeCallStackSamplingFlamegraph(
+      1u, base::nullopt, {{FilterOp::kLt, kMinTs}});
+  ASSERT_NE(tbl, nullptr);
+  EXPECT_EQ(tbl->row_count(), 0u);
+}
+
+TEST_F(FlamegraphCacheTest, ReusesCacheAcrossQueries) {
+  AddRandomProfile();
+  FlamegraphCache cache(&storage_);
+  // Interleaves the queries of different processes and groups of processes,
+  // more than the cache keeps the index of, and repeats them.
+  for (uint32_t i = 0; i < 3; ++i) {
+    for (UniquePid a = 0; a <= kProcesses; ++a) {
+      for (UniquePid b = 0; b <= kProcesses; ++b) {
+        std::string group = std::to_string(a) + "," + std::to_string(b);
+        std::vector<TimeConstraints> time_constraints = RandTimeConstraints();
+        CheckPerfSamples(&cache, base::nullopt, group, time_constraints);
+
+        // Same as the one-off computation.
+        auto cached = cache.BuildNativeCallStackSamplingFlamegraph(
+            base::nullopt, group, time_constraints);
+        auto one_off = BuildNativeCallStackSamplingFlamegraph(
+            &storage_, base::nullopt, group, time_constraints);
+        ASSERT_EQ(cached->row_count(), one_off->row_count());
+        for (uint32_t row = 0; row < cached->row_count(); ++row) {
+          EXPECT_EQ(cached->name()[row], one_off->name()[row]);
+          EXPECT_EQ(cached->parent_id()[row], one_off->parent_id()[row]);
+          EXPECT_EQ(cached->cumulative_count()[row],
+                    one_off->cumulative_count()[row]);
+        }
+
+        CheckHeapProfile(&cache, a, RandTs(100));
+      }
+    }
+  }
+}
+
+TEST_F(FlamegraphCacheTest, InvalidateAfterParse) {
+  AddRandomProfile();
+  FlamegraphCache cache(&storage_);
+  for (UniquePid upid = 0; upid < kProcesses; ++upid) {
+    CheckHeapProfile(&cache, upid, kMaxTs);
+    CheckPerfSamples(&cache, upid, base::nullopt, {});
+  }
+
+  // More of the trace is parsed: new callsites and samples, and frames which
+  // get symbolized or deobfuscated.
+  AddRandomProfile();
+  auto* frames = storage_.mutable_stack_profile_frame_table();
+  for (uint32_t i = 0; i < frames->row_count(); i += 3)
+    frames->mutable_deobfuscated_name()->Set(i, RandName());
+  cache.Invalidate();
+
+  for (UniquePid upid = 0; upid < kProcesses; ++upid) {
+    CheckHeapProfile(&cache, upid, kMaxTs);
+    CheckPerfSamples(&cache, upid, base::nullopt, {});
+  }
+  for (uint32_t i = 0; i < 50; ++i)
+    CheckRandomPerfSamples(&cache);
+}
+
+TEST_F(FlamegraphCacheTest, SkipsPerfSamplesWithoutCallsite) {
+  tables::StackProfileFrameTable::Row frame;
+  frame.name = names_[0];
+  frame.mapping = tables::StackProfileMappingTable::Id(0);
+  auto frame_id =
+      storage_.mutable_stack_profile_frame_table()->Insert(frame).id;
+  tables::StackProfileCallsiteTable::Row callsite;
+  callsite.frame_id = frame_id;
+  auto callsite_id =
+      storage_.mutable_stack_profile_callsite_table()->Insert(callsite).id;
+
+  // Samples of process 1, unwound or not.
+  tables::PerfSampleTable::Row sample;
+  sample.utid = 1;
+  sample.ts = 10;
+  storage_.mutable_perf_sample_table()->Insert(sample);
+  FlamegraphCache cache(&storage_);
+  auto tbl =
+      cache.BuildNativeCallStackSamplingFlamegraph(1u, base::nullopt, {});
+  ASSERT_NE(tbl, nullptr);
+  EXPECT_EQ(tbl->row_count(), 0u);
+
+  sample.ts = 20;
+  sample.callsite_id = callsite_id;
+  storage_.mutable_perf_sample_table()->Insert(sample);
+  sample.ts = 30;
+  sample.callsite_id = base::nullopt;
+  storage_.mutable_perf_sample_table()->Insert(sample);
+  cache.Invalidate();
+  tbl = cache.BuildNativeCallStackSamplingFlamegraph(1u, base::nullopt, {});
+  ASSERT_NE(tbl, nullptr);
+  ASSERT_EQ(tbl->row_count(), 1u);
+  EXPECT_EQ(tbl->count()[0], 1);
+  EXPECT_EQ(tbl->cumulative_count()[0], 1);
+  EXPECT_EQ(tbl->ts()[0], 20);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
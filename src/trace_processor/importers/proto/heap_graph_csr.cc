@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/heap_graph_csr.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr uint32_t kNone = std::numeric_limits<uint32_t>::max();
+
+// Returns the label with the minimum semidominator on the path from |v| to
+// the root of its tree in the forest of linked nodes, compressing the path on
+// the way. This is EVAL of Lengauer-Tarjan, with the recursion of COMPRESS
+// replaced by an explicit stack.
+uint32_t Eval(uint32_t v,
+              const std::vector<uint32_t>& semi,
+              std::vector<uint32_t>* ancestor,
+              std::vector<uint32_t>* label,
+              std::vector<uint32_t>* stack) {
+  std::vector<uint32_t>& anc = *ancestor;
+  std::vector<uint32_t>& lab = *label;
+  if (anc[v] == kNone)
+    return v;
+  stack->clear();
+  for (uint32_t u = v; anc[anc[u]] != kNone; u = anc[u])
+    stack->push_back(u);
+  while (!stack->empty()) {
+    uint32_t u = stack->back();
+    stack->pop_back();
+    uint32_t a = anc[u];
+    if (semi[lab[a]] < semi[lab[u]])
+      lab[u] = lab[a];
+    anc[u] = anc[a];
+  }
+  return lab[v];
+}
+
+}  // namespace
+
+constexpr uint32_t HeapGraphDominatorTree::kVirtualRoot;
+constexpr uint32_t HeapGraphDominatorTree::kUnreachable;
+
+uint32_t HeapGraphCsr::AddNode(std::vector<uint32_t>* children) {
+  std::sort(children->begin(), children->end());
+  children->erase(std::unique(children->begin(), children->end()),
+                  children->end());
+  targets_.insert(targets_.end(), children->begin(), children->end());
+  offsets_.push_back(static_cast<uint32_t>(targets_.size()));
+  return static_cast<uint32_t>(num_nodes() - 1);
+}
+
+void HeapGraphCsr::SetRoots(std::vector<uint32_t> roots) {
+  std::sort(roots.begin(), roots.end());
+  roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+  roots_ = std::move(roots);
+}
+
+std::vector<int32_t> ComputeRootDistances(const HeapGraphCsr& graph) {
+  std::vector<int32_t> distances(graph.num_nodes(), -1);
+  std::vector<uint32_t> queue;
+  queue.reserve(graph.num_nodes());
+  for (uint32_t root : graph.roots()) {
+    distances[root] = 0;
+    queue.push_back(root);
+  }
+  for (size_t i = 0; i < queue.size(); ++i) {
+    uint32_t node = queue[i];
+    for (const uint32_t* it = graph.children_begin(node);
+         it != graph.children_end(node); ++it) {
+      if (distances[*it] == -1) {
+        distances[*it] = distances[node] + 1;
+        queue.push_back(*it);
+      }
+    }
+  }
+  return distances;
+}
+
+HeapGraphDominatorTree ComputeDominatorTree(const HeapGraphCsr& graph) {
+  const size_t num_nodes = graph.num_nodes();
+
+  // Number the reachable nodes in DFS preorder from a virtual root, which has
+  // number 0 and the roots as children. Below, nodes are identified by their
+  // number in |vertex|, not by their index in |graph|.
+  std::vector<uint32_t> number(num_nodes, kNone);
+  std::vector<uint32_t> vertex{kNone};
+  std::vector<uint32_t> parent{0};
+  struct StackElem {
+    uint32_t number;
+    const uint32_t* next_child;
+    const uint32_t* children_end;
+  };
+  std::vector<StackElem> stack{
+      {0, graph.roots().data(), graph.roots().data() + graph.roots().size()}};
+  while (!stack.empty()) {
+    StackElem& elem = stack.back();
+    if (elem.next_child == elem.children_end) {
+      stack.pop_back();
+      continue;
+    }
+    uint32_t child = *elem.next_child++;
+    PERFETTO_DCHECK(child < num_nodes);
+    if (number[child] != kNone)
+      continue;
+    uint32_t child_number = static_cast<uint32_t>(vertex.size());
+    number[child] = child_number;
+    vertex.push_back(child);
+    parent.push_back(elem.number);
+    stack.push_back({child_number, graph.children_begin(child),
+                     graph.children_end(child)});
+  }
+  const uint32_t num_reachable = static_cast<uint32_t>(vertex.size());
+
+  // Predecessors of each reachable node, in compressed sparse row form too.
+  std::vector<uint32_t> pred_offsets(num_reachable + 1, 0);
+  for (uint32_t root : graph.roots())
+    pred_offsets[number[root] + 1]++;
+  for (uint32_t v = 1; v < num_reachable; ++v) {
+    for (const uint32_t* it = graph.children_begin(vertex[v]);
+         it != graph.children_end(vertex[v]); ++it) {
+      pred_offsets[number[*it] + 1]++;
+    }
+  }
+  for (uint32_t v = 0; v < num_reachable; ++v)
+    pred_offsets[v + 1] += pred_offsets[v];
+  std::vector<uint32_t> preds(pred_offsets[num_reachable]);
+  {
+    std::vector<uint32_t> next(pred_offsets.begin(), pred_offsets.end() - 1);
+    for (uint32_t root : graph.roots())
+      preds[next[number[root]]++] = 0;
+    for (uint32_t v = 1; v < num_reachable; ++v) {
+      for (const uint32_t* it = graph.children_begin(vertex[v]);
+           it != graph.children_end(vertex[v]); ++it) {
+        preds[next[number[*it]]++] = v;
+      }
+    }
+  }
+
+  // Semidominators, in reverse preorder.
+  std::vector<uint32_t> semi(num_reachable);
+  std::vector<uint32_t> label(num_reachable);
+  std::vector<uint32_t> ancestor(num_reachable, kNone);
+  for (uint32_t v = 0; v < num_reachable; ++v) {
+    semi[v] = v;
+    label[v] = v;
+  }
+  std::vector<uint32_t> eval_stack;
+  for (uint32_t w = num_reachable - 1; w > 0; --w) {
+    for (uint32_t i = pred_offsets[w]; i < pred_offsets[w + 1]; ++i) {
+      uint32_t u = Eval(preds[i], semi, &ancestor, &label, &eval_stack);
+      semi[w] = std::min(semi[w], semi[u]);
+    }
+    ancestor[w] = parent[w];
+  }
+
+  // The immediate dominator is the nearest common ancestor, in the DFS tree,
+  // of the parent and the semidominator.
+  std::vector<uint32_t> idom(num_reachable, 0);
+  for (uint32_t w = 1; w < num_reachable; ++w) {
+    uint32_t d = parent[w];
+    while (d > semi[w])
+      d = idom[d];
+    idom[w] = d;
+  }
+
+  HeapGraphDominatorTree tree;
+  tree.idom.assign(num_nodes, HeapGraphDominatorTree::kUnreachable);
+  tree.preorder.assign(vertex.begin() + 1, vertex.end());
+  for (uint32_t w = 1; w < num_reachable; ++w) {
+    tree.idom[vertex[w]] =
+        idom[w] == 0 ? HeapGraphDominatorTree::kVirtualRoot : vertex[idom[w]];
+  }
+  return tree;
+}
+
+std::vector<int64_t> ComputeRetainedValues(const HeapGraphDominatorTree& tree,
+                                           const std::vector<int64_t>& values) {
+  PERFETTO_DCHECK(values.size() == tree.idom.size());
+  std::vector<int64_t> retained(values.size(), 0);
+  for (auto it = tree.preorder.rbegin(); it != tree.preorder.rend(); ++it) {
+    uint32_t node = *it;
+    retained[node] += values[node];
+    uint32_t idom = tree.idom[node];
+    if (idom != HeapGraphDominatorTree::kVirtualRoot)
+      retained[idom] += retained[node];
+  }
+  return retained;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
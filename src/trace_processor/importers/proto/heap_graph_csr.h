@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_HEAP_GRAPH_CSR_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_HEAP_GRAPH_CSR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+// Heap graph in compressed sparse row form. Nodes are numbered from 0, and
+// the children of node i are targets_[offsets_[i]..offsets_[i + 1]), sorted
+// and without duplicates.
+class HeapGraphCsr {
+ public:
+  HeapGraphCsr() : offsets_{0} {}
+
+  // Appends a node with the given |children|, which are sorted and
+  // deduplicated in place. Returns the index of the node.
+  uint32_t AddNode(std::vector<uint32_t>* children);
+
+  // Sets the GC roots of the graph. They are sorted and deduplicated.
+  void SetRoots(std::vector<uint32_t> roots);
+
+  size_t num_nodes() const { return offsets_.size() - 1; }
+  size_t num_edges() const { return targets_.size(); }
+  const std::vector<uint32_t>& roots() const { return roots_; }
+
+  const uint32_t* children_begin(uint32_t node) const {
+    return targets_.data() + offsets_[node];
+  }
+  const uint32_t* children_end(uint32_t node) const {
+    return targets_.data() + offsets_[node + 1];
+  }
+  size_t num_children(uint32_t node) const {
+    return offsets_[node + 1] - offsets_[node];
+  }
+
+ private:
+  std::vector<uint32_t> offsets_;
+  std::vector<uint32_t> targets_;
+  std::vector<uint32_t> roots_;
+};
+
+// For each node, the length of the shortest path from any root, or -1 if the
+// node is not reachable.
+std::vector<int32_t> ComputeRootDistances(const HeapGraphCsr& graph);
+
+// Dominator tree of the nodes reachable from the roots. A node X dominates a
+// node Y if every path from the roots to Y goes through X.
+struct HeapGraphDominatorTree {
+  // Dominated only by the set of roots as a whole, not by a single node. This
+  // is the case for the roots themselves.
+  static constexpr uint32_t kVirtualRoot = std::numeric_limits<uint32_t>::max();
+  static constexpr uint32_t kUnreachable = kVirtualRoot - 1;
+
+  // Immediate dominator of each node.
+  std::vector<uint32_t> idom;
+  // The reachable nodes, each after its immediate dominator.
+  std::vector<uint32_t> preorder;
+};
+
+// Computes the dominator tree with the Semi-NCA algorithm, in
+// O(edges * log(nodes)) time and linear space. Does not recurse, so it works
+// for arbitrarily long reference chains.
+HeapGraphDominatorTree ComputeDominatorTree(const HeapGraphCsr& graph);
+
+// For each node, the sum of |values| over the nodes it dominates (including
+// itself). Unreachable nodes retain nothing.
+std::vector<int64_t> ComputeRetainedValues(const HeapGraphDominatorTree& tree,
+                                           const std::vector<int64_t>& values);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_HEAP_GRAPH_CSR_H_
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/heap_graph_csr.h"
+
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr uint32_t kVirtualRoot = HeapGraphDominatorTree::kVirtualRoot;
+constexpr uint32_t kUnreachable = HeapGraphDominatorTree::kUnreachable;
+
+HeapGraphCsr BuildGraph(const std::vector<std::vector<uint32_t>>& children,
+                        std::vector<uint32_t> roots) {
+  HeapGraphCsr graph;
+  for (std::vector<uint32_t> node_children : children)
+    graph.AddNode(&node_children);
+  graph.SetRoots(std::move(roots));
+  return graph;
+}
+
+// Whether |dominator| dominates |node|: |node| is not reachable from the
+// roots without going through |dominator|.
+bool Dominates(const HeapGraphCsr& graph, uint32_t dominator, uint32_t node) {
+  std::vector<bool> visited(graph.num_nodes());
+  visited[dominator] = true;
+  std::vector<uint32_t> stack;
+  for (uint32_t root : graph.roots()) {
+    if (!visited[root]) {
+      visited[root] = true;
+      stack.push_back(root);
+    }
+  }
+  while (!stack.empty()) {
+    uint32_t cur = stack.back();
+    stack.pop_back();
+    for (const uint32_t* it = graph.children_begin(cur);
+         it != graph.children_end(cur); ++it) {
+      if (!visited[*it]) {
+        visited[*it] = true;
+        stack.push_back(*it);
+      }
+    }
+  }
+  return dominator == node || !visited[node];
+}
+
+TEST(HeapGraphCsrTest, AddNodeSortsAndDeduplicates) {
+  HeapGraphCsr graph = BuildGraph({{2, 1, 2}, {}, {0}}, {2, 0, 2});
+  EXPECT_EQ(graph.num_nodes(), 3u);
+  EXPECT_EQ(graph.num_edges(), 3u);
+  EXPECT_THAT(std::vector<uint32_t>(graph.children_begin(0),
+                                    graph.children_end(0)),
+              ElementsAre(1, 2));
+  EXPECT_EQ(graph.num_children(1), 0u);
+  EXPECT_THAT(graph.roots(), ElementsAre(0, 2));
+}
+
+TEST(HeapGraphCsrTest, RootDistances) {
+  //   0 -> 1 -> 2 -> 3
+  //   4 ------------^
+  //   5 (unreachable)
+  HeapGraphCsr graph = BuildGraph({{1}, {2}, {3}, {}, {3}, {0}}, {0, 4});
+  EXPECT_THAT(ComputeRootDistances(graph), ElementsAre(0, 1, 2, 1, 0, -1));
+}
+
+TEST(HeapGraphCsrTest, DominatorTree) {
+  // 0 (root) -> 1, 2
+  // 1 -> 3
+  // 2 -> 3, 4
+  // 3 -> 6
+  // 4 <-> 5
+  // 7 (unreachable) -> 0
+  HeapGraphCsr graph =
+      BuildGraph({{1, 2}, {3}, {3, 4}, {6}, {5}, {4}, {}, {0}}, {0});
+  HeapGraphDominatorTree tree = ComputeDominatorTree(graph);
+  EXPECT_THAT(tree.idom, ElementsAre(kVirtualRoot, 0, 0, 0, 2, 4, 3,
+                                     kUnreachable));
+  EXPECT_EQ(tree.preorder.size(), 7u);
+
+  std::vector<int64_t> sizes{1, 2, 4, 8, 16, 32, 64, 128};
+  EXPECT_THAT(ComputeRetainedValues(tree, sizes),
+              ElementsAre(127, 2, 52, 72, 48, 32, 64, 0));
+}
+
+TEST(HeapGraphCsrTest, MultipleRoots) {
+  // 0 and 1 are roots that both reach 2, so only the set of roots dominates
+  // it.
+  HeapGraphCsr graph = BuildGraph({{2}, {2}, {3}, {}}, {0, 1});
+  HeapGraphDominatorTree tree = ComputeDominatorTree(graph);
+  EXPECT_THAT(tree.idom, ElementsAre(kVirtualRoot, kVirtualRoot, kVirtualRoot,
+                                     2));
+  EXPECT_THAT(ComputeRetainedValues(tree, {1, 1, 1, 1}),
+              ElementsAre(1, 1, 2, 1));
+}
+
+TEST(HeapGraphCsrTest, LongChain) {
+  // Deep enough to overflow the stack with a recursive implementation.
+  constexpr uint32_t kLength = 1000000;
+  std::vector<std::vector<uint32_t>> children(kLength);
+  for (uint32_t i = 0; i + 1 < kLength; ++i)
+    children[i].push_back(i + 1);
+  HeapGraphCsr graph = BuildGraph(children, {0});
+  HeapGraphDominatorTree tree = ComputeDominatorTree(graph);
+  EXPECT_EQ(tree.idom[kLength - 1], kLength - 2);
+  std::vector<int64_t> retained =
+      ComputeRetainedValues(tree, std::vector<int64_t>(kLength, 1));
+  EXPECT_EQ(retained[0], kLength);
+}
+
+TEST(HeapGraphCsrTest, MatchesNaiveDominators) {
+  std::minstd_rand rnd(42);
+  for (int iteration = 0; iteration < 50; ++iteration) {
+    const uint32_t num_nodes = 1 + static_cast<uint32_t>(rnd() % 30);
+    std::vector<std::vector<uint32_t>> children(num_nodes);
+    for (uint32_t i = 0; i < num_nodes; ++i) {
+      size_t num_children = rnd() % 4;
+      for (size_t j = 0; j < num_children; ++j)
+        children[i].push_back(static_cast<uint32_t>(rnd() % num_nodes));
+    }
+    std::vector<uint32_t> roots;
+    for (size_t j = 0; j < 1 + rnd() % 3; ++j)
+      roots.push_back(static_cast<uint32_t>(rnd() % num_nodes));
+    HeapGraphCsr graph = BuildGraph(children, roots);
+
+    HeapGraphDominatorTree tree = ComputeDominatorTree(graph);
+    std::vector<int32_t> distances = ComputeRootDistances(graph);
+    for (uint32_t node = 0; node < num_nodes; ++node) {
+      uint32_t idom = tree.idom[node];
+      if (distances[node] == -1) {
+        EXPECT_EQ(idom, kUnreachable);
+        continue;
+      }
+      // The immediate dominator is the dominator that is dominated by all
+      // the other dominators.
+      std::vector<uint32_t> dominators;
+      for (uint32_t other = 0; other < num_nodes; ++other) {
+        if (other != node && distances[other] != -1 &&
+            Dominates(graph, other, node)) {
+          dominators.push_back(other);
+        }
+      }
+      if (dominators.empty()) {
+        EXPECT_EQ(idom, kVirtualRoot);
+        continue;
+      }
+      ASSERT_NE(idom, kVirtualRoot);
+      ASSERT_NE(idom, kUnreachable);
+      EXPECT_TRUE(Dominates(graph, idom, node));
+      for (uint32_t dominator : dominators)
+        EXPECT_TRUE(Dominates(graph, dominator, idom));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -22,7 +22,7 @@
 #include "src/trace_processor/importers/proto/profiler_util.h"
 #include "src/trace_processor/tables/profiler_tables.h"
 
-#include <set>
+#include <algorithm>
 #include <utility>
 
 namespace perfetto {
@@ -57,46 +57,27 @@ void ForReferenceSet(const TraceStorage& storage,
   }
 }
 
-std::set<tables::HeapGraphObjectTable::Id> GetChildren(
-    const TraceStorage& storage,
-    tables::HeapGraphObjectTable::Id id) {
-  uint32_t obj_row = *storage.heap_graph_object_table().id().IndexOf(id);
-  uint32_t cls_row = *storage.heap_graph_class_table().id().IndexOf(
-      storage.heap_graph_object_table().type_id()[obj_row]);
-
-  StringPool::Id kind = storage.heap_graph_class_table().kind()[cls_row];
-  base::Optional<StringPool::Id> weakref_kind =
-      storage.string_pool().GetId("KIND_WEAK_REFERENCE");
-  base::Optional<StringPool::Id> softref_kind =
-      storage.string_pool().GetId("KIND_SOFT_REFERENCE");
-  base::Optional<StringPool::Id> finalizerref_kind =
-      storage.string_pool().GetId("KIND_FINALIZER_REFERENCE");
-  base::Optional<StringPool::Id> phantomref_kind =
-      storage.string_pool().GetId("KIND_PHANTOM_REFERENCE");
-
-  if ((weakref_kind && kind == *weakref_kind) ||
-      (softref_kind && kind == *softref_kind) ||
-      (finalizerref_kind && kind == *finalizerref_kind) ||
-      (phantomref_kind && kind == *phantomref_kind)) {
-    // Do not follow weak / soft / finalizer / phantom references.
-    return {};
+// Returns whether the references of objects of this kind should not be
+// followed, for the reachability and retention of the objects they refer to.
+class WeakReferenceKinds {
+ public:
+  explicit WeakReferenceKinds(const StringPool& pool) {
+    for (const char* kind :
+         {"KIND_WEAK_REFERENCE", "KIND_SOFT_REFERENCE",
+          "KIND_FINALIZER_REFERENCE", "KIND_PHANTOM_REFERENCE"}) {
+      base::Optional<StringPool::Id> id = pool.GetId(kind);
+      if (id)
+        kinds_.push_back(*id);
+    }
   }
 
-  std::set<tables::HeapGraphObjectTable::Id> children;
-  ForReferenceSet(
-      storage, id, [&storage, &children, id](uint32_t reference_row) {
-        PERFETTO_CHECK(
-            storage.heap_graph_reference_table().owner_id()[reference_row] ==
-            id);
-        auto opt_owned =
-            storage.heap_graph_reference_table().owned_id()[reference_row];
-        if (opt_owned) {
-          children.emplace(*opt_owned);
-        }
-        return true;
-      });
-  return children;
-}
+  bool Contains(StringPool::Id kind) const {
+    return std::find(kinds_.begin(), kinds_.end(), kind) != kinds_.end();
+  }
+
+ private:
+  std::vector<StringPool::Id> kinds_;
+};
 
 struct ClassDescriptor {
   StringId name;
@@ -198,46 +179,6 @@ int64_t GetSizeFromNativeAllocationRegistry(int64_t nar_size) {
 
 }  // namespace
 
-void MarkRoot(TraceStorage* storage,
-              tables::HeapGraphObjectTable::Id id,
-              StringPool::Id type) {
-  uint32_t row = *storage->heap_graph_object_table().id().IndexOf(id);
-  storage->mutable_heap_graph_object_table()->mutable_root_type()->Set(row,
-                                                                       type);
-
-  // Calculate shortest distance to a GC root.
-  std::deque<std::pair<int32_t, tables::HeapGraphObjectTable::Id>>
-      reachable_nodes{{0, id}};
-  while (!reachable_nodes.empty()) {
-    tables::HeapGraphObjectTable::Id cur_node;
-    int32_t distance;
-    std::tie(distance, cur_node) = reachable_nodes.front();
-    reachable_nodes.pop_front();
-    uint32_t cur_row =
-        *storage->heap_graph_object_table().id().IndexOf(cur_node);
-    int32_t cur_distance =
-        storage->heap_graph_object_table().root_distance()[cur_row];
-    if (cur_distance == -1 || cur_distance > distance) {
-      if (cur_distance == -1) {
-        storage->mutable_heap_graph_object_table()->mutable_reachable()->Set(
-            cur_row, 1);
-      }
-      storage->mutable_heap_graph_object_table()->mutable_root_distance()->Set(
-          cur_row, distance);
-
-      for (tables::HeapGraphObjectTable::Id child_node :
-           GetChildren(*storage, cur_node)) {
-        uint32_t child_row =
-            *storage->heap_graph_object_table().id().IndexOf(child_node);
-        int32_t child_distance =
-            storage->heap_graph_object_table().root_distance()[child_row];
-        if (child_distance == -1 || child_distance > distance + 1)
-          reachable_nodes.emplace_back(distance + 1, child_node);
-      }
-    }
-  }
-}
-
 base::Optional<base::StringView> GetStaticClassTypeName(base::StringView type) {
   static const base::StringView kJavaClassTemplate("java.lang.Class<");
   if (!type.empty() && type.at(type.size() - 1) == '>' &&
@@ -325,8 +266,9 @@ bool HeapGraphTracker::SetPidAndTimestamp(SequenceState* sequence_state,
 tables::HeapGraphObjectTable::Id HeapGraphTracker::GetOrInsertObject(
     SequenceState* sequence_state,
     uint64_t object_id) {
-  auto it = sequence_state->object_id_to_db_id.find(object_id);
-  if (it == sequence_state->object_id_to_db_id.end()) {
+  tables::HeapGraphObjectTable::Id* id =
+      sequence_state->object_id_to_db_id.Find(object_id);
+  if (!id) {
     auto id_and_row =
         context_->storage->mutable_heap_graph_object_table()->Insert(
             {sequence_state->current_upid,
@@ -338,11 +280,10 @@ tables::HeapGraphObjectTable::Id HeapGraphTracker::GetOrInsertObject(
              {},
              /*root_type=*/base::nullopt,
              /*root_distance*/ -1});
-    bool inserted;
-    std::tie(it, inserted) =
-        sequence_state->object_id_to_db_id.emplace(object_id, id_and_row.id);
+    id = sequence_state->object_id_to_db_id.Insert(object_id, id_and_row.id)
+             .first;
   }
-  return it->second;
+  return *id;
 }
 
 tables::HeapGraphClassTable::Id HeapGraphTracker::GetOrInsertType(
@@ -685,26 +626,133 @@ void HeapGraphTracker::FinalizeProfile(uint32_t seq_id) {
         static_cast<int>(sequence_state.current_upid));
   }
 
-  for (const SourceRoot& root : sequence_state.current_roots) {
+  UpdateGraph(&sequence_state);
+  PopulateSuperClasses(sequence_state);
+  PopulateNativeSize(sequence_state);
+  sequence_state_.erase(seq_id);
+}
+
+void HeapGraphTracker::UpdateGraph(SequenceState* seq) {
+  auto* objects_tbl = context_->storage->mutable_heap_graph_object_table();
+  const auto& class_tbl = context_->storage->heap_graph_class_table();
+  const auto& refs_tbl = context_->storage->heap_graph_reference_table();
+
+  // Usually a dump is on a single sequence, but if it is not, the graph is
+  // rebuilt with the objects of all of them.
+  HeapGraph& graph =
+      graphs_[std::make_pair(seq->current_upid, seq->current_ts)];
+  PERFETTO_DCHECK(!graph.dominator_tree_populated);
+  std::vector<tables::HeapGraphObjectTable::Id> objects =
+      std::move(graph.objects);
+  std::vector<tables::HeapGraphObjectTable::Id> roots;
+  for (uint32_t node : graph.csr.roots())
+    roots.push_back(objects[node]);
+  for (auto it = seq->object_id_to_db_id.GetIterator(); it; ++it)
+    objects.push_back(it.value());
+  if (objects.empty())
+    return;
+  std::sort(objects.begin(), objects.end());
+
+  // Maps rows of the object table to nodes. The objects of a dump are mostly
+  // contiguous in the table, so this is indexed from the first one.
+  const uint32_t first_row = *objects_tbl->id().IndexOf(objects.front());
+  const uint32_t last_row = *objects_tbl->id().IndexOf(objects.back());
+  std::vector<uint32_t> node_for_row(last_row - first_row + 1);
+  for (uint32_t node = 0; node < objects.size(); ++node)
+    node_for_row[*objects_tbl->id().IndexOf(objects[node]) - first_row] = node;
+
+  for (const SourceRoot& root : seq->current_roots) {
     for (uint64_t obj_id : root.object_ids) {
-      auto it = sequence_state.object_id_to_db_id.find(obj_id);
+      tables::HeapGraphObjectTable::Id* db_id =
+          seq->object_id_to_db_id.Find(obj_id);
       // This can only happen for an invalid type string id, which is already
       // reported as an error. Silently continue here.
-      if (it == sequence_state.object_id_to_db_id.end())
+      if (!db_id)
         continue;
+      roots.push_back(*db_id);
+      uint32_t row = *objects_tbl->id().IndexOf(*db_id);
+      if (!objects_tbl->root_type()[row])
+        objects_tbl->mutable_root_type()->Set(row, root.root_type);
+    }
+  }
 
-      tables::HeapGraphObjectTable::Id db_id = it->second;
-      auto it_and_success = roots_[std::make_pair(sequence_state.current_upid,
-                                                  sequence_state.current_ts)]
-                                .emplace(db_id);
-      if (it_and_success.second)
-        MarkRoot(context_->storage.get(), db_id, root.root_type);
+  WeakReferenceKinds weak_kinds(context_->storage->string_pool());
+  HeapGraphCsr csr;
+  std::vector<uint32_t> children;
+  for (tables::HeapGraphObjectTable::Id id : objects) {
+    children.clear();
+    uint32_t row = *objects_tbl->id().IndexOf(id);
+    uint32_t class_row = *class_tbl.id().IndexOf(objects_tbl->type_id()[row]);
+    // Do not follow weak / soft / finalizer / phantom references.
+    if (!weak_kinds.Contains(class_tbl.kind()[class_row])) {
+      ForReferenceSet(*context_->storage, id, [&](uint32_t reference_row) {
+        base::Optional<tables::HeapGraphObjectTable::Id> owned =
+            refs_tbl.owned_id()[reference_row];
+        if (owned) {
+          uint32_t owned_row = *objects_tbl->id().IndexOf(*owned);
+          PERFETTO_DCHECK(owned_row >= first_row && owned_row <= last_row);
+          children.push_back(node_for_row[owned_row - first_row]);
+        }
+        return true;
+      });
     }
+    csr.AddNode(&children);
   }
+  std::vector<uint32_t> root_nodes;
+  root_nodes.reserve(roots.size());
+  for (tables::HeapGraphObjectTable::Id id : roots) {
+    root_nodes.push_back(
+        node_for_row[*objects_tbl->id().IndexOf(id) - first_row]);
+  }
+  csr.SetRoots(std::move(root_nodes));
 
-  PopulateSuperClasses(sequence_state);
-  PopulateNativeSize(sequence_state);
-  sequence_state_.erase(seq_id);
+  std::vector<int32_t> distances = ComputeRootDistances(csr);
+  for (uint32_t node = 0; node < objects.size(); ++node) {
+    if (distances[node] == -1)
+      continue;
+    uint32_t row = *objects_tbl->id().IndexOf(objects[node]);
+    objects_tbl->mutable_reachable()->Set(row, 1);
+    objects_tbl->mutable_root_distance()->Set(row, distances[node]);
+  }
+
+  graph.objects = std::move(objects);
+  graph.csr = std::move(csr);
+}
+
+void HeapGraphTracker::PopulateDominatorTree(std::pair<UniquePid, int64_t> key,
+                                             HeapGraph* graph) {
+  if (graph->dominator_tree_populated)
+    return;
+  graph->dominator_tree_populated = true;
+
+  const auto& objects_tbl = context_->storage->heap_graph_object_table();
+  HeapGraphDominatorTree tree = ComputeDominatorTree(graph->csr);
+  std::vector<int64_t> self_sizes(graph->objects.size());
+  for (uint32_t node = 0; node < graph->objects.size(); ++node) {
+    self_sizes[node] = objects_tbl.self_size()[*objects_tbl.id().IndexOf(
+        graph->objects[node])];
+  }
+  std::vector<int64_t> retained_sizes =
+      ComputeRetainedValues(tree, self_sizes);
+  std::vector<int64_t> retained_counts = ComputeRetainedValues(
+      tree, std::vector<int64_t>(graph->objects.size(), 1));
+
+  auto* dominator_tbl =
+      context_->storage->mutable_heap_graph_dominator_tree_table();
+  for (uint32_t node = 0; node < graph->objects.size(); ++node) {
+    uint32_t idom = tree.idom[node];
+    if (idom == HeapGraphDominatorTree::kUnreachable)
+      continue;
+    tables::HeapGraphDominatorTreeTable::Row row;
+    row.upid = key.first;
+    row.graph_sample_ts = key.second;
+    row.object_id = graph->objects[node];
+    if (idom != HeapGraphDominatorTree::kVirtualRoot)
+      row.idom_id = graph->objects[idom];
+    row.retained_size = retained_sizes[node];
+    row.retained_count = retained_counts[node];
+    dominator_tbl->Insert(row);
+  }
 }
 
 base::Optional<tables::HeapGraphObjectTable::Id>
@@ -855,30 +903,31 @@ void HeapGraphTracker::PopulateSuperClasses(const SequenceState& seq) {
 }
 
 void FindPathFromRoot(TraceStorage* storage,
-                      tables::HeapGraphObjectTable::Id id,
+                      const HeapGraph& graph,
+                      uint32_t root,
                       PathFromRoot* path) {
   // We have long retention chains (e.g. from LinkedList). If we use the stack
   // here, we risk running out of stack space. This is why we use a vector to
   // simulate the stack.
   struct StackElem {
-    tables::HeapGraphObjectTable::Id node;  // Node in the original graph.
+    uint32_t node;     // Node in the original graph.
     size_t parent_id;  // id of parent node in the result tree.
     size_t i;          // Index of the next child of this node to handle.
     uint32_t depth;    // Depth in the resulting tree
                        // (including artificial root).
-    std::vector<tables::HeapGraphObjectTable::Id> children;
   };
 
-  std::vector<StackElem> stack{{id, PathFromRoot::kRoot, 0, 0, {}}};
+  std::vector<StackElem> stack{{root, PathFromRoot::kRoot, 0, 0}};
+  path->visited.resize(graph.csr.num_nodes());
 
   while (!stack.empty()) {
-    tables::HeapGraphObjectTable::Id n = stack.back().node;
-    uint32_t row = *storage->heap_graph_object_table().id().IndexOf(n);
+    uint32_t n = stack.back().node;
+    uint32_t row =
+        *storage->heap_graph_object_table().id().IndexOf(graph.objects[n]);
     size_t parent_id = stack.back().parent_id;
     uint32_t depth = stack.back().depth;
     size_t& i = stack.back().i;
-    std::vector<tables::HeapGraphObjectTable::Id>& children =
-        stack.back().children;
+    const size_t num_children = graph.csr.num_children(n);
 
     tables::HeapGraphClassTable::Id type_id =
         storage->heap_graph_object_table().type_id()[row];
@@ -918,10 +967,6 @@ void FindPathFromRoot(TraceStorage* storage,
       output_tree_node->size +=
           storage->heap_graph_object_table().self_size()[row];
       output_tree_node->count++;
-      std::set<tables::HeapGraphObjectTable::Id> children_set =
-          GetChildren(*storage, n);
-      children.assign(children_set.cbegin(), children_set.cend());
-      PERFETTO_CHECK(children.size() == children_set.size());
 
       if (storage->heap_graph_object_table().native_size()[row]) {
         StringPool::Id native_class_name_id = storage->InternString(
@@ -947,12 +992,12 @@ void FindPathFromRoot(TraceStorage* storage,
     }
 
     // We have already handled this node and just need to get its i-th child.
-    if (!children.empty()) {
-      PERFETTO_CHECK(i < children.size());
-      tables::HeapGraphObjectTable::Id child = children[i];
-      uint32_t child_row =
-          *storage->heap_graph_object_table().id().IndexOf(child);
-      if (++i == children.size())
+    if (num_children != 0) {
+      PERFETTO_CHECK(i < num_children);
+      uint32_t child = graph.csr.children_begin(n)[i];
+      uint32_t child_row = *storage->heap_graph_object_table().id().IndexOf(
+          graph.objects[child]);
+      if (++i == num_children)
         stack.pop_back();
 
       int32_t child_distance =
@@ -962,11 +1007,9 @@ void FindPathFromRoot(TraceStorage* storage,
       PERFETTO_CHECK(n_distance >= 0);
       PERFETTO_CHECK(child_distance >= 0);
 
-      bool visited = path->visited.count(child);
-
-      if (child_distance == n_distance + 1 && !visited) {
-        path->visited.emplace(child);
-        stack.emplace_back(StackElem{child, path_id, 0, depth + 1, {}});
+      if (child_distance == n_distance + 1 && !path->visited[child]) {
+        path->visited[child] = true;
+        stack.emplace_back(StackElem{child, path_id, 0, depth + 1});
       }
     } else {
       stack.pop_back();
@@ -984,8 +1027,8 @@ HeapGraphTracker::BuildFlamegraph(const int64_t current_ts,
       new tables::ExperimentalFlamegraphNodesTable(
           context_->storage->mutable_string_pool(), nullptr));
 
-  auto it = roots_.find(std::make_pair(current_upid, current_ts));
-  if (it == roots_.end()) {
+  auto it = graphs_.find(std::make_pair(current_upid, current_ts));
+  if (it == graphs_.end() || it->second.csr.roots().empty()) {
     // TODO(fmayer): This should not be within the flame graph but some marker
     // in the UI.
     if (IsTruncated(current_upid, current_ts)) {
@@ -1009,11 +1052,11 @@ HeapGraphTracker::BuildFlamegraph(const int64_t current_ts,
     return nullptr;
   }
 
-  const std::set<tables::HeapGraphObjectTable::Id>& roots = it->second;
+  const HeapGraph& graph = it->second;
 
   PathFromRoot init_path;
-  for (tables::HeapGraphObjectTable::Id root : roots) {
-    FindPathFromRoot(context_->storage.get(), root, &init_path);
+  for (uint32_t root : graph.csr.roots()) {
+    FindPathFromRoot(context_->storage.get(), graph, root, &init_path);
   }
 
   std::vector<int32_t> node_to_cumulative_size(init_path.nodes.size());
@@ -1065,6 +1108,8 @@ void HeapGraphTracker::NotifyEndOfFile() {
       FinalizeProfile(sequence_state_.begin()->first);
     }
   }
+  for (auto& key_and_graph : graphs_)
+    PopulateDominatorTree(key_and_graph.first, &key_and_graph.second);
 }
 
 bool HeapGraphTracker::IsTruncated(UniquePid upid, int64_t ts) {
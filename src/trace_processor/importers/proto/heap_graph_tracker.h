@@ -22,10 +22,13 @@
 #include <utility>
 #include <vector>
 
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/hash.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_view.h"
 
 #include "protos/perfetto/trace/profiling/heap_graph.pbzero.h"
+#include "src/trace_processor/importers/proto/heap_graph_csr.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
@@ -52,14 +55,22 @@ struct PathFromRoot {
     std::map<StringId, size_t> children;
   };
   std::vector<Node> nodes{Node{}};
-  std::set<tables::HeapGraphObjectTable::Id> visited;
+  // Indexed by node of the HeapGraph.
+  std::vector<bool> visited;
+};
+
+// The objects of one heap dump of a process, and the strong references
+// between them.
+struct HeapGraph {
+  // Object of each node of |csr|, sorted by id.
+  std::vector<tables::HeapGraphObjectTable::Id> objects;
+  HeapGraphCsr csr;
+  bool dominator_tree_populated = false;
 };
 
-void MarkRoot(TraceStorage* s,
-              tables::HeapGraphObjectTable::Id id,
-              StringPool::Id type);
 void FindPathFromRoot(TraceStorage* storage,
-                      tables::HeapGraphObjectTable::Id id,
+                      const HeapGraph& graph,
+                      uint32_t root,
                       PathFromRoot* path);
 
 base::Optional<base::StringView> GetStaticClassTypeName(base::StringView type);
@@ -163,6 +174,14 @@ class HeapGraphTracker : public Destructible {
     uint64_t classloader_id;
     StringPool::Id kind;
   };
+  // Object ids are addresses, so their low bits are mostly zero.
+  struct ObjectIdHash {
+    size_t operator()(uint64_t object_id) const {
+      base::Hash hash;
+      hash.Update(object_id);
+      return static_cast<size_t>(hash.digest());
+    }
+  };
   struct SequenceState {
     UniquePid current_upid = 0;
     int64_t current_ts = 0;
@@ -170,7 +189,8 @@ class HeapGraphTracker : public Destructible {
     std::vector<SourceRoot> current_roots;
     std::map<uint64_t, InternedType> interned_types;
     std::map<uint64_t, StringPool::Id> interned_location_names;
-    std::map<uint64_t, tables::HeapGraphObjectTable::Id> object_id_to_db_id;
+    base::FlatHashMap<uint64_t, tables::HeapGraphObjectTable::Id, ObjectIdHash>
+        object_id_to_db_id;
     std::map<uint64_t, tables::HeapGraphClassTable::Id> type_id_to_db_id;
     std::map<uint64_t, std::vector<tables::HeapGraphReferenceTable::Id>>
         references_for_field_name_id;
@@ -204,6 +224,14 @@ class HeapGraphTracker : public Destructible {
                               const InternedType* current_type);
   bool IsTruncated(UniquePid upid, int64_t ts);
 
+  // Adds the objects and roots of `seq` to its HeapGraph, and populates
+  // HeapGraphObject::root_type, reachable and root_distance.
+  void UpdateGraph(SequenceState* seq);
+
+  // Populates the HeapGraphDominatorTree table for `graph`.
+  void PopulateDominatorTree(std::pair<UniquePid, int64_t> key,
+                             HeapGraph* graph);
+
   // Returns the object pointed to by `field` in `obj`.
   base::Optional<tables::HeapGraphObjectTable::Id> GetReferenceByFieldName(
       tables::HeapGraphObjectTable::Id obj,
@@ -227,9 +255,7 @@ class HeapGraphTracker : public Destructible {
   std::map<std::pair<base::Optional<StringPool::Id>, StringPool::Id>,
            StringPool::Id>
       deobfuscation_mapping_;
-  std::map<std::pair<UniquePid, int64_t>,
-           std::set<tables::HeapGraphObjectTable::Id>>
-      roots_;
+  std::map<std::pair<UniquePid, int64_t>, HeapGraph> graphs_;
   std::set<std::pair<UniquePid, int64_t>> truncated_graphs_;
 
   StringPool::Id cleaner_thunk_str_id_;
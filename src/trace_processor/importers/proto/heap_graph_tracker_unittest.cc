@@ -321,6 +321,73 @@ TEST(HeapGraphTrackerTest, BuildFlamegraph) {
   EXPECT_THAT(counts, UnorderedElementsAre(1, 2, 1, 1, 1));
 }
 
+TEST(HeapGraphTrackerTest, DominatorTree) {
+  //   1 (root)     6
+  //    / \        |
+  //   2   3        1
+  //    \ /
+  //     4
+  //     |
+  //     5
+  constexpr uint64_t kSeqId = 1;
+  constexpr UniquePid kPid = 1;
+  constexpr int64_t kTimestamp = 1;
+  constexpr uint64_t kField = 1;
+  constexpr uint64_t kType = 1;
+
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+
+  HeapGraphTracker tracker(&context);
+  tracker.AddInternedFieldName(kSeqId, kField, base::StringView("foo"));
+  tracker.AddInternedType(kSeqId, kType, context.storage->InternString("X"),
+                          /*location_id=*/base::nullopt, /*object_size=*/0,
+                          /*field_name_ids=*/{}, /*superclass_id=*/0,
+                          /*classloader_id=*/0, /*no_fields=*/false,
+                          context.storage->InternString("KIND_NORMAL"));
+
+  const std::vector<std::vector<uint64_t>> references{
+      {}, {2, 3}, {4}, {4}, {5}, {}, {1}};
+  for (uint64_t id = 1; id < references.size(); ++id) {
+    HeapGraphTracker::SourceObject obj;
+    obj.object_id = id;
+    obj.self_size = 1u << (id - 1);
+    obj.type_id = kType;
+    obj.referred_objects = references[id];
+    obj.field_name_ids.assign(references[id].size(), kField);
+    tracker.AddObject(kSeqId, kPid, kTimestamp, std::move(obj));
+  }
+
+  HeapGraphTracker::SourceRoot root;
+  root.root_type = context.storage->InternString("ROOT");
+  root.object_ids.emplace_back(1);
+  tracker.AddRoot(kSeqId, kPid, kTimestamp, root);
+
+  tracker.FinalizeProfile(kSeqId);
+  tracker.NotifyEndOfFile();
+  // Idempotent.
+  tracker.NotifyEndOfFile();
+
+  // The objects are identified by their self size below.
+  const auto& objects = context.storage->heap_graph_object_table();
+  auto self_size = [&objects](tables::HeapGraphObjectTable::Id id) {
+    return objects.self_size()[*objects.id().IndexOf(id)];
+  };
+  const auto& tree = context.storage->heap_graph_dominator_tree_table();
+  std::vector<std::tuple<int64_t, int64_t, int64_t, int64_t>> rows;
+  for (uint32_t i = 0; i < tree.row_count(); ++i) {
+    base::Optional<tables::HeapGraphObjectTable::Id> idom = tree.idom_id()[i];
+    rows.emplace_back(self_size(tree.object_id()[i]),
+                      idom ? self_size(*idom) : -1, tree.retained_size()[i],
+                      tree.retained_count()[i]);
+  }
+  EXPECT_THAT(rows, UnorderedElementsAre(std::make_tuple(1, -1, 31, 5),
+                                         std::make_tuple(2, 1, 2, 1),
+                                         std::make_tuple(4, 1, 4, 1),
+                                         std::make_tuple(8, 1, 24, 2),
+                                         std::make_tuple(16, 8, 16, 1)));
+}
+
 static const char kArray[] = "X[]";
 static const char kDoubleArray[] = "X[][]";
 static const char kNoArray[] = "X";
@@ -243,6 +243,11 @@ void ProfileModule::ParsePerfSample(
     return;
   }
 
+  // Not a sample, but statistics of the producer's unwinders, emitted once
+  // at the end of the data source.
+  if (sample.has_unwinder_stats())
+    return;
+
   // Proper sample, populate the |perf_sample| table with everything except the
   // recorded counter values, which go to |counter|.
   context_->event_tracker->PushCounter(
@@ -214,7 +214,7 @@ class MockSliceTracker : public SliceTracker {
                base::Optional<SliceId>(int64_t timestamp,
                                        TrackId track_id,
                                        SetArgsCallback args_callback,
-                                       std::function<SliceId()> inserter));
+                                       SliceInserter inserter));
 };
 
 class MockFlowTracker : public FlowTracker {
@@ -338,6 +338,83 @@ TEST_F(ProtoTraceParserTest, LoadSingleEvent) {
   context_.sorter->ExtractEventsForced();
 }
 
+TEST_F(ProtoTraceParserTest, LoadRawFtracePage) {
+  using RawFormats = protos::pbzero::FtraceEventBundle::RawFormats;
+  static const char kProc1Name[] = "proc1";
+  static const char kProc2Name[] = "proc2";
+  constexpr uint16_t kSchedSwitchId = 47;
+
+  // A page with a single 64 bytes sched_switch event, laid out as below.
+  std::vector<uint8_t> page(16 + 4 + 64);
+  auto write = [&page](size_t offset, const void* data, size_t size) {
+    memcpy(page.data() + offset, data, size);
+  };
+  const uint64_t page_ts = 1000;
+  const uint64_t commit = 4 + 64;
+  const uint32_t event_header = 64 / 4;  // type_or_length, no time delta.
+  const int32_t common_pid = 12;
+  const int32_t prev_pid = 10, prev_prio = 256, next_pid = 100;
+  const int32_t next_prio = 1024;
+  const int64_t prev_state = 32;
+  write(0, &page_ts, 8);
+  write(8, &commit, 8);
+  write(16, &event_header, 4);
+  const size_t ev = 20;
+  write(ev + 0, &kSchedSwitchId, 2);
+  write(ev + 4, &common_pid, 4);
+  write(ev + 8, kProc2Name, sizeof(kProc2Name));
+  write(ev + 24, &prev_pid, 4);
+  write(ev + 28, &prev_prio, 4);
+  write(ev + 32, &prev_state, 8);
+  write(ev + 40, kProc1Name, sizeof(kProc1Name));
+  write(ev + 56, &next_pid, 4);
+  write(ev + 60, &next_prio, 4);
+
+  auto* packet = trace_->add_packet();
+  packet->set_trusted_packet_sequence_id(1);
+  auto* bundle = packet->set_ftrace_events();
+  bundle->set_cpu(10);
+  auto add_field = [](RawFormats::Field* field, uint32_t offset, uint32_t size,
+                      RawFormats::Encoding encoding, uint32_t proto_field_id) {
+    field->set_offset(offset);
+    field->set_size(size);
+    field->set_encoding(encoding);
+    field->set_proto_field_id(proto_field_id);
+  };
+  auto* formats = bundle->set_raw_formats();
+  formats->set_page_header_size_len(8);
+  add_field(formats->add_common_field(), 4, 4, RawFormats::ENCODING_INT, 2);
+  auto* event = formats->add_event();
+  event->set_ftrace_id(kSchedSwitchId);
+  event->set_proto_field_id(
+      protos::pbzero::FtraceEvent::kSchedSwitchFieldNumber);
+  event->set_size(64);
+  add_field(event->add_field(), 8, 16, RawFormats::ENCODING_FIXED_CSTRING, 1);
+  add_field(event->add_field(), 24, 4, RawFormats::ENCODING_INT, 2);
+  add_field(event->add_field(), 28, 4, RawFormats::ENCODING_INT, 3);
+  add_field(event->add_field(), 32, 8, RawFormats::ENCODING_INT, 4);
+  add_field(event->add_field(), 40, 16, RawFormats::ENCODING_FIXED_CSTRING, 5);
+  add_field(event->add_field(), 56, 4, RawFormats::ENCODING_INT, 6);
+  add_field(event->add_field(), 60, 4, RawFormats::ENCODING_INT, 7);
+  bundle->add_raw_page(page.data(), page.size());
+  // Truncated in the middle of the 64 bit commit field.
+  bundle->add_raw_page(page.data(), 14);
+
+  // The formats are scoped to their packet sequence.
+  packet = trace_->add_packet();
+  packet->set_trusted_packet_sequence_id(2);
+  bundle = packet->set_ftrace_events();
+  bundle->set_cpu(11);
+  bundle->add_raw_page(page.data(), page.size());
+
+  EXPECT_CALL(*sched_,
+              PushSchedSwitch(10, 1000, 10, base::StringView(kProc2Name), 256,
+                              32, 100, base::StringView(kProc1Name), 1024));
+  Tokenize();
+  context_.sorter->ExtractEventsForced();
+  EXPECT_EQ(2, storage_->stats()[stats::ftrace_raw_page_errors].value);
+}
+
 TEST_F(ProtoTraceParserTest, LoadEventsIntoRaw) {
   auto* bundle = trace_->add_packet()->set_ftrace_events();
   bundle->set_cpu(10);
@@ -210,40 +210,56 @@ void SystemProbesParser::ParseSysStats(int64_t ts, ConstBytes blob) {
       continue;
     }
 
-    TrackId track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_user_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(ts, static_cast<double>(ct.user_ns()),
-                                         track);
+    // With SysStatsConfig.delta_encode_counters, only the times that changed
+    // since the previous sample are present.
+    if (ct.has_user_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_user_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.user_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_user_nice_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(
-        ts, static_cast<double>(ct.user_ice_ns()), track);
+    if (ct.has_user_ice_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_user_nice_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.user_ice_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_system_mode_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(
-        ts, static_cast<double>(ct.system_mode_ns()), track);
+    if (ct.has_system_mode_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_system_mode_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.system_mode_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_idle_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(ts, static_cast<double>(ct.idle_ns()),
-                                         track);
+    if (ct.has_idle_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_idle_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.idle_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_io_wait_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(
-        ts, static_cast<double>(ct.io_wait_ns()), track);
+    if (ct.has_io_wait_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_io_wait_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.io_wait_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(cpu_times_irq_ns_id_,
-                                                           ct.cpu_id());
-    context_->event_tracker->PushCounter(ts, static_cast<double>(ct.irq_ns()),
-                                         track);
+    if (ct.has_irq_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_irq_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.irq_ns()), track);
+    }
 
-    track = context_->track_tracker->InternCpuCounterTrack(
-        cpu_times_softirq_ns_id_, ct.cpu_id());
-    context_->event_tracker->PushCounter(
-        ts, static_cast<double>(ct.softirq_ns()), track);
+    if (ct.has_softirq_ns()) {
+      TrackId track = context_->track_tracker->InternCpuCounterTrack(
+          cpu_times_softirq_ns_id_, ct.cpu_id());
+      context_->event_tracker->PushCounter(
+          ts, static_cast<double>(ct.softirq_ns()), track);
+    }
   }
 
   for (auto it = sys_stats.num_irq(); it; ++it) {
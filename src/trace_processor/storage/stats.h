@@ -192,11 +192,20 @@ namespace stats {
       "the tracing service. This happens if the ftrace buffers were not "      \
       "cleared properly. These packets are silently dropped by trace "         \
       "processor."),                                                           \
+  F(ftrace_raw_page_errors,             kSingle,  kError,    kTrace,           \
+      "A raw ftrace page (FtraceConfig.raw_pages) could not be decoded, "      \
+      "either because its formats were missing or because the page is "       \
+      "malformed. The events of the page after the error are lost."),         \
   F(perf_guardrail_stop_ts,             kIndexed, kDataLoss, kTrace,    ""),   \
   F(sorter_push_event_out_of_order,     kSingle, kError,     kTrace,           \
       "Trace events are out of order event after sorting. This can happen "    \
       "due to many factors including clock sync drift, producers emitting "    \
       "events out of order or a bug in trace processor's logic of sorting."),  \
+  F(sorter_spilled_runs,                kSingle,  kInfo,     kTrace,           \
+      "Number of times the sorter spilled its queued events to disk because "  \
+      "they exceeded Config.sorter_memory_limit_bytes."),                      \
+  F(sorter_spilled_bytes,               kSingle,  kInfo,     kTrace,           \
+      "Total size of the events spilled to disk by the sorter."),              \
   F(unknown_extension_fields,           kSingle,  kError,    kTrace,           \
       "TraceEvent had unknown extension fields, which might result in "        \
       "missing some arguments. You may need a newer version of trace "         \
@@ -119,6 +119,17 @@ void TraceStorage::SqlStats::RecordQueryEnd(uint32_t row, int64_t time_ended) {
   times_ended_[queue_row] = time_ended;
 }
 
+void TraceStorage::CompressTables() {
+  sched_slice_table_.Compress();
+  slice_table_.Compress();
+  thread_slice_table_.Compress();
+  counter_table_.Compress();
+  instant_table_.Compress();
+  raw_table_.Compress();
+  arg_table_.Compress();
+  android_log_table_.Compress();
+}
+
 std::pair<int64_t, int64_t> TraceStorage::GetTraceTimestampBoundsNs() const {
   int64_t start_ns = std::numeric_limits<int64_t>::max();
   int64_t end_ns = std::numeric_limits<int64_t>::min();
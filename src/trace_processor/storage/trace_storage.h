@@ -565,6 +565,16 @@ class TraceStorage {
     return &heap_graph_reference_table_;
   }
 
+  const tables::HeapGraphDominatorTreeTable& heap_graph_dominator_tree_table()
+      const {
+    return heap_graph_dominator_tree_table_;
+  }
+
+  tables::HeapGraphDominatorTreeTable*
+  mutable_heap_graph_dominator_tree_table() {
+    return &heap_graph_dominator_tree_table_;
+  }
+
   const tables::GpuTrackTable& gpu_track_table() const {
     return gpu_track_table_;
   }
@@ -647,6 +657,10 @@ class TraceStorage {
   // Returns (0, 0) if the trace is empty.
   std::pair<int64_t, int64_t> GetTraceTimestampBoundsNs() const;
 
+  // Compresses the tables which grow with the length of the trace, once it
+  // has been fully parsed (see Table::Compress).
+  void CompressTables();
+
   util::Status ExtractArg(uint32_t arg_set_id,
                           const char* key,
                           base::Optional<Variadic>* result) {
@@ -837,6 +851,8 @@ class TraceStorage {
   tables::HeapGraphClassTable heap_graph_class_table_{&string_pool_, nullptr};
   tables::HeapGraphReferenceTable heap_graph_reference_table_{&string_pool_,
                                                               nullptr};
+  tables::HeapGraphDominatorTreeTable heap_graph_dominator_tree_table_{
+      &string_pool_, nullptr};
 
   tables::VulkanMemoryAllocationsTable vulkan_memory_allocations_table_{
       &string_pool_, nullptr};
@@ -445,6 +445,55 @@ TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_EQ(arg_set_id->Get(2).long_value, 100);
 }
 
+TEST_F(TableMacrosUnittest, Compress) {
+  for (uint32_t i = 0; i < 1000; ++i) {
+    TestCpuSliceTable::Row row;
+    row.ts = 1000000 + i * 1000;
+    row.dur = 10;
+    row.cpu = i / 100;
+    cpu_slice_.Insert(row);
+  }
+  for (uint32_t i = 0; i < 1000; ++i) {
+    TestCounterTable::Row counter_row;
+    counter_row.ts = 2000000 + i;
+    if (i % 4 != 0)
+      counter_row.value = static_cast<double>(i % 3);
+    counter_.Insert(counter_row);
+  }
+  std::vector<Constraint> cpu_slice_constraints = {
+      cpu_slice_.ts().ge(1100000), cpu_slice_.cpu().eq(3),
+      cpu_slice_.dur().eq(10)};
+  std::vector<Constraint> counter_constraints = {counter_.value().gt(0.5)};
+  RowMap cpu_slice_rows = cpu_slice_.FilterToRowMap(cpu_slice_constraints);
+  RowMap counter_rows = counter_.FilterToRowMap(counter_constraints);
+  ASSERT_EQ(cpu_slice_rows.size(), 100u);
+
+  event_.Compress();
+  slice_.Compress();
+  cpu_slice_.Compress();
+  counter_.Compress();
+
+  RowMap compressed_cpu_slice_rows =
+      cpu_slice_.FilterToRowMap(cpu_slice_constraints);
+  ASSERT_EQ(compressed_cpu_slice_rows.size(), 100u);
+  for (uint32_t i = 0; i < cpu_slice_rows.size(); ++i)
+    ASSERT_EQ(compressed_cpu_slice_rows.Get(i), cpu_slice_rows.Get(i));
+  ASSERT_EQ(cpu_slice_.ts()[999], 1000000 + 999 * 1000);
+  ASSERT_EQ(cpu_slice_.cpu()[999], 9);
+
+  RowMap compressed_counter_rows = counter_.FilterToRowMap(counter_constraints);
+  ASSERT_EQ(compressed_counter_rows.size(), counter_rows.size());
+  for (uint32_t i = 0; i < counter_rows.size(); ++i)
+    ASSERT_EQ(compressed_counter_rows.Get(i), counter_rows.Get(i));
+  ASSERT_EQ(counter_.value()[0], base::nullopt);
+  ASSERT_EQ(counter_.value()[998], 2.0);
+
+  // Inserting after compressing decompresses the columns.
+  cpu_slice_.Insert(TestCpuSliceTable::Row());
+  ASSERT_EQ(cpu_slice_.cpu()[999], 9);
+  ASSERT_EQ(cpu_slice_.cpu()[1000], 0);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
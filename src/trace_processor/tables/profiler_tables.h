@@ -371,6 +371,34 @@ PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_OBJECT_DEF);
 
 PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_REFERENCE_DEF);
 
+// Dominator tree of the reachable objects in heap_graph_object.
+//
+// An object X dominates an object Y if every path from the GC roots to Y goes
+// through X, so collecting X would also collect Y.
+// @param upid UniquePid of the target {@joinable process.upid}.
+// @param graph_sample_ts timestamp this dump was taken at.
+// @param object_id the object. {@joinable heap_graph_object.id}
+// @param idom_id immediate dominator of the object. NULL if the object is
+// dominated only by the set of GC roots as a whole, e.g. for the roots
+// themselves.
+// @param retained_size sum of self_size of the objects dominated by this
+// object (including itself), i.e. the memory that would be freed by
+// collecting it.
+// @param retained_count number of objects dominated by this object (including
+// itself).
+// @tablegroup ART Heap Graphs
+#define PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF(NAME, PARENT, C) \
+  NAME(HeapGraphDominatorTreeTable, "heap_graph_dominator_tree")   \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                                \
+  C(uint32_t, upid)                                                \
+  C(int64_t, graph_sample_ts)                                      \
+  C(HeapGraphObjectTable::Id, object_id)                           \
+  C(base::Optional<HeapGraphObjectTable::Id>, idom_id)             \
+  C(int64_t, retained_size)                                        \
+  C(int64_t, retained_count)
+
+PERFETTO_TP_TABLE(PERFETTO_TP_HEAP_GRAPH_DOMINATOR_TREE_DEF);
+
 // @param arg_set_id {@joinable args.arg_set_id}
 #define PERFETTO_TP_VULKAN_MEMORY_ALLOCATIONS_DEF(NAME, PARENT, C) \
   NAME(VulkanMemoryAllocationsTable, "vulkan_memory_allocations")  \
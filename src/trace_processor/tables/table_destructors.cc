@@ -60,6 +60,7 @@ ExperimentalFlamegraphNodesTable::~ExperimentalFlamegraphNodesTable() = default;
 HeapGraphObjectTable::~HeapGraphObjectTable() = default;
 HeapGraphClassTable::~HeapGraphClassTable() = default;
 HeapGraphReferenceTable::~HeapGraphReferenceTable() = default;
+HeapGraphDominatorTreeTable::~HeapGraphDominatorTreeTable() = default;
 VulkanMemoryAllocationsTable::~VulkanMemoryAllocationsTable() = default;
 PackageListTable::~PackageListTable() = default;
 ProfilerSmapsTable::~ProfilerSmapsTable() = default;
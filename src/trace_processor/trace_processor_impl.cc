@@ -802,8 +802,10 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   SqliteRawTable::RegisterTable(*db_, query_cache_.get(), &context_);
 
   // Tables dynamically generated at query time.
+  flamegraph_cache_.reset(new FlamegraphCache(context_.storage.get()));
   RegisterDynamicTable(std::unique_ptr<ExperimentalFlamegraphGenerator>(
-      new ExperimentalFlamegraphGenerator(&context_)));
+      new ExperimentalFlamegraphGenerator(&context_,
+                                          flamegraph_cache_.get())));
   RegisterDynamicTable(std::unique_ptr<ExperimentalCounterDurGenerator>(
       new ExperimentalCounterDurGenerator(storage->counter_table())));
   RegisterDynamicTable(std::unique_ptr<DescribeSliceGenerator>(
@@ -875,6 +877,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   RegisterDbTable(storage->heap_graph_object_table());
   RegisterDbTable(storage->heap_graph_reference_table());
   RegisterDbTable(storage->heap_graph_class_table());
+  RegisterDbTable(storage->heap_graph_dominator_tree_table());
 
   RegisterDbTable(storage->symbol_table());
   RegisterDbTable(storage->heap_profile_allocation_table());
@@ -910,6 +913,7 @@ TraceProcessorImpl::~TraceProcessorImpl() = default;
 
 util::Status TraceProcessorImpl::Parse(TraceBlobView blob) {
   bytes_parsed_ += blob.size();
+  flamegraph_cache_->Invalidate();
   return TraceProcessorStorageImpl::Parse(std::move(blob));
 }
 
@@ -929,11 +933,14 @@ void TraceProcessorImpl::NotifyEndOfFile() {
     current_trace_name_ = "Unnamed trace";
 
   TraceProcessorStorageImpl::NotifyEndOfFile();
+  flamegraph_cache_->Invalidate();
 
   SchedEventTracker::GetOrCreate(&context_)->FlushPendingEvents();
   context_.metadata_tracker->SetMetadata(
       metadata::trace_size_bytes,
       Variadic::Integer(static_cast<int64_t>(bytes_parsed_)));
+  if (context_.config.compress_tables)
+    context_.storage->CompressTables();
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
 
   // Create a snapshot of all tables and views created so far. This is so later
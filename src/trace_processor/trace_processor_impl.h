@@ -29,6 +29,7 @@
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/importers/proto/flamegraph_construction_algorithms.h"
 #include "src/trace_processor/sqlite/create_function.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
@@ -123,6 +124,10 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::unique_ptr<QueryCache> query_cache_;
 
+  // Data shared by the experimental_flamegraph queries. Invalidated whenever
+  // more of the trace is parsed.
+  std::unique_ptr<FlamegraphCache> flamegraph_cache_;
+
   DescriptorPool pool_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
   std::unordered_map<std::string, std::string> proto_field_to_sql_metric_path_;
@@ -56,6 +56,7 @@
 #endif
 #include "src/profiling/deobfuscator.h"
 #include "src/profiling/symbolizer/local_symbolizer.h"
+#include "src/profiling/symbolizer/symbol_cache.h"
 #include "src/profiling/symbolizer/symbolize_database.h"
 #include "src/profiling/symbolizer/symbolizer.h"
 
@@ -717,6 +718,8 @@ struct CommandLineOptions {
   bool enable_httpd = false;
   bool wide = false;
   bool force_full_sort = false;
+  uint64_t sorter_memory_limit_mb = 0;
+  bool compress_tables = false;
   std::string metatrace_path;
   bool dev = false;
 };
@@ -766,6 +769,15 @@ Options:
  --full-sort                          Forces the trace processor into performing
                                       a full sort ignoring any windowing
                                       logic.
+ --sorter-memory-limit MB             When fully sorting the trace, spills the
+                                      events to temporary files once they take
+                                      more than MB megabytes of memory, and
+                                      merges them back at the end of the trace.
+                                      Allows importing traces larger than the
+                                      available memory.
+ --compress-tables                    Compresses the largest tables once the
+                                      trace is loaded, trading some query
+                                      speed for lower memory usage.
  --metric-extension DISK_PATH@VIRTUAL_PATH
                                       Loads metric proto and sql files from
                                       DISK_PATH/protos and DISK_PATH/sql
@@ -786,6 +798,8 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_PRE_METRICS,
     OPT_METRICS_OUTPUT,
     OPT_FORCE_FULL_SORT,
+    OPT_SORTER_MEMORY_LIMIT,
+    OPT_COMPRESS_TABLES,
     OPT_HTTP_PORT,
     OPT_METRIC_EXTENSION,
     OPT_DEV,
@@ -806,6 +820,9 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"pre-metrics", required_argument, nullptr, OPT_PRE_METRICS},
       {"metrics-output", required_argument, nullptr, OPT_METRICS_OUTPUT},
       {"full-sort", no_argument, nullptr, OPT_FORCE_FULL_SORT},
+      {"sorter-memory-limit", required_argument, nullptr,
+       OPT_SORTER_MEMORY_LIMIT},
+      {"compress-tables", no_argument, nullptr, OPT_COMPRESS_TABLES},
       {"http-port", required_argument, nullptr, OPT_HTTP_PORT},
       {"metric-extension", required_argument, nullptr, OPT_METRIC_EXTENSION},
       {"dev", no_argument, nullptr, OPT_DEV},
@@ -890,6 +907,21 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_SORTER_MEMORY_LIMIT) {
+      base::Optional<uint64_t> limit_mb = base::CStringToUInt64(optarg);
+      if (!limit_mb) {
+        PERFETTO_ELOG("Invalid --sorter-memory-limit: %s", optarg);
+        exit(1);
+      }
+      command_line_options.sorter_memory_limit_mb = *limit_mb;
+      continue;
+    }
+
+    if (option == OPT_COMPRESS_TABLES) {
+      command_line_options.compress_tables = true;
+      continue;
+    }
+
     if (option == OPT_HTTP_PORT) {
       command_line_options.port_number = optarg;
       continue;
@@ -964,8 +996,11 @@ util::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
                                       getenv("PERFETTO_SYMBOLIZER_MODE"));
 
   if (symbolizer) {
+    std::unique_ptr<profiling::SymbolCache> cache =
+        profiling::GetPerfettoSymbolCache();
     profiling::SymbolizeDatabase(
-        g_tp, symbolizer.get(), [](const std::string& trace_proto) {
+        g_tp, symbolizer.get(),
+        [](const std::string& trace_proto) {
           std::unique_ptr<uint8_t[]> buf(new uint8_t[trace_proto.size()]);
           memcpy(buf.get(), trace_proto.data(), trace_proto.size());
           auto status = g_tp->Parse(std::move(buf), trace_proto.size());
@@ -974,7 +1009,8 @@ util::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
                                     status.message().c_str());
             return;
           }
-        });
+        },
+        cache.get());
     g_tp->NotifyEndOfFile();
   }
 
@@ -1342,6 +1378,9 @@ util::Status TraceProcessorMain(int argc, char** argv) {
   config.sorting_mode = options.force_full_sort
                             ? SortingMode::kForceFullSort
                             : SortingMode::kDefaultHeuristics;
+  config.sorter_memory_limit_bytes =
+      options.sorter_memory_limit_mb * 1024 * 1024;
+  config.compress_tables = options.compress_tables;
 
   std::vector<MetricExtension> metric_extensions;
   RETURN_IF_ERROR(ParseMetricExtensionPaths(
@@ -34,6 +34,11 @@ TraceSorter::TraceSorter(TraceProcessorContext* context,
   bypass_next_stage_for_testing_ = env && !strcmp(env, "1");
   if (bypass_next_stage_for_testing_)
     PERFETTO_ELOG("TEST MODE: bypassing protobuf parsing stage");
+
+  // In kDefault mode events are extracted incrementally, without looking at
+  // the spilled runs, so spilling is only supported when fully sorting.
+  if (sorting_mode_ == SortingMode::kFullSort)
+    memory_limit_bytes_ = context_->config.sorter_memory_limit_bytes;
 }
 
 void TraceSorter::Queue::Sort() {
@@ -175,7 +180,74 @@ void TraceSorter::SortAndExtractEventsUntilPacket(uint64_t limit_packet_idx) {
 #endif
 }
 
+void TraceSorter::SpillQueues() {
+  if (queued_bytes_ == 0)
+    return;
+  int64_t max_ts = global_max_ts_;
+  std::unique_ptr<SpilledRun> run(new SpilledRun(&spilled_generations_));
+  spilling_run_ = run.get();
+  SortAndExtractEventsUntilPacket(packet_idx_);
+  spilling_run_ = nullptr;
+  run->FinishWriting();
+
+  context_->storage->IncrementStats(stats::sorter_spilled_runs);
+  context_->storage->IncrementStats(stats::sorter_spilled_bytes,
+                                    static_cast<int64_t>(run->size_bytes()));
+  spilled_runs_.emplace_back(std::move(run));
+  spilled_max_ts_ = std::max(spilled_max_ts_, max_ts);
+  queued_bytes_ = 0;
+}
+
+// This is the same "extract min from N sorted queues" as
+// SortAndExtractEventsUntilPacket(), where the queues are the spilled runs:
+// events are read from the run with the oldest event until hitting the next
+// event of the second oldest run.
+void TraceSorter::MergeSpilledRuns() {
+  constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
+  std::vector<std::unique_ptr<SpilledRun>> runs;
+  runs.swap(spilled_runs_);
+  for (auto it = runs.begin(); it != runs.end();) {
+    it = (*it)->Next() ? it + 1 : runs.erase(it);
+  }
+
+  while (!runs.empty()) {
+    // Ties go to the earliest run, which holds the earliest pushed events.
+    size_t min_run_idx = 0;
+    size_t second_min_run_idx = 0;
+    int64_t second_min_ts = kTsMax;
+    for (size_t i = 1; i < runs.size(); i++) {
+      int64_t ts = runs[i]->timestamp();
+      if (ts < runs[min_run_idx]->timestamp()) {
+        second_min_ts = runs[min_run_idx]->timestamp();
+        second_min_run_idx = min_run_idx;
+        min_run_idx = i;
+      } else if (ts < second_min_ts) {
+        second_min_ts = ts;
+        second_min_run_idx = i;
+      }
+    }
+    const bool wins_ties = min_run_idx < second_min_run_idx;
+
+    SpilledRun* run = runs[min_run_idx].get();
+    bool has_next;
+    do {
+      uint32_t queue_idx = run->queue_idx();
+      MaybePushEvent(queue_idx, run->ReadEvent());
+      has_next = run->Next();
+    } while (has_next && (run->timestamp() < second_min_ts ||
+                          (wins_ties && run->timestamp() == second_min_ts)));
+
+    if (!has_next)
+      runs.erase(runs.begin() + static_cast<ssize_t>(min_run_idx));
+  }
+}
+
 void TraceSorter::MaybePushEvent(size_t queue_idx, TimestampedTracePiece ttp) {
+  if (PERFETTO_UNLIKELY(spilling_run_)) {
+    spilling_run_->Append(static_cast<uint32_t>(queue_idx), std::move(ttp));
+    return;
+  }
+
   int64_t timestamp = ttp.timestamp;
   if (timestamp < latest_pushed_event_ts_)
     context_->storage->IncrementStats(stats::sorter_push_event_out_of_order);
@@ -17,6 +17,7 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 #define SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 
+#include <memory>
 #include <vector>
 
 #include "perfetto/ext/base/circular_queue.h"
@@ -24,6 +25,7 @@
 #include "perfetto/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/timestamped_trace_piece.h"
+#include "src/trace_processor/trace_sorter_spill.h"
 
 namespace Json {
 class Value;
@@ -82,6 +84,14 @@ struct SystraceLine;
 // We use a logarithmic bound search operation to figure out what is the index
 // within the first partition where sorting should start, and sort all events
 // from there to the end.
+//
+// Spilling to disk
+//
+// In kFullSort mode all the events are held until the end of the trace. If
+// Config.sorter_memory_limit_bytes is set, once the (approximate) size of the
+// queued events exceeds it, the queues are merge-sorted, as if extracting
+// them, into a SpilledRun written to a temporary file. ExtractEventsForced()
+// then spills the remaining events too, and merges all the sorted runs back.
 class TraceSorter {
  public:
   enum class SortingMode {
@@ -96,43 +106,55 @@ class TraceSorter {
   inline void PushTracePacket(int64_t timestamp,
                               PacketSequenceState* state,
                               TraceBlobView packet) {
+    size_t size = packet.size();
     AppendNonFtraceEvent(TimestampedTracePiece(timestamp, packet_idx_++,
                                                std::move(packet),
                                                state->current_generation()));
+    AddQueuedBytes(size);
   }
 
   inline void PushJsonValue(int64_t timestamp, std::string json_value) {
+    size_t size = json_value.size();
     AppendNonFtraceEvent(
         TimestampedTracePiece(timestamp, packet_idx_++, std::move(json_value)));
+    AddQueuedBytes(size);
   }
 
   inline void PushFuchsiaRecord(int64_t timestamp,
                                 std::unique_ptr<FuchsiaRecord> record) {
+    size_t size = sizeof(FuchsiaRecord) + record->record_view()->size();
     AppendNonFtraceEvent(
         TimestampedTracePiece(timestamp, packet_idx_++, std::move(record)));
+    AddQueuedBytes(size);
   }
 
   inline void PushSystraceLine(std::unique_ptr<SystraceLine> systrace_line) {
     int64_t timestamp = systrace_line->ts;
+    size_t size = sizeof(SystraceLine) + systrace_line->args_str.size();
     AppendNonFtraceEvent(TimestampedTracePiece(timestamp, packet_idx_++,
                                                std::move(systrace_line)));
+    AddQueuedBytes(size);
   }
 
   inline void PushTrackEventPacket(int64_t timestamp,
                                    std::unique_ptr<TrackEventData> data) {
+    size_t size = sizeof(TrackEventData) + data->packet.size();
     AppendNonFtraceEvent(
         TimestampedTracePiece(timestamp, packet_idx_++, std::move(data)));
+    AddQueuedBytes(size);
   }
 
   inline void PushFtraceEvent(uint32_t cpu,
                               int64_t timestamp,
                               TraceBlobView event,
                               PacketSequenceState* state) {
+    size_t size = event.size();
     auto* queue = GetQueue(cpu + 1);
     queue->Append(TimestampedTracePiece(
         timestamp, packet_idx_++,
         FtraceEventData{std::move(event), state->current_generation()}));
     UpdateGlobalTs(queue);
+    AddQueuedBytes(size);
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
@@ -147,6 +169,7 @@ class TraceSorter {
     queue->Append(
         TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_switch));
     UpdateGlobalTs(queue);
+    AddQueuedBytes(0);
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
@@ -155,10 +178,16 @@ class TraceSorter {
     queue->Append(
         TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_waking));
     UpdateGlobalTs(queue);
+    AddQueuedBytes(0);
   }
 
   void ExtractEventsForced() {
-    SortAndExtractEventsUntilPacket(packet_idx_);
+    if (PERFETTO_UNLIKELY(!spilled_runs_.empty())) {
+      SpillQueues();
+      MergeSpilledRuns();
+    } else {
+      SortAndExtractEventsUntilPacket(packet_idx_);
+    }
     queues_.resize(0);
 
     packet_idx_for_extraction_ = packet_idx_;
@@ -178,7 +207,9 @@ class TraceSorter {
     flushes_since_extraction_ = 0;
   }
 
-  int64_t max_timestamp() const { return global_max_ts_; }
+  int64_t max_timestamp() const {
+    return std::max(global_max_ts_, spilled_max_ts_);
+  }
 
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
@@ -222,6 +253,23 @@ class TraceSorter {
 
   void SortAndExtractEventsUntilPacket(uint64_t limit_packet_idx);
 
+  // Moves all the queued events, in order, into a new SpilledRun.
+  void SpillQueues();
+
+  // Pushes the events of all the spilled runs to the next pipeline stages,
+  // in timestamp order.
+  void MergeSpilledRuns();
+
+  // Accounts for an event just queued with |payload_size| bytes of data and
+  // spills the queues to disk if they grew over the memory limit.
+  inline void AddQueuedBytes(size_t payload_size) {
+    if (PERFETTO_LIKELY(memory_limit_bytes_ == 0))
+      return;
+    queued_bytes_ += sizeof(TimestampedTracePiece) + payload_size;
+    if (PERFETTO_UNLIKELY(queued_bytes_ >= memory_limit_bytes_))
+      SpillQueues();
+  }
+
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
       queues_.resize(index + 1);
@@ -276,6 +324,25 @@ class TraceSorter {
 
   // max(e.ts for e pushed to next stage)
   int64_t latest_pushed_event_ts_ = std::numeric_limits<int64_t>::min();
+
+  // The budget for |queued_bytes_| before the queues are spilled to disk, or 0
+  // if spilling is disabled (always the case in kDefault mode).
+  uint64_t memory_limit_bytes_ = 0;
+
+  // Approximate size of the events currently held in |queues_|.
+  uint64_t queued_bytes_ = 0;
+
+  // The runs spilled so far, in the order they were written. Runs only hold
+  // events pushed before the following runs, so the order of the runs breaks
+  // ties between events with the same timestamp.
+  std::vector<std::unique_ptr<SpilledRun>> spilled_runs_;
+  SpilledGenerations spilled_generations_;
+
+  // Set while SpillQueues() is extracting events into a run.
+  SpilledRun* spilling_run_ = nullptr;
+
+  // max(e.timestamp for e in spilled_runs_).
+  int64_t spilled_max_ts_ = 0;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/trace_sorter_spill.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/trace_processor/trace_blob.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+constexpr size_t kWriteBufferSize = 1024 * 1024;
+constexpr size_t kReadBufferSize = 1024 * 1024;
+
+// Fixed size fields of the spilled events that are not just a blob.
+struct TrackEventFields {
+  uint32_t has_thread_timestamp;
+  uint32_t has_thread_instruction_count;
+  int64_t thread_timestamp;
+  int64_t thread_instruction_count;
+  double counter_value;
+  double extra_counter_values[TrackEventData::kMaxNumExtraCounters];
+};
+
+struct SystraceLineFields {
+  int64_t ts;
+  uint32_t pid;
+  uint32_t cpu;
+  uint32_t task_size;
+  uint32_t pid_str_size;
+  uint32_t tgid_str_size;
+  uint32_t event_name_size;
+  uint32_t args_str_size;
+};
+
+struct FuchsiaRecordFields {
+  uint64_t ticks_per_second;
+  uint32_t num_strings;
+  uint32_t num_threads;
+};
+
+template <typename T>
+T ReadFields(const uint8_t** ptr) {
+  T fields;
+  memcpy(&fields, *ptr, sizeof(T));
+  *ptr += sizeof(T);
+  return fields;
+}
+
+std::string ReadString(const uint8_t** ptr, uint32_t size) {
+  std::string str(reinterpret_cast<const char*>(*ptr), size);
+  *ptr += size;
+  return str;
+}
+
+}  // namespace
+
+SpilledGenerations::SpilledGenerations() : generations_(1) {}
+SpilledGenerations::~SpilledGenerations() = default;
+
+uint32_t SpilledGenerations::Intern(
+    const RefPtr<PacketSequenceStateGeneration>& generation) {
+  if (!generation)
+    return 0;
+  auto id = static_cast<uint32_t>(generations_.size());
+  auto it_and_inserted =
+      ids_.Insert(reinterpret_cast<uintptr_t>(generation.get()), id);
+  if (it_and_inserted.second)
+    generations_.push_back(generation);
+  return *it_and_inserted.first;
+}
+
+SpilledRun::SpilledRun(SpilledGenerations* generations)
+    : generations_(generations), file_(base::TempFile::CreateUnlinked()) {
+  write_buffer_.reserve(kWriteBufferSize);
+}
+
+SpilledRun::~SpilledRun() = default;
+
+void SpilledRun::Append(uint32_t queue_idx, TimestampedTracePiece ttp) {
+  using Type = TimestampedTracePiece::Type;
+  switch (ttp.type) {
+    case Type::kFtraceEvent: {
+      const TraceBlobView& event = ttp.ftrace_event.event;
+      WriteHeader(ttp, queue_idx, event.size(),
+                  generations_->Intern(ttp.ftrace_event.sequence_state));
+      WriteBytes(event.data(), event.size());
+      break;
+    }
+    case Type::kTracePacket: {
+      const TraceBlobView& packet = ttp.packet_data.packet;
+      WriteHeader(ttp, queue_idx, packet.size(),
+                  generations_->Intern(ttp.packet_data.sequence_state));
+      WriteBytes(packet.data(), packet.size());
+      break;
+    }
+    case Type::kTrackEvent: {
+      const TrackEventData& data = *ttp.track_event_data;
+      TrackEventFields fields{};
+      fields.has_thread_timestamp = data.thread_timestamp.has_value();
+      fields.thread_timestamp = data.thread_timestamp.value_or(0);
+      fields.has_thread_instruction_count =
+          data.thread_instruction_count.has_value();
+      fields.thread_instruction_count =
+          data.thread_instruction_count.value_or(0);
+      fields.counter_value = data.counter_value;
+      std::copy(data.extra_counter_values.begin(),
+                data.extra_counter_values.end(), fields.extra_counter_values);
+      WriteHeader(ttp, queue_idx, sizeof(fields) + data.packet.size(),
+                  generations_->Intern(data.sequence_state));
+      WriteBytes(&fields, sizeof(fields));
+      WriteBytes(data.packet.data(), data.packet.size());
+      break;
+    }
+    case Type::kInlineSchedSwitch:
+      WriteHeader(ttp, queue_idx, sizeof(InlineSchedSwitch), 0);
+      WriteBytes(&ttp.sched_switch, sizeof(InlineSchedSwitch));
+      break;
+    case Type::kInlineSchedWaking:
+      WriteHeader(ttp, queue_idx, sizeof(InlineSchedWaking), 0);
+      WriteBytes(&ttp.sched_waking, sizeof(InlineSchedWaking));
+      break;
+    case Type::kJsonValue:
+      WriteHeader(ttp, queue_idx, ttp.json_value.size(), 0);
+      WriteString(ttp.json_value);
+      break;
+    case Type::kSystraceLine: {
+      const SystraceLine& line = *ttp.systrace_line;
+      SystraceLineFields fields{};
+      fields.ts = line.ts;
+      fields.pid = line.pid;
+      fields.cpu = line.cpu;
+      fields.task_size = static_cast<uint32_t>(line.task.size());
+      fields.pid_str_size = static_cast<uint32_t>(line.pid_str.size());
+      fields.tgid_str_size = static_cast<uint32_t>(line.tgid_str.size());
+      fields.event_name_size = static_cast<uint32_t>(line.event_name.size());
+      fields.args_str_size = static_cast<uint32_t>(line.args_str.size());
+      size_t size = sizeof(fields) + line.task.size() + line.pid_str.size() +
+                    line.tgid_str.size() + line.event_name.size() +
+                    line.args_str.size();
+      WriteHeader(ttp, queue_idx, size, 0);
+      WriteBytes(&fields, sizeof(fields));
+      WriteString(line.task);
+      WriteString(line.pid_str);
+      WriteString(line.tgid_str);
+      WriteString(line.event_name);
+      WriteString(line.args_str);
+      break;
+    }
+    case Type::kFuchsiaRecord: {
+      FuchsiaRecord& record = *ttp.fuchsia_record;
+      const auto& strings = record.string_entries();
+      const auto& threads = record.thread_entries();
+      FuchsiaRecordFields fields{};
+      fields.ticks_per_second = record.get_ticks_per_second();
+      fields.num_strings = static_cast<uint32_t>(strings.size());
+      fields.num_threads = static_cast<uint32_t>(threads.size());
+      size_t strings_size = strings.size() * sizeof(strings[0]);
+      size_t threads_size = threads.size() * sizeof(threads[0]);
+      const TraceBlobView& view = *record.record_view();
+      WriteHeader(ttp, queue_idx,
+                  sizeof(fields) + strings_size + threads_size + view.size(),
+                  0);
+      WriteBytes(&fields, sizeof(fields));
+      WriteBytes(strings.data(), strings_size);
+      WriteBytes(threads.data(), threads_size);
+      WriteBytes(view.data(), view.size());
+      break;
+    }
+    case Type::kInvalid:
+      PERFETTO_FATAL("Cannot spill an invalid TimestampedTracePiece");
+  }
+}
+
+void SpilledRun::WriteHeader(const TimestampedTracePiece& ttp,
+                             uint32_t queue_idx,
+                             size_t size,
+                             uint32_t generation) {
+  PERFETTO_CHECK(size <= std::numeric_limits<uint32_t>::max());
+  EventHeader header{};
+  header.timestamp = ttp.timestamp;
+  header.packet_idx = ttp.packet_idx;
+  header.queue_idx = queue_idx;
+  header.type = static_cast<uint32_t>(ttp.type);
+  header.size = static_cast<uint32_t>(size);
+  header.generation = generation;
+  WriteBytes(&header, sizeof(header));
+}
+
+void SpilledRun::WriteBytes(const void* data, size_t size) {
+  write_buffer_.append(static_cast<const char*>(data), size);
+  if (write_buffer_.size() >= kWriteBufferSize)
+    FlushWriteBuffer();
+}
+
+void SpilledRun::WriteString(const std::string& str) {
+  WriteBytes(str.data(), str.size());
+}
+
+void SpilledRun::FlushWriteBuffer() {
+  ssize_t res = base::WriteAll(file_.fd(), write_buffer_.data(),
+                               write_buffer_.size());
+  if (res != static_cast<ssize_t>(write_buffer_.size()))
+    PERFETTO_FATAL("Failed to write to the trace sorter spill file");
+  size_bytes_ += write_buffer_.size();
+  write_buffer_.clear();
+}
+
+void SpilledRun::FinishWriting() {
+  FlushWriteBuffer();
+  std::string().swap(write_buffer_);
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+  PERFETTO_CHECK(_lseeki64(file_.fd(), 0, SEEK_SET) == 0);
+#else
+  PERFETTO_CHECK(lseek(file_.fd(), 0, SEEK_SET) == 0);
+#endif
+  bytes_left_to_read_ = size_bytes_;
+}
+
+void SpilledRun::FillReadBuffer(size_t size) {
+  size_t unread = read_end_ - read_offset_;
+  if (unread >= size)
+    return;
+
+  TraceBlob blob = TraceBlob::Allocate(std::max(size, kReadBufferSize));
+  if (unread > 0)
+    memcpy(blob.data(), read_buffer_.data() + read_offset_, unread);
+  size_t filled = unread;
+  while (filled < blob.size() && bytes_left_to_read_ > 0) {
+    size_t to_read = static_cast<size_t>(std::min<uint64_t>(
+        blob.size() - filled, bytes_left_to_read_));
+    ssize_t rsize = base::Read(file_.fd(), blob.data() + filled, to_read);
+    if (rsize <= 0)
+      PERFETTO_FATAL("Failed to read the trace sorter spill file");
+    filled += static_cast<size_t>(rsize);
+    bytes_left_to_read_ -= static_cast<uint64_t>(rsize);
+  }
+  PERFETTO_CHECK(filled >= size);
+
+  read_buffer_ = TraceBlobView(std::move(blob));
+  read_offset_ = 0;
+  read_end_ = filled;
+}
+
+bool SpilledRun::Next() {
+  PERFETTO_DCHECK(!has_unread_event_);
+  if (read_offset_ == read_end_ && bytes_left_to_read_ == 0)
+    return false;
+  FillReadBuffer(sizeof(EventHeader));
+  memcpy(&header_, read_buffer_.data() + read_offset_, sizeof(EventHeader));
+  read_offset_ += sizeof(EventHeader);
+  has_unread_event_ = true;
+  return true;
+}
+
+TimestampedTracePiece SpilledRun::ReadEvent() {
+  using Type = TimestampedTracePiece::Type;
+  PERFETTO_CHECK(has_unread_event_);
+  has_unread_event_ = false;
+
+  FillReadBuffer(header_.size);
+  const size_t offset = read_offset_;
+  const uint8_t* ptr = read_buffer_.data() + offset;
+  read_offset_ += header_.size;
+
+  int64_t ts = header_.timestamp;
+  uint64_t idx = header_.packet_idx;
+  switch (static_cast<Type>(header_.type)) {
+    case Type::kFtraceEvent:
+      return TimestampedTracePiece(
+          ts, idx,
+          FtraceEventData{read_buffer_.slice_off(offset, header_.size),
+                          generations_->Get(header_.generation)});
+    case Type::kTracePacket:
+      return TimestampedTracePiece(ts, idx,
+                                   read_buffer_.slice_off(offset, header_.size),
+                                   generations_->Get(header_.generation));
+    case Type::kTrackEvent: {
+      auto fields = ReadFields<TrackEventFields>(&ptr);
+      std::unique_ptr<TrackEventData> data(new TrackEventData(
+          read_buffer_.slice_off(offset + sizeof(fields),
+                                 header_.size - sizeof(fields)),
+          generations_->Get(header_.generation)));
+      if (fields.has_thread_timestamp)
+        data->thread_timestamp = fields.thread_timestamp;
+      if (fields.has_thread_instruction_count)
+        data->thread_instruction_count = fields.thread_instruction_count;
+      data->counter_value = fields.counter_value;
+      std::copy(std::begin(fields.extra_counter_values),
+                std::end(fields.extra_counter_values),
+                data->extra_counter_values.begin());
+      return TimestampedTracePiece(ts, idx, std::move(data));
+    }
+    case Type::kInlineSchedSwitch:
+      return TimestampedTracePiece(ts, idx,
+                                   ReadFields<InlineSchedSwitch>(&ptr));
+    case Type::kInlineSchedWaking:
+      return TimestampedTracePiece(ts, idx,
+                                   ReadFields<InlineSchedWaking>(&ptr));
+    case Type::kJsonValue:
+      return TimestampedTracePiece(ts, idx, ReadString(&ptr, header_.size));
+    case Type::kSystraceLine: {
+      auto fields = ReadFields<SystraceLineFields>(&ptr);
+      std::unique_ptr<SystraceLine> line(new SystraceLine());
+      line->ts = fields.ts;
+      line->pid = fields.pid;
+      line->cpu = fields.cpu;
+      line->task = ReadString(&ptr, fields.task_size);
+      line->pid_str = ReadString(&ptr, fields.pid_str_size);
+      line->tgid_str = ReadString(&ptr, fields.tgid_str_size);
+      line->event_name = ReadString(&ptr, fields.event_name_size);
+      line->args_str = ReadString(&ptr, fields.args_str_size);
+      return TimestampedTracePiece(ts, idx, std::move(line));
+    }
+    case Type::kFuchsiaRecord: {
+      auto fields = ReadFields<FuchsiaRecordFields>(&ptr);
+      std::vector<FuchsiaRecord::StringTableEntry> strings(fields.num_strings);
+      std::vector<FuchsiaRecord::ThreadTableEntry> threads(fields.num_threads);
+      size_t strings_size = strings.size() * sizeof(strings[0]);
+      size_t threads_size = threads.size() * sizeof(threads[0]);
+      memcpy(strings.data(), ptr, strings_size);
+      ptr += strings_size;
+      memcpy(threads.data(), ptr, threads_size);
+      ptr += threads_size;
+      size_t view_offset = static_cast<size_t>(ptr - read_buffer_.data());
+      std::unique_ptr<FuchsiaRecord> record(
+          new FuchsiaRecord(read_buffer_.slice_off(
+              view_offset, header_.size - (view_offset - offset))));
+      record->set_ticks_per_second(fields.ticks_per_second);
+      for (const auto& entry : strings)
+        record->InsertString(entry.index, entry.string_id);
+      for (const auto& entry : threads)
+        record->InsertThread(entry.index, entry.info);
+      return TimestampedTracePiece(ts, idx, std::move(record));
+    }
+    case Type::kInvalid:
+      break;
+  }
+  PERFETTO_FATAL("Invalid event in the trace sorter spill file");
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
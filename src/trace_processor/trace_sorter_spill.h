@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_TRACE_SORTER_SPILL_H_
+#define SRC_TRACE_PROCESSOR_TRACE_SORTER_SPILL_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/flat_hash_map.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/trace_processor/ref_counted.h"
+#include "perfetto/trace_processor/trace_blob_view.h"
+#include "src/trace_processor/timestamped_trace_piece.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Keeps alive the sequence state generations referenced by spilled events.
+// Generations (i.e. the interned data of a packet sequence) can't be written
+// to disk, so spilled events refer to them by id.
+class SpilledGenerations {
+ public:
+  SpilledGenerations();
+  ~SpilledGenerations();
+
+  uint32_t Intern(const RefPtr<PacketSequenceStateGeneration>& generation);
+
+  const RefPtr<PacketSequenceStateGeneration>& Get(uint32_t id) const {
+    return generations_[id];
+  }
+
+ private:
+  // generations_[0] is the null generation.
+  std::vector<RefPtr<PacketSequenceStateGeneration>> generations_;
+  base::FlatHashMap<uintptr_t, uint32_t> ids_;
+};
+
+// A run of events, in the order TraceSorter pushes them to the parser, that
+// has been spilled to an unlinked temporary file to bound the memory used by
+// the sorter. The run is first written with Append() and FinishWriting(), then
+// read back, in the same order, with Next() and ReadEvent().
+class SpilledRun {
+ public:
+  explicit SpilledRun(SpilledGenerations* generations);
+  ~SpilledRun();
+
+  // Appends |ttp|, which was extracted from the sorter queue |queue_idx|.
+  void Append(uint32_t queue_idx, TimestampedTracePiece ttp);
+
+  // Flushes the buffered events and rewinds the run for reading.
+  void FinishWriting();
+
+  // Moves to the next event of the run. Returns false after the last event.
+  bool Next();
+
+  // Timestamp and queue of the event Next() moved to.
+  int64_t timestamp() const { return header_.timestamp; }
+  uint32_t queue_idx() const { return header_.queue_idx; }
+
+  // Deserializes the event Next() moved to. Trace packets and ftrace events
+  // are returned as slices of the read buffer, without further copies.
+  TimestampedTracePiece ReadEvent();
+
+  uint64_t size_bytes() const { return size_bytes_; }
+
+ private:
+  struct EventHeader {
+    int64_t timestamp;
+    uint64_t packet_idx;
+    uint32_t queue_idx;
+    uint32_t type;
+    uint32_t size;
+    uint32_t generation;
+  };
+
+  void WriteHeader(const TimestampedTracePiece&,
+                   uint32_t queue_idx,
+                   size_t size,
+                   uint32_t generation);
+  void WriteBytes(const void* data, size_t size);
+  void WriteString(const std::string&);
+  void FlushWriteBuffer();
+
+  // Ensures that at least |size| unread bytes are in |read_buffer_|.
+  void FillReadBuffer(size_t size);
+
+  SpilledGenerations* const generations_;
+  base::TempFile file_;
+  uint64_t size_bytes_ = 0;
+
+  std::string write_buffer_;
+
+  // A blob holding the bytes read from the file, the offset of the first byte
+  // which hasn't been consumed yet and the number of valid bytes. The blob is
+  // replaced, rather than overwritten, when refilled, because the previously
+  // returned events can still hold slices of it.
+  TraceBlobView read_buffer_;
+  size_t read_offset_ = 0;
+  size_t read_end_ = 0;
+  uint64_t bytes_left_to_read_ = 0;
+
+  EventHeader header_{};
+  bool has_unread_event_ = false;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_TRACE_SORTER_SPILL_H_
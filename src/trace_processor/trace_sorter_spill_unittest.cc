@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/trace_sorter_spill.h"
+
+#include <string>
+
+#include "perfetto/trace_processor/trace_blob.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TraceBlobView ViewOf(const std::string& str) {
+  return TraceBlobView(TraceBlob::CopyFrom(str.data(), str.size()));
+}
+
+std::string ToString(const TraceBlobView& view) {
+  return std::string(reinterpret_cast<const char*>(view.data()), view.size());
+}
+
+TEST(SpilledRunTest, RoundTripsAllTypes) {
+  TraceProcessorContext context;
+  context.storage.reset(new TraceStorage());
+  PacketSequenceState state(&context);
+  SpilledGenerations generations;
+  SpilledRun run(&generations);
+
+  run.Append(0, TimestampedTracePiece(10, 0, ViewOf("packet"),
+                                      state.current_generation()));
+  run.Append(1, TimestampedTracePiece(
+                    11, 1,
+                    FtraceEventData{ViewOf("ftrace"),
+                                    state.current_generation()}));
+  std::unique_ptr<TrackEventData> track_event(
+      new TrackEventData(ViewOf("track_event"), state.current_generation()));
+  track_event->thread_timestamp = 42;
+  track_event->extra_counter_values[1] = 1.5;
+  run.Append(0, TimestampedTracePiece(12, 2, std::move(track_event)));
+  run.Append(2, TimestampedTracePiece(
+                    13, 3, InlineSchedSwitch{1, 2, 3, StringId::Raw(4)}));
+  // Larger than the read and write buffers.
+  std::string json(3 * 1024 * 1024, 'x');
+  run.Append(0, TimestampedTracePiece(14, 4, json));
+  std::unique_ptr<SystraceLine> line(
+      new SystraceLine{15, 1, 2, "task", "1", "1", "event", "args"});
+  run.Append(0, TimestampedTracePiece(15, 5, std::move(line)));
+  std::unique_ptr<FuchsiaRecord> record(new FuchsiaRecord(ViewOf("fuchsia")));
+  record->set_ticks_per_second(1000);
+  record->InsertString(1, StringId::Raw(2));
+  record->InsertThread(3, fuchsia_trace_utils::ThreadInfo{4, 5});
+  run.Append(0, TimestampedTracePiece(16, 6, std::move(record)));
+  run.FinishWriting();
+
+  ASSERT_TRUE(run.Next());
+  ASSERT_EQ(run.timestamp(), 10);
+  ASSERT_EQ(run.queue_idx(), 0u);
+  TimestampedTracePiece ttp = run.ReadEvent();
+  ASSERT_EQ(ttp.type, TimestampedTracePiece::Type::kTracePacket);
+  ASSERT_EQ(ToString(ttp.packet_data.packet), "packet");
+  ASSERT_EQ(ttp.packet_data.sequence_state.get(),
+            state.current_generation().get());
+
+  ASSERT_TRUE(run.Next());
+  ASSERT_EQ(run.queue_idx(), 1u);
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ttp.packet_idx, 1u);
+  ASSERT_EQ(ToString(ttp.ftrace_event.event), "ftrace");
+
+  ASSERT_TRUE(run.Next());
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ToString(ttp.track_event_data->packet), "track_event");
+  ASSERT_EQ(ttp.track_event_data->thread_timestamp, 42);
+  ASSERT_FALSE(ttp.track_event_data->thread_instruction_count.has_value());
+  ASSERT_EQ(ttp.track_event_data->extra_counter_values[1], 1.5);
+
+  ASSERT_TRUE(run.Next());
+  ASSERT_EQ(run.queue_idx(), 2u);
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ttp.sched_switch.next_prio, 3);
+  ASSERT_EQ(ttp.sched_switch.next_comm, StringId::Raw(4));
+
+  ASSERT_TRUE(run.Next());
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ttp.json_value, json);
+
+  ASSERT_TRUE(run.Next());
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ttp.systrace_line->cpu, 2u);
+  ASSERT_EQ(ttp.systrace_line->event_name, "event");
+  ASSERT_EQ(ttp.systrace_line->args_str, "args");
+
+  ASSERT_TRUE(run.Next());
+  ttp = run.ReadEvent();
+  ASSERT_EQ(ToString(*ttp.fuchsia_record->record_view()), "fuchsia");
+  ASSERT_EQ(ttp.fuchsia_record->get_ticks_per_second(), 1000u);
+  ASSERT_EQ(ttp.fuchsia_record->GetString(1), StringId::Raw(2));
+  ASSERT_EQ(ttp.fuchsia_record->GetThread(3).tid, 5u);
+
+  ASSERT_FALSE(run.Next());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -15,8 +15,12 @@
  */
 #include "src/trace_processor/importers/proto/proto_trace_parser.h"
 
+#include <algorithm>
+#include <limits>
 #include <map>
 #include <random>
+#include <string>
+#include <tuple>
 #include <vector>
 
 #include "perfetto/trace_processor/basic_types.h"
@@ -296,6 +300,68 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
   EXPECT_TRUE(expectations.empty());
 }
 
+// Pushes the same shuffled stream of ftrace events and trace packets through a
+// sorter without and with a (tiny) memory limit. The events spilled to disk
+// must come back in the same order and with the same payloads.
+TEST_F(TraceSorterTest, SpillToDisk) {
+  using Event = std::tuple<uint32_t /*cpu*/, int64_t /*ts*/, std::string>;
+  static constexpr uint32_t kNonFtrace = std::numeric_limits<uint32_t>::max();
+
+  std::vector<int64_t> timestamps;
+  for (int64_t ts = 0; ts < 5000; ts++)
+    timestamps.push_back(ts * 10);
+  std::minstd_rand0 rnd_engine(0);
+  std::shuffle(timestamps.begin(), timestamps.end(), rnd_engine);
+  std::vector<Event> input;
+  for (int64_t ts : timestamps) {
+    uint32_t cpu = rnd_engine() % 2 ? kNonFtrace : rnd_engine() % 4;
+    input.emplace_back(cpu, ts, "payload " + std::to_string(ts));
+  }
+
+  auto sort = [this, &input](uint64_t memory_limit_bytes) {
+    context_.config.sorter_memory_limit_bytes = memory_limit_bytes;
+    CreateSorter();
+    std::vector<Event> output;
+    auto to_string = [](const uint8_t* data, size_t length) {
+      return std::string(reinterpret_cast<const char*>(data), length);
+    };
+    EXPECT_CALL(*parser_, MOCK_ParseFtracePacket(_, _, _, _))
+        .WillRepeatedly(Invoke([&](uint32_t cpu, int64_t ts,
+                                   const uint8_t* data, size_t length) {
+          output.emplace_back(cpu, ts, to_string(data, length));
+        }));
+    EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _))
+        .WillRepeatedly(
+            Invoke([&](int64_t ts, const uint8_t* data, size_t length) {
+              output.emplace_back(kNonFtrace, ts, to_string(data, length));
+            }));
+
+    PacketSequenceState state(&context_);
+    for (const Event& event : input) {
+      const std::string& payload = std::get<2>(event);
+      TraceBlobView view(TraceBlob::CopyFrom(payload.data(), payload.size()));
+      if (std::get<0>(event) == kNonFtrace) {
+        context_.sorter->PushTracePacket(std::get<1>(event), &state,
+                                         std::move(view));
+      } else {
+        context_.sorter->PushFtraceEvent(std::get<0>(event),
+                                         std::get<1>(event), std::move(view),
+                                         &state);
+      }
+    }
+    context_.sorter->ExtractEventsForced();
+    return output;
+  };
+
+  std::vector<Event> expected = sort(0);
+  ASSERT_EQ(expected.size(), input.size());
+  EXPECT_EQ(context_.storage->stats()[stats::sorter_spilled_runs].value, 0);
+
+  std::vector<Event> actual = sort(64 * 1024);
+  EXPECT_EQ(actual, expected);
+  EXPECT_GT(context_.storage->stats()[stats::sorter_spilled_runs].value, 1);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -25,6 +25,7 @@
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/base/time.h"
 #include "perfetto/ext/base/crash_keys.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/optional.h"
@@ -56,6 +57,11 @@ namespace {
 // TODO(rsavitski): consider making part of compact_sched config.
 constexpr size_t kCompactSchedInternerThreshold = 64;
 
+// The FtraceEventBundle.RawFormats are incremental state: they are written
+// again periodically so that the pages can still be decoded when the packet
+// with the previous formats has been overwritten in a ring buffer.
+constexpr uint64_t kRawFormatsPeriodNs = 5ull * 1000 * 1000 * 1000;
+
 // For further documentation of these constants see the kernel source:
 // linux/include/linux/ring_buffer.h
 // Some information about the values of these constants are exposed to user
@@ -72,42 +78,6 @@ struct EventHeader {
   uint32_t time_delta : 27;
 };
 
-// Reads a string from `start` until the first '\0' byte or until fixed_len
-// characters have been read. Appends it to `*out` as field `field_id`.
-void ReadIntoString(const uint8_t* start,
-                    size_t fixed_len,
-                    uint32_t field_id,
-                    protozero::Message* out) {
-  size_t len = strnlen(reinterpret_cast<const char*>(start), fixed_len);
-  out->AppendBytes(field_id, reinterpret_cast<const char*>(start), len);
-}
-
-bool ReadDataLoc(const uint8_t* start,
-                 const uint8_t* field_start,
-                 const uint8_t* end,
-                 const Field& field,
-                 protozero::Message* message) {
-  PERFETTO_DCHECK(field.ftrace_size == 4);
-  // See
-  // https://github.com/torvalds/linux/blob/master/include/trace/trace_events.h
-  uint32_t data = 0;
-  const uint8_t* ptr = field_start;
-  if (!CpuReader::ReadAndAdvance(&ptr, end, &data)) {
-    PERFETTO_DFATAL("Buffer overflowed.");
-    return false;
-  }
-
-  const uint16_t offset = data & 0xffff;
-  const uint16_t len = (data >> 16) & 0xffff;
-  const uint8_t* const string_start = start + offset;
-  if (string_start <= start || string_start + len > end) {
-    PERFETTO_DFATAL("Buffer overflowed.");
-    return false;
-  }
-  ReadIntoString(string_start, len, field.proto_field_id, message);
-  return true;
-}
-
 template <typename T>
 T ReadValue(const uint8_t* ptr) {
   T t;
@@ -137,6 +107,174 @@ bool SetBlocking(int fd, bool is_blocking) {
   return fcntl(fd, F_SETFL, flags) == 0;
 }
 
+using RawFormats = protos::pbzero::FtraceEventBundle::RawFormats;
+
+// Sets the fields that every bundle written for |cpu| starts with.
+void WriteBundleHeader(size_t cpu,
+                       protos::pbzero::FtraceClock ftrace_clock,
+                       const FtraceClockSnapshot* ftrace_clock_snapshot,
+                       protos::pbzero::FtraceEventBundle* bundle) {
+  if (ftrace_clock) {
+    bundle->set_ftrace_clock(ftrace_clock);
+
+    if (ftrace_clock_snapshot && ftrace_clock_snapshot->ftrace_clock_ts) {
+      bundle->set_ftrace_timestamp(ftrace_clock_snapshot->ftrace_clock_ts);
+      bundle->set_boot_timestamp(ftrace_clock_snapshot->boot_clock_ts);
+    }
+  }
+
+  // Note: The fastpath in proto_trace_parser.cc speculates on the fact
+  // that the cpu field is the first field of the proto message. If this
+  // changes, change proto_trace_parser.cc accordingly.
+  bundle->set_cpu(static_cast<uint32_t>(cpu));
+}
+
+// Maps the translation strategy of |field| to the encoding used to describe
+// it in the RawFormats, i.e. how trace processor has to decode the field to
+// obtain the same proto as ParseField(). Returns false if the field can't be
+// decoded off-device, in which case it's left out of the RawFormats.
+bool GetRawEncoding(const Field& field,
+                    RawFormats::Encoding* encoding,
+                    uint32_t* size) {
+  switch (field.strategy) {
+    case kUint8ToUint32:
+    case kUint8ToUint64:
+    case kBoolToUint32:
+    case kBoolToUint64:
+      *encoding = RawFormats::ENCODING_UINT;
+      *size = 1;
+      return true;
+    case kUint16ToUint32:
+    case kUint16ToUint64:
+      *encoding = RawFormats::ENCODING_UINT;
+      *size = 2;
+      return true;
+    case kUint32ToUint32:
+    case kUint32ToUint64:
+    case kInode32ToUint64:
+      *encoding = RawFormats::ENCODING_UINT;
+      *size = 4;
+      return true;
+    case kUint64ToUint64:
+    case kInode64ToUint64:
+      *encoding = RawFormats::ENCODING_UINT;
+      *size = 8;
+      return true;
+    case kInt8ToInt32:
+    case kInt8ToInt64:
+      *encoding = RawFormats::ENCODING_INT;
+      *size = 1;
+      return true;
+    case kInt16ToInt32:
+    case kInt16ToInt64:
+      *encoding = RawFormats::ENCODING_INT;
+      *size = 2;
+      return true;
+    case kInt32ToInt32:
+    case kInt32ToInt64:
+    case kPid32ToInt32:
+    case kPid32ToInt64:
+    case kCommonPid32ToInt32:
+    case kCommonPid32ToInt64:
+      *encoding = RawFormats::ENCODING_INT;
+      *size = 4;
+      return true;
+    case kInt64ToInt64:
+      *encoding = RawFormats::ENCODING_INT;
+      *size = 8;
+      return true;
+    case kFixedCStringToString:
+      *encoding = RawFormats::ENCODING_FIXED_CSTRING;
+      *size = field.ftrace_size;
+      return true;
+    case kCStringToString:
+      *encoding = RawFormats::ENCODING_CSTRING;
+      *size = field.ftrace_size;
+      return true;
+    case kStringPtrToString:
+      *encoding = RawFormats::ENCODING_STRING_PTR;
+      *size = std::min<uint32_t>(field.ftrace_size, sizeof(uint64_t));
+      return true;
+    case kDataLocToString:
+      *encoding = RawFormats::ENCODING_DATA_LOC;
+      *size = field.ftrace_size;
+      return true;
+    case kDevId32ToUint64:
+      *encoding = RawFormats::ENCODING_DEV_ID;
+      *size = 4;
+      return true;
+    case kDevId64ToUint64:
+      *encoding = RawFormats::ENCODING_DEV_ID;
+      *size = 8;
+      return true;
+    case kFtraceSymAddr64ToUint64:
+      // The raw addresses would disclose the KASLR layout, see
+      // CpuReader::ReadSymbolAddr().
+      return false;
+    case kInvalidTranslationStrategy:
+      return false;
+  }
+  return false;
+}
+
+// Appends the description of |fields| via |add_field|, which is either
+// RawFormats::add_common_field() or RawFormats::Event::add_field(). Returns
+// true if any of them needs the printk formats.
+template <typename AddFieldFn>
+bool WriteRawFields(const std::vector<Field>& fields,
+                    bool is_generic,
+                    AddFieldFn add_field) {
+  bool uses_string_ptrs = false;
+  for (const Field& field : fields) {
+    RawFormats::Encoding encoding;
+    uint32_t size;
+    if (!GetRawEncoding(field, &encoding, &size))
+      continue;
+    RawFormats::Field* raw_field = add_field();
+    raw_field->set_offset(field.ftrace_offset);
+    raw_field->set_size(size);
+    raw_field->set_encoding(encoding);
+    raw_field->set_proto_field_id(field.proto_field_id);
+    if (is_generic)
+      raw_field->set_name(field.ftrace_name);
+    uses_string_ptrs |= encoding == RawFormats::ENCODING_STRING_PTR;
+  }
+  return uses_string_ptrs;
+}
+
+void WriteRawFormats(const ProtoTranslationTable* table,
+                     const FtraceDataSourceConfig* ds_config,
+                     RawFormats* formats) {
+  formats->set_page_header_size_len(table->page_header_size_len());
+  bool uses_string_ptrs =
+      WriteRawFields(table->common_fields(), /*is_generic=*/false,
+                     [formats] { return formats->add_common_field(); });
+
+  for (size_t ftrace_id : ds_config->event_filter.GetEnabledEvents()) {
+    const Event* info = table->GetEventById(ftrace_id);
+    if (!info)
+      continue;
+    bool is_generic = info->proto_field_id ==
+                      protos::pbzero::FtraceEvent::kGenericFieldNumber;
+    RawFormats::Event* event = formats->add_event();
+    event->set_ftrace_id(info->ftrace_event_id);
+    event->set_proto_field_id(info->proto_field_id);
+    event->set_size(info->size);
+    if (is_generic)
+      event->set_name(info->name);
+    uses_string_ptrs |= WriteRawFields(info->fields, is_generic,
+                                       [event] { return event->add_field(); });
+  }
+
+  if (!uses_string_ptrs)
+    return;
+  for (const PrintkEntry& entry : table->printk_formats()) {
+    RawFormats::PrintkFormat* printk_format = formats->add_printk_format();
+    printk_format->set_address(entry.address);
+    printk_format->set_str(entry.name);
+  }
+}
+
 void LogInvalidPage(const void* start, size_t size) {
   PERFETTO_ELOG("Invalid ftrace page");
   std::string hexdump = base::HexDump(start, size);
@@ -171,18 +309,19 @@ size_t CpuReader::ReadCycle(
     uint8_t* parsing_buf,
     size_t parsing_buf_size_pages,
     size_t max_pages,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<Sink>& sinks) {
   PERFETTO_DCHECK(max_pages > 0 && parsing_buf_size_pages > 0);
   auto scoped_key = g_crash_key_cpu.SetScoped(static_cast<int>(cpu_));
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_CPU_READ_CYCLE);
+  const int64_t start_ns = base::GetWallTimeNs().count();
 
   // Work in batches to keep cache locality, and limit memory usage.
   size_t batch_pages = std::min(parsing_buf_size_pages, max_pages);
   size_t total_pages_read = 0;
   for (bool is_first_batch = true;; is_first_batch = false) {
-    size_t pages_read = ReadAndProcessBatch(
-        parsing_buf, batch_pages, is_first_batch, started_data_sources);
+    size_t pages_read =
+        ReadAndProcessBatch(parsing_buf, batch_pages, is_first_batch, sinks);
 
     PERFETTO_DCHECK(pages_read <= batch_pages);
     total_pages_read += pages_read;
@@ -197,6 +336,14 @@ size_t CpuReader::ReadCycle(
   }
   PERFETTO_METATRACE_COUNTER(TAG_FTRACE, FTRACE_PAGES_DRAINED,
                              total_pages_read);
+
+  // Only this thread writes the stats, hence no need for a CAS loop.
+  const auto cycle_ns =
+      static_cast<uint64_t>(base::GetWallTimeNs().count() - start_ns);
+  drain_stats_.pages.fetch_add(total_pages_read, std::memory_order_relaxed);
+  drain_stats_.time_ns.fetch_add(cycle_ns, std::memory_order_relaxed);
+  if (cycle_ns > drain_stats_.max_cycle_ns.load(std::memory_order_relaxed))
+    drain_stats_.max_cycle_ns.store(cycle_ns, std::memory_order_relaxed);
   return total_pages_read;
 }
 
@@ -208,7 +355,7 @@ size_t CpuReader::ReadAndProcessBatch(
     uint8_t* parsing_buf,
     size_t max_pages,
     bool first_batch_in_cycle,
-    const std::set<FtraceDataSource*>& started_data_sources) {
+    const std::vector<Sink>& sinks) {
   size_t pages_read = 0;
   {
     metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
@@ -281,11 +428,11 @@ size_t CpuReader::ReadAndProcessBatch(
   if (pages_read == 0)
     return pages_read;
 
-  for (FtraceDataSource* data_source : started_data_sources) {
+  for (const Sink& sink : sinks) {
     bool pages_parsed_ok = ProcessPagesForDataSource(
-        data_source->trace_writer(), data_source->mutable_metadata(), cpu_,
-        data_source->parsing_config(), parsing_buf, pages_read, table_,
-        symbolizer_, ftrace_clock_snapshot_, ftrace_clock_);
+        sink.trace_writer, sink.metadata, cpu_, sink.parsing_config,
+        parsing_buf, pages_read, table_, symbolizer_, ftrace_clock_snapshot_,
+        ftrace_clock_);
     // If this CHECK fires, it means that we did not know how to parse the
     // kernel binary format. This is a bug in either perfetto or the kernel, and
     // must be investigated. Hence we CHECK instead of recording a bit
@@ -308,6 +455,12 @@ bool CpuReader::ProcessPagesForDataSource(
     LazyKernelSymbolizer* symbolizer,
     const FtraceClockSnapshot* ftrace_clock_snapshot,
     protos::pbzero::FtraceClock ftrace_clock) {
+  if (ds_config->raw_pages) {
+    return WriteRawPagesForDataSource(trace_writer, metadata, cpu, ds_config,
+                                      parsing_buf, pages_read, table,
+                                      ftrace_clock_snapshot, ftrace_clock);
+  }
+
   // Allocate the buffer for compact scheduler events (which will be unused if
   // the compact option isn't enabled).
   CompactSchedBuffer compact_sched;
@@ -388,19 +541,7 @@ bool CpuReader::ProcessPagesForDataSource(
       finalize_cur_packet();
     packet = trace_writer->NewTracePacket();
     bundle = packet->set_ftrace_events();
-    if (ftrace_clock) {
-      bundle->set_ftrace_clock(ftrace_clock);
-
-      if (ftrace_clock_snapshot && ftrace_clock_snapshot->ftrace_clock_ts) {
-        bundle->set_ftrace_timestamp(ftrace_clock_snapshot->ftrace_clock_ts);
-        bundle->set_boot_timestamp(ftrace_clock_snapshot->boot_clock_ts);
-      }
-    }
-
-    // Note: The fastpath in proto_trace_parser.cc speculates on the fact
-    // that the cpu field is the first field of the proto message. If this
-    // changes, change proto_trace_parser.cc accordingly.
-    bundle->set_cpu(static_cast<uint32_t>(cpu));
+    WriteBundleHeader(cpu, ftrace_clock, ftrace_clock_snapshot, bundle);
     if (lost_events)
       bundle->set_lost_events(true);
   };
@@ -452,6 +593,61 @@ bool CpuReader::ProcessPagesForDataSource(
   return pages_parsed_ok;
 }
 
+// static
+bool CpuReader::WriteRawPagesForDataSource(
+    TraceWriter* trace_writer,
+    FtraceMetadata* metadata,
+    size_t cpu,
+    const FtraceDataSourceConfig* ds_config,
+    const uint8_t* parsing_buf,
+    const size_t pages_read,
+    const ProtoTranslationTable* table,
+    const FtraceClockSnapshot* ftrace_clock_snapshot,
+    protos::pbzero::FtraceClock ftrace_clock) {
+  // The pages are validated as much as needed to know how much of each page to
+  // copy. The events themselves are decoded only by trace processor. Unlike
+  // parsed bundles, a bundle can contain pages with and without data loss:
+  // the RB_MISSED_EVENTS flag is preserved in each page header.
+  auto now_ns = static_cast<uint64_t>(base::GetBootTimeNs().count());
+  bool write_formats =
+      metadata->raw_formats_written_ns == 0 ||
+      now_ns - metadata->raw_formats_written_ns >= kRawFormatsPeriodNs;
+
+  TraceWriter::TracePacketHandle packet = trace_writer->NewTracePacket();
+  packet->set_sequence_flags(
+      write_formats
+          ? protos::pbzero::TracePacket::SEQ_INCREMENTAL_STATE_CLEARED
+          : protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+  protos::pbzero::FtraceEventBundle* bundle = packet->set_ftrace_events();
+  WriteBundleHeader(cpu, ftrace_clock, ftrace_clock_snapshot, bundle);
+  if (write_formats) {
+    WriteRawFormats(table, ds_config, bundle->set_raw_formats());
+    metadata->raw_formats_written_ns = now_ns;
+  }
+
+  bool pages_valid = true;
+  for (size_t i = 0; i < pages_read; i++) {
+    const uint8_t* curr_page = parsing_buf + (i * base::kPageSize);
+    const uint8_t* curr_page_end = curr_page + base::kPageSize;
+    const uint8_t* parse_pos = curr_page;
+    base::Optional<PageHeader> page_header =
+        ParsePageHeader(&parse_pos, table->page_header_size_len());
+
+    if (!page_header.has_value() || page_header->size == 0 ||
+        parse_pos >= curr_page_end ||
+        parse_pos + page_header->size > curr_page_end) {
+      pages_valid = false;
+      LogInvalidPage(curr_page, base::kPageSize);
+      PERFETTO_DFATAL("invalid page header");
+      continue;
+    }
+    size_t valid_size =
+        static_cast<size_t>(parse_pos - curr_page) + page_header->size;
+    bundle->add_raw_page(curr_page, valid_size);
+  }
+  return pages_valid;
+}
+
 // A page header consists of:
 // * timestamp: 8 bytes
 // * commit: 8 bytes on 64 bit, 4 bytes on 32 bit kernels
@@ -679,6 +875,8 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
                                   field.ftrace_name);
       success &= ParseField(field, start, end, table, generic_field, metadata);
     }
+  } else if (EventParserFn parse = table->GetEventParser(ftrace_event_id)) {
+    success &= parse(start, end, info.fields.data(), table, nested, metadata);
   } else {  // Parse all other events.
     for (const Field& field : info.fields) {
       success &= ParseField(field, start, end, table, nested, metadata);
@@ -700,6 +898,33 @@ bool CpuReader::ParseEvent(uint16_t ftrace_event_id,
   return success;
 }
 
+// static
+bool CpuReader::ReadDataLoc(const uint8_t* start,
+                            const uint8_t* field_start,
+                            const uint8_t* end,
+                            const Field& field,
+                            protozero::Message* message) {
+  PERFETTO_DCHECK(field.ftrace_size == 4);
+  // See
+  // https://github.com/torvalds/linux/blob/master/include/trace/trace_events.h
+  uint32_t data = 0;
+  const uint8_t* ptr = field_start;
+  if (!CpuReader::ReadAndAdvance(&ptr, end, &data)) {
+    PERFETTO_DFATAL("Buffer overflowed.");
+    return false;
+  }
+
+  const uint16_t offset = data & 0xffff;
+  const uint16_t len = (data >> 16) & 0xffff;
+  const uint8_t* const string_start = start + offset;
+  if (string_start <= start || string_start + len > end) {
+    PERFETTO_DFATAL("Buffer overflowed.");
+    return false;
+  }
+  ReadIntoString(string_start, len, field.proto_field_id, message);
+  return true;
+}
+
 // Caller must guarantee that the field fits in the range,
 // explicitly: start + field.ftrace_offset + field.ftrace_size <= end
 // The only exception is fields with strategy = kCStringToString
@@ -755,21 +980,9 @@ bool CpuReader::ParseField(const Field& field,
       ReadIntoString(field_start, static_cast<size_t>(end - field_start),
                      field_id, message);
       return true;
-    case kStringPtrToString: {
-      uint64_t n = 0;
-      // The ftrace field may be 8 or 4 bytes and we need to copy it into the
-      // bottom of n. In the unlikely case where the field is >8 bytes we
-      // should avoid making things worse by corrupting the stack but we
-      // don't need to handle it correctly.
-      size_t size = std::min<size_t>(field.ftrace_size, sizeof(n));
-      memcpy(base::AssumeLittleEndian(&n),
-             reinterpret_cast<const void*>(field_start), size);
-      // Look up the adddress in the printk format map and write it into the
-      // proto.
-      base::StringView name = table->LookupTraceString(n);
-      message->AppendBytes(field_id, name.begin(), name.size());
+    case kStringPtrToString:
+      ReadStringPtr(field_start, field.ftrace_size, field_id, table, message);
       return true;
-    }
     case kDataLocToString:
       return ReadDataLoc(start, field_start, end, field, message);
     case kBoolToUint32:
@@ -20,17 +20,20 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <memory>
-#include <set>
 #include <thread>
+#include <vector>
 
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/pipe.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/ext/base/thread_checker.h"
+#include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/traced/data_source_types.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/protozero/message.h"
@@ -41,7 +44,6 @@
 
 namespace perfetto {
 
-class FtraceDataSource;
 class LazyKernelSymbolizer;
 class ProtoTranslationTable;
 struct FtraceClockSnapshot;
@@ -66,6 +68,23 @@ class CpuReader {
     bool lost_events;
   };
 
+  // Where the data parsed for one data source goes. When reading on the main
+  // thread these are owned by the FtraceDataSource, reader threads have their
+  // own writer and metadata for each data source instead.
+  struct Sink {
+    TraceWriter* trace_writer;
+    FtraceMetadata* metadata;
+    const FtraceDataSourceConfig* parsing_config;
+  };
+
+  // Cumulative counters, see FtraceCpuStats in ftrace_stats.proto. Updated by
+  // the thread reading this cpu and read by the main thread, hence atomic.
+  struct DrainStats {
+    std::atomic<uint64_t> pages{};
+    std::atomic<uint64_t> time_ns{};
+    std::atomic<uint64_t> max_cycle_ns{};
+  };
+
   CpuReader(size_t cpu,
             const ProtoTranslationTable* table,
             LazyKernelSymbolizer* symbolizer,
@@ -78,7 +97,7 @@ class CpuReader {
   size_t ReadCycle(uint8_t* parsing_buf,
                    size_t parsing_buf_size_pages,
                    size_t max_pages,
-                   const std::set<FtraceDataSource*>& started_data_sources);
+                   const std::vector<Sink>& sinks);
 
   template <typename T>
   static bool ReadAndAdvance(const uint8_t** ptr, const uint8_t* end, T* out) {
@@ -103,6 +122,44 @@ class CpuReader {
     return t;
   }
 
+  // Reads a string from |start| until the first '\0' byte or until
+  // |fixed_len| characters have been read. Appends it to |out| as field
+  // |field_id|.
+  static void ReadIntoString(const uint8_t* start,
+                             size_t fixed_len,
+                             uint32_t field_id,
+                             protozero::Message* out) {
+    size_t len = strnlen(reinterpret_cast<const char*>(start), fixed_len);
+    out->AppendBytes(field_id, reinterpret_cast<const char*>(start), len);
+  }
+
+  // Reads a pointer to a string in the kernel, e.g. the format of a
+  // __trace_printk(), and appends the string it points to, as found in the
+  // printk formats of |table|.
+  static void ReadStringPtr(const uint8_t* start,
+                            size_t size,
+                            uint32_t field_id,
+                            const ProtoTranslationTable* table,
+                            protozero::Message* out) {
+    uint64_t n = 0;
+    // The ftrace field may be 8 or 4 bytes and we need to copy it into the
+    // bottom of n. In the unlikely case where the field is >8 bytes we
+    // should avoid making things worse by corrupting the stack but we
+    // don't need to handle it correctly.
+    memcpy(base::AssumeLittleEndian(&n), reinterpret_cast<const void*>(start),
+           std::min(size, sizeof(n)));
+    base::StringView name = table->LookupTraceString(n);
+    out->AppendBytes(field_id, name.begin(), name.size());
+  }
+
+  // Reads a __data_loc field at |field_start|: a string stored after the fixed
+  // size fields of the event that begins at |start|.
+  static bool ReadDataLoc(const uint8_t* start,
+                          const uint8_t* field_start,
+                          const uint8_t* end,
+                          const Field& field,
+                          protozero::Message* message);
+
   template <typename T>
   static void ReadInode(const uint8_t* start,
                         uint32_t field_id,
@@ -246,10 +303,35 @@ class CpuReader {
                                         const FtraceClockSnapshot*,
                                         protos::pbzero::FtraceClock);
 
+  // Copies the given range of contiguous tracing pages verbatim into the
+  // trace, for data sources with FtraceConfig.raw_pages. Called by
+  // |ProcessPagesForDataSource| in place of the parsing.
+  //
+  // public and static for testing
+  static bool WriteRawPagesForDataSource(
+      TraceWriter* trace_writer,
+      FtraceMetadata* metadata,
+      size_t cpu,
+      const FtraceDataSourceConfig* ds_config,
+      const uint8_t* parsing_buf,
+      const size_t pages_read,
+      const ProtoTranslationTable* table,
+      const FtraceClockSnapshot*,
+      protos::pbzero::FtraceClock);
+
   void set_ftrace_clock(protos::pbzero::FtraceClock clock) {
     ftrace_clock_ = clock;
   }
 
+  // Used by the reader threads, which keep their own copy of the snapshot.
+  void set_ftrace_clock_snapshot(const FtraceClockSnapshot* snapshot) {
+    ftrace_clock_snapshot_ = snapshot;
+  }
+
+  size_t cpu() const { return cpu_; }
+  int trace_fd() const { return *trace_fd_; }
+  const DrainStats& drain_stats() const { return drain_stats_; }
+
  private:
   CpuReader(const CpuReader&) = delete;
   CpuReader& operator=(const CpuReader&) = delete;
@@ -258,18 +340,18 @@ class CpuReader {
   // into |started_data_sources|. Returns number of pages read.
   // See comment on ftrace_controller.cc:kMaxParsingWorkingSetPages for
   // rationale behind the batching.
-  size_t ReadAndProcessBatch(
-      uint8_t* parsing_buf,
-      size_t max_pages,
-      bool first_batch_in_cycle,
-      const std::set<FtraceDataSource*>& started_data_sources);
+  size_t ReadAndProcessBatch(uint8_t* parsing_buf,
+                             size_t max_pages,
+                             bool first_batch_in_cycle,
+                             const std::vector<Sink>& sinks);
 
   const size_t cpu_;
   const ProtoTranslationTable* const table_;
   LazyKernelSymbolizer* const symbolizer_;
-  const FtraceClockSnapshot* const ftrace_clock_snapshot_;
+  const FtraceClockSnapshot* ftrace_clock_snapshot_;
   base::ScopedFile trace_fd_;
   protos::pbzero::FtraceClock ftrace_clock_{};
+  DrainStats drain_stats_;
 };
 
 }  // namespace perfetto
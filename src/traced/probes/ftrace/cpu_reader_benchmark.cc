@@ -293,8 +293,11 @@ perfetto::ExamplePage g_full_page_sched_switch{
 using perfetto::CompactSchedBuffer;
 using perfetto::CpuReader;
 using perfetto::DisabledCompactSchedConfigForTesting;
+using perfetto::Event;
 using perfetto::EventFilter;
+using perfetto::EventParserFn;
 using perfetto::ExamplePage;
+using perfetto::Field;
 using perfetto::FtraceDataSourceConfig;
 using perfetto::FtraceMetadata;
 using perfetto::GetTable;
@@ -345,3 +348,84 @@ static void BM_ParsePageFullOfSchedSwitch(benchmark::State& state) {
   }
 }
 BENCHMARK(BM_ParsePageFullOfSchedSwitch);
+
+// Same as above, but parsing on several threads at once, each with its own
+// writer and metadata, as done by the reader threads (see
+// FtraceConfig.reader_threads). The translation table is shared and only read.
+static void BM_ParsePageFullOfSchedSwitchThreads(benchmark::State& state) {
+  const ExamplePage* test_case = &g_full_page_sched_switch;
+  static ProtoTranslationTable* table = GetTable(test_case->name);
+
+  ScatteredStreamWriterNullDelegate delegate(perfetto::base::kPageSize);
+  ScatteredStreamWriter stream(&delegate);
+  protozero::RootMessage<FtraceEventBundle> writer;
+
+  auto page = PageFromXxd(test_case->data);
+
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  FtraceMetadata metadata{};
+  // Unused, as compact_sched is disabled.
+  std::unique_ptr<CompactSchedBuffer> compact_buffer(new CompactSchedBuffer());
+  for (auto _ : state) {
+    writer.Reset(&stream);
+    const uint8_t* parse_pos = page.get();
+    perfetto::base::Optional<CpuReader::PageHeader> page_header =
+        CpuReader::ParsePageHeader(&parse_pos, table->page_header_size_len());
+
+    if (!page_header.has_value())
+      return;
+
+    CpuReader::ParsePagePayload(parse_pos, &page_header.value(), table,
+                                &ds_config, compact_buffer.get(), &writer,
+                                &metadata);
+
+    metadata.Clear();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ParsePageFullOfSchedSwitchThreads)
+    ->ThreadRange(1, 8)
+    ->UseRealTime();
+
+// Decoding of the fields of a single sched_switch record, field by field
+// (arg 0) or with the parser generated for its layout (arg 1).
+static void BM_ParseSchedSwitchFields(benchmark::State& state) {
+  ProtoTranslationTable* table = GetTable("synthetic");
+  const Event* event = table->GetEvent(GroupAndName("sched", "sched_switch"));
+  EventParserFn parse = table->GetEventParser(event->ftrace_event_id);
+  if (!parse) {
+    state.SkipWithError("No parser for sched_switch");
+    return;
+  }
+  const bool use_parser = state.range(0) != 0;
+
+  std::vector<uint8_t> record(event->size);
+  for (size_t i = 0; i < record.size(); i++)
+    record[i] = static_cast<uint8_t>('a' + i % 16);
+  const uint8_t* start = record.data();
+  const uint8_t* end = start + record.size();
+
+  ScatteredStreamWriterNullDelegate delegate(perfetto::base::kPageSize);
+  ScatteredStreamWriter stream(&delegate);
+  protozero::RootMessage<protozero::Message> message;
+  FtraceMetadata metadata{};
+  for (auto _ : state) {
+    message.Reset(&stream);
+    if (use_parser) {
+      parse(start, end, event->fields.data(), table, &message, &metadata);
+    } else {
+      for (const Field& field : event->fields)
+        CpuReader::ParseField(field, start, end, table, &message, &metadata);
+    }
+    metadata.Clear();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_ParseSchedSwitchFields)->Arg(0)->Arg(1);
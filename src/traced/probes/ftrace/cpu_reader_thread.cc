@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ftrace/cpu_reader_thread.h"
+
+#include <poll.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "src/traced/probes/ftrace/ftrace_config_muxer.h"
+#include "src/traced/probes/ftrace/ftrace_controller.h"
+
+namespace perfetto {
+
+namespace {
+
+// FtraceDataSourceConfig isn't copyable because of the EventFilter.
+const FtraceDataSourceConfig* CopyParsingConfig(
+    const FtraceDataSourceConfig& config) {
+  EventFilter event_filter;
+  event_filter.EnableEventsFrom(config.event_filter);
+  return new FtraceDataSourceConfig(
+      std::move(event_filter), config.compact_sched, config.atrace_apps,
+      config.atrace_categories, config.symbolize_ksyms, config.raw_pages);
+}
+
+}  // namespace
+
+CpuReaderThread::DataSourceState::DataSourceState(
+    FtraceDataSource* _data_source,
+    const FtraceDataSourceConfig& _parsing_config,
+    std::unique_ptr<TraceWriter> _trace_writer)
+    : data_source(_data_source),
+      parsing_config(CopyParsingConfig(_parsing_config)),
+      trace_writer(std::move(_trace_writer)),
+      metadata(new FtraceMetadata()) {}
+
+CpuReaderThread::DataSourceState::~DataSourceState() = default;
+
+CpuReaderThread::CpuReaderThread(base::TaskRunner* task_runner,
+                                 std::vector<CpuReader*> cpu_readers,
+                                 size_t parsing_buf_size_pages,
+                                 size_t max_pages_per_cycle,
+                                 uint32_t drain_period_ms,
+                                 bool pin_to_cpus)
+    : task_runner_(task_runner),
+      cpu_readers_(std::move(cpu_readers)),
+      parsing_buf_size_pages_(parsing_buf_size_pages),
+      max_pages_per_cycle_(max_pages_per_cycle),
+      drain_period_ms_(drain_period_ms),
+      pin_to_cpus_(pin_to_cpus),
+      parsing_mem_(base::PagedMemory::Allocate(base::kPageSize *
+                                               parsing_buf_size_pages)),
+      ftrace_clock_snapshot_(new FtraceClockSnapshot()) {
+  PERFETTO_CHECK(!cpu_readers_.empty());
+  for (CpuReader* reader : cpu_readers_)
+    reader->set_ftrace_clock_snapshot(ftrace_clock_snapshot_.get());
+  thread_ = std::thread(&CpuReaderThread::ThreadMain, this);
+}
+
+CpuReaderThread::~CpuReaderThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wakeup_event_.Notify();
+  thread_.join();
+}
+
+void CpuReaderThread::AddDataSource(
+    FtraceDataSource* data_source,
+    const FtraceDataSourceConfig& parsing_config,
+    std::unique_ptr<TraceWriter> trace_writer) {
+  PERFETTO_CHECK(trace_writer);
+  std::unique_ptr<DataSourceState> state(new DataSourceState(
+      data_source, parsing_config, std::move(trace_writer)));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_source_requests_.push_back({data_source, std::move(state)});
+  }
+  wakeup_event_.Notify();
+}
+
+void CpuReaderThread::RemoveDataSource(FtraceDataSource* data_source) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_source_requests_.push_back({data_source, nullptr});
+    // Don't hand over anything for a data source which is going away (and
+    // whose address might be reused by the next one).
+    metadata_outbox_.erase(
+        std::remove_if(metadata_outbox_.begin(), metadata_outbox_.end(),
+                       [data_source](const MetadataList::value_type& entry) {
+                         return entry.first == data_source;
+                       }),
+        metadata_outbox_.end());
+  }
+  wakeup_event_.Notify();
+}
+
+void CpuReaderThread::SetFtraceClockSnapshot(
+    const FtraceClockSnapshot& snapshot) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_ftrace_clock_snapshot_.reset(new FtraceClockSnapshot(snapshot));
+}
+
+void CpuReaderThread::ClearIncrementalState(FtraceDataSource* data_source) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  incremental_state_clears_.push_back(data_source);
+}
+
+void CpuReaderThread::Flush(std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush_callbacks_.push_back(std::move(callback));
+  }
+  wakeup_event_.Notify();
+}
+
+CpuReaderThread::MetadataList CpuReaderThread::TakeMetadata() {
+  MetadataList metadata;
+  std::lock_guard<std::mutex> lock(mutex_);
+  metadata.swap(metadata_outbox_);
+  metadata_requested_ = true;
+  return metadata;
+}
+
+void CpuReaderThread::Quit(std::function<void()> callback) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+    quit_callback_ = std::move(callback);
+  }
+  wakeup_event_.Notify();
+}
+
+void CpuReaderThread::ThreadMain() {
+  base::MaybeSetThreadName("ftrace_cpu" +
+                           std::to_string(cpu_readers_.front()->cpu()));
+  if (pin_to_cpus_) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (const CpuReader* reader : cpu_readers_) {
+      if (reader->cpu() < CPU_SETSIZE)
+        CPU_SET(reader->cpu(), &cpus);
+    }
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+      PERFETTO_PLOG("sched_setaffinity() failed");
+  }
+
+  // The wakeup event goes first, so it's always polled.
+  std::vector<struct pollfd> poll_fds;
+  poll_fds.push_back({wakeup_event_.fd(), POLLIN, 0});
+  for (const CpuReader* reader : cpu_readers_)
+    poll_fds.push_back({reader->trace_fd(), POLLIN, 0});
+
+  uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
+  std::vector<std::function<void()>> flush_callbacks;
+  bool wait_for_data = true;
+  for (;;) {
+    // Leave the data in the kernel buffers until there is somewhere to write
+    // it, i.e. until the controller adds the first data source.
+    nfds_t num_fds = wait_for_data && !sinks_.empty() ? poll_fds.size() : 1;
+    int res = PERFETTO_EINTR(
+        poll(poll_fds.data(), num_fds, static_cast<int>(drain_period_ms_)));
+    PERFETTO_CHECK(res >= 0);
+    if (poll_fds[0].revents)
+      wakeup_event_.Clear();
+
+    if (!ApplyRequests(&flush_callbacks))
+      break;
+
+    size_t pages_read = 0;
+    if (!sinks_.empty()) {
+      for (CpuReader* reader : cpu_readers_) {
+        pages_read += reader->ReadCycle(parsing_buf, parsing_buf_size_pages_,
+                                        max_pages_per_cycle_, sinks_);
+      }
+    }
+
+    // The flushes requested before this cycle are complete once the data is
+    // committed: TraceWriter::Flush() posts the commit on the main thread,
+    // hence before the callbacks.
+    const bool flushing = !flush_callbacks.empty();
+    if (flushing) {
+      for (const auto& state : data_sources_)
+        state->trace_writer->Flush();
+    }
+    PublishMetadata(/*force=*/flushing);
+    for (auto& callback : flush_callbacks)
+      task_runner_->PostTask(std::move(callback));
+    flush_callbacks.clear();
+
+    // If some buffer was reported readable but there was nothing to read (e.g.
+    // the data was consumed by somebody else, or the fd doesn't support
+    // polling) don't spin. Just sleep until the next drain period instead.
+    bool trace_fds_ready = false;
+    for (size_t i = 1; i < num_fds; i++)
+      trace_fds_ready |= poll_fds[i].revents != 0;
+    wait_for_data = pages_read > 0 || !trace_fds_ready;
+  }
+
+  // Release the writers (and with them the chunks of the shared memory
+  // buffer) here, rather than on the main thread.
+  data_sources_.clear();
+  sinks_.clear();
+
+  std::function<void()> quit_callback;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_callback = std::move(quit_callback_);
+  }
+  if (quit_callback)
+    task_runner_->PostTask(std::move(quit_callback));
+}
+
+bool CpuReaderThread::ApplyRequests(
+    std::vector<std::function<void()>>* flush_callbacks) {
+  std::vector<DataSourceRequest> requests;
+  std::vector<FtraceDataSource*> incremental_state_clears;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (quit_)
+      return false;
+    requests.swap(data_source_requests_);
+    flush_callbacks->swap(flush_callbacks_);
+    incremental_state_clears.swap(incremental_state_clears_);
+    if (pending_ftrace_clock_snapshot_) {
+      *ftrace_clock_snapshot_ = *pending_ftrace_clock_snapshot_;
+      pending_ftrace_clock_snapshot_.reset();
+    }
+  }
+
+  // The writers of the removed data sources are destroyed here, outside of
+  // the lock, as that can touch the shared memory buffer.
+  for (DataSourceRequest& request : requests) {
+    if (request.added) {
+      data_sources_.push_back(std::move(request.added));
+      continue;
+    }
+    FtraceDataSource* data_source = request.data_source;
+    data_sources_.erase(
+        std::remove_if(data_sources_.begin(), data_sources_.end(),
+                       [data_source](const std::unique_ptr<DataSourceState>& s) {
+                         return s->data_source == data_source;
+                       }),
+        data_sources_.end());
+  }
+  if (!requests.empty())
+    UpdateSinks();
+
+  for (FtraceDataSource* data_source : incremental_state_clears) {
+    for (const auto& state : data_sources_) {
+      if (state->data_source == data_source)
+        state->metadata->raw_formats_written_ns = 0;
+    }
+  }
+  return true;
+}
+
+void CpuReaderThread::PublishMetadata(bool force) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!metadata_requested_ && !force)
+    return;
+  metadata_requested_ = false;
+  for (const auto& state : data_sources_) {
+    FtraceDataSource* data_source = state->data_source;
+    // Skip the data sources removed in the meantime, see RemoveDataSource().
+    bool removal_pending = std::any_of(
+        data_source_requests_.begin(), data_source_requests_.end(),
+        [data_source](const DataSourceRequest& request) {
+          return request.data_source == data_source;
+        });
+    if (removal_pending)
+      continue;
+
+    // The new metadata also restarts the interning of kernel symbols, which is
+    // scoped to the packet sequence of this thread's writer. The next bundle
+    // written will clear the incremental state, like it happens on the main
+    // thread after every ReadTick().
+    std::unique_ptr<FtraceMetadata> metadata(new FtraceMetadata());
+    metadata->raw_formats_written_ns = state->metadata->raw_formats_written_ns;
+    metadata_outbox_.emplace_back(data_source, std::move(state->metadata));
+    state->metadata = std::move(metadata);
+  }
+  UpdateSinks();
+}
+
+void CpuReaderThread::UpdateSinks() {
+  sinks_.clear();
+  for (const auto& state : data_sources_) {
+    sinks_.push_back({state->trace_writer.get(), state->metadata.get(),
+                      state->parsing_config.get()});
+  }
+}
+
+}  // namespace perfetto
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_CPU_READER_THREAD_H_
+#define SRC_TRACED_PROBES_FTRACE_CPU_READER_THREAD_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "perfetto/base/task_runner.h"
+#include "perfetto/ext/base/event_fd.h"
+#include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/tracing/core/trace_writer.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+
+namespace perfetto {
+
+class FtraceDataSource;
+
+// Drains the kernel buffers of a group of cpus on a dedicated thread, used when
+// FtraceConfig.reader_threads is set. The thread sleeps until any of its
+// buffers becomes readable (or for at most |drain_period_ms|), then reads all
+// of them until it catches up with the kernel.
+//
+// The thread writes the parsed data into its own TraceWriter and
+// FtraceMetadata for each data source, as neither is thread-safe, and parses
+// with its own copy of the parsing config and of the FtraceClockSnapshot.
+//
+// Writing into the shared memory buffer can stall until the main thread
+// commits the chunks to the service, so the main thread must never wait for a
+// read cycle to complete. Instead, the public methods below only queue
+// requests, which the thread picks up between read cycles. The results (the
+// metadata and the flush acks) are handed back asynchronously.
+class CpuReaderThread {
+ public:
+  using MetadataList =
+      std::vector<std::pair<FtraceDataSource*, std::unique_ptr<FtraceMetadata>>>;
+
+  // The CpuReader-s must outlive this object. The |task_runner| is the one
+  // of the main thread.
+  CpuReaderThread(base::TaskRunner* task_runner,
+                  std::vector<CpuReader*> cpu_readers,
+                  size_t parsing_buf_size_pages,
+                  size_t max_pages_per_cycle,
+                  uint32_t drain_period_ms,
+                  bool pin_to_cpus);
+
+  // Joins the thread, which blocks until the ongoing read cycle completes. Use
+  // Quit() first if the main thread might have to commit the data written in
+  // the meantime.
+  ~CpuReaderThread();
+
+  // The |data_source| is only used as a key, it's never dereferenced by the
+  // thread.
+  void AddDataSource(FtraceDataSource* data_source,
+                     const FtraceDataSourceConfig& parsing_config,
+                     std::unique_ptr<TraceWriter>);
+  void RemoveDataSource(FtraceDataSource*);
+
+  void SetFtraceClockSnapshot(const FtraceClockSnapshot&);
+
+  // Writes the raw formats again with the next pages of |data_source|.
+  void ClearIncrementalState(FtraceDataSource* data_source);
+
+  // Reads everything in the buffers, flushes the writers and makes the
+  // metadata available to TakeMetadata(), then posts |callback|.
+  void Flush(std::function<void()> callback);
+
+  // Returns the metadata (pids, rename pids and inodes) collected by the
+  // thread since the last call, and asks the thread to hand over the next
+  // batch once done with the current read cycle.
+  MetadataList TakeMetadata();
+
+  // Stops the thread after the current read cycle, then posts |callback|. The
+  // destructor won't block after that.
+  void Quit(std::function<void()> callback);
+
+ private:
+  struct DataSourceState {
+    DataSourceState(FtraceDataSource*,
+                    const FtraceDataSourceConfig&,
+                    std::unique_ptr<TraceWriter>);
+    ~DataSourceState();
+
+    FtraceDataSource* const data_source;
+    std::unique_ptr<const FtraceDataSourceConfig> parsing_config;
+    std::unique_ptr<TraceWriter> trace_writer;
+    std::unique_ptr<FtraceMetadata> metadata;
+  };
+
+  // A data source to add, or to remove if |added| is null.
+  struct DataSourceRequest {
+    FtraceDataSource* data_source;
+    std::unique_ptr<DataSourceState> added;
+  };
+
+  CpuReaderThread(const CpuReaderThread&) = delete;
+  CpuReaderThread& operator=(const CpuReaderThread&) = delete;
+
+  void ThreadMain();
+
+  // Applies the requests queued by the main thread. Returns false if the
+  // thread has to quit.
+  bool ApplyRequests(std::vector<std::function<void()>>* flush_callbacks);
+
+  // Moves the metadata into |metadata_outbox_|, if requested or |force|d.
+  void PublishMetadata(bool force);
+
+  void UpdateSinks();
+
+  base::TaskRunner* const task_runner_;
+  const std::vector<CpuReader*> cpu_readers_;
+  const size_t parsing_buf_size_pages_;
+  const size_t max_pages_per_cycle_;
+  const uint32_t drain_period_ms_;
+  const bool pin_to_cpus_;
+  base::PagedMemory parsing_mem_;
+  base::EventFd wakeup_event_;
+
+  // Only accessed by the thread.
+  std::vector<std::unique_ptr<DataSourceState>> data_sources_;
+  std::vector<CpuReader::Sink> sinks_;
+  std::unique_ptr<FtraceClockSnapshot> ftrace_clock_snapshot_;
+
+  // Guarded by |mutex_|, which is never held while reading.
+  std::mutex mutex_;
+  bool quit_ = false;
+  std::function<void()> quit_callback_;
+  std::vector<DataSourceRequest> data_source_requests_;
+  std::unique_ptr<FtraceClockSnapshot> pending_ftrace_clock_snapshot_;
+  std::vector<FtraceDataSource*> incremental_state_clears_;
+  std::vector<std::function<void()>> flush_callbacks_;
+  bool metadata_requested_ = false;
+  MetadataList metadata_outbox_;
+
+  std::thread thread_;  // Keep last, the thread uses all the above.
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_CPU_READER_THREAD_H_
@@ -16,20 +16,31 @@
 
 #include "src/traced/probes/ftrace/cpu_reader.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <unistd.h>
+
+#include <thread>
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/protozero/scattered_stream_writer.h"
+#include "src/base/test/test_task_runner.h"
+#include "src/traced/probes/ftrace/cpu_reader_thread.h"
 #include "src/traced/probes/ftrace/event_info.h"
 #include "src/traced/probes/ftrace/ftrace_config_muxer.h"
+#include "src/traced/probes/ftrace/ftrace_controller.h"
+#include "src/traced/probes/ftrace/ftrace_data_source.h"
 #include "src/traced/probes/ftrace/ftrace_procfs.h"
 #include "src/traced/probes/ftrace/proto_translation_table.h"
 #include "src/traced/probes/ftrace/test/cpu_reader_support.h"
+#include "src/tracing/core/shared_memory_arbiter_impl.h"
 #include "src/tracing/core/trace_writer_for_testing.h"
+#include "src/tracing/test/fake_producer_endpoint.h"
+#include "src/tracing/test/test_shared_memory.h"
 #include "test/gtest_and_gmock.h"
 
 #include "protos/perfetto/trace/ftrace/ftrace.gen.h"
@@ -1186,6 +1197,71 @@ TEST(CpuReaderTest, TaskRenameEvent) {
   EXPECT_THAT(metadata.pids, Contains(9999));
 }
 
+// The generated parsers must produce the same output as parsing the fields one
+// by one, for all the events and kernels they get attached to.
+TEST(CpuReaderTest, EventParsersMatchParseField) {
+  const char* kDevices[] = {
+      "android_flounder_lte_LRX16F_3.10.40",
+      "android_hammerhead_MRA59G_3.4.0",
+      "android_seed_N2F62_3.10.49",
+      "android_walleye_OPM5.171019.017.A1_4.4.88",
+      "synthetic",
+  };
+  size_t num_parsers = 0;
+  for (const char* device : kDevices) {
+    ProtoTranslationTable* table = GetTable(device);
+    ASSERT_TRUE(table);
+    for (const Event& event : table->events()) {
+      EventParserFn parse = table->GetEventParser(event.ftrace_event_id);
+      if (!parse)
+        continue;
+      num_parsers++;
+
+      // Fill the fixed size part of the record with arbitrary non-zero bytes
+      // and point every __data_loc field to the 8 bytes that follow it.
+      constexpr uint16_t kDataLocLen = 8;
+      std::vector<uint8_t> record(event.size + kDataLocLen + 1u);
+      for (size_t i = 0; i < record.size(); i++)
+        record[i] = static_cast<uint8_t>(i * 7 + 1);
+      record.back() = '\0';
+      for (const Field& field : event.fields) {
+        if (field.strategy == kDataLocToString) {
+          uint32_t data_loc = event.size | (kDataLocLen << 16);
+          memcpy(&record[field.ftrace_offset], &data_loc, sizeof(data_loc));
+        } else if (field.strategy == kStringPtrToString) {
+          memset(&record[field.ftrace_offset], 0, field.ftrace_size);
+        }
+      }
+      const uint8_t* start = record.data();
+      const uint8_t* end = start + record.size();
+
+      protozero::HeapBuffered<protozero::Message> expected;
+      FtraceMetadata expected_metadata{};
+      expected_metadata.last_seen_common_pid = 1;
+      for (const Field& field : event.fields) {
+        ASSERT_TRUE(CpuReader::ParseField(field, start, end, table,
+                                          expected.get(), &expected_metadata));
+      }
+
+      protozero::HeapBuffered<protozero::Message> actual;
+      FtraceMetadata actual_metadata{};
+      actual_metadata.last_seen_common_pid = 1;
+      ASSERT_TRUE(parse(start, end, event.fields.data(), table, actual.get(),
+                        &actual_metadata));
+
+      EXPECT_EQ(actual.SerializeAsString(), expected.SerializeAsString())
+          << device << " " << event.group << "/" << event.name;
+      EXPECT_THAT(actual_metadata.pids,
+                  ElementsAreArray(expected_metadata.pids));
+      EXPECT_THAT(actual_metadata.inode_and_device,
+                  ElementsAreArray(expected_metadata.inode_and_device));
+      EXPECT_THAT(actual_metadata.kernel_addrs,
+                  ElementsAreArray(expected_metadata.kernel_addrs));
+    }
+  }
+  EXPECT_GT(num_parsers, 0u);
+}
+
 // Regression test for b/205763418: Kernels without f0a515780393("tracing: Don't
 // make assumptions about length of string on task rename") can output non
 // zero-terminated strings in some cases. Even though it's a kernel bug, there's
@@ -1291,6 +1367,90 @@ TEST(CpuReaderTest, NewPacketOnLostEvents) {
   EXPECT_EQ(4u, packets[2].ftrace_events().event().size());
 }
 
+TEST(CpuReaderTest, RawPages) {
+  auto page_ok = PageFromXxd(g_switch_page);
+  auto page_loss = PageFromXxd(g_switch_page_lost_events);
+
+  std::vector<const void*> test_page_order = {page_ok.get(), page_loss.get(),
+                                              page_ok.get()};
+  static constexpr size_t kTestPages = 3;
+
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[base::kPageSize * kTestPages]());
+  for (size_t i = 0; i < kTestPages; i++) {
+    void* dest = buf.get() + (i * base::kPageSize);
+    memcpy(dest, static_cast<const void*>(test_page_order[i]), base::kPageSize);
+  }
+
+  ProtoTranslationTable* table = GetTable("synthetic");
+  FtraceMetadata metadata{};
+  FtraceDataSourceConfig ds_config{EventFilter{},
+                                   DisabledCompactSchedConfigForTesting(),
+                                   {},
+                                   {},
+                                   false /*symbolize_ksyms*/,
+                                   true /*raw_pages*/};
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+
+  TraceWriterForTesting trace_writer;
+  for (int i = 0; i < 4; i++) {
+    // The formats are incremental state: after the first batch, they are
+    // written again only when cleared or when they are old enough.
+    if (i == 2)
+      metadata.raw_formats_written_ns = 0;
+    if (i == 3)
+      metadata.raw_formats_written_ns = 1;
+    CpuReader::ProcessPagesForDataSource(
+        &trace_writer, &metadata, /*cpu=*/1, &ds_config, buf.get(), kTestPages,
+        table, /*symbolizer=*/nullptr, /*ftrace_clock_snapshot=*/nullptr,
+        protos::pbzero::FTRACE_CLOCK_UNSPECIFIED);
+  }
+
+  // One packet per batch of pages, with the pages copied as they are, up to
+  // the end of their data.
+  auto packets = trace_writer.GetAllTracePackets();
+  ASSERT_EQ(4u, packets.size());
+  EXPECT_EQ(static_cast<uint32_t>(
+                protos::gen::TracePacket::SEQ_INCREMENTAL_STATE_CLEARED),
+            packets[0].sequence_flags());
+  const auto& bundle = packets[0].ftrace_events();
+  EXPECT_EQ(1u, bundle.cpu());
+  EXPECT_EQ(0u, bundle.event().size());
+  ASSERT_EQ(3u, bundle.raw_page().size());
+  for (size_t i = 0; i < kTestPages; i++) {
+    const std::string& page = bundle.raw_page()[i];
+    ASSERT_GT(page.size(), 16u);
+    ASSERT_LE(page.size(), base::kPageSize);
+    EXPECT_EQ(0, memcmp(page.data(), test_page_order[i], page.size()));
+  }
+
+  ASSERT_TRUE(bundle.has_raw_formats());
+  const auto& formats = bundle.raw_formats();
+  EXPECT_EQ(table->page_header_size_len(), formats.page_header_size_len());
+  EXPECT_FALSE(formats.common_field().empty());
+  ASSERT_EQ(1u, formats.event().size());
+  EXPECT_EQ(table->EventToFtraceId(GroupAndName("sched", "sched_switch")),
+            formats.event()[0].ftrace_id());
+  EXPECT_EQ(static_cast<uint32_t>(
+                protos::pbzero::FtraceEvent::kSchedSwitchFieldNumber),
+            formats.event()[0].proto_field_id());
+  EXPECT_FALSE(formats.event()[0].field().empty());
+
+  EXPECT_EQ(3u, packets[1].ftrace_events().raw_page().size());
+  EXPECT_FALSE(packets[1].ftrace_events().has_raw_formats());
+  EXPECT_EQ(static_cast<uint32_t>(
+                protos::gen::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE),
+            packets[1].sequence_flags());
+
+  for (size_t i = 2; i < packets.size(); i++) {
+    EXPECT_EQ(3u, packets[i].ftrace_events().raw_page().size());
+    EXPECT_TRUE(packets[i].ftrace_events().has_raw_formats());
+    EXPECT_EQ(static_cast<uint32_t>(
+                  protos::gen::TracePacket::SEQ_INCREMENTAL_STATE_CLEARED),
+              packets[i].sequence_flags());
+  }
+}
+
 // Page containing an absolute timestamp (RINGBUF_TYPE_TIME_STAMP).
 static char g_abs_timestamp[] =
     R"(
@@ -1995,6 +2155,123 @@ TEST(CpuReaderTest, ParseFullPageSchedSwitch) {
   EXPECT_EQ(bundle->event().size(), 59u);
 }
 
+namespace {
+
+// Frees the chunks as soon as they are committed, like the service does once
+// it has copied them into the trace buffer.
+class ChunkReleasingProducerEndpoint : public FakeProducerEndpoint {
+ public:
+  void CommitData(const CommitDataRequest& req,
+                  CommitDataCallback callback) override {
+    for (const auto& chunk : req.chunks_to_move()) {
+      SharedMemoryABI::Chunk read_chunk =
+          shmem_abi->TryAcquireChunkForReading(chunk.page(), chunk.chunk());
+      if (!read_chunk.is_valid())
+        continue;
+      chunks_committed++;
+      shmem_abi->ReleaseChunkAsFree(std::move(read_chunk));
+    }
+    if (callback)
+      callback();
+  }
+
+  SharedMemoryABI* shmem_abi = nullptr;
+  size_t chunks_committed = 0;
+};
+
+}  // namespace
+
+// Runs a reader thread against a shared memory buffer much smaller than the
+// data it parses, so its writers keep stalling until the main thread commits
+// their chunks. The main thread meanwhile keeps changing the data sources and
+// collecting the metadata, like FtraceController does, without ever waiting
+// for the thread.
+TEST(CpuReaderThreadTest, SmallSharedMemoryBuffer) {
+  const ExamplePage* test_case = &g_full_page_sched_switch;
+  ProtoTranslationTable* table = GetTable(test_case->name);
+  auto page = PageFromXxd(test_case->data);
+  const size_t kNumPages = 512;
+  const size_t kSmbPages = 4;
+
+  // The pages go through a pipe, like trace_pipe_raw.
+  int pipe_fds[2];
+  ASSERT_EQ(pipe(pipe_fds), 0);
+  base::ScopedFile read_fd(pipe_fds[0]);
+  base::ScopedFile write_fd(pipe_fds[1]);
+  ASSERT_EQ(fcntl(*read_fd, F_SETFL, O_NONBLOCK), 0);
+  CpuReader cpu_reader(0, table, /*symbolizer=*/nullptr,
+                       /*ftrace_clock_snapshot=*/nullptr, std::move(read_fd));
+
+  base::TestTaskRunner task_runner;
+  ChunkReleasingProducerEndpoint endpoint;
+  TestSharedMemory smb(kSmbPages * base::kPageSize);
+  SharedMemoryArbiterImpl arbiter(smb.start(), smb.size(), base::kPageSize,
+                                  &endpoint, &task_runner);
+  endpoint.shmem_abi = arbiter.shmem_abi_for_testing();
+
+  FtraceDataSourceConfig ds_config = EmptyConfig();
+  ds_config.event_filter.AddEnabledEvent(
+      table->EventToFtraceId(GroupAndName("sched", "sched_switch")));
+  FtraceDataSource data_source(base::WeakPtr<FtraceController>(), 0,
+                               FtraceConfig(), nullptr);
+  FtraceDataSource data_source2(base::WeakPtr<FtraceController>(), 0,
+                                FtraceConfig(), nullptr);
+
+  std::unique_ptr<CpuReaderThread> thread(new CpuReaderThread(
+      &task_runner, {&cpu_reader}, /*parsing_buf_size_pages=*/4,
+      /*max_pages_per_cycle=*/64, /*drain_period_ms=*/1,
+      /*pin_to_cpus=*/false));
+  thread->AddDataSource(&data_source, ds_config, arbiter.CreateTraceWriter(1));
+  thread->AddDataSource(&data_source2, ds_config,
+                        arbiter.CreateTraceWriter(2));
+
+  size_t num_pids = 0;
+  size_t num_ticks = 0;
+  bool done = false;
+  std::function<void()> tick;
+  tick = [&] {
+    for (const auto& ds_and_metadata : thread->TakeMetadata()) {
+      EXPECT_TRUE(ds_and_metadata.first == &data_source || num_ticks < 10);
+      num_pids += ds_and_metadata.second->pids.size();
+    }
+    if (++num_ticks == 10)
+      thread->RemoveDataSource(&data_source2);
+    FtraceClockSnapshot snapshot;
+    snapshot.ftrace_clock_ts = static_cast<int64_t>(num_ticks);
+    thread->SetFtraceClockSnapshot(snapshot);
+    if (!done)
+      task_runner.PostDelayedTask(tick, 1);
+  };
+  task_runner.PostTask(tick);
+
+  auto all_written = task_runner.CreateCheckpoint("all_written");
+  std::thread feeder([&] {
+    for (size_t i = 0; i < kNumPages; i++) {
+      PERFETTO_CHECK(PERFETTO_EINTR(write(*write_fd, page.get(),
+                                          base::kPageSize)) ==
+                     static_cast<ssize_t>(base::kPageSize));
+    }
+    task_runner.PostTask(all_written);
+  });
+  task_runner.RunUntilCheckpoint("all_written", 30000);
+  feeder.join();
+
+  thread->Flush(task_runner.CreateCheckpoint("flushed"));
+  task_runner.RunUntilCheckpoint("flushed");
+  done = true;
+
+  EXPECT_EQ(cpu_reader.drain_stats().pages.load(), kNumPages);
+  // The data went through the buffer several times over.
+  EXPECT_GT(endpoint.chunks_committed, 10 * kSmbPages);
+  for (const auto& ds_and_metadata : thread->TakeMetadata())
+    num_pids += ds_and_metadata.second->pids.size();
+  EXPECT_GT(num_pids, 0u);
+
+  thread->Quit(task_runner.CreateCheckpoint("quit"));
+  task_runner.RunUntilCheckpoint("quit");
+  thread.reset();
+}
+
 // clang-format off
 // # tracer: nop
 // #
@@ -0,0 +1,690 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Autogenerated by:
+// ../../tools/ftrace_proto_gen/ftrace_parser_gen.cc
+// Do not edit.
+
+#include "src/traced/probes/ftrace/event_parsers.h"
+
+#include "perfetto/protozero/message.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+
+namespace perfetto {
+namespace {
+
+constexpr EventParserField kSchedSwitchFields[] = {
+    {1, kFixedCStringToString},
+    {2, kPid32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt64ToInt64},
+    {5, kFixedCStringToString},
+    {6, kPid32ToInt32},
+    {7, kInt32ToInt32},
+};
+
+bool ParseSchedSwitch(const uint8_t* start,
+                      const uint8_t*,
+                      const Field* fields,
+                      const ProtoTranslationTable*,
+                      protozero::Message* message,
+                      FtraceMetadata* metadata) {
+  CpuReader::ReadIntoString(start + fields[0].ftrace_offset,
+                            fields[0].ftrace_size, 1, message);
+  CpuReader::ReadPid(start + fields[1].ftrace_offset, 2, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int64_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoString(start + fields[4].ftrace_offset,
+                            fields[4].ftrace_size, 5, message);
+  CpuReader::ReadPid(start + fields[5].ftrace_offset, 6, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[6].ftrace_offset, 7,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kSchedSwitch2Fields[] = {
+    {1, kFixedCStringToString},
+    {2, kPid32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt32ToInt64},
+    {5, kFixedCStringToString},
+    {6, kPid32ToInt32},
+    {7, kInt32ToInt32},
+};
+
+bool ParseSchedSwitch2(const uint8_t* start,
+                       const uint8_t*,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata* metadata) {
+  CpuReader::ReadIntoString(start + fields[0].ftrace_offset,
+                            fields[0].ftrace_size, 1, message);
+  CpuReader::ReadPid(start + fields[1].ftrace_offset, 2, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoString(start + fields[4].ftrace_offset,
+                            fields[4].ftrace_size, 5, message);
+  CpuReader::ReadPid(start + fields[5].ftrace_offset, 6, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[6].ftrace_offset, 7,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kSchedWakingFields[] = {
+    {1, kFixedCStringToString},
+    {2, kPid32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt32ToInt32},
+    {5, kInt32ToInt32},
+};
+
+bool ParseSchedWaking(const uint8_t* start,
+                      const uint8_t*,
+                      const Field* fields,
+                      const ProtoTranslationTable*,
+                      protozero::Message* message,
+                      FtraceMetadata* metadata) {
+  CpuReader::ReadIntoString(start + fields[0].ftrace_offset,
+                            fields[0].ftrace_size, 1, message);
+  CpuReader::ReadPid(start + fields[1].ftrace_offset, 2, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kSchedWakeupFields[] = {
+    {1, kFixedCStringToString},
+    {2, kPid32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt32ToInt32},
+    {5, kInt32ToInt32},
+};
+
+bool ParseSchedWakeup(const uint8_t* start,
+                      const uint8_t*,
+                      const Field* fields,
+                      const ProtoTranslationTable*,
+                      protozero::Message* message,
+                      FtraceMetadata* metadata) {
+  CpuReader::ReadIntoString(start + fields[0].ftrace_offset,
+                            fields[0].ftrace_size, 1, message);
+  CpuReader::ReadPid(start + fields[1].ftrace_offset, 2, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kSchedWakeupNewFields[] = {
+    {1, kFixedCStringToString},
+    {2, kPid32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt32ToInt32},
+    {5, kInt32ToInt32},
+};
+
+bool ParseSchedWakeupNew(const uint8_t* start,
+                         const uint8_t*,
+                         const Field* fields,
+                         const ProtoTranslationTable*,
+                         protozero::Message* message,
+                         FtraceMetadata* metadata) {
+  CpuReader::ReadIntoString(start + fields[0].ftrace_offset,
+                            fields[0].ftrace_size, 1, message);
+  CpuReader::ReadPid(start + fields[1].ftrace_offset, 2, message, metadata);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kCpuFrequencyFields[] = {
+    {1, kUint32ToUint32},
+    {2, kUint32ToUint32},
+};
+
+bool ParseCpuFrequency(const uint8_t* start,
+                       const uint8_t*,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[1].ftrace_offset, 2,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kCpuIdleFields[] = {
+    {1, kUint32ToUint32},
+    {2, kUint32ToUint32},
+};
+
+bool ParseCpuIdle(const uint8_t* start,
+                  const uint8_t*,
+                  const Field* fields,
+                  const ProtoTranslationTable*,
+                  protozero::Message* message,
+                  FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[1].ftrace_offset, 2,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kIrqHandlerEntryFields[] = {
+    {1, kInt32ToInt32},
+    {2, kDataLocToString},
+};
+
+bool ParseIrqHandlerEntry(const uint8_t* start,
+                          const uint8_t* end,
+                          const Field* fields,
+                          const ProtoTranslationTable*,
+                          protozero::Message* message,
+                          FtraceMetadata*) {
+  bool success = true;
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  success &= CpuReader::ReadDataLoc(start, start + fields[1].ftrace_offset, end,
+                                    fields[1], message);
+  return success;
+}
+
+constexpr EventParserField kIrqHandlerEntry2Fields[] = {
+    {1, kInt32ToInt32},
+    {2, kDataLocToString},
+    {3, kUint32ToUint32},
+};
+
+bool ParseIrqHandlerEntry2(const uint8_t* start,
+                           const uint8_t* end,
+                           const Field* fields,
+                           const ProtoTranslationTable*,
+                           protozero::Message* message,
+                           FtraceMetadata*) {
+  bool success = true;
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  success &= CpuReader::ReadDataLoc(start, start + fields[1].ftrace_offset, end,
+                                    fields[1], message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  return success;
+}
+
+constexpr EventParserField kIrqHandlerExitFields[] = {
+    {1, kInt32ToInt32},
+    {2, kInt32ToInt32},
+};
+
+bool ParseIrqHandlerExit(const uint8_t* start,
+                         const uint8_t*,
+                         const Field* fields,
+                         const ProtoTranslationTable*,
+                         protozero::Message* message,
+                         FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[1].ftrace_offset, 2,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kSoftirqEntryFields[] = {
+    {1, kUint32ToUint32},
+};
+
+bool ParseSoftirqEntry(const uint8_t* start,
+                       const uint8_t*,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kSoftirqExitFields[] = {
+    {1, kUint32ToUint32},
+};
+
+bool ParseSoftirqExit(const uint8_t* start,
+                      const uint8_t*,
+                      const Field* fields,
+                      const ProtoTranslationTable*,
+                      protozero::Message* message,
+                      FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kSoftirqRaiseFields[] = {
+    {1, kUint32ToUint32},
+};
+
+bool ParseSoftirqRaise(const uint8_t* start,
+                       const uint8_t*,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kBlockRqIssueFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kUint64ToUint64},
+    {3, kUint32ToUint32},
+    {4, kUint32ToUint32},
+    {5, kFixedCStringToString},
+    {6, kFixedCStringToString},
+    {7, kDataLocToString},
+};
+
+bool ParseBlockRqIssue(const uint8_t* start,
+                       const uint8_t* end,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata* metadata) {
+  bool success = true;
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[1].ftrace_offset, 2,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoString(start + fields[4].ftrace_offset,
+                            fields[4].ftrace_size, 5, message);
+  CpuReader::ReadIntoString(start + fields[5].ftrace_offset,
+                            fields[5].ftrace_size, 6, message);
+  success &= CpuReader::ReadDataLoc(start, start + fields[6].ftrace_offset, end,
+                                    fields[6], message);
+  return success;
+}
+
+constexpr EventParserField kBlockRqCompleteFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kUint64ToUint64},
+    {3, kUint32ToUint32},
+    {4, kInt32ToInt32},
+    {5, kFixedCStringToString},
+    {6, kDataLocToString},
+};
+
+bool ParseBlockRqComplete(const uint8_t* start,
+                          const uint8_t* end,
+                          const Field* fields,
+                          const ProtoTranslationTable*,
+                          protozero::Message* message,
+                          FtraceMetadata* metadata) {
+  bool success = true;
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[1].ftrace_offset, 2,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoString(start + fields[4].ftrace_offset,
+                            fields[4].ftrace_size, 5, message);
+  success &= CpuReader::ReadDataLoc(start, start + fields[5].ftrace_offset, end,
+                                    fields[5], message);
+  return success;
+}
+
+constexpr EventParserField kBlockRqInsertFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kUint64ToUint64},
+    {3, kUint32ToUint32},
+    {4, kUint32ToUint32},
+    {5, kFixedCStringToString},
+    {6, kFixedCStringToString},
+    {7, kDataLocToString},
+};
+
+bool ParseBlockRqInsert(const uint8_t* start,
+                        const uint8_t* end,
+                        const Field* fields,
+                        const ProtoTranslationTable*,
+                        protozero::Message* message,
+                        FtraceMetadata* metadata) {
+  bool success = true;
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[1].ftrace_offset, 2,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoString(start + fields[4].ftrace_offset,
+                            fields[4].ftrace_size, 5, message);
+  CpuReader::ReadIntoString(start + fields[5].ftrace_offset,
+                            fields[5].ftrace_size, 6, message);
+  success &= CpuReader::ReadDataLoc(start, start + fields[6].ftrace_offset, end,
+                                    fields[6], message);
+  return success;
+}
+
+constexpr EventParserField kF2fsSyncFileEnterFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kInode64ToUint64},
+    {3, kInode64ToUint64},
+    {4, kUint16ToUint32},
+    {5, kInt64ToInt64},
+    {6, kUint32ToUint32},
+    {7, kUint64ToUint64},
+    {8, kUint8ToUint32},
+};
+
+bool ParseF2fsSyncFileEnter(const uint8_t* start,
+                            const uint8_t*,
+                            const Field* fields,
+                            const ProtoTranslationTable*,
+                            protozero::Message* message,
+                            FtraceMetadata* metadata) {
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadInode<uint64_t>(start + fields[1].ftrace_offset, 2, message,
+                                 metadata);
+  CpuReader::ReadInode<uint64_t>(start + fields[2].ftrace_offset, 3, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<uint16_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoVarInt<int64_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[5].ftrace_offset, 6,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[6].ftrace_offset, 7,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint8_t>(start + fields[7].ftrace_offset, 8,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kF2fsSyncFileExitFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kInode64ToUint64},
+    {3, kBoolToUint32},
+    {4, kInt32ToInt32},
+    {5, kInt32ToInt32},
+};
+
+bool ParseF2fsSyncFileExit(const uint8_t* start,
+                           const uint8_t*,
+                           const Field* fields,
+                           const ProtoTranslationTable*,
+                           protozero::Message* message,
+                           FtraceMetadata* metadata) {
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadInode<uint64_t>(start + fields[1].ftrace_offset, 2, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<uint8_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kF2fsWriteBeginFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kInode64ToUint64},
+    {3, kInt64ToInt64},
+    {4, kUint32ToUint32},
+    {5, kUint32ToUint32},
+};
+
+bool ParseF2fsWriteBegin(const uint8_t* start,
+                         const uint8_t*,
+                         const Field* fields,
+                         const ProtoTranslationTable*,
+                         protozero::Message* message,
+                         FtraceMetadata* metadata) {
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadInode<uint64_t>(start + fields[1].ftrace_offset, 2, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<int64_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[4].ftrace_offset, 5,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kF2fsWriteEndFields[] = {
+    {1, kDevId32ToUint64},
+    {2, kInode64ToUint64},
+    {3, kInt64ToInt64},
+    {4, kUint32ToUint32},
+    {5, kUint32ToUint32},
+};
+
+bool ParseF2fsWriteEnd(const uint8_t* start,
+                       const uint8_t*,
+                       const Field* fields,
+                       const ProtoTranslationTable*,
+                       protozero::Message* message,
+                       FtraceMetadata* metadata) {
+  CpuReader::ReadDevId<uint32_t>(start + fields[0].ftrace_offset, 1, message,
+                                 metadata);
+  CpuReader::ReadInode<uint64_t>(start + fields[1].ftrace_offset, 2, message,
+                                 metadata);
+  CpuReader::ReadIntoVarInt<int64_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[4].ftrace_offset, 5,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kBinderTransactionFields[] = {
+    {1, kInt32ToInt32},
+    {2, kInt32ToInt32},
+    {3, kInt32ToInt32},
+    {4, kInt32ToInt32},
+    {5, kInt32ToInt32},
+    {6, kUint32ToUint32},
+    {7, kUint32ToUint32},
+};
+
+bool ParseBinderTransaction(const uint8_t* start,
+                            const uint8_t*,
+                            const Field* fields,
+                            const ProtoTranslationTable*,
+                            protozero::Message* message,
+                            FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[1].ftrace_offset, 2,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[2].ftrace_offset, 3,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[3].ftrace_offset, 4,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[4].ftrace_offset, 5,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[5].ftrace_offset, 6,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[6].ftrace_offset, 7,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kBinderTransactionReceivedFields[] = {
+    {1, kInt32ToInt32},
+};
+
+bool ParseBinderTransactionReceived(const uint8_t* start,
+                                    const uint8_t*,
+                                    const Field* fields,
+                                    const ProtoTranslationTable*,
+                                    protozero::Message* message,
+                                    FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  return true;
+}
+
+constexpr EventParserField kBinderTransactionAllocBufFields[] = {
+    {1, kUint64ToUint64},
+    {2, kInt32ToInt32},
+    {3, kUint64ToUint64},
+};
+
+bool ParseBinderTransactionAllocBuf(const uint8_t* start,
+                                    const uint8_t*,
+                                    const Field* fields,
+                                    const ProtoTranslationTable*,
+                                    protozero::Message* message,
+                                    FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[1].ftrace_offset, 2,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint64_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kBinderTransactionAllocBuf2Fields[] = {
+    {1, kUint32ToUint64},
+    {2, kInt32ToInt32},
+    {3, kUint32ToUint64},
+};
+
+bool ParseBinderTransactionAllocBuf2(const uint8_t* start,
+                                     const uint8_t*,
+                                     const Field* fields,
+                                     const ProtoTranslationTable*,
+                                     protozero::Message* message,
+                                     FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[0].ftrace_offset, 1,
+                                      message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[1].ftrace_offset, 2,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  return true;
+}
+
+constexpr EventParserField kBinderSetPriorityFields[] = {
+    {1, kInt32ToInt32},
+    {2, kInt32ToInt32},
+    {3, kUint32ToUint32},
+    {4, kUint32ToUint32},
+    {5, kUint32ToUint32},
+};
+
+bool ParseBinderSetPriority(const uint8_t* start,
+                            const uint8_t*,
+                            const Field* fields,
+                            const ProtoTranslationTable*,
+                            protozero::Message* message,
+                            FtraceMetadata*) {
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[0].ftrace_offset, 1,
+                                     message);
+  CpuReader::ReadIntoVarInt<int32_t>(start + fields[1].ftrace_offset, 2,
+                                     message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[2].ftrace_offset, 3,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[3].ftrace_offset, 4,
+                                      message);
+  CpuReader::ReadIntoVarInt<uint32_t>(start + fields[4].ftrace_offset, 5,
+                                      message);
+  return true;
+}
+
+}  // namespace
+
+std::vector<EventParser> GetEventParsers() {
+  return {
+      {"sched", "sched_switch", kSchedSwitchFields, 7, &ParseSchedSwitch},
+      {"sched", "sched_switch", kSchedSwitch2Fields, 7, &ParseSchedSwitch2},
+      {"sched", "sched_waking", kSchedWakingFields, 5, &ParseSchedWaking},
+      {"sched", "sched_wakeup", kSchedWakeupFields, 5, &ParseSchedWakeup},
+      {"sched", "sched_wakeup_new", kSchedWakeupNewFields, 5,
+       &ParseSchedWakeupNew},
+      {"power", "cpu_frequency", kCpuFrequencyFields, 2, &ParseCpuFrequency},
+      {"power", "cpu_idle", kCpuIdleFields, 2, &ParseCpuIdle},
+      {"irq", "irq_handler_entry", kIrqHandlerEntryFields, 2,
+       &ParseIrqHandlerEntry},
+      {"irq", "irq_handler_entry", kIrqHandlerEntry2Fields, 3,
+       &ParseIrqHandlerEntry2},
+      {"irq", "irq_handler_exit", kIrqHandlerExitFields, 2,
+       &ParseIrqHandlerExit},
+      {"irq", "softirq_entry", kSoftirqEntryFields, 1, &ParseSoftirqEntry},
+      {"irq", "softirq_exit", kSoftirqExitFields, 1, &ParseSoftirqExit},
+      {"irq", "softirq_raise", kSoftirqRaiseFields, 1, &ParseSoftirqRaise},
+      {"block", "block_rq_issue", kBlockRqIssueFields, 7, &ParseBlockRqIssue},
+      {"block", "block_rq_complete", kBlockRqCompleteFields, 6,
+       &ParseBlockRqComplete},
+      {"block", "block_rq_insert", kBlockRqInsertFields, 7,
+       &ParseBlockRqInsert},
+      {"f2fs", "f2fs_sync_file_enter", kF2fsSyncFileEnterFields, 8,
+       &ParseF2fsSyncFileEnter},
+      {"f2fs", "f2fs_sync_file_exit", kF2fsSyncFileExitFields, 5,
+       &ParseF2fsSyncFileExit},
+      {"f2fs", "f2fs_write_begin", kF2fsWriteBeginFields, 5,
+       &ParseF2fsWriteBegin},
+      {"f2fs", "f2fs_write_end", kF2fsWriteEndFields, 5, &ParseF2fsWriteEnd},
+      {"binder", "binder_transaction", kBinderTransactionFields, 7,
+       &ParseBinderTransaction},
+      {"binder", "binder_transaction_received",
+       kBinderTransactionReceivedFields, 1, &ParseBinderTransactionReceived},
+      {"binder", "binder_transaction_alloc_buf",
+       kBinderTransactionAllocBufFields, 3, &ParseBinderTransactionAllocBuf},
+      {"binder", "binder_transaction_alloc_buf",
+       kBinderTransactionAllocBuf2Fields, 3, &ParseBinderTransactionAllocBuf2},
+      {"binder", "binder_set_priority", kBinderSetPriorityFields, 5,
+       &ParseBinderSetPriority},
+  };
+}
+
+}  // namespace perfetto
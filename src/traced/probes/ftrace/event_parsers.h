@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_FTRACE_EVENT_PARSERS_H_
+#define SRC_TRACED_PROBES_FTRACE_EVENT_PARSERS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/traced/probes/ftrace/event_info_constants.h"
+
+namespace protozero {
+class Message;
+}  // namespace protozero
+
+namespace perfetto {
+
+struct FtraceMetadata;
+class ProtoTranslationTable;
+
+// Parses the fields of one event record, from |start| to |end|, into
+// |message|. |fields| are the fields of the event in the translation table,
+// only their (kernel dependent) offsets and sizes are read. Returns false if
+// the record is malformed.
+using EventParserFn = bool (*)(const uint8_t* start,
+                               const uint8_t* end,
+                               const Field* fields,
+                               const ProtoTranslationTable* table,
+                               protozero::Message* message,
+                               FtraceMetadata* metadata);
+
+struct EventParserField {
+  uint32_t proto_field_id;
+  TranslationStrategy strategy;
+};
+
+// A parser specialized for one layout of an event, with the proto field ids
+// and the translation strategies of its fields resolved at compile time. This
+// saves the per-field switch of CpuReader::ParseField() for the most frequent
+// events. The parser is only used if the fields of the event, as parsed from
+// the format file of the running kernel, match |fields| exactly.
+struct EventParser {
+  const char* group;
+  const char* name;
+  const EventParserField* fields;
+  size_t num_fields;
+  EventParserFn parse;
+};
+
+// Generated by tools/ftrace_proto_gen/ftrace_parser_gen.cc, from the formats
+// in src/traced/probes/ftrace/test/data, for the events listed in
+// tools/ftrace_proto_gen/parser_event_list. An event can have more than one
+// parser, one for each layout seen across those kernels.
+std::vector<EventParser> GetEventParsers();
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_FTRACE_EVENT_PARSERS_H_
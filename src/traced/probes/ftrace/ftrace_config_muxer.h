@@ -41,12 +41,14 @@ struct FtraceDataSourceConfig {
                          CompactSchedConfig _compact_sched,
                          std::vector<std::string> _atrace_apps,
                          std::vector<std::string> _atrace_categories,
-                         bool _symbolize_ksyms)
+                         bool _symbolize_ksyms,
+                         bool _raw_pages = false)
       : event_filter(std::move(_event_filter)),
         compact_sched(_compact_sched),
         atrace_apps(std::move(_atrace_apps)),
         atrace_categories(std::move(_atrace_categories)),
-        symbolize_ksyms(_symbolize_ksyms) {}
+        symbolize_ksyms(_symbolize_ksyms),
+        raw_pages(_raw_pages) {}
 
   // The event filter allows to quickly check if a certain ftrace event with id
   // x is enabled for this data source.
@@ -61,6 +63,10 @@ struct FtraceDataSourceConfig {
 
   // When enabled will turn on the kallsyms symbolizer in CpuReader.
   const bool symbolize_ksyms;
+
+  // When enabled CpuReader copies the pages verbatim instead of parsing them.
+  // See FtraceConfig.raw_pages.
+  const bool raw_pages;
 };
 
 // Ftrace is a bunch of globally modifiable persistent state.
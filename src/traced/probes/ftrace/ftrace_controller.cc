@@ -24,6 +24,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <string>
 #include <utility>
@@ -39,6 +40,7 @@
 #include "src/kallsyms/lazy_kernel_symbolizer.h"
 #include "src/traced/probes/ftrace/atrace_hal_wrapper.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/cpu_reader_thread.h"
 #include "src/traced/probes/ftrace/cpu_stats_parser.h"
 #include "src/traced/probes/ftrace/discover_vendor_tracepoints.h"
 #include "src/traced/probes/ftrace/event_info.h"
@@ -112,6 +114,27 @@ base::Optional<int64_t> ReadFtraceNowTs(const base::ScopedFile& cpu_stats_fd) {
   return static_cast<int64_t>(stats.now_ts * 1000 * 1000 * 1000);
 }
 
+std::vector<CpuReader::Sink> GetSinks(
+    const std::set<FtraceDataSource*>& data_sources) {
+  std::vector<CpuReader::Sink> sinks;
+  sinks.reserve(data_sources.size());
+  for (FtraceDataSource* data_source : data_sources) {
+    sinks.push_back({data_source->trace_writer(),
+                     data_source->mutable_metadata(),
+                     data_source->parsing_config()});
+  }
+  return sinks;
+}
+
+void MergeMetadata(const FtraceMetadata& src, FtraceMetadata* dst) {
+  for (const auto& inode_and_device : src.inode_and_device)
+    dst->inode_and_device.insert(inode_and_device);
+  for (int32_t pid : src.rename_pids)
+    dst->rename_pids.insert(pid);
+  for (int32_t pid : src.pids)
+    dst->AddPid(pid);
+}
+
 }  // namespace
 
 // Method of last resort to reset ftrace state.
@@ -181,6 +204,10 @@ FtraceController::~FtraceController() {
   data_sources_.clear();
   started_data_sources_.clear();
   StopIfNeeded();
+
+  // This can block on a read cycle in progress, unlike StopIfNeeded().
+  quitting_reader_threads_.clear();
+  quitting_per_cpu_.clear();
 }
 
 uint64_t FtraceController::NowMs() const {
@@ -214,9 +241,14 @@ void FtraceController::StartIfNeeded() {
     auto reader = std::unique_ptr<CpuReader>(new CpuReader(
         cpu, table_.get(), symbolizer_.get(), ftrace_clock_snapshot_.get(),
         ftrace_procfs_->OpenPipeForCpu(cpu)));
+    reader->set_ftrace_clock(clock);
     per_cpu_.emplace_back(std::move(reader), period_page_quota);
   }
 
+  const FtraceConfig& config = (*started_data_sources_.begin())->config();
+  if (config.has_reader_threads())
+    StartReaderThreads(config.reader_threads());
+
   // Start the repeating read tasks.
   auto generation = ++generation_;
   auto drain_period_ms = GetDrainPeriodMs();
@@ -229,6 +261,40 @@ void FtraceController::StartIfNeeded() {
       drain_period_ms - (NowMs() % drain_period_ms));
 }
 
+void FtraceController::StartReaderThreads(
+    const FtraceConfig::ReaderThreadsConfig& config) {
+  PERFETTO_DCHECK(reader_threads_.empty());
+  const size_t cpus_per_thread =
+      std::max(static_cast<size_t>(config.cpus_per_thread()), size_t(1));
+  // A reader thread doesn't compete with other tasks, so it can read as much
+  // as the kernel buffer contains in one go, like Flush() does.
+  const size_t max_pages_per_cycle =
+      ftrace_config_muxer_->GetPerCpuBufferSizePages();
+  for (size_t first = 0; first < per_cpu_.size(); first += cpus_per_thread) {
+    const size_t end = std::min(first + cpus_per_thread, per_cpu_.size());
+    std::vector<CpuReader*> cpu_readers;
+    for (size_t cpu = first; cpu < end; cpu++)
+      cpu_readers.push_back(per_cpu_[cpu].reader.get());
+    reader_threads_.emplace_back(new CpuReaderThread(
+        task_runner_, std::move(cpu_readers), kParsingBufferSizePages,
+        max_pages_per_cycle, GetDrainPeriodMs(), config.pin_to_cpus()));
+    reader_threads_.back()->SetFtraceClockSnapshot(*ftrace_clock_snapshot_);
+  }
+  PERFETTO_LOG("Draining ftrace on %zu reader threads", reader_threads_.size());
+}
+
+void FtraceController::CollectReaderThreadsMetadata() {
+  for (const auto& reader_thread : reader_threads_) {
+    for (const auto& ds_and_metadata : reader_thread->TakeMetadata()) {
+      FtraceDataSource* data_source = ds_and_metadata.first;
+      if (started_data_sources_.count(data_source)) {
+        MergeMetadata(*ds_and_metadata.second,
+                      data_source->mutable_metadata());
+      }
+    }
+  }
+}
+
 // We handle the ftrace buffers in a repeating task (ReadTick). On a given tick,
 // we iterate over all per-cpu buffers, parse their contents, and then write out
 // the serialized packets. This is handled by |CpuReader| instances, which
@@ -252,6 +318,11 @@ void FtraceController::StartIfNeeded() {
 // drain period. Therefore we introduce |per_cpu_.period_page_quota|. If the
 // consumer wants to handle a high bandwidth of ftrace events, they should set
 // the config values appropriately.
+//
+// With FtraceConfig.reader_threads none of the above applies: each
+// CpuReaderThread drains its cpus as soon as their buffers become readable,
+// without quotas. The ReadTick then only hands over the metadata collected by
+// the threads to the data sources and takes the periodic clock snapshot.
 void FtraceController::ReadTick(int generation) {
   metatrace::ScopedEvent evt(metatrace::TAG_FTRACE,
                              metatrace::FTRACE_READ_TICK);
@@ -269,11 +340,17 @@ void FtraceController::ReadTick(int generation) {
   }
 #endif
 
-  // Read all cpu buffers with remaining per-period quota.
+  // Collect the metadata from the reader threads, if any, which are already
+  // reading the cpu buffers on their own.
+  CollectReaderThreadsMetadata();
+
+  // Otherwise read all cpu buffers with remaining per-period quota.
   bool all_cpus_done = true;
   uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
   const auto ftrace_clock = ftrace_config_muxer_->ftrace_clock();
-  for (size_t i = 0; i < per_cpu_.size(); i++) {
+  const std::vector<CpuReader::Sink> sinks = GetSinks(started_data_sources_);
+  const size_t num_cpus_to_read = reader_threads_.empty() ? per_cpu_.size() : 0;
+  for (size_t i = 0; i < num_cpus_to_read; i++) {
     size_t orig_quota = per_cpu_[i].period_page_quota;
     if (orig_quota == 0)
       continue;
@@ -282,7 +359,7 @@ void FtraceController::ReadTick(int generation) {
     CpuReader& cpu_reader = *per_cpu_[i].reader;
     cpu_reader.set_ftrace_clock(ftrace_clock);
     size_t pages_read = cpu_reader.ReadCycle(
-        parsing_buf, kParsingBufferSizePages, max_pages, started_data_sources_);
+        parsing_buf, kParsingBufferSizePages, max_pages, sinks);
 
     size_t new_quota = (pages_read >= orig_quota) ? 0 : orig_quota - pages_read;
     per_cpu_[i].period_page_quota = new_quota;
@@ -360,12 +437,39 @@ void FtraceController::Flush(FlushRequestID flush_id) {
   // events.
   size_t per_cpu_buf_size_pages =
       ftrace_config_muxer_->GetPerCpuBufferSizePages();
+  if (!reader_threads_.empty()) {
+    // The reader threads drain their cpus and flush their writers on their
+    // own. This thread must not wait for them, as it has to commit the chunks
+    // they write. The flush completes once all of them are done.
+    pending_reader_thread_flushes_[flush_id] += reader_threads_.size();
+    auto weak_this = weak_factory_.GetWeakPtr();
+    for (const auto& reader_thread : reader_threads_) {
+      reader_thread->Flush([weak_this, flush_id] {
+        if (weak_this)
+          weak_this->OnReaderThreadFlushed(flush_id);
+      });
+    }
+    return;
+  }
   uint8_t* parsing_buf = reinterpret_cast<uint8_t*>(parsing_mem_.Get());
+  const std::vector<CpuReader::Sink> sinks = GetSinks(started_data_sources_);
   for (size_t i = 0; i < per_cpu_.size(); i++) {
     per_cpu_[i].reader->ReadCycle(parsing_buf, kParsingBufferSizePages,
-                                  per_cpu_buf_size_pages,
-                                  started_data_sources_);
+                                  per_cpu_buf_size_pages, sinks);
   }
+  NotifyFlushComplete(flush_id);
+}
+
+void FtraceController::OnReaderThreadFlushed(FlushRequestID flush_id) {
+  auto it = pending_reader_thread_flushes_.find(flush_id);
+  if (it == pending_reader_thread_flushes_.end() || --it->second > 0)
+    return;
+  pending_reader_thread_flushes_.erase(it);
+  CollectReaderThreadsMetadata();
+  NotifyFlushComplete(flush_id);
+}
+
+void FtraceController::NotifyFlushComplete(FlushRequestID flush_id) {
   observer_->OnFtraceDataWrittenIntoDataSourceBuffers();
 
   for (FtraceDataSource* data_source : started_data_sources_)
@@ -380,8 +484,28 @@ void FtraceController::StopIfNeeded() {
   // ask for an explicit flush before stopping, unless it needs to perform a
   // non-graceful stop.
 
+  // The reader threads can't be joined here: they might be stalled writing
+  // into a full shared memory buffer, until this thread commits their chunks.
+  // They are destroyed, together with the cpu readers they use, once they
+  // quit.
+  if (!reader_threads_.empty()) {
+    auto weak_this = weak_factory_.GetWeakPtr();
+    for (auto& reader_thread : reader_threads_) {
+      reader_thread->Quit([weak_this] {
+        if (weak_this)
+          weak_this->OnReaderThreadQuit();
+      });
+      quitting_reader_threads_.push_back(std::move(reader_thread));
+    }
+    for (PerCpuState& per_cpu : per_cpu_)
+      quitting_per_cpu_.push_back(std::move(per_cpu));
+    reader_threads_.clear();
+    pending_reader_thread_flushes_.clear();
+  }
   per_cpu_.clear();
-  symbolizer_->Destroy();
+  // The quitting reader threads might still be symbolizing.
+  if (quitting_reader_threads_.empty())
+    symbolizer_->Destroy();
   cpu_zero_stats_fd_.reset();
 
   if (parsing_mem_.IsValid()) {
@@ -389,6 +513,18 @@ void FtraceController::StopIfNeeded() {
   }
 }
 
+void FtraceController::OnReaderThreadQuit() {
+  PERFETTO_DCHECK(quitting_reader_threads_.size() > num_quit_reader_threads_);
+  if (++num_quit_reader_threads_ < quitting_reader_threads_.size())
+    return;
+  // The threads have exited their loop, so joining them doesn't block.
+  quitting_reader_threads_.clear();
+  quitting_per_cpu_.clear();
+  num_quit_reader_threads_ = 0;
+  if (per_cpu_.empty())
+    symbolizer_->Destroy();
+}
+
 bool FtraceController::AddDataSource(FtraceDataSource* data_source) {
   if (!ValidConfig(data_source->config()))
     return false;
@@ -416,6 +552,16 @@ bool FtraceController::StartDataSource(FtraceDataSource* data_source) {
 
   started_data_sources_.insert(data_source);
   StartIfNeeded();
+  for (const auto& reader_thread : reader_threads_) {
+    std::unique_ptr<TraceWriter> trace_writer =
+        data_source->CreateTraceWriter();
+    if (!trace_writer) {
+      PERFETTO_ELOG("Failed to create a trace writer for the reader threads");
+      break;
+    }
+    reader_thread->AddDataSource(data_source, *data_source->parsing_config(),
+                                 std::move(trace_writer));
+  }
 
   // If the config is requesting to symbolize kernel addresses, create the
   // symbolizer and parse /proc/kallsyms (it will take 200-300 ms). This is not
@@ -441,12 +587,32 @@ void FtraceController::RemoveDataSource(FtraceDataSource* data_source) {
   size_t removed = data_sources_.erase(data_source);
   if (!removed)
     return;  // Can happen if AddDataSource failed (e.g. too many sessions).
+  // The reader threads parse with their own copy of the config.
+  for (const auto& reader_thread : reader_threads_)
+    reader_thread->RemoveDataSource(data_source);
   ftrace_config_muxer_->RemoveConfig(data_source->config_id());
   StopIfNeeded();
 }
 
+void FtraceController::ClearIncrementalState(FtraceDataSource* data_source) {
+  for (const auto& thread : reader_threads_)
+    thread->ClearIncrementalState(data_source);
+}
+
 void FtraceController::DumpFtraceStats(FtraceStats* stats) {
   DumpAllCpuStats(ftrace_procfs_.get(), stats);
+  for (const PerCpuState& per_cpu : per_cpu_) {
+    const CpuReader& reader = *per_cpu.reader;
+    if (reader.cpu() >= stats->cpu_stats.size())
+      continue;
+    FtraceCpuStats& cpu_stats = stats->cpu_stats[reader.cpu()];
+    const CpuReader::DrainStats& drain_stats = reader.drain_stats();
+    cpu_stats.drained_pages = drain_stats.pages.load(std::memory_order_relaxed);
+    cpu_stats.drain_time_ns =
+        drain_stats.time_ns.load(std::memory_order_relaxed);
+    cpu_stats.max_drain_cycle_ns =
+        drain_stats.max_cycle_ns.load(std::memory_order_relaxed);
+  }
   if (symbolizer_ && symbolizer_->is_valid()) {
     auto* symbol_map = symbolizer_->GetOrCreateKernelSymbolMap();
     stats->kernel_symbols_parsed =
@@ -471,6 +637,9 @@ void FtraceController::MaybeSnapshotFtraceClock() {
   // A value of zero will cause this snapshot to be skipped.
   ftrace_clock_snapshot_->ftrace_clock_ts =
       ReadFtraceNowTs(cpu_zero_stats_fd_).value_or(0);
+
+  for (const auto& reader_thread : reader_threads_)
+    reader_thread->SetFtraceClockSnapshot(*ftrace_clock_snapshot_);
 }
 
 FtraceController::Observer::~Observer() = default;
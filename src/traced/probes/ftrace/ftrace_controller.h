@@ -26,6 +26,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/paged_memory.h"
@@ -33,6 +34,7 @@
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/cpu_reader_thread.h"
 #include "src/traced/probes/ftrace/ftrace_config_utils.h"
 
 namespace perfetto {
@@ -88,6 +90,10 @@ class FtraceController {
   // all |started_data_sources_|.
   void Flush(FlushRequestID);
 
+  // Makes the reader threads, if any, write the incremental state of the data
+  // source again on their packet sequences.
+  void ClearIncrementalState(FtraceDataSource*);
+
   void DumpFtraceStats(FtraceStats*);
 
   base::WeakPtr<FtraceController> GetWeakPtr() {
@@ -126,6 +132,16 @@ class FtraceController {
   void StartIfNeeded();
   void StopIfNeeded();
 
+  // Moves the reading of the per-cpu buffers to dedicated threads.
+  void StartReaderThreads(const FtraceConfig::ReaderThreadsConfig&);
+
+  // Moves the metadata collected by the reader threads into the data sources.
+  void CollectReaderThreadsMetadata();
+
+  void OnReaderThreadFlushed(FlushRequestID);
+  void OnReaderThreadQuit();
+  void NotifyFlushComplete(FlushRequestID);
+
   void MaybeSnapshotFtraceClock();
 
   base::TaskRunner* const task_runner_;
@@ -140,6 +156,15 @@ class FtraceController {
   int generation_ = 0;
   bool atrace_running_ = false;
   std::vector<PerCpuState> per_cpu_;  // empty if tracing isn't active
+  // Empty unless the first data source started asked for reader threads.
+  std::vector<std::unique_ptr<CpuReaderThread>> reader_threads_;
+  // Number of acks still expected from the reader threads for each flush.
+  std::map<FlushRequestID, size_t> pending_reader_thread_flushes_;
+  // Reader threads of the previous sessions which haven't quit yet, see
+  // StopIfNeeded(), and the cpu readers they use.
+  std::vector<PerCpuState> quitting_per_cpu_;
+  std::vector<std::unique_ptr<CpuReaderThread>> quitting_reader_threads_;
+  size_t num_quit_reader_threads_ = 0;
   std::set<FtraceDataSource*> data_sources_;
   std::set<FtraceDataSource*> started_data_sources_;
   base::WeakPtrFactory<FtraceController> weak_factory_;  // Keep last.
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
@@ -183,6 +184,7 @@ class TestFtraceController : public FtraceController,
   MockFtraceProcfs* procfs() { return procfs_; }
   uint64_t NowMs() const override { return now_ms; }
   uint32_t drain_period_ms() { return GetDrainPeriodMs(); }
+  size_t num_reader_threads() { return reader_threads_.size(); }
 
   std::unique_ptr<FtraceDataSource> AddFakeDataSource(const FtraceConfig& cfg) {
     std::unique_ptr<FtraceDataSource> data_source(new FtraceDataSource(
@@ -472,6 +474,37 @@ TEST(FtraceControllerTest, PeriodicDrainConfig) {
   }
 }
 
+TEST(FtraceControllerTest, ReaderThreads) {
+  auto controller =
+      CreateTestController(true /* nice procfs */, 4 /* num cpus */);
+
+  FtraceConfig config = CreateFtraceConfig({"group/foo"});
+  config.set_drain_period_ms(1);
+  config.mutable_reader_threads()->set_cpus_per_thread(3);
+  auto data_source = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source);
+  EXPECT_EQ(controller->num_reader_threads(), 0u);
+
+  // 4 cpus, 3 per thread.
+  ASSERT_TRUE(controller->StartDataSource(data_source.get()));
+  EXPECT_EQ(controller->num_reader_threads(), 2u);
+
+  // A second data source joins the existing threads.
+  auto data_source2 = controller->AddFakeDataSource(config);
+  ASSERT_TRUE(data_source2);
+  ASSERT_TRUE(controller->StartDataSource(data_source2.get()));
+  EXPECT_EQ(controller->num_reader_threads(), 2u);
+
+  // The threads poll the fake per-cpu pipes (/dev/null) in the meantime.
+  usleep(10 * 1000);
+  controller->Flush(1);
+
+  data_source2.reset();
+  EXPECT_EQ(controller->num_reader_threads(), 2u);
+  data_source.reset();
+  EXPECT_EQ(controller->num_reader_threads(), 0u);
+}
+
 TEST(FtraceMetadataTest, Clear) {
   FtraceMetadata metadata;
   metadata.inode_and_device.insert(std::make_pair(1, 1));
@@ -525,6 +558,7 @@ TEST(FtraceStatsTest, Write) {
   cpu_stats.cpu = 0;
   cpu_stats.entries = 1;
   cpu_stats.overrun = 2;
+  cpu_stats.drained_pages = 3;
   stats.cpu_stats.push_back(cpu_stats);
 
   std::unique_ptr<TraceWriterForTesting> writer =
@@ -540,6 +574,7 @@ TEST(FtraceStatsTest, Write) {
   EXPECT_EQ(result.cpu(), 0u);
   EXPECT_EQ(result.entries(), 1u);
   EXPECT_EQ(result.overrun(), 2u);
+  EXPECT_EQ(result.drained_pages(), 3u);
 }
 
 }  // namespace perfetto
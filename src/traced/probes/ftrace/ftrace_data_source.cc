@@ -28,7 +28,7 @@ namespace perfetto {
 // static
 const ProbesDataSource::Descriptor FtraceDataSource::descriptor = {
     /*name*/ "linux.ftrace",
-    /*flags*/ Descriptor::kFlagsNone,
+    /*flags*/ Descriptor::kHandlesIncrementalState,
 };
 
 FtraceDataSource::FtraceDataSource(
@@ -82,6 +82,15 @@ void FtraceDataSource::Flush(FlushRequestID flush_request_id,
   controller_weak_->Flush(flush_request_id);
 }
 
+// Called periodically by the service if the trace config has an
+// incremental_state_config. Only the FtraceConfig.raw_pages mode has
+// incremental state to write again: the raw formats.
+void FtraceDataSource::ClearIncrementalState() {
+  metadata_.raw_formats_written_ns = 0;
+  if (controller_weak_)
+    controller_weak_->ClearIncrementalState(this);
+}
+
 // Called by FtraceController after all CPUs have acked the flush or timed out.
 void FtraceDataSource::OnFtraceFlushComplete(FlushRequestID flush_request_id) {
   auto it = pending_flushes_.find(flush_request_id);
@@ -56,6 +56,8 @@ class FtraceDataSource : public ProbesDataSource {
  public:
   static const ProbesDataSource::Descriptor descriptor;
 
+  using TraceWriterFactory = std::function<std::unique_ptr<TraceWriter>()>;
+
   FtraceDataSource(base::WeakPtr<FtraceController>,
                    TracingSessionID,
                    const FtraceConfig&,
@@ -72,6 +74,7 @@ class FtraceDataSource : public ProbesDataSource {
   // Flushes the ftrace buffers into the userspace trace buffers and writes
   // also ftrace stats.
   void Flush(FlushRequestID, std::function<void()> callback) override;
+  void ClearIncrementalState() override;
   void OnFtraceFlushComplete(FlushRequestID);
 
   FtraceConfigId config_id() const { return config_id_; }
@@ -83,6 +86,15 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceMetadata* mutable_metadata() { return &metadata_; }
   TraceWriter* trace_writer() { return writer_.get(); }
 
+  // Used to create further writers targeting the same buffer, one for each
+  // ftrace reader thread (see FtraceConfig.reader_threads).
+  void set_trace_writer_factory(TraceWriterFactory factory) {
+    trace_writer_factory_ = std::move(factory);
+  }
+  std::unique_ptr<TraceWriter> CreateTraceWriter() {
+    return trace_writer_factory_ ? trace_writer_factory_() : nullptr;
+  }
+
  private:
   // Hands out internal pointers to callbacks.
   FtraceDataSource(const FtraceDataSource&) = delete;
@@ -97,6 +109,7 @@ class FtraceDataSource : public ProbesDataSource {
   FtraceMetadata metadata_;
   FtraceStats stats_before_ = {};
   std::map<FlushRequestID, std::function<void()>> pending_flushes_;
+  TraceWriterFactory trace_writer_factory_;
 
   // -- Fields initialized by the Initialize() call:
   FtraceConfigId config_id_ = 0;
@@ -144,6 +144,12 @@ struct FtraceMetadata {
   int32_t last_seen_common_pid = 0;
   uint32_t last_kernel_addr_index_written = 0;
 
+  // When the FtraceEventBundle.RawFormats were last written on the packet
+  // sequence of this metadata, for FtraceConfig.raw_pages, or 0 if they have
+  // to be written with the next pages (e.g. after ClearIncrementalState()).
+  // Unlike the rest, this is not reset by Clear().
+  uint64_t raw_formats_written_ns = 0;
+
   base::FlatSet<InodeBlockPair> inode_and_device;
   base::FlatSet<int32_t> rename_pids;
   base::FlatSet<int32_t> pids;
@@ -38,6 +38,9 @@ void FtraceCpuStats::Write(protos::pbzero::FtraceCpuStats* writer) const {
   writer->set_now_ts(now_ts);
   writer->set_dropped_events(dropped_events);
   writer->set_read_events(read_events);
+  writer->set_drained_pages(drained_pages);
+  writer->set_drain_time_ns(drain_time_ns);
+  writer->set_max_drain_cycle_ns(max_drain_cycle_ns);
 }
 
 }  // namespace perfetto
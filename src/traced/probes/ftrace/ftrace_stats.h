@@ -40,6 +40,11 @@ struct FtraceCpuStats {
   uint64_t dropped_events;
   uint64_t read_events;
 
+  // Not from the kernel, see CpuReader::DrainStats.
+  uint64_t drained_pages;
+  uint64_t drain_time_ns;
+  uint64_t max_drain_cycle_ns;
+
   void Write(protos::pbzero::FtraceCpuStats*) const;
 };
 
@@ -60,6 +60,11 @@ class PrintkMap {
 
   size_t empty() const { return set_.empty(); }
 
+  base::FlatSet<PrintkEntry>::const_iterator begin() const {
+    return set_.begin();
+  }
+  base::FlatSet<PrintkEntry>::const_iterator end() const { return set_.end(); }
+
   base::FlatSet<PrintkEntry> set_;
 };
 
@@ -24,6 +24,7 @@
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/event_parsers.h"
 #include "src/traced/probes/ftrace/ftrace_procfs.h"
 
 #include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
@@ -248,6 +249,19 @@ void SetProtoType(FtraceFieldType ftrace_type,
   }
 }
 
+bool EventMatchesParser(const Event& event, const EventParser& parser) {
+  if (event.fields.size() != parser.num_fields)
+    return false;
+  for (size_t i = 0; i < parser.num_fields; i++) {
+    const Field& field = event.fields[i];
+    if (field.proto_field_id != parser.fields[i].proto_field_id ||
+        field.strategy != parser.fields[i].strategy) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 // This is similar but different from InferProtoType (see format_parser.cc).
@@ -489,12 +503,32 @@ ProtoTranslationTable::ProtoTranslationTable(
       ftrace_page_header_spec_(ftrace_page_header_spec),
       compact_sched_format_(compact_sched_format),
       printk_formats_(printk_formats) {
+  events_by_id_history_.emplace_back(new EventsById(events_.size()));
+  events_by_id_.store(events_by_id_history_.back().get(),
+                      std::memory_order_release);
   for (const Event& event : events) {
+    IndexEvent(&events_.at(event.ftrace_event_id));
     group_and_name_to_event_[GroupAndName(event.group, event.name)] =
         &events_.at(event.ftrace_event_id);
     name_to_events_[event.name].push_back(&events_.at(event.ftrace_event_id));
     group_to_events_[event.group].push_back(&events_.at(event.ftrace_event_id));
   }
+
+  // Attach the specialized parsers whose compile-time assumptions about the
+  // fields of the event hold for this kernel.
+  event_parsers_.resize(events_.size());
+  for (const EventParser& parser : GetEventParsers()) {
+    auto it =
+        group_and_name_to_event_.find(GroupAndName(parser.group, parser.name));
+    if (it == group_and_name_to_event_.end())
+      continue;
+    const Event& event = *it->second;
+    if (event_parsers_[event.ftrace_event_id] ||
+        !EventMatchesParser(event, parser)) {
+      continue;
+    }
+    event_parsers_[event.ftrace_event_id] = parser.parse;
+  }
 }
 
 const Event* ProtoTranslationTable::GetOrCreateEvent(
@@ -534,6 +568,7 @@ const Event* ProtoTranslationTable::GetOrCreateEvent(
   for (const FtraceEvent::Field& ftrace_field : ftrace_event.fields)
     e->size = std::max(CreateGenericEventField(ftrace_field, *e), e->size);
 
+  IndexEvent(e);
   group_and_name_to_event_[group_and_name] = &events_.at(e->ftrace_event_id);
   name_to_events_[e->name].push_back(&events_.at(e->ftrace_event_id));
   group_to_events_[e->group].push_back(&events_.at(e->ftrace_event_id));
@@ -541,6 +576,26 @@ const Event* ProtoTranslationTable::GetOrCreateEvent(
   return e;
 }
 
+void ProtoTranslationTable::IndexEvent(const Event* event) {
+  const size_t id = event->ftrace_event_id;
+  if (!id)
+    return;
+  const EventsById* index = events_by_id_.load(std::memory_order_relaxed);
+  if (id >= index->size) {
+    std::unique_ptr<EventsById> new_index(
+        new EventsById(std::max(events_.size(), index->size * 2)));
+    for (size_t i = 0; i < index->size; i++) {
+      new_index->events[i].store(
+          index->events[i].load(std::memory_order_relaxed),
+          std::memory_order_relaxed);
+    }
+    index = new_index.get();
+    events_by_id_history_.push_back(std::move(new_index));
+    events_by_id_.store(index, std::memory_order_release);
+  }
+  index->events[id].store(event, std::memory_order_release);
+}
+
 const char* ProtoTranslationTable::InternString(const std::string& str) {
   auto it_and_inserted = interned_strings_.insert(str);
   return it_and_inserted.first->c_str();
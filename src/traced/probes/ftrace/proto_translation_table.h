@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <deque>
 #include <iostream>
 #include <map>
@@ -30,6 +31,7 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "src/traced/probes/ftrace/compact_sched.h"
 #include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/event_parsers.h"
 #include "src/traced/probes/ftrace/format_parser/format_parser.h"
 #include "src/traced/probes/ftrace/printk_formats_parser.h"
 
@@ -121,13 +123,22 @@ class ProtoTranslationTable {
     return &group_to_events_.at(group);
   }
 
+  // Safe to call on the ftrace reader threads (see CpuReaderThread) while the
+  // main thread adds events through GetOrCreateEvent().
   const Event* GetEventById(size_t id) const {
-    if (id == 0 || id > largest_id_)
+    const EventsById* events_by_id =
+        events_by_id_.load(std::memory_order_acquire);
+    if (id >= events_by_id->size)
       return nullptr;
-    const Event* evt = &events_[id];
-    if (!evt->ftrace_event_id)
+    return events_by_id->events[id].load(std::memory_order_acquire);
+  }
+
+  // Returns the specialized parser for the fields of the event, or nullptr if
+  // the event has to be parsed field by field. See event_parsers.h.
+  EventParserFn GetEventParser(size_t id) const {
+    if (id >= event_parsers_.size())
       return nullptr;
-    return evt;
+    return event_parsers_[id];
   }
 
   size_t EventToFtraceId(const GroupAndName& group_and_name) const {
@@ -170,6 +181,8 @@ class ProtoTranslationTable {
     return printk_formats_.at(address);
   }
 
+  const PrintkMap& printk_formats() const { return printk_formats_; }
+
  private:
   ProtoTranslationTable(const ProtoTranslationTable&) = delete;
   ProtoTranslationTable& operator=(const ProtoTranslationTable&) = delete;
@@ -177,16 +190,35 @@ class ProtoTranslationTable {
   // Store strings so they can be read when writing the trace output.
   const char* InternString(const std::string& str);
 
+  // Lock-free index of |events_|, as growing the deque isn't safe while other
+  // threads access it. Slots for ids without an event are null.
+  struct EventsById {
+    explicit EventsById(size_t _size)
+        : size(_size), events(new std::atomic<const Event*>[_size]()) {}
+    const size_t size;
+    std::unique_ptr<std::atomic<const Event*>[]> events;
+  };
+
+  // Makes |event| visible to GetEventById(), replacing the index with a
+  // larger copy if needed.
+  void IndexEvent(const Event* event);
+
   uint16_t CreateGenericEventField(const FtraceEvent::Field& ftrace_field,
                                    Event& event);
 
   const FtraceProcfs* ftrace_procfs_;
   std::deque<Event> events_;
   size_t largest_id_;
+  // The replaced indexes are kept around, as a reader thread might still be
+  // using them. Their capacity doubles, so they take at most as much memory as
+  // the current one.
+  std::vector<std::unique_ptr<EventsById>> events_by_id_history_;
+  std::atomic<const EventsById*> events_by_id_{nullptr};
   std::map<GroupAndName, const Event*> group_and_name_to_event_;
   std::map<std::string, std::vector<const Event*>> name_to_events_;
   std::map<std::string, std::vector<const Event*>> group_to_events_;
   std::vector<Field> common_fields_;
+  std::vector<EventParserFn> event_parsers_;  // Indexed by ftrace event id.
   FtracePageHeaderSpec ftrace_page_header_spec_{};
   std::set<std::string> interned_strings_;
   CompactSchedEventFormat compact_sched_format_;
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ps/proc_pid_file_cache.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include <utility>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_utils.h"
+
+namespace perfetto {
+
+namespace {
+
+// Reads the whole file from offset 0 into |out|. procfs files are generated
+// on each read from the start, so this returns the current contents.
+bool ReadFromStart(int fd, std::string* out) {
+  constexpr size_t kReadSize = 4096;
+  size_t len = 0;
+  for (;;) {
+    if (out->size() < len + kReadSize)
+      out->resize(len + kReadSize);
+    ssize_t rsize = PERFETTO_EINTR(
+        pread(fd, &(*out)[len], kReadSize, static_cast<off_t>(len)));
+    if (rsize < 0) {
+      out->clear();
+      return false;
+    }
+    if (rsize == 0)
+      break;
+    len += static_cast<size_t>(rsize);
+  }
+  out->resize(len);
+  return true;
+}
+
+}  // namespace
+
+ProcPidFileCache::ProcPidFileCache(std::string proc_root,
+                                   std::vector<std::string> files,
+                                   size_t max_open_files)
+    : proc_root_(std::move(proc_root)),
+      files_(std::move(files)),
+      max_open_files_(max_open_files) {
+  PERFETTO_CHECK(files_.size() <= kMaxFiles);
+}
+
+ProcPidFileCache::~ProcPidFileCache() = default;
+
+bool ProcPidFileCache::Read(int32_t pid, const char* file, std::string* out) {
+  out->clear();
+  size_t index = 0;
+  while (index < files_.size() && files_[index] != file)
+    index++;
+  PERFETTO_CHECK(index < files_.size());
+
+  auto it = pids_.find(pid);
+  if (it == pids_.end()) {
+    if (num_open_files_ >= max_open_files_) {
+      base::ScopedFile fd = Open(pid, index);
+      return fd && ReadFromStart(*fd, out);
+    }
+    it = pids_.emplace(pid, PidFiles()).first;
+  }
+  PidFiles& pid_files = it->second;
+  pid_files.read_since_last_sweep = true;
+
+  base::ScopedFile& fd = pid_files.fds[index];
+  if (fd) {
+    if (ReadFromStart(*fd, out))
+      return true;
+    // Reads fail (ESRCH) once the process is gone. The pid might have been
+    // recycled already, so retry with a fresh fd.
+    fd.reset();
+    num_open_files_--;
+  }
+
+  base::ScopedFile new_fd = Open(pid, index);
+  if (!new_fd || !ReadFromStart(*new_fd, out))
+    return false;
+  if (num_open_files_ < max_open_files_) {
+    fd = std::move(new_fd);
+    num_open_files_++;
+  }
+  return true;
+}
+
+void ProcPidFileCache::RemoveStaleFiles() {
+  for (auto it = pids_.begin(); it != pids_.end();) {
+    PidFiles& pid_files = it->second;
+    if (pid_files.read_since_last_sweep) {
+      pid_files.read_since_last_sweep = false;
+      ++it;
+      continue;
+    }
+    for (const base::ScopedFile& fd : pid_files.fds)
+      num_open_files_ -= fd ? 1 : 0;
+    it = pids_.erase(it);
+  }
+}
+
+base::ScopedFile ProcPidFileCache::Open(int32_t pid, size_t file_index) {
+  base::StackString<256> path("%s/%" PRId32 "/%s", proc_root_.c_str(), pid,
+                              files_[file_index].c_str());
+  return base::OpenFile(path.c_str(), O_RDONLY);
+}
+
+}  // namespace perfetto
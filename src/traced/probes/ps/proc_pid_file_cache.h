@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACED_PROBES_PS_PROC_PID_FILE_CACHE_H_
+#define SRC_TRACED_PROBES_PS_PROC_PID_FILE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "perfetto/ext/base/scoped_file.h"
+
+namespace perfetto {
+
+// Reads the /proc/pid files that are sampled over and over, e.g. status and
+// oom_score_adj for each poll of ProcessStatsDataSource. The files are kept
+// open across reads and re-read from the start with pread(), which saves the
+// path walk, open() and close() of each read.
+//
+// If a process dies, its files are not reopened until the next read fails, so
+// a recycled pid is read from the right process. Files of pids that were not
+// read between two calls to RemoveStaleFiles() are closed.
+//
+// Not thread-safe. Different instances can be used on different threads.
+class ProcPidFileCache {
+ public:
+  static constexpr size_t kMaxFiles = 4;
+
+  // |files| are the names of the files to keep open, e.g. "status". At most
+  // |max_open_files| fds are kept open, any other read is one-shot.
+  ProcPidFileCache(std::string proc_root,
+                   std::vector<std::string> files,
+                   size_t max_open_files);
+  ~ProcPidFileCache();
+
+  // Reads |proc_root|/|pid|/|file| into |out|, reusing its capacity. |file|
+  // must be one of the |files| passed to the constructor. Returns false, and
+  // leaves |out| empty, if the file can't be read.
+  bool Read(int32_t pid, const char* file, std::string* out);
+
+  // Closes the files of the pids that were not read since the last call.
+  void RemoveStaleFiles();
+
+  size_t num_open_files() const { return num_open_files_; }
+
+ private:
+  struct PidFiles {
+    std::array<base::ScopedFile, kMaxFiles> fds;
+    bool read_since_last_sweep = false;
+  };
+
+  ProcPidFileCache(const ProcPidFileCache&) = delete;
+  ProcPidFileCache& operator=(const ProcPidFileCache&) = delete;
+
+  base::ScopedFile Open(int32_t pid, size_t file_index);
+
+  const std::string proc_root_;
+  const std::vector<std::string> files_;
+  const size_t max_open_files_;
+  size_t num_open_files_ = 0;
+  std::unordered_map<int32_t, PidFiles> pids_;
+};
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACED_PROBES_PS_PROC_PID_FILE_CACHE_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/traced/probes/ps/proc_pid_file_cache.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace {
+
+// A fake /proc with a directory per pid. Unlike procfs, the files are
+// rewritten in place so that the fds kept open by the cache see the changes.
+class FakeProc {
+ public:
+  FakeProc() : root_(base::TempDir::Create()) {}
+
+  ~FakeProc() {
+    for (auto it = files_.rbegin(); it != files_.rend(); ++it)
+      remove(it->c_str());
+    for (auto it = dirs_.rbegin(); it != dirs_.rend(); ++it)
+      base::Rmdir(*it);
+  }
+
+  void Write(int32_t pid, const std::string& file, const std::string& data) {
+    std::string dir = root_.path() + "/" + std::to_string(pid);
+    if (mkdir(dir.c_str(), 0755) == 0)
+      dirs_.push_back(dir);
+    std::string path = dir + "/" + file;
+    base::ScopedFile fd = base::OpenFile(path, O_WRONLY | O_CREAT, 0644);
+    ASSERT_TRUE(fd);
+    if (std::find(files_.begin(), files_.end(), path) == files_.end())
+      files_.push_back(path);
+    ASSERT_EQ(ftruncate(*fd, 0), 0);
+    ASSERT_EQ(base::WriteAll(*fd, data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+  }
+
+  void Remove(int32_t pid, const std::string& file) {
+    std::string path = root_.path() + "/" + std::to_string(pid) + "/" + file;
+    remove(path.c_str());
+    files_.erase(std::remove(files_.begin(), files_.end(), path),
+                 files_.end());
+  }
+
+  const std::string& path() const { return root_.path(); }
+
+ private:
+  base::TempDir root_;
+  std::vector<std::string> dirs_;
+  std::vector<std::string> files_;
+};
+
+TEST(ProcPidFileCacheTest, RereadsOpenFiles) {
+  FakeProc proc;
+  proc.Write(1, "status", "VmRSS: 1 kB\n");
+  proc.Write(1, "stat", "1 (init) S");
+  ProcPidFileCache cache(proc.path(), {"status", "stat"}, 16);
+
+  std::string out;
+  ASSERT_TRUE(cache.Read(1, "status", &out));
+  EXPECT_EQ(out, "VmRSS: 1 kB\n");
+  ASSERT_TRUE(cache.Read(1, "stat", &out));
+  EXPECT_EQ(out, "1 (init) S");
+  EXPECT_EQ(cache.num_open_files(), 2u);
+
+  // The fd is kept open and read again from the start.
+  proc.Write(1, "status", "VmRSS: 12345 kB\n");
+  ASSERT_TRUE(cache.Read(1, "status", &out));
+  EXPECT_EQ(out, "VmRSS: 12345 kB\n");
+  EXPECT_EQ(cache.num_open_files(), 2u);
+
+  // Larger than a single read() chunk.
+  std::string big(10000, 'x');
+  proc.Write(1, "status", big);
+  ASSERT_TRUE(cache.Read(1, "status", &out));
+  EXPECT_EQ(out, big);
+}
+
+TEST(ProcPidFileCacheTest, MissingFile) {
+  FakeProc proc;
+  ProcPidFileCache cache(proc.path(), {"status"}, 16);
+  std::string out = "stale";
+  EXPECT_FALSE(cache.Read(42, "status", &out));
+  EXPECT_TRUE(out.empty());
+  EXPECT_EQ(cache.num_open_files(), 0u);
+}
+
+TEST(ProcPidFileCacheTest, MaxOpenFiles) {
+  FakeProc proc;
+  for (int32_t pid = 1; pid <= 3; pid++)
+    proc.Write(pid, "status", "pid" + std::to_string(pid));
+  ProcPidFileCache cache(proc.path(), {"status"}, 2);
+
+  // The files beyond the limit are still read, but not kept open.
+  std::string out;
+  for (int32_t pid = 1; pid <= 3; pid++) {
+    ASSERT_TRUE(cache.Read(pid, "status", &out));
+    EXPECT_EQ(out, "pid" + std::to_string(pid));
+  }
+  EXPECT_EQ(cache.num_open_files(), 2u);
+}
+
+TEST(ProcPidFileCacheTest, RemoveStaleFiles) {
+  FakeProc proc;
+  proc.Write(1, "status", "a");
+  proc.Write(2, "status", "b");
+  ProcPidFileCache cache(proc.path(), {"status"}, 16);
+
+  std::string out;
+  ASSERT_TRUE(cache.Read(1, "status", &out));
+  ASSERT_TRUE(cache.Read(2, "status", &out));
+  EXPECT_EQ(cache.num_open_files(), 2u);
+
+  // Both pids were read since the last sweep.
+  cache.RemoveStaleFiles();
+  EXPECT_EQ(cache.num_open_files(), 2u);
+
+  // Only pid 1 is read before the next sweep, pid 2 is closed.
+  ASSERT_TRUE(cache.Read(1, "status", &out));
+  cache.RemoveStaleFiles();
+  EXPECT_EQ(cache.num_open_files(), 1u);
+
+  // The files of pid 2 were closed, so it is looked up again.
+  proc.Remove(2, "status");
+  EXPECT_FALSE(cache.Read(2, "status", &out));
+  EXPECT_EQ(cache.num_open_files(), 1u);
+}
+
+}  // namespace
+}  // namespace perfetto
@@ -17,6 +17,7 @@
 #include "src/traced/probes/ps/process_stats_data_source.h"
 
 #include <stdlib.h>
+#include <sys/resource.h>
 
 #include <algorithm>
 #include <utility>
@@ -30,6 +31,8 @@
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/waitable_event.h"
 #include "perfetto/tracing/core/data_source_config.h"
 
 #include "protos/perfetto/config/process_stats/process_stats_config.pbzero.h"
@@ -55,6 +58,23 @@ namespace {
 // was provided in the config. The cache is trimmed if it exceeds this size.
 const size_t kThreadTimeInStateCacheSize = 10000;
 
+// Upper bound for ProcessStatsConfig.proc_stats_scan_threads.
+const uint32_t kMaxScanThreads = 8;
+
+// The files read for each process at every poll, kept open across polls.
+const char* const kPolledFiles[] = {"status", "oom_score_adj", "stat"};
+
+// Upper bound on the number of fds kept open for the polls, across all the
+// scan threads. Lowered to a quarter of RLIMIT_NOFILE if that's smaller.
+const size_t kMaxPolledFds = 4096;
+
+size_t GetMaxPolledFds() {
+  struct rlimit rlim {};
+  if (getrlimit(RLIMIT_NOFILE, &rlim) != 0 || rlim.rlim_cur == RLIM_INFINITY)
+    return kMaxPolledFds;
+  return std::min(kMaxPolledFds, static_cast<size_t>(rlim.rlim_cur / 4));
+}
+
 // TODO(b/189749310): For debugging of b/189749310. Remove by Jan 2022.
 base::CrashKey g_crash_key_proc_file("proc_file");
 base::CrashKey g_crash_key_proc_count("proc_count");
@@ -121,16 +141,36 @@ ProcessStatsDataSource::ProcessStatsDataSource(
     process_stats_cache_ttl_ticks_ =
         std::max(proc_stats_ttl_ms / poll_period_ms_, 1u);
   }
+  mem_change_threshold_kb_ = cfg.proc_stats_mem_change_threshold_kb();
 
   record_thread_time_in_state_ = cfg.record_thread_time_in_state();
   thread_time_in_state_cache_size_ = cfg.thread_time_in_state_cache_size();
   if (thread_time_in_state_cache_size_ == 0)
     thread_time_in_state_cache_size_ = kThreadTimeInStateCacheSize;
   thread_time_in_state_cache_.resize(thread_time_in_state_cache_size_);
+
+  if (poll_period_ms_ > 0) {
+    uint32_t num_threads =
+        std::min(std::max(cfg.proc_stats_scan_threads(), 1u), kMaxScanThreads);
+    size_t max_open_files = GetMaxPolledFds() / num_threads;
+    for (uint32_t i = 0; i < num_threads; i++) {
+      scan_shards_.emplace_back(new ScanShard(max_open_files));
+      if (i > 0) {
+        scan_threads_.emplace_back(
+            base::ThreadTaskRunner::CreateAndStart("procstats_scan"));
+      }
+    }
+  }
 }
 
 ProcessStatsDataSource::~ProcessStatsDataSource() = default;
 
+ProcessStatsDataSource::ScanShard::ScanShard(size_t max_open_files)
+    : file_cache("/proc",
+                 std::vector<std::string>(std::begin(kPolledFiles),
+                                          std::end(kPolledFiles)),
+                 max_open_files) {}
+
 void ProcessStatsDataSource::Start() {
   if (dump_all_procs_on_start_)
     WriteAllProcesses();
@@ -172,8 +212,8 @@ void ProcessStatsDataSource::WriteAllProcesses() {
         // a proc file for each thread. We can save time and directly write the
         // thread record. Note that we still read proc_status for recording
         // NSpid entries.
-        std::string proc_status = ReadProcPidFile(tid, "status");
-        WriteThread(tid, pid, /*optional_name=*/nullptr, proc_status);
+        ReadProcPidFile(tid, "status", &status_buf_);
+        WriteThread(tid, pid, /*optional_name=*/nullptr, status_buf_);
       }
     }
   }
@@ -223,9 +263,9 @@ void ProcessStatsDataSource::WriteProcessOrThread(int32_t pid) {
   // In case we're called from outside WriteAllProcesses()
   CacheProcFsScanStartTimestamp();
 
-  std::string proc_status = ReadProcPidFile(pid, "status");
-  if (proc_status.empty())
+  if (!ReadProcPidFile(pid, "status", &status_buf_))
     return;
+  const std::string& proc_status = status_buf_;
   int tgid = ToInt(ReadProcStatusEntry(proc_status, "Tgid:"));
   if (tgid <= 0)
     return;
@@ -288,8 +328,8 @@ void ProcessStatsDataSource::WriteProcess(int32_t pid,
     proc->add_nspid(nspid);
   }
 
-  std::string cmdline = ReadProcPidFile(pid, "cmdline");
-  if (!cmdline.empty()) {
+  std::string& cmdline = cmdline_buf_;
+  if (ReadProcPidFile(pid, "cmdline", &cmdline)) {
     if (cmdline.back() != '\0') {
       // Some kernels can miss the NUL terminator due to a bug. b/147438623.
       cmdline.push_back('\0');
@@ -332,16 +372,25 @@ base::ScopedDir ProcessStatsDataSource::OpenProcDir() {
   return proc_dir;
 }
 
-std::string ProcessStatsDataSource::ReadProcPidFile(int32_t pid,
-                                                    const std::string& file) {
-  base::StackString<128> path("/proc/%" PRId32 "/%s", pid, file.c_str());
+bool ProcessStatsDataSource::ReadProcPidFile(int32_t pid,
+                                             const char* file,
+                                             std::string* out) {
+  base::StackString<128> path("/proc/%" PRId32 "/%s", pid, file);
   auto scoped_key = g_crash_key_proc_file.SetScoped(path.string_view());
   g_crash_key_proc_count.Set(g_crash_key_proc_count.int_value() + 1);
-  std::string contents;
-  contents.reserve(4096);
-  if (!base::ReadFile(path.c_str(), &contents))
-    return "";
-  return contents;
+  out->clear();
+  if (!base::ReadFile(path.c_str(), out)) {
+    out->clear();
+    return false;
+  }
+  return !out->empty();
+}
+
+bool ProcessStatsDataSource::ReadPolledProcPidFile(ProcPidFileCache* cache,
+                                                   int32_t pid,
+                                                   const char* file,
+                                                   std::string* out) {
+  return cache->Read(pid, file, out) && !out->empty();
 }
 
 base::ScopedDir ProcessStatsDataSource::OpenProcTaskDir(int32_t pid) {
@@ -446,47 +495,76 @@ void ProcessStatsDataSource::Tick(
 
 void ProcessStatsDataSource::WriteAllProcessStats() {
   // TODO(primiano): implement filtering of processes by names.
-  // TODO(primiano): Have a pid cache to avoid wasting cycles reading kthreads
-  // proc files over and over. Same for non-filtered processes (see above).
 
   CacheProcFsScanStartTimestamp();
   PERFETTO_METATRACE_SCOPED(TAG_PROC_POLLERS, PS_WRITE_ALL_PROCESS_STATS);
   base::ScopedDir proc_dir = OpenProcDir();
   if (!proc_dir)
     return;
-  base::FlatSet<int32_t> pids;
-  while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
-    cur_ps_stats_process_ = nullptr;
 
+  // Reading the /proc files dominates the cost of a poll. They are read first,
+  // split across the scan shards by pid, and then written out here on the
+  // main thread in the order of /proc, so that the trace doesn't depend on
+  // the number of scan threads.
+  PERFETTO_DCHECK(!scan_shards_.empty());
+  size_t num_samples = 0;
+  for (auto& shard : scan_shards_)
+    shard->samples.clear();
+  while (int32_t pid = ReadNextNumericDir(*proc_dir)) {
     uint32_t pid_u = static_cast<uint32_t>(pid);
     if (skip_stats_for_pids_.size() > pid_u && skip_stats_for_pids_[pid_u])
       continue;
+    if (num_samples == samples_.size())
+      samples_.emplace_back(new ProcStatsSample());
+    ProcStatsSample* sample = samples_[num_samples++].get();
+    sample->pid = pid;
+    scan_shards_[pid_u % scan_shards_.size()]->samples.push_back(sample);
+  }
+
+  std::array<base::WaitableEvent, kMaxScanThreads> scan_done;
+  for (size_t i = 0; i < scan_threads_.size(); i++) {
+    ScanShard* shard = scan_shards_[i + 1].get();
+    base::WaitableEvent* done = &scan_done[i];
+    scan_threads_[i].PostTask([this, shard, done] {
+      ReadSamples(shard);
+      done->Notify();
+    });
+  }
+  ReadSamples(scan_shards_[0].get());
+  for (size_t i = 0; i < scan_threads_.size(); i++)
+    scan_done[i].Wait();
+
+  base::FlatSet<int32_t> pids;
+  for (size_t i = 0; i < num_samples; i++) {
+    ProcStatsSample& sample = *samples_[i];
+    int32_t pid = sample.pid;
+    cur_ps_stats_process_ = nullptr;
 
-    std::string proc_status = ReadProcPidFile(pid, "status");
-    if (proc_status.empty())
+    if (sample.status.empty())
       continue;
 
-    if (!WriteMemCounters(pid, proc_status)) {
+    if (!WriteMemCounters(pid, sample.status)) {
       // If WriteMemCounters() fails the pid is very likely a kernel thread
       // that has a valid /proc/[pid]/status but no memory values. In this
       // case avoid keep polling it over and over.
+      uint32_t pid_u = static_cast<uint32_t>(pid);
       if (skip_stats_for_pids_.size() <= pid_u)
         skip_stats_for_pids_.resize(pid_u + 1);
       skip_stats_for_pids_[pid_u] = true;
       continue;
     }
 
-    std::string oom_score_adj = ReadProcPidFile(pid, "oom_score_adj");
-    if (!oom_score_adj.empty()) {
+    if (!sample.oom_score_adj.empty()) {
       CachedProcessStats& cached = process_stats_cache_[pid];
-      auto counter = ToInt(oom_score_adj);
+      auto counter = ToInt(sample.oom_score_adj);
       if (counter != cached.oom_score_adj) {
         GetOrCreateStatsProcess(pid)->set_oom_score_adj(counter);
         cached.oom_score_adj = counter;
       }
     }
 
-    if (record_thread_time_in_state_ && ShouldWriteThreadStats(pid)) {
+    if (record_thread_time_in_state_ &&
+        ShouldWriteThreadStats(pid, &sample.stat)) {
       if (auto task_dir = OpenProcTaskDir(pid)) {
         while (int32_t tid = ReadNextNumericDir(*task_dir)) {
           WriteThreadStats(pid, tid);
@@ -497,13 +575,44 @@ void ProcessStatsDataSource::WriteAllProcessStats() {
 
     pids.insert(pid);
   }
+
+  // Written on every poll, even if no process changed, so that the cost of
+  // the scans can be tracked.
+  protos::pbzero::ProcessStats* stats = GetOrCreateStats();
+  uint64_t now = static_cast<uint64_t>(base::GetBootTimeNs().count());
+  stats->set_scan_duration_ns(now - CacheProcFsScanStartTimestamp());
+  stats->set_scan_threads(static_cast<uint32_t>(scan_shards_.size()));
   FinalizeCurPacket();
 
+  // Close the files of the processes that went away or are now skipped.
+  for (auto& shard : scan_shards_)
+    shard->file_cache.RemoveStaleFiles();
+
   // Ensure that we write once long-term process info (e.g., name) for new pids
   // that we haven't seen before.
   WriteProcessTree(pids);
 }
 
+// Runs on the main thread for the first shard and on |scan_threads_| for the
+// others. Must not touch any state other than |shard| and its samples.
+void ProcessStatsDataSource::ReadSamples(ScanShard* shard) {
+  for (ProcStatsSample* sample : shard->samples) {
+    ProcPidFileCache* cache = &shard->file_cache;
+    if (!ReadPolledProcPidFile(cache, sample->pid, "status", &sample->status)) {
+      sample->oom_score_adj.clear();
+      sample->stat.clear();
+      continue;
+    }
+    ReadPolledProcPidFile(cache, sample->pid, "oom_score_adj",
+                          &sample->oom_score_adj);
+    if (record_thread_time_in_state_) {
+      ReadPolledProcPidFile(cache, sample->pid, "stat", &sample->stat);
+    } else {
+      sample->stat.clear();
+    }
+  }
+}
+
 // Returns true if the stats for the given |pid| have been written, false it
 // it failed (e.g., |pid| was a kernel thread and, as such, didn't report any
 // memory counters).
@@ -522,125 +631,121 @@ bool ProcessStatsDataSource::WriteMemCounters(int32_t pid,
   // VmSize:     5992 kB
   // VmLck:         0 kB
   // ...
-  std::vector<char> key;
-  std::vector<char> value;
-  enum { kKey, kSeparator, kValue } state = kKey;
-  for (char c : proc_status) {
-    if (c == '\n') {
-      key.push_back('\0');
-      value.push_back('\0');
-
-      // |value| will contain "1234 KB". We rely on strtol() (in ToU32()) to
-      // stop parsing at the first non-numeric character.
-      if (strcmp(key.data(), "VmSize") == 0) {
-        // Assume that if we see VmSize we'll see also the others.
-        proc_status_has_mem_counters = true;
-
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_size_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_size_kb(counter);
-          cached.vm_size_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmLck") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_locked_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_locked_kb(counter);
-          cached.vm_locked_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmHWM") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_hvm_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_hwm_kb(counter);
-          cached.vm_hvm_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmRSS") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_rss_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_rss_kb(counter);
-          cached.vm_rss_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssAnon") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_anon_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_anon_kb(counter);
-          cached.rss_anon_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssFile") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_file_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_file_kb(counter);
-          cached.rss_file_kb = counter;
-        }
-      } else if (strcmp(key.data(), "RssShmem") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.rss_shmem_kb) {
-          GetOrCreateStatsProcess(pid)->set_rss_shmem_kb(counter);
-          cached.rss_shmem_kb = counter;
-        }
-      } else if (strcmp(key.data(), "VmSwap") == 0) {
-        auto counter = ToU32(value.data());
-        if (counter != cached.vm_swap_kb) {
-          GetOrCreateStatsProcess(pid)->set_vm_swap_kb(counter);
-          cached.vm_swap_kb = counter;
-        }
-      }
-
-      key.clear();
-      state = kKey;
+  // The lines are parsed in place, as this runs for each process at each poll.
+  const char* line = proc_status.c_str();
+  const char* const end = line + proc_status.size();
+  for (const char* next; line < end; line = next + 1) {
+    next = static_cast<const char*>(memchr(line, '\n', size_t(end - line)));
+    if (!next)
+      next = end;
+    const char* sep =
+        static_cast<const char*>(memchr(line, ':', size_t(next - line)));
+    if (!sep)
       continue;
-    }
-
-    if (state == kKey) {
-      if (c == ':') {
-        state = kSeparator;
-        continue;
+    base::StringView key(line, size_t(sep - line));
+    // |value| will contain "  1234 kB". We rely on strtol() (in ToU32()) to
+    // skip the leading spaces and stop parsing at the first non-numeric
+    // character.
+    const char* value = sep + 1;
+
+    if (key == "VmSize") {
+      // Assume that if we see VmSize we'll see also the others.
+      proc_status_has_mem_counters = true;
+
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.vm_size_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_vm_size_kb(counter);
+        cached.vm_size_kb = counter;
+      }
+    } else if (key == "VmLck") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.vm_locked_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_vm_locked_kb(counter);
+        cached.vm_locked_kb = counter;
+      }
+    } else if (key == "VmHWM") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.vm_hvm_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_vm_hwm_kb(counter);
+        cached.vm_hvm_kb = counter;
+      }
+    } else if (key == "VmRSS") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.vm_rss_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_vm_rss_kb(counter);
+        cached.vm_rss_kb = counter;
+      }
+    } else if (key == "RssAnon") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.rss_anon_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_rss_anon_kb(counter);
+        cached.rss_anon_kb = counter;
+      }
+    } else if (key == "RssFile") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.rss_file_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_rss_file_kb(counter);
+        cached.rss_file_kb = counter;
+      }
+    } else if (key == "RssShmem") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.rss_shmem_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_rss_shmem_kb(counter);
+        cached.rss_shmem_kb = counter;
+      }
+    } else if (key == "VmSwap") {
+      auto counter = ToU32(value);
+      if (MemCounterChanged(cached.vm_swap_kb, counter)) {
+        GetOrCreateStatsProcess(pid)->set_vm_swap_kb(counter);
+        cached.vm_swap_kb = counter;
       }
-      key.push_back(c);
-      continue;
-    }
-
-    if (state == kSeparator) {
-      if (isspace(c))
-        continue;
-      value.clear();
-      value.push_back(c);
-      state = kValue;
-      continue;
-    }
-
-    if (state == kValue) {
-      value.push_back(c);
     }
   }
   return proc_status_has_mem_counters;
 }
 
+bool ProcessStatsDataSource::MemCounterChanged(uint32_t cached_kb,
+                                               uint32_t value_kb) const {
+  // Not written yet, or not since the cache was last cleared.
+  if (cached_kb == std::numeric_limits<uint32_t>::max())
+    return true;
+  uint32_t delta = value_kb > cached_kb ? value_kb - cached_kb
+                                        : cached_kb - value_kb;
+  return delta > 0 && delta >= mem_change_threshold_kb_;
+}
+
 // Fast check to avoid reading information about all threads of a process.
 // If the total process cpu time has not changed, we can skip reading
-// time_in_state for all its threads.
-bool ProcessStatsDataSource::ShouldWriteThreadStats(int32_t pid) {
-  std::string stat = ReadProcPidFile(pid, "stat");
+// time_in_state for all its threads. |proc_stat| is the content of
+// /proc/pid/stat, it is tokenized in place.
+bool ProcessStatsDataSource::ShouldWriteThreadStats(int32_t pid,
+                                                    std::string* proc_stat) {
   // /proc/pid/stat may contain an additional space inside comm. For example:
   // 1 (comm foo) 2 3 ...
   // We strip the prefix including comm. So the result is: 2 3 ...
-  size_t comm_end = stat.rfind(") ");
+  size_t comm_end = proc_stat->rfind(") ");
   if (comm_end == std::string::npos)
     return false;
-  std::string stat_after_comm = stat.substr(comm_end + 2);
+  size_t after_comm = comm_end + 2;
 
   // Indices of space separated fields in /proc/pid/stat offset by 2 to make
   // up for fields removed by stripping the prefix including comm.
   const uint32_t kStatCTimeIndex = 13 - 2;
   const uint32_t kStatSTimeIndex = 14 - 2;
 
-  auto stat_parts = base::SplitString(stat_after_comm, " ");
-  if (stat_parts.size() <= kStatSTimeIndex)
-    return false;
-  auto maybe_ctime = base::StringToUInt64(stat_parts[kStatCTimeIndex]);
-  if (!maybe_ctime.has_value())
-    return false;
-  auto maybe_stime = base::StringToUInt64(stat_parts[kStatSTimeIndex]);
-  if (!maybe_stime.has_value())
+  base::StringSplitter stat_parts(&(*proc_stat)[after_comm],
+                                  proc_stat->size() - after_comm, ' ');
+  base::Optional<uint64_t> maybe_ctime;
+  base::Optional<uint64_t> maybe_stime;
+  for (uint32_t i = 0; i <= kStatSTimeIndex; i++) {
+    if (!stat_parts.Next())
+      return false;
+    if (i == kStatCTimeIndex)
+      maybe_ctime = base::CStringToUInt64(stat_parts.cur_token());
+    if (i == kStatSTimeIndex)
+      maybe_stime = base::CStringToUInt64(stat_parts.cur_token());
+  }
+  if (!maybe_ctime.has_value() || !maybe_stime.has_value())
     return false;
   uint64_t current = maybe_ctime.value() + maybe_stime.value();
   uint64_t& cached = process_stats_cache_[pid].cpu_time;
@@ -662,20 +767,22 @@ void ProcessStatsDataSource::WriteThreadStats(int32_t pid, int32_t tid) {
   // 300 70
   // ...
   // Pairs of CPU frequency and the number of ticks at that frequency.
-  std::string time_in_state = ReadProcPidFile(tid, "time_in_state");
+  std::string& time_in_state = time_in_state_buf_;
+  ReadProcPidFile(tid, "time_in_state", &time_in_state);
   // Bail if time_in_state does not have cpuN headings. Parsing this data
   // without them is more complicated and requires additional information.
   if (!base::StartsWith(time_in_state, "cpu"))
     return;
   protos::pbzero::ProcessStats_Thread* thread = nullptr;
-  base::StringSplitter entries(std::move(time_in_state), '\n');
+  base::StringSplitter entries(&time_in_state[0], time_in_state.size(),
+                               '\n');
   uint32_t last_cpu = 0;
   // Whether all frequencies with non-zero ticks are added to cpu_freq_indices.
   bool full = true;
   while (entries.Next()) {
-    std::string line(entries.cur_token());
-    if (base::StartsWith(line, "cpu")) {
-      last_cpu = base::StringToUInt32(line.substr(3)).value();
+    const char* line = entries.cur_token();
+    if (strncmp(line, "cpu", 3) == 0) {
+      last_cpu = base::CStringToUInt32(line + 3).value();
       continue;
     }
     base::StringSplitter key_value(&entries, ' ');
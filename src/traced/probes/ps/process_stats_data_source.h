@@ -21,17 +21,20 @@
 #include <limits>
 #include <memory>
 #include <set>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 #include "perfetto/base/flat_set.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_task_runner.h"
 #include "perfetto/ext/base/weak_ptr.h"
 #include "perfetto/ext/tracing/core/basic_types.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/forward_decls.h"
 #include "src/traced/probes/common/cpu_freq_info.h"
 #include "src/traced/probes/probes_data_source.h"
+#include "src/traced/probes/ps/proc_pid_file_cache.h"
 
 namespace perfetto {
 
@@ -73,8 +76,17 @@ class ProcessStatsDataSource : public ProbesDataSource {
 
   // Virtual for testing.
   virtual base::ScopedDir OpenProcDir();
-  virtual std::string ReadProcPidFile(int32_t pid, const std::string& file);
   virtual base::ScopedDir OpenProcTaskDir(int32_t pid);
+  // Reads /proc/|pid|/|file| into |out|, reusing its capacity. Returns false
+  // if the file can't be read.
+  virtual bool ReadProcPidFile(int32_t pid, const char* file, std::string* out);
+  // Same as above, for the files read at every poll, which are kept open in
+  // |cache|. Called concurrently by the scan threads, each one with its own
+  // |cache|.
+  virtual bool ReadPolledProcPidFile(ProcPidFileCache* cache,
+                                     int32_t pid,
+                                     const char* file,
+                                     std::string* out);
 
  private:
   struct CachedProcessStats {
@@ -92,6 +104,25 @@ class ProcessStatsDataSource : public ProbesDataSource {
     uint64_t cpu_time = std::numeric_limits<uint64_t>::max();
   };
 
+  // The contents of the /proc/pid files read at each poll. Kept across polls
+  // to reuse the buffers.
+  struct ProcStatsSample {
+    int32_t pid = 0;
+    std::string status;
+    std::string oom_score_adj;
+    std::string stat;  // Only if |record_thread_time_in_state_|.
+  };
+
+  // One per scan thread. The samples of a pid are read by the scan thread
+  // with index pid % scan_shards_.size(), so the pid keeps using the same
+  // ProcPidFileCache.
+  struct ScanShard {
+    explicit ScanShard(size_t max_open_files);
+
+    ProcPidFileCache file_cache;
+    std::vector<ProcStatsSample*> samples;
+  };
+
   // Common functions.
   ProcessStatsDataSource(const ProcessStatsDataSource&) = delete;
   ProcessStatsDataSource& operator=(const ProcessStatsDataSource&) = delete;
@@ -122,8 +153,10 @@ class ProcessStatsDataSource : public ProbesDataSource {
   // Functions for periodically sampling process stats/counters.
   static void Tick(base::WeakPtr<ProcessStatsDataSource>);
   void WriteAllProcessStats();
+  void ReadSamples(ScanShard*);
   bool WriteMemCounters(int32_t pid, const std::string& proc_status);
-  bool ShouldWriteThreadStats(int32_t pid);
+  bool MemCounterChanged(uint32_t cached_kb, uint32_t value_kb) const;
+  bool ShouldWriteThreadStats(int32_t pid, std::string* proc_stat);
   void WriteThreadStats(int32_t pid, int32_t tid);
 
   // Scans /proc/pid/status and writes the ProcessTree packet for input pids.
@@ -168,11 +201,25 @@ class ProcessStatsDataSource : public ProbesDataSource {
   protos::pbzero::ProcessStats_Process* cur_ps_stats_process_ = nullptr;
   std::vector<bool> skip_stats_for_pids_;
 
+  // Buffers for the proc files read outside of the polls.
+  std::string status_buf_;
+  std::string cmdline_buf_;
+  std::string time_in_state_buf_;
+
+  // Samples of the current poll, see WriteAllProcessStats().
+  std::vector<std::unique_ptr<ProcStatsSample>> samples_;
+  std::vector<std::unique_ptr<ScanShard>> scan_shards_;
+  // Run the shards other than the first, which runs on the main thread.
+  std::vector<base::ThreadTaskRunner> scan_threads_;
+
   // Cached process stats per process. Cleared every |cache_ttl_ticks_| *
   // |poll_period_ms_| ms.
   uint32_t process_stats_cache_ttl_ticks_ = 0;
   std::unordered_map<int32_t, CachedProcessStats> process_stats_cache_;
 
+  // Minimum change of a cached memory counter for it to be written again.
+  uint32_t mem_change_threshold_kb_ = 0;
+
   using TimeInStateCacheEntry = std::tuple</* tid */ int32_t,
                                            /* cpu_freq_index */ uint32_t,
                                            /* ticks */ uint64_t>;
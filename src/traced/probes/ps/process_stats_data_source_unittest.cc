@@ -18,6 +18,9 @@
 
 #include <dirent.h>
 
+#include <algorithm>
+#include <map>
+
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
@@ -59,6 +62,20 @@ class TestProcessStatsDataSource : public ProcessStatsDataSource {
   MOCK_METHOD0(OpenProcDir, base::ScopedDir());
   MOCK_METHOD2(ReadProcPidFile, std::string(int32_t pid, const std::string&));
   MOCK_METHOD1(OpenProcTaskDir, base::ScopedDir(int32_t pid));
+
+  // Both the one-shot and the polled reads go through the mock above.
+  bool ReadProcPidFile(int32_t pid,
+                       const char* file,
+                       std::string* out) override {
+    *out = ReadProcPidFile(pid, std::string(file));
+    return !out->empty();
+  }
+  bool ReadPolledProcPidFile(ProcPidFileCache*,
+                             int32_t pid,
+                             const char* file,
+                             std::string* out) override {
+    return ReadProcPidFile(pid, file, out);
+  }
 };
 
 class ProcessStatsDataSourceTest : public ::testing::Test {
@@ -397,6 +414,87 @@ TEST_F(ProcessStatsDataSourceTest, ProcessStats) {
     base::Rmdir(path);
 }
 
+TEST_F(ProcessStatsDataSourceTest, ProcessStatsScanThreads) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(1);
+  cfg.set_proc_stats_scan_threads(3);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory.
+  auto fake_proc = base::TempDir::Create();
+  const int kPids[] = {1, 2, 3, 4, 5, 6, 7};
+  std::vector<std::string> dirs_to_delete;
+  for (int pid : kPids) {
+    char path[256];
+    sprintf(path, "%s/%d", fake_proc.path().c_str(), pid);
+    dirs_to_delete.push_back(path);
+    mkdir(path, 0755);
+  }
+
+  // Stop after the first poll.
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+  int polls = 0;
+  EXPECT_CALL(*data_source, OpenProcDir())
+      .WillRepeatedly(Invoke([&fake_proc, &polls, checkpoint] {
+        if (++polls > 1) {
+          checkpoint();
+          return base::ScopedDir();
+        }
+        return base::ScopedDir(opendir(fake_proc.path().c_str()));
+      }));
+
+  // The files are read on the scan threads.
+  for (int pid : kPids) {
+    EXPECT_CALL(*data_source, ReadProcPidFile(pid, "status"))
+        .WillRepeatedly(Invoke([](int32_t p, const std::string&) {
+          char ret[1024];
+          sprintf(ret, "Name:	pid_10\nVmSize:	 %d kB\nVmRSS:\t%d  kB\n",
+                  p * 100 + 1, p * 100 + 2);
+          return std::string(ret);
+        }));
+    EXPECT_CALL(*data_source, ReadProcPidFile(pid, "oom_score_adj"))
+        .WillRepeatedly(Return(std::to_string(pid * 100 + 3)));
+  }
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  // Each process is written once, regardless of the scan thread that read
+  // its files.
+  // The poll also reports how long it took, and with how many threads.
+  std::map<int32_t, protos::gen::ProcessStats::Process> processes;
+  int scans = 0;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes()) {
+      EXPECT_TRUE(processes.emplace(process.pid(), process).second);
+    }
+    if (packet.process_stats().has_scan_duration_ns()) {
+      scans++;
+      EXPECT_EQ(packet.process_stats().scan_threads(), 3u);
+      EXPECT_LE(packet.process_stats().scan_duration_ns(),
+                packet.process_stats().collection_end_timestamp() -
+                    packet.timestamp());
+    }
+  }
+  EXPECT_EQ(scans, 1);
+  ASSERT_EQ(processes.size(), base::ArraySize(kPids));
+  for (int pid : kPids) {
+    const auto& proc_counters = processes[pid];
+    ASSERT_EQ(static_cast<int>(proc_counters.vm_size_kb()), pid * 100 + 1);
+    ASSERT_EQ(static_cast<int>(proc_counters.vm_rss_kb()), pid * 100 + 2);
+    ASSERT_EQ(static_cast<int>(proc_counters.oom_score_adj()), pid * 100 + 3);
+  }
+
+  // Cleanup |fake_proc|. TempDir checks that the directory is empty.
+  for (std::string& path : dirs_to_delete)
+    base::Rmdir(path);
+}
+
 TEST_F(ProcessStatsDataSourceTest, CacheProcessStats) {
   DataSourceConfig ds_config;
   ProcessStatsConfig cfg;
@@ -465,6 +563,70 @@ TEST_F(ProcessStatsDataSourceTest, CacheProcessStats) {
   base::Rmdir(path);
 }
 
+TEST_F(ProcessStatsDataSourceTest, MemChangeThreshold) {
+  DataSourceConfig ds_config;
+  ProcessStatsConfig cfg;
+  cfg.set_proc_stats_poll_ms(100);
+  cfg.set_proc_stats_cache_ttl_ms(100000);
+  cfg.set_proc_stats_mem_change_threshold_kb(10);
+  cfg.add_quirks(ProcessStatsConfig::DISABLE_ON_DEMAND);
+  ds_config.set_process_stats_config_raw(cfg.SerializeAsString());
+  auto data_source = GetProcessStatsDataSource(ds_config);
+
+  // Populate a fake /proc/ directory.
+  auto fake_proc = base::TempDir::Create();
+  const int kPid = 1;
+
+  char path[256];
+  sprintf(path, "%s/%d", fake_proc.path().c_str(), kPid);
+  mkdir(path, 0755);
+
+  auto checkpoint = task_runner_.CreateCheckpoint("all_done");
+
+  EXPECT_CALL(*data_source, OpenProcDir()).WillRepeatedly(Invoke([&fake_proc] {
+    return base::ScopedDir(opendir(fake_proc.path().c_str()));
+  }));
+
+  // VmRSS changes by less than the threshold at the second and fourth polls.
+  // At the third, it reaches the threshold since it was last written.
+  const int kRss[] = {1000, 1009, 1010, 1005};
+  const int kNumIters = base::ArraySize(kRss);
+  int iter = 0;
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "status"))
+      .WillRepeatedly(Invoke([&kRss, &iter](int32_t, const std::string&) {
+        char ret[1024];
+        // Also read after the last poll, to dump the process tree.
+        int rss = kRss[std::min(iter, kNumIters - 1)];
+        sprintf(ret, "Name:	pid_10\nVmSize:	 %d kB\nVmRSS:\t%d  kB\n", 5000,
+                rss);
+        return std::string(ret);
+      }));
+
+  EXPECT_CALL(*data_source, ReadProcPidFile(kPid, "oom_score_adj"))
+      .WillRepeatedly(Invoke([checkpoint, &iter](int32_t, const std::string&) {
+        if (++iter == kNumIters)
+          checkpoint();
+        return std::string("0");
+      }));
+
+  data_source->Start();
+  task_runner_.RunUntilCheckpoint("all_done");
+  data_source->Flush(1 /* FlushRequestId */, []() {});
+
+  std::vector<uint32_t> rss;
+  auto trace = writer_raw_->GetAllTracePackets();
+  for (const auto& packet : trace) {
+    for (const auto& process : packet.process_stats().processes()) {
+      if (process.has_vm_rss_kb())
+        rss.push_back(static_cast<uint32_t>(process.vm_rss_kb()));
+    }
+  }
+  EXPECT_THAT(rss, ElementsAre(1000u, 1010u));
+
+  // Cleanup |fake_proc|. TempDir checks that the directory is empty.
+  base::Rmdir(path);
+}
+
 TEST_F(ProcessStatsDataSourceTest, ThreadTimeInState) {
   DataSourceConfig ds_config;
   ProcessStatsConfig config;
@@ -46,6 +46,18 @@ using protos::pbzero::SysStatsConfig;
 
 namespace {
 constexpr size_t kReadBufSize = 1024 * 16;
+constexpr uint32_t kDefaultKeyframePeriodMs = 10000;
+
+// Marks the counters that were not written since the last keyframe.
+constexpr uint64_t kNotWritten = std::numeric_limits<uint64_t>::max();
+
+// Returns the last written value of the counter at |index|, growing |values|
+// if needed (e.g. for a cpu that was hotplugged).
+uint64_t* LastValueAt(std::vector<uint64_t>* values, size_t index) {
+  if (index >= values->size())
+    values->resize(index + 1, kNotWritten);
+  return &(*values)[index];
+}
 
 base::ScopedFile OpenReadOnly(const char* path) {
   base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
@@ -64,12 +76,21 @@ uint32_t ClampTo10Ms(uint32_t period_ms, const char* counter_name) {
   return period_ms;
 }
 
+uint64_t Gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
 }  // namespace
 
 // static
 const ProbesDataSource::Descriptor SysStatsDataSource::descriptor = {
     /*name*/ "linux.sys_stats",
-    /*flags*/ Descriptor::kFlagsNone,
+    /*flags*/ Descriptor::kHandlesIncrementalState,
 };
 
 SysStatsDataSource::SysStatsDataSource(base::TaskRunner* task_runner,
@@ -80,6 +101,9 @@ SysStatsDataSource::SysStatsDataSource(base::TaskRunner* task_runner,
     : ProbesDataSource(session_id, &descriptor),
       task_runner_(task_runner),
       writer_(std::move(writer)),
+      last_num_irq_total_(kNotWritten),
+      last_num_softirq_total_(kNotWritten),
+      last_num_forks_(kNotWritten),
       weak_factory_(this) {
   ns_per_user_hz_ = 1000000000ull / static_cast<uint64_t>(sysconf(_SC_CLK_TCK));
 
@@ -169,6 +193,38 @@ SysStatsDataSource::SysStatsDataSource(base::TaskRunner* task_runner,
   vmstat_ticks_ = ticks[1];
   stat_ticks_ = ticks[2];
   devfreq_ticks_ = ticks[3];
+
+  // All the counters are read at the ticks that are multiples of the least
+  // common multiple of the periods (e.g. 6 for periods of 1, 2 and 3 ticks).
+  // Keyframes must be at one of those, or some counters would never be
+  // written in full.
+  // Can't overflow, as it's multiplied only while it fits in 32 bits.
+  uint64_t all_counters_ticks = 1;
+  for (uint32_t t : ticks) {
+    if (t && all_counters_ticks <= std::numeric_limits<uint32_t>::max())
+      all_counters_ticks = all_counters_ticks / Gcd(all_counters_ticks, t) * t;
+  }
+  delta_encode_ = cfg.delta_encode_counters();
+  if (delta_encode_ &&
+      all_counters_ticks > std::numeric_limits<uint32_t>::max() / 2) {
+    PERFETTO_ELOG("SysStat periods too far apart to delta encode counters");
+    delta_encode_ = false;
+  }
+  all_counters_ticks_ = static_cast<uint32_t>(all_counters_ticks);
+  if (delta_encode_) {
+    uint32_t keyframe_period_ms = cfg.keyframe_period_ms()
+                                      ? cfg.keyframe_period_ms()
+                                      : kDefaultKeyframePeriodMs;
+    // Rounded up to a multiple of |all_counters_ticks_|.
+    uint64_t all_counters_ms = all_counters_ticks * tick_period_ms_;
+    uint64_t keyframes = std::max<uint64_t>(
+        (keyframe_period_ms + all_counters_ms - 1) / all_counters_ms, 1);
+    keyframe_ticks_ = static_cast<uint32_t>(std::min<uint64_t>(
+        keyframes * all_counters_ticks,
+        std::numeric_limits<uint32_t>::max() / all_counters_ticks *
+            all_counters_ticks));
+    meminfo_change_threshold_kb_ = cfg.meminfo_change_threshold_kb();
+  }
 }
 
 void SysStatsDataSource::Start() {
@@ -198,6 +254,18 @@ void SysStatsDataSource::ReadSysStats() {
   auto packet = writer_->NewTracePacket();
 
   packet->set_timestamp(static_cast<uint64_t>(base::GetBootTimeNs().count()));
+  if (delta_encode_) {
+    is_keyframe_ = tick_ % keyframe_ticks_ == 0 ||
+                   (keyframe_pending_ && tick_ % all_counters_ticks_ == 0);
+    if (is_keyframe_) {
+      keyframe_pending_ = false;
+      packet->set_sequence_flags(
+          protos::pbzero::TracePacket::SEQ_INCREMENTAL_STATE_CLEARED);
+    } else {
+      packet->set_sequence_flags(
+          protos::pbzero::TracePacket::SEQ_NEEDS_INCREMENTAL_STATE);
+    }
+  }
   auto* sys_stats = packet->set_sys_stats();
 
   if (meminfo_ticks_ && tick_ % meminfo_ticks_ == 0)
@@ -281,6 +349,10 @@ void SysStatsDataSource::ReadMeminfo(protos::pbzero::SysStats* sys_stats) {
     if (!words.Next())
       continue;
     auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+    if (!CounterChanged(LastValueAt(&last_meminfo_, size_t(counter_id)), value,
+                        meminfo_change_threshold_kb_)) {
+      continue;
+    }
     auto* meminfo = sys_stats->add_meminfo();
     meminfo->set_key(static_cast<protos::pbzero::MeminfoCounters>(counter_id));
     meminfo->set_value(value);
@@ -303,6 +375,8 @@ void SysStatsDataSource::ReadVmstat(protos::pbzero::SysStats* sys_stats) {
     if (!words.Next())
       continue;
     auto value = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+    if (!CounterChanged(LastValueAt(&last_vmstat_, size_t(counter_id)), value))
+      continue;
     auto* vmstat = sys_stats->add_vmstat();
     vmstat->set_key(static_cast<protos::pbzero::VmstatCounters>(counter_id));
     vmstat->set_value(value);
@@ -322,21 +396,42 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     // Per-CPU stats.
     if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_CPU_TIMES)) &&
         words.cur_token_size() > 3 && !strncmp(words.cur_token(), "cpu", 3)) {
-      long cpu_id = strtol(words.cur_token() + 3, nullptr, 10);
+      auto cpu_id =
+          static_cast<uint32_t>(strtol(words.cur_token() + 3, nullptr, 10));
       std::array<uint64_t, 7> cpu_times{};
       for (size_t i = 0; i < cpu_times.size() && words.Next(); i++) {
         cpu_times[i] =
-            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)) *
+            ns_per_user_hz_;
       }
+      if (cpu_id >= last_cpu_times_.size()) {
+        std::array<uint64_t, 7> not_written;
+        not_written.fill(kNotWritten);
+        last_cpu_times_.resize(cpu_id + 1, not_written);
+      }
+      uint32_t changed = 0;
+      for (size_t i = 0; i < cpu_times.size(); i++) {
+        if (CounterChanged(&last_cpu_times_[cpu_id][i], cpu_times[i]))
+          changed |= 1u << i;
+      }
+      if (!changed)
+        continue;
       auto* cpu_stat = sys_stats->add_cpu_stat();
-      cpu_stat->set_cpu_id(static_cast<uint32_t>(cpu_id));
-      cpu_stat->set_user_ns(cpu_times[0] * ns_per_user_hz_);
-      cpu_stat->set_user_ice_ns(cpu_times[1] * ns_per_user_hz_);
-      cpu_stat->set_system_mode_ns(cpu_times[2] * ns_per_user_hz_);
-      cpu_stat->set_idle_ns(cpu_times[3] * ns_per_user_hz_);
-      cpu_stat->set_io_wait_ns(cpu_times[4] * ns_per_user_hz_);
-      cpu_stat->set_irq_ns(cpu_times[5] * ns_per_user_hz_);
-      cpu_stat->set_softirq_ns(cpu_times[6] * ns_per_user_hz_);
+      cpu_stat->set_cpu_id(cpu_id);
+      if (changed & (1u << 0))
+        cpu_stat->set_user_ns(cpu_times[0]);
+      if (changed & (1u << 1))
+        cpu_stat->set_user_ice_ns(cpu_times[1]);
+      if (changed & (1u << 2))
+        cpu_stat->set_system_mode_ns(cpu_times[2]);
+      if (changed & (1u << 3))
+        cpu_stat->set_idle_ns(cpu_times[3]);
+      if (changed & (1u << 4))
+        cpu_stat->set_io_wait_ns(cpu_times[4]);
+      if (changed & (1u << 5))
+        cpu_stat->set_irq_ns(cpu_times[5]);
+      if (changed & (1u << 6))
+        cpu_stat->set_softirq_ns(cpu_times[6]);
     }
     // IRQ counters
     else if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_IRQ_COUNTS)) &&
@@ -344,8 +439,10 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
       for (size_t i = 0; words.Next(); i++) {
         auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
         if (i == 0) {
-          sys_stats->set_num_irq_total(v);
-        } else if (v > 0) {
+          if (CounterChanged(&last_num_irq_total_, v))
+            sys_stats->set_num_irq_total(v);
+        } else if (v > 0 &&
+                   CounterChanged(LastValueAt(&last_irq_counts_, i - 1), v)) {
           auto* irq_stat = sys_stats->add_num_irq();
           irq_stat->set_irq(static_cast<int32_t>(i - 1));
           irq_stat->set_count(v);
@@ -359,8 +456,10 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
       for (size_t i = 0; words.Next(); i++) {
         auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
         if (i == 0) {
-          sys_stats->set_num_softirq_total(v);
-        } else {
+          if (CounterChanged(&last_num_softirq_total_, v))
+            sys_stats->set_num_softirq_total(v);
+        } else if (CounterChanged(LastValueAt(&last_softirq_counts_, i - 1),
+                                  v)) {
           auto* softirq_stat = sys_stats->add_num_softirq();
           softirq_stat->set_irq(static_cast<int32_t>(i - 1));
           softirq_stat->set_count(v);
@@ -371,8 +470,9 @@ void SysStatsDataSource::ReadStat(protos::pbzero::SysStats* sys_stats) {
     else if ((stat_enabled_fields_ & (1 << SysStatsConfig::STAT_FORK_COUNT)) &&
              !strcmp(words.cur_token(), "processes")) {
       if (words.Next()) {
-        sys_stats->set_num_forks(
-            static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10)));
+        auto v = static_cast<uint64_t>(strtoll(words.cur_token(), nullptr, 10));
+        if (CounterChanged(&last_num_forks_, v))
+          sys_stats->set_num_forks(v);
       }
     }
 
@@ -387,6 +487,26 @@ void SysStatsDataSource::Flush(FlushRequestID, std::function<void()> callback) {
   writer_->Flush(callback);
 }
 
+void SysStatsDataSource::ClearIncrementalState() {
+  // Write all the counters again at the next tick that reads all of them.
+  keyframe_pending_ = true;
+}
+
+bool SysStatsDataSource::CounterChanged(uint64_t* last_value,
+                                        uint64_t value,
+                                        uint64_t threshold) {
+  if (!delta_encode_)
+    return true;
+  if (!is_keyframe_ && *last_value != kNotWritten) {
+    uint64_t delta =
+        value > *last_value ? value - *last_value : *last_value - value;
+    if (delta == 0 || delta < threshold)
+      return false;
+  }
+  *last_value = value;
+  return true;
+}
+
 size_t SysStatsDataSource::ReadFile(base::ScopedFile* fd, const char* path) {
   if (!*fd)
     return 0;
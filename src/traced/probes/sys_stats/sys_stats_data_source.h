@@ -19,9 +19,11 @@
 
 #include <string.h>
 
+#include <array>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/scoped_file.h"
@@ -58,6 +60,7 @@ class SysStatsDataSource : public ProbesDataSource {
   // ProbesDataSource implementation.
   void Start() override;
   void Flush(FlushRequestID, std::function<void()> callback) override;
+  void ClearIncrementalState() override;
 
   base::WeakPtr<SysStatsDataSource> GetWeakPtr() const;
 
@@ -86,6 +89,14 @@ class SysStatsDataSource : public ProbesDataSource {
   void ReadDevfreq(protos::pbzero::SysStats* sys_stats);
   size_t ReadFile(base::ScopedFile*, const char* path);
 
+  // Returns true if a counter with the given |value| should be written, i.e.
+  // always unless |delta_encode_| is set. In that case, only if it changed by
+  // at least |threshold| since |*last_value| or if this is a keyframe.
+  // Updates |*last_value| if true.
+  bool CounterChanged(uint64_t* last_value,
+                      uint64_t value,
+                      uint64_t threshold = 0);
+
   base::TaskRunner* const task_runner_;
   std::unique_ptr<TraceWriter> writer_;
   base::ScopedFile meminfo_fd_;
@@ -105,6 +116,23 @@ class SysStatsDataSource : public ProbesDataSource {
   uint32_t devfreq_ticks_ = 0;
   bool devfreq_error_logged_ = false;
 
+  // State for SysStatsConfig.delta_encode_counters. The last written values
+  // are indexed by counter enum, cpu and irq number respectively.
+  bool delta_encode_ = false;
+  bool is_keyframe_ = false;
+  bool keyframe_pending_ = false;
+  uint32_t keyframe_ticks_ = 0;
+  uint32_t all_counters_ticks_ = 0;
+  uint64_t meminfo_change_threshold_kb_ = 0;
+  std::vector<uint64_t> last_meminfo_;
+  std::vector<uint64_t> last_vmstat_;
+  std::vector<std::array<uint64_t, 7>> last_cpu_times_;
+  std::vector<uint64_t> last_irq_counts_;
+  std::vector<uint64_t> last_softirq_counts_;
+  uint64_t last_num_irq_total_;
+  uint64_t last_num_softirq_total_;
+  uint64_t last_num_forks_;
+
   base::WeakPtrFactory<SysStatsDataSource> weak_factory_;  // Keep last.
 };
 
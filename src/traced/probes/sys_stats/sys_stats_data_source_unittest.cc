@@ -236,18 +236,22 @@ class SysStatsDataSourceTest : public ::testing::Test {
     return instance;
   }
 
-  void Poller(SysStatsDataSource* ds, std::function<void()> checkpoint) {
-    if (ds->tick_for_testing())
+  void Poller(SysStatsDataSource* ds,
+              uint32_t ticks,
+              std::function<void()> checkpoint) {
+    if (ds->tick_for_testing() >= ticks)
       checkpoint();
     else
       task_runner_.PostDelayedTask(
-          [ds, checkpoint, this] { Poller(ds, checkpoint); }, 1);
+          [ds, ticks, checkpoint, this] { Poller(ds, ticks, checkpoint); }, 1);
   }
 
-  void WaitTick(SysStatsDataSource* data_source) {
-    auto checkpoint = task_runner_.CreateCheckpoint("on_tick");
-    Poller(data_source, checkpoint);
-    task_runner_.RunUntilCheckpoint("on_tick");
+  // Waits until |data_source| has polled |ticks| times since the start.
+  void WaitTick(SysStatsDataSource* data_source, uint32_t ticks = 1) {
+    std::string name = "on_tick_" + std::to_string(ticks);
+    auto checkpoint = task_runner_.CreateCheckpoint(name);
+    Poller(data_source, ticks, checkpoint);
+    task_runner_.RunUntilCheckpoint(name);
   }
 
   TraceWriterForTesting* writer_raw_ = nullptr;
@@ -482,5 +486,92 @@ TEST_F(SysStatsDataSourceTest, StatForksOnly) {
   ASSERT_EQ(sys_stats.num_softirq_size(), 0);
 }
 
+TEST_F(SysStatsDataSourceTest, DeltaEncodeCounters) {
+  using protos::gen::TracePacket;
+  DataSourceConfig config;
+  protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_meminfo_period_ms(10);
+  sys_cfg.set_stat_period_ms(20);
+  sys_cfg.set_delta_encode_counters(true);
+  sys_cfg.set_keyframe_period_ms(1000000);
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+  auto data_source = GetSysStatsDataSource(config);
+
+  // The first sample is a keyframe. The mock /proc files never change, so the
+  // next ones have no counters.
+  WaitTick(data_source.get(), 3);
+  auto packets = writer_raw_->GetAllTracePackets();
+  ASSERT_GE(packets.size(), 3u);
+  EXPECT_EQ(packets[0].sequence_flags(),
+            static_cast<uint32_t>(TracePacket::SEQ_INCREMENTAL_STATE_CLEARED));
+  EXPECT_GE(packets[0].sys_stats().meminfo_size(), 10);
+  EXPECT_EQ(packets[0].sys_stats().cpu_stat_size(), 8);
+  EXPECT_EQ(packets[0].sys_stats().num_forks(), 243320u);
+  for (size_t i = 1; i < packets.size(); i++) {
+    EXPECT_EQ(packets[i].sequence_flags(),
+              static_cast<uint32_t>(TracePacket::SEQ_NEEDS_INCREMENTAL_STATE));
+    EXPECT_EQ(packets[i].sys_stats().meminfo_size(), 0);
+    EXPECT_EQ(packets[i].sys_stats().cpu_stat_size(), 0);
+    EXPECT_FALSE(packets[i].sys_stats().has_num_forks());
+  }
+
+  // Clearing the incremental state triggers a keyframe at the next tick that
+  // reads all the counters (i.e. an even one, given the periods above).
+  data_source->ClearIncrementalState();
+  size_t num_packets = packets.size();
+  WaitTick(data_source.get(), static_cast<uint32_t>(num_packets) + 2);
+  packets = writer_raw_->GetAllTracePackets();
+  size_t keyframes = 0;
+  for (size_t i = num_packets; i < packets.size(); i++) {
+    if (packets[i].sequence_flags() !=
+        static_cast<uint32_t>(TracePacket::SEQ_INCREMENTAL_STATE_CLEARED)) {
+      continue;
+    }
+    keyframes++;
+    EXPECT_EQ(i % 2, 0u);
+    EXPECT_GE(packets[i].sys_stats().meminfo_size(), 10);
+    EXPECT_EQ(packets[i].sys_stats().cpu_stat_size(), 8);
+  }
+  EXPECT_EQ(keyframes, 1u);
+}
+
+TEST_F(SysStatsDataSourceTest, DeltaEncodeCountersCoprimePeriods) {
+  using protos::gen::TracePacket;
+  DataSourceConfig config;
+  protos::gen::SysStatsConfig sys_cfg;
+  sys_cfg.set_stat_period_ms(10);
+  sys_cfg.set_meminfo_period_ms(20);
+  sys_cfg.set_vmstat_period_ms(30);
+  sys_cfg.set_delta_encode_counters(true);
+  sys_cfg.set_keyframe_period_ms(70);
+  config.set_sys_stats_config_raw(sys_cfg.SerializeAsString());
+  auto data_source = GetSysStatsDataSource(config);
+
+  // All the counters are read together only every 6 ticks (60 ms), so that's
+  // where the keyframes must be: both the periodic ones (70 ms is rounded up
+  // to 12 ticks) and the one after clearing the incremental state.
+  WaitTick(data_source.get(), 2);
+  data_source->ClearIncrementalState();
+  WaitTick(data_source.get(), 13);
+  auto packets = writer_raw_->GetAllTracePackets();
+  ASSERT_GE(packets.size(), 13u);
+  size_t keyframes = 0;
+  for (size_t i = 0; i < packets.size(); i++) {
+    if (packets[i].sequence_flags() !=
+        static_cast<uint32_t>(TracePacket::SEQ_INCREMENTAL_STATE_CLEARED)) {
+      EXPECT_EQ(packets[i].sequence_flags(),
+                static_cast<uint32_t>(TracePacket::SEQ_NEEDS_INCREMENTAL_STATE));
+      continue;
+    }
+    keyframes++;
+    EXPECT_EQ(i % 6, 0u);
+    EXPECT_GE(packets[i].sys_stats().meminfo_size(), 10);
+    EXPECT_GT(packets[i].sys_stats().vmstat_size(), 0);
+    EXPECT_EQ(packets[i].sys_stats().cpu_stat_size(), 8);
+    EXPECT_EQ(packets[i].sys_stats().num_forks(), 243320u);
+  }
+  EXPECT_GE(keyframes, 3u);
+}
+
 }  // namespace
 }  // namespace perfetto
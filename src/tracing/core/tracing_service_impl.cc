@@ -334,15 +334,18 @@ std::string GetBugreportPath() {
 // static
 std::unique_ptr<TracingService> TracingService::CreateInstance(
     std::unique_ptr<SharedMemory::Factory> shm_factory,
-    base::TaskRunner* task_runner) {
+    base::TaskRunner* task_runner,
+    InitOpts init_opts) {
   return std::unique_ptr<TracingService>(
-      new TracingServiceImpl(std::move(shm_factory), task_runner));
+      new TracingServiceImpl(std::move(shm_factory), task_runner, init_opts));
 }
 
 TracingServiceImpl::TracingServiceImpl(
     std::unique_ptr<SharedMemory::Factory> shm_factory,
-    base::TaskRunner* task_runner)
+    base::TaskRunner* task_runner,
+    InitOpts init_opts)
     : task_runner_(task_runner),
+      init_opts_(init_opts),
       shm_factory_(std::move(shm_factory)),
       uid_(base::GetCurrentUserId()),
       buffer_ids_(kMaxTraceBufferID),
@@ -807,6 +810,15 @@ base::Status TracingServiceImpl::EnableTracing(ConsumerEndpointImpl* consumer,
   if (trace_filter)
     tracing_session->trace_filter = std::move(trace_filter);
 
+  if (cfg.compression_type() == TraceConfig::COMPRESSION_TYPE_DEFLATE &&
+      !cfg.compress_from_cli()) {
+    if (init_opts_.compressor_fn) {
+      tracing_session->compress_deflate = true;
+    } else {
+      PERFETTO_LOG("Compression requested but not supported by the service");
+    }
+  }
+
   if (cfg.write_into_file()) {
     if (!fd ^ !cfg.output_path().empty()) {
       tracing_sessions_.erase(tsid);
@@ -1614,9 +1626,23 @@ void TracingServiceImpl::DisableTracingNotifyConsumerAndFlushFile(
 
   if (tracing_session->write_into_file) {
     tracing_session->write_period_ms = 0;
-    ReadBuffersIntoFile(tracing_session->id);
+    // A pending chunk of a compressed trace keeps draining the buffers on its
+    // own, see ReadBuffers().
+    if (!tracing_session->write_into_file_chunk_pending)
+      ReadBuffersIntoFile(tracing_session->id);
+    // Don't tell the consumer (or the bugreport) that tracing is disabled
+    // until the rest of the trace is in the file.
+    if (tracing_session->write_into_file_chunk_pending) {
+      tracing_session->notify_disabled_after_write_into_file = true;
+      return;
+    }
   }
 
+  NotifyConsumerTracingDisabled(tracing_session);
+}
+
+void TracingServiceImpl::NotifyConsumerTracingDisabled(
+    TracingSession* tracing_session) {
   if (tracing_session->on_disable_callback_for_bugreport) {
     std::move(tracing_session->on_disable_callback_for_bugreport)();
     tracing_session->on_disable_callback_for_bugreport = nullptr;
@@ -2118,6 +2144,21 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
   // buffers are full and hang the service for a bit (until the consumer
   // catches up).
   static constexpr size_t kApproxBytesPerTask = 32768;
+
+  // When writing into a file, the buffers are normally drained in one task, as
+  // writing doesn't block on the consumer. Compressing them, though, takes
+  // about as long as reading them back over IPC (DEFLATE runs at a few tens
+  // of MB/s), and would block the service thread for seconds at the end of a
+  // large trace. So compressed traces are written in chunks of this size, one
+  // task each.
+  static constexpr size_t kApproxCompressedFileBytesPerTask = 1024 * 1024;
+
+  size_t max_bytes_per_task = kApproxBytesPerTask;
+  if (tracing_session->write_into_file) {
+    max_bytes_per_task = tracing_session->compress_deflate
+                             ? kApproxCompressedFileBytesPerTask
+                             : std::numeric_limits<size_t>::max();
+  }
   bool did_hit_threshold = false;
 
   // TODO(primiano): Extend the ReadBuffers API to allow reading only some
@@ -2182,8 +2223,7 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
 
       // Append the packet (inclusive of the trusted uid) to |packets|.
       packets_bytes += packet.size();
-      did_hit_threshold = packets_bytes >= kApproxBytesPerTask &&
-                          !tracing_session->write_into_file;
+      did_hit_threshold = packets_bytes >= max_bytes_per_task;
       packets.emplace_back(std::move(packet));
     }  // for(packets...)
   }    // for(buffers...)
@@ -2255,6 +2295,13 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
     }  // for (packet)
   }    // if (trace_filter)
 
+  // Compression is applied after filtering, as the filter needs to see the
+  // original TracePacket(s). This replaces |packets| with (fewer) packets that
+  // contain only the |compressed_packets| field.
+  if (tracing_session->compress_deflate) {
+    init_opts_.compressor_fn(&packets);
+  }
+
   // If the caller asked us to write into a file by setting
   // |write_into_file| == true in the trace config, drain the packets read
   // (if any) into the given file descriptor.
@@ -2305,35 +2352,80 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
     int fd = *tracing_session->write_into_file;
 
     uint64_t total_wr_size = 0;
+    const int64_t write_start_ns = base::GetWallTimeNs().count();
 
     // writev() can take at most IOV_MAX entries per call. Batch them.
+    // The iovecs point directly into the TraceBuffer chunks (and into the
+    // TracePacket preambles), so no payload copy happens in userspace.
     constexpr size_t kIOVMax = IOV_MAX;
-    for (size_t i = 0; i < num_iovecs; i += kIOVMax) {
+    for (size_t i = 0; i < num_iovecs;) {
       int iov_batch_size = static_cast<int>(std::min(num_iovecs - i, kIOVMax));
       ssize_t wr_size = PERFETTO_EINTR(writev(fd, &iovecs[i], iov_batch_size));
+      tracing_session->write_into_file_syscalls++;
       if (wr_size <= 0) {
         PERFETTO_PLOG("writev() failed");
         stop_writing_into_file = true;
         break;
       }
       total_wr_size += static_cast<size_t>(wr_size);
+
+      // writev() is allowed to perform a short write (e.g. pipes, or when
+      // getting close to RLIMIT_FSIZE). Skip the iovecs that have been fully
+      // written and resume from the middle of the partially written one, so
+      // that we never leave a truncated packet in the middle of the file.
+      size_t bytes_left = static_cast<size_t>(wr_size);
+      while (i < num_iovecs && bytes_left >= iovecs[i].iov_len) {
+        bytes_left -= iovecs[i].iov_len;
+        i++;
+      }
+      if (bytes_left > 0) {
+        PERFETTO_DCHECK(i < num_iovecs);
+        char* iov_base = static_cast<char*>(iovecs[i].iov_base);
+        iovecs[i].iov_base = iov_base + bytes_left;
+        iovecs[i].iov_len -= bytes_left;
+      }
     }
 
+    const uint64_t write_dur_ns =
+        static_cast<uint64_t>(base::GetWallTimeNs().count() - write_start_ns);
+    tracing_session->write_into_file_total_dur_ns += write_dur_ns;
+    tracing_session->write_into_file_max_dur_ns =
+        std::max(tracing_session->write_into_file_max_dur_ns, write_dur_ns);
     tracing_session->bytes_written_into_file += total_wr_size;
 
     PERFETTO_DLOG("Draining into file, written: %" PRIu64 " KB, stop: %d",
                   (total_wr_size + 1023) / 1024, stop_writing_into_file);
-    if (stop_writing_into_file || tracing_session->write_period_ms == 0) {
+    if (stop_writing_into_file ||
+        (tracing_session->write_period_ms == 0 && !has_more)) {
       // Ensure all data was written to the file before we close it.
       base::FlushFile(fd);
       tracing_session->write_into_file.reset();
       tracing_session->write_period_ms = 0;
       if (tracing_session->state == TracingSession::STARTED)
         DisableTracing(tsid);
+      if (tracing_session->notify_disabled_after_write_into_file) {
+        tracing_session->notify_disabled_after_write_into_file = false;
+        NotifyConsumerTracingDisabled(tracing_session);
+      }
       return true;
     }
 
     auto weak_this = weak_ptr_factory_.GetWeakPtr();
+    if (has_more) {
+      // Compress and write the next chunk in a separate task, so that other
+      // tasks (e.g. commits from the producers) can run in between.
+      tracing_session->write_into_file_chunk_pending = true;
+      task_runner_->PostTask([weak_this, tsid] {
+        if (!weak_this)
+          return;
+        TracingSession* session = weak_this->GetTracingSession(tsid);
+        if (!session)
+          return;
+        session->write_into_file_chunk_pending = false;
+        weak_this->ReadBuffersIntoFile(tsid);
+      });
+      return true;
+    }
     task_runner_->PostDelayedTask(
         [weak_this, tsid] {
           if (weak_this)
@@ -3167,6 +3259,17 @@ TraceStats TracingServiceImpl::GetTraceStats(TracingSession* tracing_session) {
     filt_stats->set_errors(tracing_session->filter_errors);
   }
 
+  if (tracing_session->write_into_file ||
+      tracing_session->bytes_written_into_file) {
+    auto* wr_stats = trace_stats.mutable_write_into_file_stats();
+    wr_stats->set_bytes_written(tracing_session->bytes_written_into_file);
+    wr_stats->set_write_syscalls(tracing_session->write_into_file_syscalls);
+    wr_stats->set_total_write_duration_ns(
+        tracing_session->write_into_file_total_dur_ns);
+    wr_stats->set_max_write_duration_ns(
+        tracing_session->write_into_file_max_dur_ns);
+  }
+
   for (BufferID buf_id : tracing_session->buffers_index) {
     TraceBuffer* buf = GetBufferByID(buf_id);
     if (!buf) {
@@ -3722,6 +3825,7 @@ void TracingServiceImpl::ConsumerEndpointImpl::QueryCapabilities(
   TracingServiceCapabilities caps;
   caps.set_has_query_capabilities(true);
   caps.set_has_trace_config_output_path(true);
+  caps.set_has_trace_compression(!!service_->init_opts_.compressor_fn);
   caps.add_observable_events(ObservableEvents::TYPE_DATA_SOURCES_INSTANCES);
   caps.add_observable_events(ObservableEvents::TYPE_ALL_DATA_SOURCES_STARTED);
   static_assert(ObservableEvents::Type_MAX ==
@@ -248,7 +248,8 @@ class TracingServiceImpl : public TracingService {
   };
 
   explicit TracingServiceImpl(std::unique_ptr<SharedMemory::Factory>,
-                              base::TaskRunner*);
+                              base::TaskRunner*,
+                              InitOpts = {});
   ~TracingServiceImpl() override;
 
   // Called by ProducerEndpointImpl.
@@ -304,11 +305,13 @@ class TracingServiceImpl : public TracingService {
   // them into the associated file.
   //
   // Reads all the data in the buffers (or until the file is full) before
-  // returning.
+  // returning, unless the trace is compressed. In that case it reads (and
+  // compresses) a chunk of the data and schedules itself to run again right
+  // away, until the buffers are drained.
   //
   // If the tracing session write_period_ms is 0, the file is full or there has
-  // been an error, flushes the file and closes it. Otherwise, schedules itself
-  // to be executed after write_period_ms.
+  // been an error, flushes the file and closes it once the buffers are
+  // drained. Otherwise, schedules itself to be executed after write_period_ms.
   //
   // Returns false in case of error.
   bool ReadBuffersIntoFile(TracingSessionID);
@@ -606,6 +609,12 @@ class TracingServiceImpl : public TracingService {
     uint64_t max_file_size_bytes = 0;
     uint64_t bytes_written_into_file = 0;
 
+    // Accounting of the periodic draining into |write_into_file|. Reported
+    // in TraceStats.write_into_file_stats.
+    uint64_t write_into_file_syscalls = 0;
+    uint64_t write_into_file_total_dur_ns = 0;
+    uint64_t write_into_file_max_dur_ns = 0;
+
     // Set when using SaveTraceForBugreport(). This callback will be called
     // when the tracing session ends and the data has been saved into the file.
     std::function<void()> on_disable_callback_for_bugreport;
@@ -621,6 +630,19 @@ class TracingServiceImpl : public TracingService {
     uint64_t filter_input_bytes = 0;
     uint64_t filter_output_bytes = 0;
     uint64_t filter_errors = 0;
+
+    // When true, ReadBuffers() passes the packets through
+    // InitOpts.compressor_fn before handing them to the consumer or writing
+    // them into the file.
+    bool compress_deflate = false;
+
+    // Set while a task is pending to compress and write the next chunk of the
+    // buffers into |write_into_file|, see ReadBuffers().
+    bool write_into_file_chunk_pending = false;
+
+    // Set if tracing was disabled while chunks were still pending. The
+    // consumer is notified once all of them have been written into the file.
+    bool notify_disabled_after_write_into_file = false;
   };
 
   TracingServiceImpl(const TracingServiceImpl&) = delete;
@@ -675,6 +697,7 @@ class TracingServiceImpl : public TracingService {
   void OnFlushTimeout(TracingSessionID, FlushRequestID);
   void OnDisableTracingTimeout(TracingSessionID);
   void DisableTracingNotifyConsumerAndFlushFile(TracingSession*);
+  void NotifyConsumerTracingDisabled(TracingSession*);
   void PeriodicFlushTask(TracingSessionID, bool post_next_only);
   void CompleteFlush(TracingSessionID tsid,
                      ConsumerEndpoint::FlushCallback callback,
@@ -697,6 +720,7 @@ class TracingServiceImpl : public TracingService {
                                              uint64_t trigger_name_hash);
 
   base::TaskRunner* const task_runner_;
+  const InitOpts init_opts_;
   std::unique_ptr<SharedMemory::Factory> shm_factory_;
   ProducerID last_producer_id_ = 0;
   DataSourceInstanceID last_data_source_instance_id_ = 0;
@@ -17,6 +17,7 @@
 #include "src/tracing/core/tracing_service_impl.h"
 
 #include <string.h>
+#include <set>
 
 #include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/temp_file.h"
@@ -29,6 +30,7 @@
 #include "perfetto/ext/tracing/core/trace_writer.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/data_source_descriptor.h"
+#include "perfetto/tracing/core/tracing_service_capabilities.h"
 #include "src/base/test/test_task_runner.h"
 #include "src/tracing/core/shared_memory_arbiter_impl.h"
 #include "src/tracing/core/trace_writer_impl.h"
@@ -95,6 +97,29 @@ MATCHER_P(HasTriggerMode, mode, "") {
   return HasTriggerModeInternal(arg, mode);
 }
 
+// A fake compressor that wraps all the packets, uncompressed, into a single
+// |compressed_packets| field. Enough to test the service plumbing without
+// depending on zlib.
+void FakeCompressFn(std::vector<TracePacket>* packets) {
+  std::string raw;
+  for (TracePacket& packet : *packets) {
+    char* preamble;
+    size_t preamble_size;
+    std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+    raw.append(preamble, preamble_size);
+    for (const Slice& slice : packet.slices())
+      raw.append(static_cast<const char*>(slice.start), slice.size);
+  }
+  protos::gen::TracePacket wrapper;
+  wrapper.set_compressed_packets(raw);
+  std::string wrapper_raw = wrapper.SerializeAsString();
+  Slice slice = Slice::Allocate(wrapper_raw.size());
+  memcpy(slice.own_data(), wrapper_raw.data(), wrapper_raw.size());
+  packets->clear();
+  packets->emplace_back();
+  packets->back().AddSlice(std::move(slice));
+}
+
 }  // namespace
 
 class TracingServiceImplTest : public testing::Test {
@@ -1731,6 +1756,235 @@ TEST_F(TracingServiceImplTest, WriteIntoFileWithPath) {
                   Property(&protos::gen::TestEvent::str, Eq("payload")))));
 }
 
+// Checks that the periodic draining into file is accounted in the
+// write_into_file_stats of the TraceStats.
+TEST_F(TracingServiceImplTest, WriteIntoFileStats) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(1);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload");
+  }
+  writer->Flush();
+  writer.reset();
+
+  // Let a few write periods elapse.
+  auto periods_elapsed = task_runner.CreateCheckpoint("periods_elapsed");
+  task_runner.PostDelayedTask([periods_elapsed] { periods_elapsed(); }, 50);
+  task_runner.RunUntilCheckpoint("periods_elapsed");
+
+  // The stats are taken synchronously by GetTraceStats(), read the file before
+  // WaitForTraceStats() lets more write periods run.
+  consumer->GetTraceStats();
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  TraceStats stats = consumer->WaitForTraceStats(true);
+  ASSERT_TRUE(stats.has_write_into_file_stats());
+  const auto& wr_stats = stats.write_into_file_stats();
+  EXPECT_GT(wr_stats.bytes_written(), 0u);
+  EXPECT_GT(wr_stats.write_syscalls(), 0u);
+  EXPECT_GE(wr_stats.total_write_duration_ns(),
+            wr_stats.max_write_duration_ns());
+
+  // The stats must match what actually landed in the file.
+  EXPECT_EQ(wr_stats.bytes_written(), trace_raw.size());
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+}
+
+TEST_F(TracingServiceImplTest, CompressionUsesCompressorFn) {
+  TracingService::InitOpts init_opts;
+  init_opts.compressor_fn = &FakeCompressFn;
+  std::unique_ptr<SharedMemory::Factory> shm_factory(
+      new TestSharedMemory::Factory());
+  svc.reset(static_cast<TracingServiceImpl*>(
+      TracingService::CreateInstance(std::move(shm_factory), &task_runner,
+                                     init_opts)
+          .release()));
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_DEFLATE);
+  consumer->EnableTracing(trace_config);
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-1");
+  }
+  {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload-2");
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::vector<protos::gen::TracePacket> packets = consumer->ReadBuffers();
+  ASSERT_THAT(packets, Not(IsEmpty()));
+  std::vector<protos::gen::TracePacket> inner_packets;
+  for (const auto& packet : packets) {
+    ASSERT_TRUE(packet.has_compressed_packets());
+    protos::gen::Trace inner;
+    ASSERT_TRUE(inner.ParseFromString(packet.compressed_packets()));
+    inner_packets.insert(inner_packets.end(), inner.packet().begin(),
+                         inner.packet().end());
+  }
+  EXPECT_THAT(inner_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-1")))));
+  EXPECT_THAT(inner_packets,
+              Contains(Property(
+                  &protos::gen::TracePacket::for_testing,
+                  Property(&protos::gen::TestEvent::str, Eq("payload-2")))));
+}
+
+// Checks that a compressed write_into_file trace is drained and compressed in
+// bounded chunks, and that the consumer is notified of the end of the trace
+// only once the last chunk has landed in the file.
+TEST_F(TracingServiceImplTest, CompressionWritesIntoFileInChunks) {
+  TracingService::InitOpts init_opts;
+  init_opts.compressor_fn = &FakeCompressFn;
+  std::unique_ptr<SharedMemory::Factory> shm_factory(
+      new TestSharedMemory::Factory());
+  svc.reset(static_cast<TracingServiceImpl*>(
+      TracingService::CreateInstance(std::move(shm_factory), &task_runner,
+                                     init_opts)
+          .release()));
+
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(8192);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_file_write_period_ms(100000);  // 100s
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_DEFLATE);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  // ~3 MB of payload, which doesn't fit in a single compression chunk.
+  static const size_t kNumTestPackets = 30;
+  static const size_t kPayloadSize = 100 * 1024;
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    std::string payload = std::to_string(i) + ":";
+    payload.append(kPayloadSize, static_cast<char>('a' + i % 26));
+    tp->set_for_testing()->set_str(payload.c_str(), payload.size());
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  EXPECT_GT(trace.packet_size(), 1);
+  std::set<std::string> payloads;
+  for (const auto& packet : trace.packet()) {
+    ASSERT_TRUE(packet.has_compressed_packets());
+    protos::gen::Trace inner;
+    ASSERT_TRUE(inner.ParseFromString(packet.compressed_packets()));
+    for (const auto& inner_packet : inner.packet()) {
+      if (inner_packet.has_for_testing())
+        payloads.insert(inner_packet.for_testing().str());
+    }
+  }
+  ASSERT_EQ(payloads.size(), kNumTestPackets);
+  for (size_t i = 0; i < kNumTestPackets; i++) {
+    std::string payload = std::to_string(i) + ":";
+    payload.append(kPayloadSize, static_cast<char>('a' + i % 26));
+    EXPECT_EQ(payloads.count(payload), 1u);
+  }
+}
+
+TEST_F(TracingServiceImplTest, CapabilitiesReportTraceCompression) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+  bool has_trace_compression = true;
+  consumer->endpoint()->QueryCapabilities(
+      [&has_trace_compression](const TracingServiceCapabilities& caps) {
+        has_trace_compression = caps.has_trace_compression();
+      });
+  EXPECT_FALSE(has_trace_compression);
+
+  TracingService::InitOpts init_opts;
+  init_opts.compressor_fn = &FakeCompressFn;
+  std::unique_ptr<SharedMemory::Factory> shm_factory(
+      new TestSharedMemory::Factory());
+  consumer.reset();
+  svc.reset(static_cast<TracingServiceImpl*>(
+      TracingService::CreateInstance(std::move(shm_factory), &task_runner,
+                                     init_opts)
+          .release()));
+  consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+  consumer->endpoint()->QueryCapabilities(
+      [&has_trace_compression](const TracingServiceCapabilities& caps) {
+        has_trace_compression = caps.has_trace_compression();
+      });
+  EXPECT_TRUE(has_trace_compression);
+}
+
 // Test the logic that allows the trace config to set the shm total size and
 // page size from the trace config. Also check that, if the config doesn't
 // specify a value we fall back on the hint provided by the producer.
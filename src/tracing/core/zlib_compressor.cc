@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/zlib_compressor.h"
+
+#include <zlib.h>
+
+#include <memory>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/tracing/core/slice.h"
+#include "perfetto/protozero/proto_utils.h"
+
+namespace perfetto {
+
+namespace {
+
+// ID of |compressed_packets| in trace_packet.proto. Hardcoded as we don't want
+// to depend on the TracePacket protos here.
+constexpr uint32_t kCompressedPacketsFieldNumber = 50;
+
+// Size of each of the buffers that deflate() writes into. The output packet
+// references these buffers as slices, without copying them.
+constexpr size_t kSliceSize = 128 * 1024;
+
+// Some transport mechanisms have a 512kb limit on packet size. Stop appending
+// to the current compressed packet once it gets close to this limit.
+// Keep this in sync with kMaxPacketSize in perfetto_cmd's packet_writer.cc.
+constexpr size_t kMaxCompressedPacketSize = 500 * 1024;
+
+class ZlibPacketCompressor {
+ public:
+  ZlibPacketCompressor();
+  ~ZlibPacketCompressor();
+
+  // Appends |packet| (with its preamble) to the compressed stream.
+  void PushPacket(TracePacket* packet);
+
+  // Number of compressed bytes emitted so far (excluding data still buffered
+  // inside zlib).
+  size_t compressed_size() const {
+    size_t cur_slice_used = cur_slice_ ? kSliceSize - stream_.avail_out : 0;
+    return total_slices_size_ + cur_slice_used;
+  }
+
+  // Flushes the zlib stream and returns a packet with a |compressed_packets|
+  // field that references the compressed data.
+  TracePacket Finish();
+
+ private:
+  void PushData(const void* data, size_t size);
+  void NewOutputSlice();
+  void PushCurSlice();
+
+  z_stream stream_{};
+  size_t total_slices_size_ = 0;
+  std::vector<Slice> slices_;
+  std::unique_ptr<uint8_t[]> cur_slice_;
+};
+
+ZlibPacketCompressor::ZlibPacketCompressor() {
+  int status = deflateInit(&stream_, 6);
+  PERFETTO_CHECK(status == Z_OK);
+  NewOutputSlice();
+}
+
+ZlibPacketCompressor::~ZlibPacketCompressor() {
+  deflateEnd(&stream_);
+}
+
+void ZlibPacketCompressor::PushPacket(TracePacket* packet) {
+  char* preamble;
+  size_t preamble_size;
+  std::tie(preamble, preamble_size) = packet->GetProtoPreamble();
+  PushData(preamble, preamble_size);
+  for (const Slice& slice : packet->slices())
+    PushData(slice.start, slice.size);
+}
+
+void ZlibPacketCompressor::PushData(const void* data, size_t size) {
+  stream_.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+  stream_.avail_in = static_cast<uInt>(size);
+  while (stream_.avail_in != 0) {
+    if (stream_.avail_out == 0)
+      NewOutputSlice();
+    int status = deflate(&stream_, Z_NO_FLUSH);
+    PERFETTO_CHECK(status == Z_OK);
+  }
+}
+
+TracePacket ZlibPacketCompressor::Finish() {
+  for (;;) {
+    int status = deflate(&stream_, Z_FINISH);
+    if (status == Z_STREAM_END)
+      break;
+    PERFETTO_CHECK(status == Z_OK || status == Z_BUF_ERROR);
+    if (stream_.avail_out == 0)
+      NewOutputSlice();
+  }
+  PushCurSlice();
+
+  TracePacket packet;
+  Slice preamble = Slice::Allocate(16);
+  uint8_t* wptr = preamble.own_data();
+  wptr = protozero::proto_utils::WriteVarInt(
+      protozero::proto_utils::MakeTagLengthDelimited(
+          kCompressedPacketsFieldNumber),
+      wptr);
+  wptr = protozero::proto_utils::WriteVarInt(total_slices_size_, wptr);
+  preamble.size = static_cast<size_t>(wptr - preamble.own_data());
+  packet.AddSlice(std::move(preamble));
+  for (Slice& slice : slices_)
+    packet.AddSlice(std::move(slice));
+  slices_.clear();
+  return packet;
+}
+
+void ZlibPacketCompressor::NewOutputSlice() {
+  PushCurSlice();
+  cur_slice_.reset(new uint8_t[kSliceSize]);
+  stream_.next_out = cur_slice_.get();
+  stream_.avail_out = static_cast<uInt>(kSliceSize);
+}
+
+void ZlibPacketCompressor::PushCurSlice() {
+  if (!cur_slice_)
+    return;
+  size_t used = kSliceSize - stream_.avail_out;
+  total_slices_size_ += used;
+  slices_.push_back(Slice::TakeOwnership(std::move(cur_slice_), used));
+  stream_.next_out = nullptr;
+  stream_.avail_out = 0;
+}
+
+}  // namespace
+
+void ZlibCompressFn(std::vector<TracePacket>* packets) {
+  if (packets->empty())
+    return;
+
+  std::vector<TracePacket> output;
+  std::unique_ptr<ZlibPacketCompressor> compressor;
+  for (TracePacket& packet : *packets) {
+    if (!compressor)
+      compressor.reset(new ZlibPacketCompressor());
+    compressor->PushPacket(&packet);
+    if (compressor->compressed_size() >= kMaxCompressedPacketSize) {
+      output.emplace_back(compressor->Finish());
+      compressor.reset();
+    }
+  }
+  if (compressor)
+    output.emplace_back(compressor->Finish());
+
+  *packets = std::move(output);
+}
+
+}  // namespace perfetto
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
+#define SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
+
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/tracing/core/trace_packet.h"
+
+namespace perfetto {
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+// Compresses |packets| with zlib (deflate) and replaces them with one or more
+// TracePacket(s) that contain only the |compressed_packets| field. Each output
+// packet is capped (on a best effort basis) to |kMaxCompressedPacketSize| of
+// compressed data, so that it can be decompressed independently and doesn't
+// exceed the size limits of some transports.
+// Suitable to be passed as TracingService::InitOpts::compressor_fn.
+void ZlibCompressFn(std::vector<TracePacket>* packets);
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+}  // namespace perfetto
+
+#endif  // SRC_TRACING_CORE_ZLIB_COMPRESSOR_H_
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/tracing/core/zlib_compressor.h"
+
+#include <zlib.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/tracing/core/trace_packet.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/test_event.gen.h"
+#include "protos/perfetto/trace/trace.gen.h"
+#include "protos/perfetto/trace/trace_packet.gen.h"
+
+namespace perfetto {
+namespace {
+
+using ::testing::Each;
+using ::testing::ElementsAreArray;
+using ::testing::Property;
+using ::testing::SizeIs;
+
+// Owns the serialized packets that the TracePacket slices point to.
+struct TestPackets {
+  std::vector<std::string> payloads;
+  std::vector<TracePacket> packets;
+};
+
+TestPackets CreatePackets(const std::vector<std::string>& strs) {
+  TestPackets res;
+  for (const std::string& str : strs) {
+    protos::gen::TracePacket proto;
+    proto.mutable_for_testing()->set_str(str);
+    res.payloads.push_back(proto.SerializeAsString());
+  }
+  for (const std::string& payload : res.payloads) {
+    TracePacket packet;
+    // Split each packet in two slices, to exercise multi-slice input.
+    size_t half = payload.size() / 2;
+    packet.AddSlice(payload.data(), half);
+    packet.AddSlice(payload.data() + half, payload.size() - half);
+    res.packets.push_back(std::move(packet));
+  }
+  return res;
+}
+
+std::string Inflate(const std::string& compressed) {
+  z_stream stream{};
+  EXPECT_EQ(inflateInit(&stream), Z_OK);
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = static_cast<uInt>(compressed.size());
+  std::string out;
+  char buf[4096];
+  int status;
+  do {
+    stream.next_out = reinterpret_cast<Bytef*>(buf);
+    stream.avail_out = sizeof(buf);
+    status = inflate(&stream, Z_NO_FLUSH);
+    EXPECT_TRUE(status == Z_OK || status == Z_STREAM_END);
+    out.append(buf, sizeof(buf) - stream.avail_out);
+  } while (status == Z_OK);
+  inflateEnd(&stream);
+  return out;
+}
+
+// Decompresses all the |compressed_packets| and returns the for_testing
+// strings of the inner packets.
+std::vector<std::string> Decompress(std::vector<TracePacket>* packets) {
+  std::vector<std::string> strs;
+  for (TracePacket& packet : *packets) {
+    protos::gen::TracePacket outer;
+    EXPECT_TRUE(outer.ParseFromString(packet.GetRawBytesForTesting()));
+    EXPECT_TRUE(outer.has_compressed_packets());
+    protos::gen::Trace inner;
+    EXPECT_TRUE(inner.ParseFromString(Inflate(outer.compressed_packets())));
+    for (const auto& inner_packet : inner.packet())
+      strs.push_back(inner_packet.for_testing().str());
+  }
+  return strs;
+}
+
+TEST(ZlibCompressorTest, Empty) {
+  std::vector<TracePacket> packets;
+  ZlibCompressFn(&packets);
+  EXPECT_THAT(packets, SizeIs(0));
+}
+
+TEST(ZlibCompressorTest, SmallPacketsInOneCompressedPacket) {
+  std::vector<std::string> strs;
+  for (int i = 0; i < 100; i++)
+    strs.push_back("packet " + std::to_string(i));
+  TestPackets input = CreatePackets(strs);
+  size_t input_size = 0;
+  for (const TracePacket& packet : input.packets)
+    input_size += packet.size();
+
+  ZlibCompressFn(&input.packets);
+
+  ASSERT_THAT(input.packets, SizeIs(1));
+  EXPECT_LT(input.packets[0].size(), input_size);
+  EXPECT_THAT(Decompress(&input.packets), ElementsAreArray(strs));
+}
+
+TEST(ZlibCompressorTest, IncompressibleDataIsSplit) {
+  // Random data doesn't compress, so 4 x 300KB packets need to be spread over
+  // more than one compressed packet to honor the 500KB cap.
+  std::minstd_rand rnd(42);
+  std::vector<std::string> strs;
+  for (int i = 0; i < 4; i++) {
+    std::string str(300 * 1024, '\0');
+    for (char& c : str)
+      c = static_cast<char>(rnd());
+    strs.push_back(std::move(str));
+  }
+  TestPackets input = CreatePackets(strs);
+
+  ZlibCompressFn(&input.packets);
+
+  EXPECT_GT(input.packets.size(), 1u);
+  EXPECT_THAT(input.packets,
+              Each(Property(&TracePacket::size, testing::Lt(1024u * 1024))));
+  EXPECT_THAT(Decompress(&input.packets), ElementsAreArray(strs));
+}
+
+}  // namespace
+}  // namespace perfetto
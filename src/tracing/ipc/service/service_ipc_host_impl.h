@@ -33,7 +33,7 @@ class Host;
 // producer_ipc_service.cc and consumer_ipc_service.cc.
 class ServiceIPCHostImpl : public ServiceIPCHost {
  public:
-  ServiceIPCHostImpl(base::TaskRunner*);
+  ServiceIPCHostImpl(base::TaskRunner*, TracingService::InitOpts);
   ~ServiceIPCHostImpl() override;
 
   // ServiceIPCHost implementation.
@@ -49,6 +49,7 @@ class ServiceIPCHostImpl : public ServiceIPCHost {
   void Shutdown();
 
   base::TaskRunner* const task_runner_;
+  const TracingService::InitOpts init_opts_;
   std::unique_ptr<TracingService> svc_;  // The service business logic.
 
   // The IPC host that listens on the Producer socket. It owns the
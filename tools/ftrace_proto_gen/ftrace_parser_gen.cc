@@ -0,0 +1,441 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Generates src/traced/probes/ftrace/event_parsers.cc: a parser specialized
+// for each layout of the events in the event list, as found in the ftrace
+// formats of the given kernels (usually src/traced/probes/ftrace/test/data/*/).
+// See src/traced/probes/ftrace/event_parsers.h.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/getopt.h"
+#include "src/traced/probes/ftrace/event_info.h"
+#include "src/traced/probes/ftrace/ftrace_procfs.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+#include "tools/ftrace_proto_gen/ftrace_proto_gen.h"
+#include "tools/ftrace_proto_gen/proto_gen_utils.h"
+
+namespace perfetto {
+namespace {
+
+const char* ToString(TranslationStrategy strategy) {
+  switch (strategy) {
+    case kUint8ToUint32:
+      return "kUint8ToUint32";
+    case kUint8ToUint64:
+      return "kUint8ToUint64";
+    case kUint16ToUint32:
+      return "kUint16ToUint32";
+    case kUint16ToUint64:
+      return "kUint16ToUint64";
+    case kUint32ToUint32:
+      return "kUint32ToUint32";
+    case kUint32ToUint64:
+      return "kUint32ToUint64";
+    case kUint64ToUint64:
+      return "kUint64ToUint64";
+    case kInt8ToInt32:
+      return "kInt8ToInt32";
+    case kInt8ToInt64:
+      return "kInt8ToInt64";
+    case kInt16ToInt32:
+      return "kInt16ToInt32";
+    case kInt16ToInt64:
+      return "kInt16ToInt64";
+    case kInt32ToInt32:
+      return "kInt32ToInt32";
+    case kInt32ToInt64:
+      return "kInt32ToInt64";
+    case kInt64ToInt64:
+      return "kInt64ToInt64";
+    case kFixedCStringToString:
+      return "kFixedCStringToString";
+    case kCStringToString:
+      return "kCStringToString";
+    case kStringPtrToString:
+      return "kStringPtrToString";
+    case kBoolToUint32:
+      return "kBoolToUint32";
+    case kBoolToUint64:
+      return "kBoolToUint64";
+    case kInode32ToUint64:
+      return "kInode32ToUint64";
+    case kInode64ToUint64:
+      return "kInode64ToUint64";
+    case kPid32ToInt32:
+      return "kPid32ToInt32";
+    case kPid32ToInt64:
+      return "kPid32ToInt64";
+    case kCommonPid32ToInt32:
+      return "kCommonPid32ToInt32";
+    case kCommonPid32ToInt64:
+      return "kCommonPid32ToInt64";
+    case kDevId32ToUint64:
+      return "kDevId32ToUint64";
+    case kDevId64ToUint64:
+      return "kDevId64ToUint64";
+    case kDataLocToString:
+      return "kDataLocToString";
+    case kFtraceSymAddr64ToUint64:
+      return "kFtraceSymAddr64ToUint64";
+    case kInvalidTranslationStrategy:
+      break;
+  }
+  PERFETTO_FATAL("Unexpected translation strategy");
+}
+
+// The CpuReader helper and the extra arguments used to read a field with the
+// given strategy. Mirrors CpuReader::ParseField().
+struct Reader {
+  std::string fn;
+  bool uses_end;
+  bool uses_table;
+  bool uses_metadata;
+};
+
+Reader GetReader(TranslationStrategy strategy) {
+  switch (strategy) {
+    case kUint8ToUint32:
+    case kUint8ToUint64:
+    case kBoolToUint32:
+    case kBoolToUint64:
+      return {"ReadIntoVarInt<uint8_t>", false, false, false};
+    case kUint16ToUint32:
+    case kUint16ToUint64:
+      return {"ReadIntoVarInt<uint16_t>", false, false, false};
+    case kUint32ToUint32:
+    case kUint32ToUint64:
+      return {"ReadIntoVarInt<uint32_t>", false, false, false};
+    case kUint64ToUint64:
+      return {"ReadIntoVarInt<uint64_t>", false, false, false};
+    case kInt8ToInt32:
+    case kInt8ToInt64:
+      return {"ReadIntoVarInt<int8_t>", false, false, false};
+    case kInt16ToInt32:
+    case kInt16ToInt64:
+      return {"ReadIntoVarInt<int16_t>", false, false, false};
+    case kInt32ToInt32:
+    case kInt32ToInt64:
+      return {"ReadIntoVarInt<int32_t>", false, false, false};
+    case kInt64ToInt64:
+      return {"ReadIntoVarInt<int64_t>", false, false, false};
+    case kFixedCStringToString:
+      return {"ReadIntoString", false, false, false};
+    case kCStringToString:
+      return {"ReadIntoString", true, false, false};
+    case kStringPtrToString:
+      return {"ReadStringPtr", false, true, false};
+    case kDataLocToString:
+      return {"ReadDataLoc", true, false, false};
+    case kInode32ToUint64:
+      return {"ReadInode<uint32_t>", false, false, true};
+    case kInode64ToUint64:
+      return {"ReadInode<uint64_t>", false, false, true};
+    case kPid32ToInt32:
+    case kPid32ToInt64:
+      return {"ReadPid", false, false, true};
+    case kCommonPid32ToInt32:
+    case kCommonPid32ToInt64:
+      return {"ReadCommonPid", false, false, true};
+    case kDevId32ToUint64:
+      return {"ReadDevId<uint32_t>", false, false, true};
+    case kDevId64ToUint64:
+      return {"ReadDevId<uint64_t>", false, false, true};
+    case kFtraceSymAddr64ToUint64:
+      return {"ReadSymbolAddr<uint64_t>", false, false, true};
+    case kInvalidTranslationStrategy:
+      break;
+  }
+  PERFETTO_FATAL("Unexpected translation strategy");
+}
+
+// Writes "<open><args><close>" indented by |indent|, packing the arguments
+// into lines of at most 80 columns like clang-format does.
+void WriteCall(std::ostream* out,
+               size_t indent,
+               const std::string& open,
+               const std::vector<std::string>& args,
+               const std::string& close) {
+  std::string line = std::string(indent, ' ') + open;
+  const size_t args_column = line.size();
+  for (size_t i = 0; i < args.size(); i++) {
+    std::string arg = args[i] + (i + 1 < args.size() ? "," : close);
+    bool first_on_line = line.size() == args_column;
+    if (!first_on_line && line.size() + 1 + arg.size() > 80) {
+      *out << line << "\n";
+      line = std::string(args_column, ' ');
+      first_on_line = true;
+    }
+    line += (first_on_line ? "" : " ") + arg;
+  }
+  *out << line << "\n";
+}
+
+struct Variant {
+  std::string group;
+  std::string name;
+  std::string fn_name;
+  std::vector<Field> fields;
+};
+
+bool SameLayout(const std::vector<Field>& a, const std::vector<Field>& b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].proto_field_id != b[i].proto_field_id ||
+        a[i].strategy != b[i].strategy) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void WriteParser(std::ostream* out, const Variant& variant) {
+  bool uses_end = false;
+  bool uses_table = false;
+  bool uses_metadata = false;
+  bool has_data_loc = false;
+  for (const Field& field : variant.fields) {
+    Reader reader = GetReader(field.strategy);
+    uses_end |= reader.uses_end;
+    uses_table |= reader.uses_table;
+    uses_metadata |= reader.uses_metadata;
+    has_data_loc |= field.strategy == kDataLocToString;
+  }
+
+  std::string prefix = "bool " + variant.fn_name;
+  std::string params_indent(prefix.size() + 1, ' ');
+  *out << prefix << "(const uint8_t* start,\n";
+  *out << params_indent << "const uint8_t*" << (uses_end ? " end" : "")
+       << ",\n";
+  *out << params_indent << "const Field* fields,\n";
+  *out << params_indent << "const ProtoTranslationTable*"
+       << (uses_table ? " table" : "") << ",\n";
+  *out << params_indent << "protozero::Message* message,\n";
+  *out << params_indent << "FtraceMetadata*"
+       << (uses_metadata ? " metadata" : "") << ") {\n";
+  if (has_data_loc)
+    *out << "  bool success = true;\n";
+
+  for (size_t i = 0; i < variant.fields.size(); i++) {
+    const Field& field = variant.fields[i];
+    Reader reader = GetReader(field.strategy);
+    std::string f = "fields[" + std::to_string(i) + "]";
+    std::string field_start = "start + " + f + ".ftrace_offset";
+    std::string id = std::to_string(field.proto_field_id);
+    std::vector<std::string> args;
+    switch (field.strategy) {
+      case kFixedCStringToString:
+        args = {field_start, f + ".ftrace_size", id, "message"};
+        break;
+      case kCStringToString:
+        args = {field_start,
+                "static_cast<size_t>(end - (" + field_start + "))", id,
+                "message"};
+        break;
+      case kStringPtrToString:
+        args = {field_start, f + ".ftrace_size", id, "table", "message"};
+        break;
+      case kDataLocToString:
+        args = {"start", field_start, "end", f, "message"};
+        break;
+      default:
+        args = {field_start, id, "message"};
+        if (reader.uses_metadata)
+          args.push_back("metadata");
+        break;
+    }
+    if (field.strategy == kDataLocToString) {
+      WriteCall(out, 2, "success &= CpuReader::" + reader.fn + "(", args,
+                ");");
+    } else {
+      WriteCall(out, 2, "CpuReader::" + reader.fn + "(", args, ");");
+    }
+  }
+  *out << "  return " << (has_data_loc ? "success" : "true") << ";\n";
+  *out << "}\n\n";
+}
+
+std::string FieldsArrayName(const Variant& variant) {
+  return "k" + variant.fn_name.substr(strlen("Parse")) + "Fields";
+}
+
+void WriteFile(std::ostream* out, const std::vector<Variant>& variants) {
+  *out << R"(/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Autogenerated by:
+// ../../tools/ftrace_proto_gen/ftrace_parser_gen.cc
+// Do not edit.
+
+#include "src/traced/probes/ftrace/event_parsers.h"
+
+#include "perfetto/protozero/message.h"
+#include "src/traced/probes/ftrace/cpu_reader.h"
+#include "src/traced/probes/ftrace/ftrace_metadata.h"
+#include "src/traced/probes/ftrace/proto_translation_table.h"
+
+namespace perfetto {
+namespace {
+
+)";
+
+  for (const Variant& variant : variants) {
+    *out << "constexpr EventParserField " << FieldsArrayName(variant)
+         << "[] = {\n";
+    for (const Field& field : variant.fields) {
+      *out << "    {" << field.proto_field_id << ", "
+           << ToString(field.strategy) << "},\n";
+    }
+    *out << "};\n\n";
+    WriteParser(out, variant);
+  }
+
+  *out << "}  // namespace\n\n";
+  *out << "std::vector<EventParser> GetEventParsers() {\n";
+  *out << "  return {\n";
+  for (const Variant& variant : variants) {
+    WriteCall(out, 6, "{",
+              {"\"" + variant.group + "\"", "\"" + variant.name + "\"",
+               FieldsArrayName(variant), std::to_string(variant.fields.size()),
+               "&" + variant.fn_name},
+              "},");
+  }
+  *out << "  };\n";
+  *out << "}\n\n";
+  *out << "}  // namespace perfetto\n";
+}
+
+void PrintUsage(const char* bin_name) {
+  fprintf(stderr,
+          "Usage: %s -w event_list_path -o output_path [--check_only] "
+          "ftrace_root_dir...\n",
+          bin_name);
+}
+
+}  // namespace
+}  // namespace perfetto
+
+int main(int argc, char** argv) {
+  static option long_options[] = {
+      {"event_list", required_argument, nullptr, 'w'},
+      {"output", required_argument, nullptr, 'o'},
+      {"check_only", no_argument, nullptr, 'c'},
+      {nullptr, 0, nullptr, 0}};
+
+  std::string event_list_path;
+  std::string output_path;
+  bool check_only = false;
+
+  int c;
+  while ((c = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+    switch (c) {
+      case 'w':
+        event_list_path = optarg;
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      case 'c':
+        check_only = true;
+        break;
+      default:
+        perfetto::PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (optind >= argc || event_list_path.empty() || output_path.empty()) {
+    perfetto::PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::vector<std::unique_ptr<perfetto::FtraceProcfs>> procfs;
+  std::vector<std::unique_ptr<perfetto::ProtoTranslationTable>> tables;
+  for (int i = optind; i < argc; ++i) {
+    std::string root = argv[i];
+    if (root.back() != '/')
+      root += "/";
+    procfs.emplace_back(new perfetto::FtraceProcfs(root));
+    tables.emplace_back(perfetto::ProtoTranslationTable::Create(
+        procfs.back().get(), perfetto::GetStaticEventInfo(),
+        perfetto::GetStaticCommonFieldsInfo()));
+    PERFETTO_CHECK(tables.back());
+  }
+
+  std::vector<perfetto::Variant> variants;
+  for (const perfetto::FtraceEventName& event :
+       perfetto::ReadAllowList(event_list_path)) {
+    if (!event.valid())
+      continue;
+    size_t num_variants = 0;
+    for (const auto& table : tables) {
+      const perfetto::Event* info = table->GetEvent(
+          perfetto::GroupAndName(event.group(), event.name()));
+      if (!info || info->fields.empty())
+        continue;
+      bool seen = false;
+      for (const perfetto::Variant& variant : variants) {
+        seen |= variant.group == event.group() &&
+                variant.name == event.name() &&
+                perfetto::SameLayout(variant.fields, info->fields);
+      }
+      if (seen)
+        continue;
+      num_variants++;
+      std::string fn_name = "Parse" + perfetto::ToCamelCase(event.name());
+      if (num_variants > 1)
+        fn_name += std::to_string(num_variants);
+      variants.push_back(
+          {event.group(), event.name(), fn_name, info->fields});
+    }
+    if (!num_variants) {
+      fprintf(stderr, "No format found for %s/%s\n", event.group().c_str(),
+              event.name().c_str());
+      return 1;
+    }
+  }
+
+  std::unique_ptr<std::ostream> out;
+  if (check_only) {
+    out.reset(new perfetto::VerifyStream(output_path));
+  } else {
+    out.reset(new std::ofstream(output_path));
+  }
+  perfetto::WriteFile(out.get(), variants);
+  return 0;
+}
@@ -23,6 +23,7 @@
 
 #include "src/profiling/symbolizer/breakpad_symbolizer.h"
 #include "src/profiling/symbolizer/local_symbolizer.h"
+#include "src/profiling/symbolizer/symbol_cache.h"
 #include "src/profiling/symbolizer/symbolize_database.h"
 #include "src/profiling/symbolizer/symbolizer.h"
 
@@ -56,9 +57,12 @@ int SymbolizeProfile(std::istream* input, std::ostream* output) {
 
   tp->NotifyEndOfFile();
 
+  std::unique_ptr<profiling::SymbolCache> cache =
+      profiling::GetPerfettoSymbolCache();
   SymbolizeDatabase(
       tp.get(), symbolizer.get(),
-      [output](const std::string& trace_proto) { *output << trace_proto; });
+      [output](const std::string& trace_proto) { *output << trace_proto; },
+      cache.get());
   return 0;
 }
 
@@ -81,8 +81,8 @@ int TraceToJson(std::istream* input,
                 bool compress,
                 Keep truncate_keep,
                 bool full_sort) {
-  std::unique_ptr<TraceWriter> trace_writer(
-      compress ? new DeflateTraceWriter(output) : new TraceWriter(output));
+  std::unique_ptr<TraceWriter> trace_writer =
+      CreateTraceWriter(output, compress);
 
   trace_processor::Config config;
   config.sorting_mode = full_sort
@@ -22,6 +22,7 @@
 
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/profiling/symbolizer/local_symbolizer.h"
+#include "src/profiling/symbolizer/symbol_cache.h"
 #include "src/profiling/symbolizer/symbolize_database.h"
 #include "tools/trace_to_text/utils.h"
 
@@ -72,10 +73,14 @@ void MaybeSymbolize(trace_processor::TraceProcessor* tp) {
                                       getenv("PERFETTO_SYMBOLIZER_MODE"));
   if (!symbolizer)
     return;
-  profiling::SymbolizeDatabase(tp, symbolizer.get(),
-                               [tp](const std::string& trace_proto) {
-                                 IngestTraceOrDie(tp, trace_proto);
-                               });
+  std::unique_ptr<profiling::SymbolCache> cache =
+      profiling::GetPerfettoSymbolCache();
+  profiling::SymbolizeDatabase(
+      tp, symbolizer.get(),
+      [tp](const std::string& trace_proto) {
+        IngestTraceOrDie(tp, trace_proto);
+      },
+      cache.get());
   tp->NotifyEndOfFile();
 }
 
@@ -84,6 +84,17 @@ const char kSystemTraceEventsFooter[] =
     "\\n<...>-12345 (-----) [000] ...1 0.000000: tracing_mark_write: "
     "trace_event_clock_sync: parent_ts=0\\n\"";
 
+// Each row is formatted into a buffer of fixed size, whose bounds
+// base::StringWriter only checks in debug builds. Appends as much of |str| as
+// fits while leaving |reserve| bytes for the rest of the row, truncating the
+// unusually long names and ftrace lines.
+void AppendTruncated(base::StringView str,
+                     size_t reserve,
+                     base::StringWriter* writer) {
+  size_t used = std::min(writer->pos() + reserve, writer->size());
+  writer->AppendString(str.substr(0, writer->size() - used));
+}
+
 inline void FormatProcess(uint32_t pid,
                           uint32_t ppid,
                           const base::StringView& name,
@@ -93,8 +104,9 @@ inline void FormatProcess(uint32_t pid,
   writer->AppendLiteral("     ");
   writer->AppendInt(ppid);
   writer->AppendLiteral("   00000   000 null 0000000000 S ");
-  writer->AppendString(name);
-  writer->AppendLiteral("         null");
+  static const char kSuffix[] = "         null";
+  AppendTruncated(name, sizeof(kSuffix) - 1, writer);
+  writer->AppendLiteral(kSuffix);
 }
 
 inline void FormatThread(uint32_t tid,
@@ -109,7 +121,7 @@ inline void FormatThread(uint32_t tid,
   if (name.empty()) {
     writer->AppendLiteral("<...>");
   } else {
-    writer->AppendString(name);
+    AppendTruncated(name, 0, writer);
   }
 }
 
@@ -118,24 +130,22 @@ class QueryWriter {
   QueryWriter(trace_processor::TraceProcessor* tp, TraceWriter* trace_writer)
       : tp_(tp),
         buffer_(base::PagedMemory::Allocate(kBufferSize)),
-        global_writer_(static_cast<char*>(buffer_.Get()), kBufferSize),
+        buffer_start_(static_cast<char*>(buffer_.Get())),
         trace_writer_(trace_writer) {}
 
   template <typename Callback>
   bool RunQuery(const std::string& sql, Callback callback) {
-    char buffer[2048];
     auto iterator = tp_->ExecuteQuery(sql);
     for (uint32_t rows = 0; iterator.Next(); rows++) {
-      base::StringWriter line_writer(buffer, base::ArraySize(buffer));
-      callback(&iterator, &line_writer);
-
-      if (global_writer_.pos() + line_writer.pos() >= global_writer_.size()) {
+      if (kBufferSize - buffer_pos_ < kMaxLineSize) {
         fprintf(stderr, "Writing row %" PRIu32 "%c", rows, kProgressChar);
-        auto str = global_writer_.GetStringView();
-        trace_writer_->Write(str.data(), str.size());
-        global_writer_.reset();
+        Flush();
       }
-      global_writer_.AppendStringView(line_writer.GetStringView());
+      // Format the row in place, straight into the output buffer.
+      base::StringWriter line_writer(buffer_start_ + buffer_pos_,
+                                     kMaxLineSize);
+      callback(&iterator, &line_writer);
+      buffer_pos_ += line_writer.pos();
     }
 
     // Check if we have an error in the iterator and print if so.
@@ -145,19 +155,28 @@ class QueryWriter {
       return false;
     }
 
-    // Flush any dangling pieces in the global writer.
-    auto str = global_writer_.GetStringView();
-    trace_writer_->Write(str.data(), str.size());
-    global_writer_.reset();
+    // Flush any dangling pieces in the buffer.
+    Flush();
     return true;
   }
 
  private:
-  static constexpr uint32_t kBufferSize = 1024u * 1024u * 16u;
+  static constexpr size_t kBufferSize = 1024u * 1024u * 16u;
+
+  // Upper bound on the size of a single formatted row. Ftrace lines can be a
+  // few KB long and can double in size when escaped for JSON. The callbacks
+  // truncate the rows that would not fit, see AppendTruncated().
+  static constexpr size_t kMaxLineSize = 16u * 1024u;
+
+  void Flush() {
+    trace_writer_->Write(buffer_start_, buffer_pos_);
+    buffer_pos_ = 0;
+  }
 
   trace_processor::TraceProcessor* tp_ = nullptr;
   base::PagedMemory buffer_;
-  base::StringWriter global_writer_;
+  char* const buffer_start_;
+  size_t buffer_pos_ = 0;
   TraceWriter* trace_writer_;
 };
 
@@ -192,7 +211,11 @@ int ExtractRawEvents(TraceWriter* trace_writer,
                                         base::StringWriter* writer) {
     const char* line = it->Get(0 /* col */).string_value;
     if (wrapped_in_json) {
+      // Stop when there is no room for another escaped character and the
+      // trailing "\n", truncating the line.
       for (uint32_t i = 0; line[i] != '\0'; i++) {
+        if (writer->size() - writer->pos() < 4)
+          break;
         char c = line[i];
         switch (c) {
           case '\n':
@@ -224,7 +247,7 @@ int ExtractRawEvents(TraceWriter* trace_writer,
       writer->AppendChar('\\');
       writer->AppendChar('n');
     } else {
-      writer->AppendString(line);
+      AppendTruncated(base::StringView(line), 1, writer);
       writer->AppendChar('\n');
     }
   };
@@ -276,9 +299,6 @@ int TraceToSystrace(std::istream* input,
                     bool ctrace,
                     Keep truncate_keep,
                     bool full_sort) {
-  std::unique_ptr<TraceWriter> trace_writer(
-      ctrace ? new DeflateTraceWriter(output) : new TraceWriter(output));
-
   trace_processor::Config config;
   config.sorting_mode = full_sort
                             ? trace_processor::SortingMode::kForceFullSort
@@ -293,6 +313,8 @@ int TraceToSystrace(std::istream* input,
   if (ctrace)
     *output << "TRACE:\n";
 
+  std::unique_ptr<TraceWriter> trace_writer =
+      CreateTraceWriter(output, ctrace);
   return ExtractSystrace(tp.get(), trace_writer.get(),
                          /*wrapped_in_json=*/false, truncate_keep);
 }
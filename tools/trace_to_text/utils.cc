@@ -19,9 +19,13 @@
 #include <stdio.h>
 
 #include <cinttypes>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <ostream>
 #include <set>
+#include <thread>
 #include <utility>
 
 #include "perfetto/base/logging.h"
@@ -46,12 +50,110 @@ namespace {
 constexpr size_t kCompressionBufferSize = 500 * 1024;
 #endif
 
+// Reads the trace in fixed size chunks. Where threads are available, the
+// chunks are read ahead on a background thread, so that reading the input
+// overlaps with parsing it.
+class TraceChunkReader {
+ public:
+  // 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
+  static constexpr size_t kChunkSize = 1024 * 1024;
+
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size = 0;
+  };
+
+  explicit TraceChunkReader(std::istream* input) : input_(input) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+    reader_thread_ = std::thread(&TraceChunkReader::ReaderMain, this);
+#endif
+  }
+
+  ~TraceChunkReader() {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    reader_thread_.join();
+#endif
+  }
+
+  // Returns the next chunk in |chunk|, which is empty at the end of the input.
+  // Returns false if reading the input failed.
+  bool ReadNext(Chunk* chunk) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+    return ReadChunk(chunk);
+#else
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this] { return !chunks_.empty() || eof_; });
+    if (chunks_.empty()) {
+      *chunk = Chunk();
+      return !failed_;
+    }
+    *chunk = std::move(chunks_.front());
+    chunks_.pop_front();
+    lock.unlock();
+    cv_.notify_all();
+    return true;
+#endif
+  }
+
+ private:
+  bool ReadChunk(Chunk* chunk) {
+    chunk->data.reset(new uint8_t[kChunkSize]);
+    input_->read(reinterpret_cast<char*>(chunk->data.get()), kChunkSize);
+    if (input_->bad())
+      return false;
+    auto rsize = input_->gcount();
+    chunk->size = rsize > 0 ? static_cast<size_t>(rsize) : 0;
+    return true;
+  }
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  static constexpr size_t kMaxPendingChunks = 8;
+
+  void ReaderMain() {
+    for (;;) {
+      Chunk chunk;
+      bool ok = ReadChunk(&chunk);
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (!ok || chunk.size == 0) {
+        failed_ = !ok;
+        eof_ = true;
+        lock.unlock();
+        cv_.notify_all();
+        return;
+      }
+      cv_.wait(lock, [this] {
+        return chunks_.size() < kMaxPendingChunks || stopped_;
+      });
+      if (stopped_)
+        return;
+      chunks_.push_back(std::move(chunk));
+      lock.unlock();
+      cv_.notify_all();
+    }
+  }
+#endif
+
+  std::istream* const input_;
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Chunk> chunks_;  // Guarded by |mutex_|.
+  bool eof_ = false;          // Guarded by |mutex_|.
+  bool failed_ = false;       // Guarded by |mutex_|.
+  bool stopped_ = false;      // Guarded by |mutex_|.
+  std::thread reader_thread_;
+#endif
+};
+
 }  // namespace
 
 bool ReadTrace(trace_processor::TraceProcessor* tp, std::istream* input) {
-  // 1MB chunk size seems the best tradeoff on a MacBook Pro 2013 - i7 2.8 GHz.
-  constexpr size_t kChunkSize = 1024 * 1024;
-
 // Printing the status update on stderr can be a perf bottleneck. On WASM print
 // status updates more frequently because it can be slower to parse each chunk.
 #if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
@@ -60,6 +162,7 @@ bool ReadTrace(trace_processor::TraceProcessor* tp, std::istream* input) {
   constexpr int kStderrRate = 128;
 #endif
   uint64_t file_size = 0;
+  TraceChunkReader reader(input);
 
   for (int i = 0;; i++) {
     if (i % kStderrRate == 0) {
@@ -68,18 +171,15 @@ bool ReadTrace(trace_processor::TraceProcessor* tp, std::istream* input) {
       fflush(stderr);
     }
 
-    std::unique_ptr<uint8_t[]> buf(new uint8_t[kChunkSize]);
-    input->read(reinterpret_cast<char*>(buf.get()), kChunkSize);
-    if (input->bad()) {
+    TraceChunkReader::Chunk chunk;
+    if (!reader.ReadNext(&chunk)) {
       PERFETTO_ELOG("Failed when reading trace");
       return false;
     }
-
-    auto rsize = input->gcount();
-    if (rsize <= 0)
+    if (chunk.size == 0)
       break;
-    file_size += static_cast<uint64_t>(rsize);
-    tp->Parse(std::move(buf), static_cast<size_t>(rsize));
+    file_size += chunk.size;
+    tp->Parse(std::move(chunk.data), chunk.size);
   }
 
   fprintf(stderr, "Loaded trace%c", kProgressChar);
@@ -100,7 +200,8 @@ void IngestTraceOrDie(trace_processor::TraceProcessor* tp,
 TraceWriter::TraceWriter(std::ostream* output) : output_(output) {}
 
 TraceWriter::~TraceWriter() {
-  output_->flush();
+  if (output_)
+    output_->flush();
 }
 
 void TraceWriter::Write(const std::string& s) {
@@ -170,5 +271,72 @@ DeflateTraceWriter::~DeflateTraceWriter() = default;
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+
+AsyncTraceWriter::AsyncTraceWriter(std::unique_ptr<TraceWriter> sink)
+    : TraceWriter(nullptr),
+      sink_(std::move(sink)),
+      writer_thread_(&AsyncTraceWriter::WriterMain, this) {
+  chunk_.reserve(kChunkSize);
+}
+
+AsyncTraceWriter::~AsyncTraceWriter() {
+  SubmitChunk();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  cv_.notify_all();
+  writer_thread_.join();
+}
+
+void AsyncTraceWriter::Write(const char* data, size_t sz) {
+  chunk_.append(data, sz);
+  if (chunk_.size() >= kChunkSize)
+    SubmitChunk();
+}
+
+void AsyncTraceWriter::SubmitChunk() {
+  if (chunk_.empty())
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock,
+           [this] { return pending_chunks_.size() < kMaxPendingChunks; });
+  pending_chunks_.emplace_back(std::move(chunk_));
+  lock.unlock();
+  cv_.notify_all();
+  chunk_ = std::string();
+  chunk_.reserve(kChunkSize);
+}
+
+void AsyncTraceWriter::WriterMain() {
+  for (;;) {
+    std::string chunk;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return !pending_chunks_.empty() || done_; });
+      if (pending_chunks_.empty())
+        return;
+      chunk = std::move(pending_chunks_.front());
+      pending_chunks_.pop_front();
+    }
+    cv_.notify_all();
+    sink_->Write(chunk.data(), chunk.size());
+  }
+}
+
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+
+std::unique_ptr<TraceWriter> CreateTraceWriter(std::ostream* output,
+                                               bool compress) {
+  std::unique_ptr<TraceWriter> writer(compress ? new DeflateTraceWriter(output)
+                                               : new TraceWriter(output));
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  return writer;
+#else
+  return std::unique_ptr<TraceWriter>(new AsyncTraceWriter(std::move(writer)));
+#endif
+}
+
 }  // namespace trace_to_text
 }  // namespace perfetto
@@ -19,9 +19,14 @@
 
 #include <stdio.h>
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "perfetto/base/build_config.h"
@@ -98,6 +103,40 @@ class DeflateTraceWriter : public TraceWriter {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+// Buffers writes and forwards them to |sink| in large chunks from a
+// background thread, so that compressing and writing the output overlaps with
+// producing it. At most kMaxPendingChunks chunks are queued at any time.
+class AsyncTraceWriter : public TraceWriter {
+ public:
+  explicit AsyncTraceWriter(std::unique_ptr<TraceWriter> sink);
+  ~AsyncTraceWriter() override;
+
+  void Write(const char* data, size_t sz) override;
+
+ private:
+  static constexpr size_t kChunkSize = 4 * 1024 * 1024;
+  static constexpr size_t kMaxPendingChunks = 4;
+
+  void SubmitChunk();
+  void WriterMain();
+
+  std::unique_ptr<TraceWriter> sink_;
+  std::string chunk_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> pending_chunks_;  // Guarded by |mutex_|.
+  bool done_ = false;                       // Guarded by |mutex_|.
+  std::thread writer_thread_;
+};
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+
+// Creates the writer for the converted trace, optionally deflating it. Where
+// threads are available, the output is written from a background thread.
+std::unique_ptr<TraceWriter> CreateTraceWriter(std::ostream* output,
+                                               bool compress);
+
 }  // namespace trace_to_text
 }  // namespace perfetto
 
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright (C) 2022 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+""" Measures wall time and peak memory of traceconv conversions.
+
+Runs a locally built trace_to_text binary over each of the given traces, for
+each of the given output formats, and prints the median wall time, the
+conversion throughput and the peak RSS of the runs.
+
+Example usage:
+tools/traceconv_benchmark.py --traceconv out/linux/trace_to_text \\
+    --formats systrace,json,ctrace --repeat 5 trace1.pftrace trace2.pftrace
+"""
+
+import argparse
+import os
+import statistics
+import subprocess
+import sys
+import time
+
+
+def RunConversion(traceconv, fmt, extra_args, trace_path):
+  args = [traceconv, fmt] + extra_args + [trace_path, os.devnull]
+  start = time.monotonic()
+  proc = subprocess.Popen(
+      args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+  _, status, rusage = os.wait4(proc.pid, 0)
+  wall_time_s = time.monotonic() - start
+  proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+  if proc.returncode != 0:
+    raise RuntimeError('%s failed with exit code %d' %
+                       (' '.join(args), proc.returncode))
+  # ru_maxrss is in KB on Linux.
+  return wall_time_s, rusage.ru_maxrss
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Benchmark traceconv conversions.',
+      formatter_class=argparse.RawDescriptionHelpFormatter,
+      epilog=__doc__)
+  parser.add_argument(
+      '--traceconv', required=True, help='Path to the trace_to_text binary.')
+  parser.add_argument(
+      '--formats',
+      default='systrace,json',
+      help='Comma-separated list of output formats (default: %(default)s).')
+  parser.add_argument(
+      '--repeat',
+      type=int,
+      default=3,
+      help='Number of runs for each trace and format (default: %(default)s).')
+  parser.add_argument(
+      '--full-sort',
+      action='store_true',
+      help='Pass --full-sort to traceconv.')
+  parser.add_argument('traces', nargs='+', help='Traces to convert.')
+  args = parser.parse_args()
+
+  extra_args = ['--full-sort'] if args.full_sort else []
+  print('%-40s %-10s %10s %10s %14s' %
+        ('trace', 'format', 'wall (s)', 'MB/s', 'peak RSS (MB)'))
+  for trace_path in args.traces:
+    trace_mb = os.path.getsize(trace_path) / 1e6
+    for fmt in args.formats.split(','):
+      wall_times = []
+      peak_rss_kb = 0
+      for _ in range(args.repeat):
+        wall_time_s, max_rss_kb = RunConversion(args.traceconv, fmt,
+                                                extra_args, trace_path)
+        wall_times.append(wall_time_s)
+        peak_rss_kb = max(peak_rss_kb, max_rss_kb)
+      median_s = statistics.median(wall_times)
+      print('%-40s %-10s %10.2f %10.1f %14.1f' %
+            (os.path.basename(trace_path)[-40:], fmt, median_s,
+             trace_mb / median_s, peak_rss_kb / 1024))
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())